@@ -2,18 +2,20 @@
 #include <stdlib.h>
 #include <memory.h>
 #include "ByteCircularBuffer.h"
+#include "TcpMemPool.h"
 
 /**
- * @brief 创建新的字符环形缓冲区
+ * @brief 创建新的字符环形缓冲区, 结构体和存储都从内存池按大小类分配
  *
  * @param size 环形缓冲区的长度
  * @return ByteCircularBuffer_t*
  */
 ByteCircularBuffer_t *BCBCreateNew(uint16_t size)
 {
-    ByteCircularBuffer_t *bcb = (ByteCircularBuffer_t *)calloc(1, sizeof(ByteCircularBuffer_t));
+    ByteCircularBuffer_t *bcb = (ByteCircularBuffer_t *)TcpMemPoolCalloc(sizeof(ByteCircularBuffer_t));
     bcb->buffer_size = size;
-    bcb->buffer = (unsigned char *)calloc(size, sizeof(unsigned char));
+    // 环形缓冲区只读取写入过的字节, 存储不需要清零
+    bcb->buffer = (unsigned char *)TcpMemPoolAlloc(size);
     bcb->current_size = 0;
     bcb->front = 0;
     bcb->rear = 0;
@@ -28,8 +30,8 @@ ByteCircularBuffer_t *BCBCreateNew(uint16_t size)
 void BCBFree(ByteCircularBuffer_t *bcb)
 {
 
-    free(bcb->buffer);
-    free(bcb);
+    TcpMemPoolFree(bcb->buffer);
+    TcpMemPoolFree(bcb);
 }
 
 /**
@@ -156,4 +158,92 @@ void BCBReset(ByteCircularBuffer_t *bcb)
     bcb->current_size = 0;
     bcb->front = 0;
     bcb->rear = 0;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief 获取环形缓冲区中可写入的空闲区域(最多两段), 用于 readv() 直接写入
+ *
+ * @param bcb 环形缓冲区 ByteCircularBuffer_t 指针
+ * @param iov 输出, 空闲区域
+ * @return int 空闲区域的段数 (0 表示缓冲区已满)
+ */
+int BCBWritableRegions(ByteCircularBuffer_t *bcb, struct iovec iov[2])
+{
+    if (BCBIsFull(bcb))
+        return 0;
+
+    // 空闲区域不跨越缓冲区末尾: [front, rear)
+    if (bcb->front < bcb->rear)
+    {
+        iov[0].iov_base = BCB(bcb, bcb->front);
+        iov[0].iov_len = bcb->rear - bcb->front;
+        return 1;
+    }
+
+    // 空闲区域跨越缓冲区末尾: [front, buffer_size) + [0, rear)
+    iov[0].iov_base = BCB(bcb, bcb->front);
+    iov[0].iov_len = bcb->buffer_size - bcb->front;
+
+    if (bcb->rear == 0)
+        return 1;
+
+    iov[1].iov_base = BCB(bcb, 0);
+    iov[1].iov_len = bcb->rear;
+    return 2;
+}
+
+/**
+ * @brief 确认已经通过 BCBWritableRegions() 直接写入的字节数
+ *
+ * @param bcb 环形缓冲区 ByteCircularBuffer_t 指针
+ * @param data_size 写入的字节数
+ */
+void BCBCommitWrite(ByteCircularBuffer_t *bcb, uint16_t data_size)
+{
+    bcb->front = (uint16_t)(((uint32_t)bcb->front + data_size) % bcb->buffer_size);
+    bcb->current_size += data_size;
+}
+
+/**
+ * @brief 原地读取(不删除)环形缓冲区中从 offset 开始的 data_size 字节
+ *
+ * 数据在缓冲区中连续时直接返回指向环形缓冲区内部的指针, 只有跨越缓冲区末尾时才拷贝到 scratch
+ *
+ * @param bcb 环形缓冲区 ByteCircularBuffer_t 指针
+ * @param offset 相对于读位置(rear)的偏移
+ * @param data_size 要读取的字节数
+ * @param scratch 数据不连续时使用的外部缓冲区, 至少 data_size 字节
+ * @return unsigned char* 数据指针, 数据不足时返回 NULL
+ */
+unsigned char *BCBPeek(ByteCircularBuffer_t *bcb, uint16_t offset, uint16_t data_size, unsigned char *scratch)
+{
+    uint16_t start, leading_space;
+
+    if ((uint32_t)offset + data_size > bcb->current_size)
+        return NULL;
+
+    start = (uint16_t)(((uint32_t)bcb->rear + offset) % bcb->buffer_size);
+    leading_space = bcb->buffer_size - start;
+
+    if (data_size <= leading_space)
+        return BCB(bcb, start);
+
+    memcpy(scratch, BCB(bcb, start), leading_space);
+    memcpy(scratch + leading_space, BCB(bcb, 0), data_size - leading_space);
+    return scratch;
+}
+
+/**
+ * @brief 从环形缓冲区中删除 data_size 字节(与 BCBPeek() 配合使用)
+ *
+ * @param bcb 环形缓冲区 ByteCircularBuffer_t 指针
+ * @param data_size 要删除的字节数
+ */
+void BCBConsume(ByteCircularBuffer_t *bcb, uint16_t data_size)
+{
+    if (data_size > bcb->current_size)
+        data_size = bcb->current_size;
+
+    bcb->rear = (uint16_t)(((uint32_t)bcb->rear + data_size) % bcb->buffer_size);
+    bcb->current_size -= data_size;
+}
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <sys/uio.h>
 
 typedef struct ByteCircularBuffer_
 {
@@ -19,9 +20,15 @@ ByteCircularBuffer_t *BCBCreateNew(uint16_t size);
 void BCBFree(ByteCircularBuffer_t *bcb);
 uint16_t BCBWrite(ByteCircularBuffer_t *bcb, unsigned char *data, uint16_t data_size);
 uint16_t BCBRead(ByteCircularBuffer_t *bcb, unsigned char *buffer, uint16_t data_size, bool remove_read_bytes);
-bool BCBIsFull(ByteCircularBuffer_t bcb);
+bool BCBIsFull(ByteCircularBuffer_t *bcb);
 uint16_t BCBAvailableSize(ByteCircularBuffer_t *bcb);
 void BCBReset(ByteCircularBuffer_t *bcb);
 void BCBPrintSnapshot(ByteCircularBuffer_t *bcb);
 
+// zero-copy 接口: 直接 readv() 进环形缓冲区, 并原地读取完整消息
+int BCBWritableRegions(ByteCircularBuffer_t *bcb, struct iovec iov[2]);
+void BCBCommitWrite(ByteCircularBuffer_t *bcb, uint16_t data_size);
+unsigned char *BCBPeek(ByteCircularBuffer_t *bcb, uint16_t offset, uint16_t data_size, unsigned char *scratch);
+void BCBConsume(ByteCircularBuffer_t *bcb, uint16_t data_size);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "MirroredCircularBuffer.h"
+
+#define MCB_CACHE_SIZE_CLASSES 8  // 缓存的不同缓冲区长度数量
+#define MCB_CACHE_MAX_PER_CLASS 64 // 每种长度最多缓存的缓冲区数量
+
+/**
+ * @brief 释放的镜像缓冲区按长度缓存, 避免每个连接都执行 memfd_create + 3 次 mmap + munmap
+ */
+typedef struct MCBCacheClass_
+{
+    uint64_t buffer_size;                                    // 缓冲区长度, 0 表示未使用
+    uint32_t n_free;                                         // 缓存的缓冲区数量
+    MirroredCircularBuffer_t *free_list[MCB_CACHE_MAX_PER_CLASS]; // 缓存的缓冲区
+} MCBCacheClass_t;
+
+static MCBCacheClass_t mcb_cache[MCB_CACHE_SIZE_CLASSES];
+static pthread_mutex_t mcb_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t mcb_cache_n_creates; // MCBCreateNew() 调用次数
+static uint64_t mcb_cache_n_hits;    // 从缓存中取得的次数
+
+/**
+ * @brief 从缓存中取出一个长度为 size 的缓冲区
+ *
+ * @return MirroredCircularBuffer_t* 缓存中没有时返回 NULL
+ */
+static MirroredCircularBuffer_t *mcb_cache_get(uint64_t size)
+{
+    uint32_t i;
+    MirroredCircularBuffer_t *mcb = NULL;
+
+    pthread_mutex_lock(&mcb_cache_mutex);
+    mcb_cache_n_creates++;
+
+    for (i = 0; i < MCB_CACHE_SIZE_CLASSES; i++)
+    {
+        if (mcb_cache[i].buffer_size == size && mcb_cache[i].n_free)
+        {
+            mcb = mcb_cache[i].free_list[--mcb_cache[i].n_free];
+            mcb_cache_n_hits++;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&mcb_cache_mutex);
+    return mcb;
+}
+
+/**
+ * @brief 将缓冲区放回缓存
+ *
+ * @return true 已缓存
+ * @return false 缓存已满或没有空闲的长度类, 调用方直接释放
+ */
+static bool mcb_cache_put(MirroredCircularBuffer_t *mcb)
+{
+    uint32_t i;
+    MCBCacheClass_t *cls = NULL;
+
+    pthread_mutex_lock(&mcb_cache_mutex);
+
+    for (i = 0; i < MCB_CACHE_SIZE_CLASSES; i++)
+    {
+        if (mcb_cache[i].buffer_size == mcb->buffer_size)
+        {
+            cls = &mcb_cache[i];
+            break;
+        }
+
+        // 第一次出现的长度占用一个空闲(或已经清空)的长度类
+        if (!cls && (mcb_cache[i].buffer_size == 0 || mcb_cache[i].n_free == 0))
+            cls = &mcb_cache[i];
+    }
+
+    if (!cls || cls->n_free == MCB_CACHE_MAX_PER_CLASS)
+    {
+        pthread_mutex_unlock(&mcb_cache_mutex);
+        return false;
+    }
+
+    cls->buffer_size = mcb->buffer_size;
+    cls->free_list[cls->n_free++] = mcb;
+    pthread_mutex_unlock(&mcb_cache_mutex);
+    return true;
+}
+
+/**
+ * @brief 获取缓存统计
+ *
+ * @param n_creates MCBCreateNew() 调用次数
+ * @param n_hits 从缓存中取得的次数
+ */
+void MCBCacheStats(uint64_t *n_creates, uint64_t *n_hits)
+{
+    pthread_mutex_lock(&mcb_cache_mutex);
+    *n_creates = mcb_cache_n_creates;
+    *n_hits = mcb_cache_n_hits;
+    pthread_mutex_unlock(&mcb_cache_mutex);
+}
+
+/**
+ * @brief 创建新的镜像环形缓冲区
+ *
+ * 1.memfd_create() 创建匿名内存文件, 长度为 size(向上取整为页大小)
+ *
+ * 2.先预留 2 * size 的连续虚拟地址空间, 再把 memfd 以 MAP_FIXED 映射到前后两半
+ *
+ * 3.优先复用 MCBFree() 缓存的同样长度的缓冲区
+ *
+ * @param size 环形缓冲区的长度
+ * @return MirroredCircularBuffer_t* 失败返回 NULL
+ */
+MirroredCircularBuffer_t *MCBCreateNew(uint64_t size)
+{
+    int fd;
+    unsigned char *addr;
+    uint64_t page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+
+    if (size == 0)
+        size = page_size;
+
+    size = (size + page_size - 1) / page_size * page_size;
+
+    MirroredCircularBuffer_t *mcb = mcb_cache_get(size);
+
+    if (mcb)
+    {
+        MCBReset(mcb);
+        return mcb;
+    }
+
+    fd = memfd_create("tcp_mcb", MFD_CLOEXEC);
+
+    if (fd < 0)
+    {
+        printf("%s() memfd_create failed, error = %d\n", __FUNCTION__, errno);
+        return NULL;
+    }
+
+    if (ftruncate(fd, size) < 0)
+    {
+        printf("%s() ftruncate failed, error = %d\n", __FUNCTION__, errno);
+        close(fd);
+        return NULL;
+    }
+
+    // 预留连续的 2 * size 虚拟地址, 保证两份映射首尾相接
+    addr = (unsigned char *)mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (addr == MAP_FAILED)
+    {
+        printf("%s() mmap reserve failed, error = %d\n", __FUNCTION__, errno);
+        close(fd);
+        return NULL;
+    }
+
+    if (mmap(addr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+        mmap(addr + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        printf("%s() mmap mirror failed, error = %d\n", __FUNCTION__, errno);
+        munmap(addr, 2 * size);
+        close(fd);
+        return NULL;
+    }
+
+    // 映射建立后 fd 不再需要, 物理页由映射持有
+    close(fd);
+
+    mcb = (MirroredCircularBuffer_t *)calloc(1, sizeof(MirroredCircularBuffer_t));
+    mcb->buffer = addr;
+    mcb->buffer_size = size;
+    mcb->current_size = 0;
+    mcb->front = 0;
+    mcb->rear = 0;
+    return mcb;
+}
+
+/**
+ * @brief 释放镜像环形缓冲区, 缓存未满时保留映射供下一个同样长度的缓冲区使用
+ *
+ */
+void MCBFree(MirroredCircularBuffer_t *mcb)
+{
+    if (mcb_cache_put(mcb))
+        return;
+
+    munmap(mcb->buffer, 2 * mcb->buffer_size);
+    free(mcb);
+}
+
+uint64_t MCBAvailableSize(MirroredCircularBuffer_t *mcb)
+{
+    return mcb->buffer_size - mcb->current_size;
+}
+
+bool MCBIsFull(MirroredCircularBuffer_t *mcb)
+{
+    return mcb->current_size == mcb->buffer_size;
+}
+
+void MCBReset(MirroredCircularBuffer_t *mcb)
+{
+    mcb->current_size = 0;
+    mcb->front = 0;
+    mcb->rear = 0;
+}
+
+/**
+ * @brief 向环形缓冲区写入数据, 跨越缓冲区末尾时也只需一次 memcpy
+ *
+ * @param mcb 指向镜像环形缓冲区的指针
+ * @param data 要写入的数据
+ * @param data_size 写入数据的字节数
+ * @return uint64_t 实际写入的数据的字节数, 空间不足时返回 0
+ */
+uint64_t MCBWrite(MirroredCircularBuffer_t *mcb, unsigned char *data, uint64_t data_size)
+{
+    if (MCBAvailableSize(mcb) < data_size)
+        return 0;
+
+    memcpy(MCB(mcb, mcb->front), data, data_size);
+    MCBCommitWrite(mcb, data_size);
+    return data_size;
+}
+
+/**
+ * @brief 从环形缓冲区中读取数据, 跨越缓冲区末尾时也只需一次 memcpy
+ *
+ * @param mcb 指向镜像环形缓冲区的指针
+ * @param buffer 接受环形缓冲区数据的外部缓冲区
+ * @param data_size 要读取的字节数
+ * @param remove_read_bytes 是否从环形缓冲区中删除以读取的数据
+ * @return uint64_t 实际读取的字节数目, 数据不足时返回 0
+ */
+uint64_t MCBRead(MirroredCircularBuffer_t *mcb, unsigned char *buffer, uint64_t data_size, bool remove_read_bytes)
+{
+    if (mcb->current_size < data_size)
+        return 0;
+
+    memcpy(buffer, MCB(mcb, mcb->rear), data_size);
+
+    if (remove_read_bytes)
+        MCBConsume(mcb, data_size);
+
+    return data_size;
+}
+
+/**
+ * @brief 获取可直接写入的连续空闲区域, 用于 recv() 直接写入
+ *
+ * @param mcb 指向镜像环形缓冲区的指针
+ * @param writable_size 输出, 空闲区域长度(0 表示缓冲区已满)
+ * @return unsigned char* 空闲区域起始地址
+ */
+unsigned char *MCBWritePtr(MirroredCircularBuffer_t *mcb, uint64_t *writable_size)
+{
+    *writable_size = MCBAvailableSize(mcb);
+    return MCB(mcb, mcb->front);
+}
+
+/**
+ * @brief 确认已经通过 MCBWritePtr() 直接写入的字节数
+ */
+void MCBCommitWrite(MirroredCircularBuffer_t *mcb, uint64_t data_size)
+{
+    mcb->front += data_size;
+    if (mcb->front >= mcb->buffer_size)
+        mcb->front -= mcb->buffer_size;
+    mcb->current_size += data_size;
+}
+
+/**
+ * @brief 原地读取(不删除)从读位置偏移 offset 开始的 data_size 字节, 返回的数据总是连续的
+ *
+ * @param mcb 指向镜像环形缓冲区的指针
+ * @param offset 相对于读位置(rear)的偏移
+ * @param data_size 要读取的字节数
+ * @return unsigned char* 数据指针, 数据不足时返回 NULL
+ */
+unsigned char *MCBPeek(MirroredCircularBuffer_t *mcb, uint64_t offset, uint64_t data_size)
+{
+    if (offset + data_size > mcb->current_size)
+        return NULL;
+
+    // rear + offset < 2 * buffer_size, 落在第二份映射中也指向同一物理页
+    return MCB(mcb, mcb->rear + offset);
+}
+
+/**
+ * @brief 从环形缓冲区中删除 data_size 字节(与 MCBPeek() 配合使用)
+ */
+void MCBConsume(MirroredCircularBuffer_t *mcb, uint64_t data_size)
+{
+    if (data_size > mcb->current_size)
+        data_size = mcb->current_size;
+
+    mcb->rear += data_size;
+    if (mcb->rear >= mcb->buffer_size)
+        mcb->rear -= mcb->buffer_size;
+    mcb->current_size -= data_size;
+}
+
+void MCBPrintSnapshot(MirroredCircularBuffer_t *mcb)
+{
+    printf("MCB : buffer_size = %lu, front = %lu, rear = %lu, current_size = %lu\n",
+           (unsigned long)mcb->buffer_size,
+           (unsigned long)mcb->front,
+           (unsigned long)mcb->rear,
+           (unsigned long)mcb->current_size);
+}
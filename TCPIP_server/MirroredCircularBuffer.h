@@ -0,0 +1,43 @@
+#ifndef MIRROREDCIRCULARBUFFER_H_
+#define MIRROREDCIRCULARBUFFER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief 虚拟内存镜像环形缓冲区
+ *
+ * 同一块 memfd 物理内存被连续映射两次: [buffer, buffer + size) 与 [buffer + size, buffer + 2 * size)
+ * 指向同一组物理页, 因此从任意位置开始、长度不超过 buffer_size 的数据在虚拟地址上总是连续的,
+ * 读写都不需要在缓冲区末尾拆成两段, 分帧器可以直接在缓冲区中原地解析消息.
+ *
+ * buffer_size 会向上取整为页大小的整数倍, 长度使用 64 位, 不再受 64 KiB 的限制.
+ */
+typedef struct MirroredCircularBuffer_
+{
+    unsigned char *buffer; // 第一份映射的起始地址, 共映射 2 * buffer_size 字节
+    uint64_t buffer_size;  // 缓冲区长度(页大小的整数倍)
+    uint64_t front;        // 写位置, [0, buffer_size)
+    uint64_t rear;         // 读位置, [0, buffer_size)
+    uint64_t current_size; // 缓冲区中未读取的字节数
+} MirroredCircularBuffer_t;
+
+#define MCB(_mcb, n) (&_mcb->buffer[n])
+
+MirroredCircularBuffer_t *MCBCreateNew(uint64_t size);
+void MCBFree(MirroredCircularBuffer_t *mcb);
+uint64_t MCBWrite(MirroredCircularBuffer_t *mcb, unsigned char *data, uint64_t data_size);
+uint64_t MCBRead(MirroredCircularBuffer_t *mcb, unsigned char *buffer, uint64_t data_size, bool remove_read_bytes);
+bool MCBIsFull(MirroredCircularBuffer_t *mcb);
+uint64_t MCBAvailableSize(MirroredCircularBuffer_t *mcb);
+void MCBReset(MirroredCircularBuffer_t *mcb);
+void MCBPrintSnapshot(MirroredCircularBuffer_t *mcb);
+void MCBCacheStats(uint64_t *n_creates, uint64_t *n_hits);
+
+// zero-copy 接口: 空闲区域和未读数据都是连续的一段
+unsigned char *MCBWritePtr(MirroredCircularBuffer_t *mcb, uint64_t *writable_size);
+void MCBCommitWrite(MirroredCircularBuffer_t *mcb, uint64_t data_size);
+unsigned char *MCBPeek(MirroredCircularBuffer_t *mcb, uint64_t offset, uint64_t data_size);
+void MCBConsume(MirroredCircularBuffer_t *mcb, uint64_t data_size);
+
+#endif
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <assert.h>
+#include <new>
+#include "TcpClient.h"
+#include "TcpMsgDemarcar.h"
+#include "TcpMemPool.h"
+#include "network_utils.h"
+
+TcpClient::TcpClient(uint32_t ip_addr, uint16_t port_no)
+{
+    this->ip_addr = ip_addr;
+    this->port_no = port_no;
+    this->server_ip_addr = 0;
+    this->server_port_no = 0;
+    this->comm_fd = -1;
+    this->ref_count = 0;
+    this->state_flags = 0;
+    this->client_thread = nullptr;
+    this->active_connect_thread = nullptr;
+    this->tcp_ctrlr = nullptr;
+    this->svc_mgr = nullptr;
+    this->msgd = nullptr;
+    this->shm = nullptr;
+    this->shm_channel_id = 0;
+    this->ctrlr_list = nullptr;
+    this->server_prev = nullptr;
+    this->server_next = nullptr;
+    this->connect_attempts = 0;
+    this->connect_inflight = false;
+    this->read_paused = false;
+    this->recv_armed = false;
+    pthread_rwlock_init(&this->rwlock, nullptr);
+    sem_init(&this->wait_for_thread_operation_to_complete, 0, 0);
+}
+
+TcpClient::TcpClient()
+    : TcpClient(0, 0)
+{
+}
+
+/**
+ * @brief 引用计数归零时由 Dereference() 调用, 释放分帧器并关闭 socket
+ *
+ */
+TcpClient::~TcpClient()
+{
+    assert(this->ref_count == 0);
+    assert(!this->svc_mgr);
+
+    if (this->msgd)
+    {
+        delete this->msgd;
+        this->msgd = nullptr;
+    }
+
+    // TcpShmTransport 已经 Detach(), 不会再访问通道
+    if (this->shm)
+    {
+        TcpShmChannelDestroy(this->shm);
+        this->shm = nullptr;
+    }
+
+    if (this->comm_fd >= 0)
+    {
+        close(this->comm_fd);
+        this->comm_fd = -1;
+    }
+
+    if (this->client_thread)
+    {
+        free(this->client_thread);
+        this->client_thread = nullptr;
+    }
+
+    pthread_rwlock_destroy(&this->rwlock);
+    sem_destroy(&this->wait_for_thread_operation_to_complete);
+}
+
+/**
+ * @brief 客户端对象从内存池分配, 连接频繁建立/断开时复用之前释放的对象
+ *
+ */
+void *TcpClient::operator new(size_t size)
+{
+    void *ptr = TcpMemPoolAlloc(size);
+
+    if (!ptr)
+        throw std::bad_alloc();
+
+    return ptr;
+}
+
+void TcpClient::operator delete(void *ptr)
+{
+    TcpMemPoolFree(ptr);
+}
+
+/**
+ * @brief 增加引用计数, 可以被任意线程调用
+ *
+ */
+void TcpClient::Reference()
+{
+    __atomic_add_fetch(&this->ref_count, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief 减少引用计数, 归零时销毁客户端并放回内存池
+ *
+ * @return TcpClient* 客户端已被销毁时返回 nullptr
+ */
+TcpClient *TcpClient::Dereference()
+{
+    int ref_count = __atomic_sub_fetch(&this->ref_count, 1, __ATOMIC_ACQ_REL);
+
+    assert(ref_count >= 0);
+
+    if (ref_count > 0)
+        return this;
+
+    delete this;
+    return nullptr;
+}
+
+void TcpClient::SetState(client_state_bit flag_bit)
+{
+    __atomic_or_fetch(&this->state_flags, flag_bit, __ATOMIC_SEQ_CST);
+}
+
+void TcpClient::UnSetState(client_state_bit flag_bit)
+{
+    __atomic_and_fetch(&this->state_flags, ~flag_bit, __ATOMIC_SEQ_CST);
+}
+
+bool TcpClient::IsStateSet(client_state_bit flag_bit)
+{
+    return __atomic_load_n(&this->state_flags, __ATOMIC_SEQ_CST) & flag_bit;
+}
+
+/**
+ * @brief 获取客户端计数器的快照, 可以被任意线程调用, 接收计数器由 DRS 线程更新, 读到的是近似值
+ *
+ * @param metrics 输出
+ */
+void TcpClient::GetMetrics(TcpClientMetrics_t *metrics)
+{
+    metrics->bytes_recvd = TcpMetricGet(&this->conn.bytes_recvd);
+    metrics->frames_recvd = TcpMetricGet(&this->conn.frames_recvd);
+    metrics->recv_calls = TcpMetricGet(&this->conn.recv_calls);
+    metrics->partial_reads = TcpMetricGet(&this->conn.partial_reads);
+    metrics->ring_hwm = TcpMetricGet(&this->conn.ring_hwm);
+
+    this->out_queue.GetStats(this, &metrics->bytes_sent, &metrics->frames_sent, &metrics->send_calls, &metrics->queued_bytes);
+}
+
+/**
+ * @brief 停止客户端专用线程并释放线程句柄
+ *
+ */
+void TcpClient::StopThread()
+{
+    if (!this->client_thread)
+        return;
+
+    pthread_cancel(*this->client_thread);
+    pthread_join(*this->client_thread, nullptr);
+    free(this->client_thread);
+    this->client_thread = nullptr;
+    this->UnSetState(TCP_CLIENT_STATE_THREADED);
+}
+
+/**
+ * @brief 打印客户端信息: 地址, fd, 引用计数, 状态位, 收发计数器
+ *
+ */
+void TcpClient::Display()
+{
+    char ip_str[16];
+    char server_ip_str[16];
+    TcpClientMetrics_t metrics;
+
+    this->GetMetrics(&metrics);
+
+    printf("Tcp Client : [%s, %u] -> [%s, %u], fd : %d, ref_count : %d, state : 0x%x%s\n",
+           network_convert_ip_n_to_p(this->ip_addr, ip_str), this->port_no,
+           network_convert_ip_n_to_p(this->server_ip_addr, server_ip_str), this->server_port_no,
+           this->comm_fd, __atomic_load_n(&this->ref_count, __ATOMIC_RELAXED),
+           __atomic_load_n(&this->state_flags, __ATOMIC_RELAXED), this->shm ? ", shm" : "");
+    printf("  recvd : %lu bytes / %lu frames, sent : %lu bytes / %lu frames, queued : %lu bytes, ka sent/recvd : %u/%u\n",
+           (unsigned long)metrics.bytes_recvd, (unsigned long)metrics.frames_recvd,
+           (unsigned long)metrics.bytes_sent, (unsigned long)metrics.frames_sent,
+           (unsigned long)metrics.queued_bytes, this->conn.ka_sent, this->conn.ka_recvd);
+}
+
+void TcpClient::SetTcpMsgDemarcar(TcpMsgDemarcar *msgd)
+{
+    this->msgd = msgd;
+}
+
+void TcpClient::SetConnectionType(tcp_connection_type_t conn_type)
+{
+    this->conn.conn_type = conn_type;
+}
+
+/**
+ * @brief 发送一条消息, 不会阻塞调用线程
+ *
+ * 消息直接发送或进入客户端的发送队列, 由 TcpClientOutQueue 批量发送;
+ * 协商了共享内存通道的客户端的所有消息都写入 s2c 环(超过 TCP_SHM_MSG_MAX 的消息拆成片段), 与 TCP 不会交错;
+ * 环满时在 shm 队列中排队, 对端释放空间后继续写入
+ *
+ * @param msg 消息内容, 返回后调用方可以重用
+ * @param msg_size 消息长度
+ * @return int 成功返回 msg_size(已发送或已入队), 连接出错返回 -1(errno)
+ */
+int TcpClient::SendMsg(char *msg, uint32_t msg_size)
+{
+    TcpShmChannel_t *shm = __atomic_load_n(&this->shm, __ATOMIC_ACQUIRE);
+
+    if (shm)
+        return this->out_queue.SendShm(this, shm, (const unsigned char *)msg, msg_size);
+
+    return this->out_queue.Send(this, (const unsigned char *)msg, msg_size);
+}
@@ -4,7 +4,13 @@
 #include <stdint.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <list>
 #include "TcpConn.h"
+#include "TcpWorkerPool.h"
+#include "TcpClientOutQueue.h"
+#include "TcpTimerWheel.h"
+#include "TcpMetrics.h"
+#include "TcpShmChannel.h"
 
 #define MAX_CLIENT_BUFFER_SIZE 1024
 
@@ -17,6 +23,7 @@
 #define TCP_CLIENT_STATE_KA_EXPIRED 64         // KeepAlive 超时（可能无响应）
 #define TCP_CLIENT_STATE_MULTIPLEX_LISTEN 128  // 多路 select/poll 监听模式
 #define TCP_CLIENT_STATE_THREADED 256          // 为此客户端创建了独立处理线程
+#define TCP_CLIENT_STATE_POOLED 512            // 消息交给工作线程池处理(多线程客户端), I/O 仍由 DRS 完成
 
 typedef uint32_t client_state_bit;
 
@@ -53,16 +60,41 @@ public:
     pthread_t *client_thread;                          // 客户端专用线程
     pthread_t *active_connect_thread;                  // 主动连接线程
     TcpServerController *tcp_ctrlr;                    //
+    TcpClientServiceManager *svc_mgr;                  // 正在监听此客户端的 DRS 分片, 未被监听时为 nullptr
     sem_t wait_for_thread_operation_to_complete;       // 信号量
 
     TcpMsgDemarcar *msgd; // 指向消息分包器
     TcpConn conn;         // 封装发送/接收逻辑的连接对象
+    TcpClientStrand strand; // 线程池模式下等待处理的消息, 保证同一客户端的消息顺序
+    TcpClientOutQueue out_queue; // 发送队列, 内核缓冲区满时缓存待发送的消息
+    TcpShmChannel_t *shm;        // 协商成功的共享内存通道, 设置后消息不再经过 TCP, 析构时释放
+    uint64_t shm_channel_id;     // 通道在 TcpShmTransport 中的编号
+
+    // 以下字段只在持有 Controller 的 connect_db_rwlock 写锁时访问(主动连接的客户端)
+    std::list<TcpClient *> *ctrlr_list;             // 所在的列表(connectpendingClients/establishedClient), 不在列表中时为 nullptr
+    std::list<TcpClient *>::iterator ctrlr_list_it; // 在 ctrlr_list 中的位置, 移除时不需要查找
+    TcpClient *server_prev;                         // 连接到同一服务器的已建立客户端(双向链表), 表头在 established_index 中
+    TcpClient *server_next;
+
+    // 以下字段只由监听此客户端的 DRS 线程访问, 在加入监听集合时初始化
+    TcpTimer liveness_timer;   // DRS 时间轮中的 keepalive/空闲超时定时器
+    uint64_t last_active_tick; // 最近一次收到数据时的时间轮 tick
+    uint32_t ka_missed;        // 连续未得到响应的 keepalive 次数
+    bool read_paused;          // 线程池积压过多, 暂停读取此客户端, 由 ClientFDResumeRead() 恢复
+    bool recv_armed;           // (io_uring) multishot recv 尚未结束(包括已请求取消但还没有最后一个完成事件)
+
+    // 以下字段只由为此客户端主动连接的 DRS 线程访问(liveness_timer 此时用作连接超时/重试定时器)
+    uint32_t connect_attempts; // 连续失败的连接次数, 决定下一次重试的退避时间
+    bool connect_inflight;     // connect() 已发起, 正在等待结果; false 表示正在等待重试
 
     TcpClient(uint32_t, uint16_t); // 使用 IP + Port 构造客户端
     TcpClient();                   // 默认构造函数
     TcpClient(TcpClient *);        // 拷贝构造函数
 
-    int SendMsg(char *, uint32_t);                 // 发送消息
+    static void *operator new(size_t size); // 从内存池分配, 引用计数归零时放回内存池
+    static void operator delete(void *ptr);
+
+    int SendMsg(char *, uint32_t);                 // 发送消息(非阻塞, 内核缓冲区满时进入发送队列)
     void StartThread();                            // 启动客户端专用线程
     void StopThread();                             // 停止客户端线程
     void StopConnectorThread();                    // 停止主动连接
@@ -70,6 +102,7 @@ public:
     TcpClient *Dereference();                      // 引用计数减少
     void Reference();                              // 引用计数增加
     void Display();                                // 打印客户端信息
+    void GetMetrics(TcpClientMetrics_t *);         // 获取客户端计数器的快照
     void SetTcpMsgDemarcar(TcpMsgDemarcar *);      // 设置消息分包器
     void SetConnectionType(tcp_connection_type_t); // 设置连接类型
     int TryClientConnect(bool);                    // 尝试主动连接服务器
@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <assert.h>
 
 #include "TcpClientDbManager.h"
@@ -13,7 +14,7 @@ TcpClientDbManager::TcpClientDbManager(TcpServerController *tcp_ctrlr)
 
 TcpClientDbManager::~TcpClientDbManager()
 {
-    assert(this->tcp_client_db.empty());
+    assert(this->tcp_client_db.GetSize() == 0);
 }
 
 /**
@@ -25,17 +26,7 @@ TcpClientDbManager::~TcpClientDbManager()
  */
 TcpClient *TcpClientDbManager::LookUpClientDB(uint32_t ip_addr, uint16_t port_no)
 {
-    TcpClient *tcp_client;
-    std::list<TcpClient *>::iterator it;
-
-    for (it = this->tcp_client_db.begin(); it != this->tcp_client_db.end(); ++it)
-    {
-        tcp_client = *it;
-        if (tcp_client->ip_addr == ip_addr && tcp_client->port_no == tcp_client->port_no)
-            return tcp_client;
-    }
-
-    return nullptr;
+    return this->tcp_client_db.Lookup(ip_addr, port_no);
 }
 
 /**
@@ -56,6 +47,48 @@ TcpClient *TcpClientDbManager::LookUpClientDB_ThreadSafe(uint32_t ip_addr, uint1
     return tcp_client;
 }
 
+/**
+ * @brief 在客户端数据库中查找指定 IP + port 的客户端并增加引用计数(线程安全)
+ *
+ * 与 LookUpClientDB_ThreadSafe() 不同, 返回的客户端在调用方 Dereference() 之前不会被释放
+ *
+ * @param ip_addr 客户端 IP 地址
+ * @param port_no 客户端 port
+ * @return TcpClient* 找到的客户端对象指针, 调用方负责 Dereference()
+ */
+TcpClient *TcpClientDbManager::LookUpClientDB_Reference(uint32_t ip_addr, uint16_t port_no)
+{
+    TcpClient *tcp_client = nullptr;
+
+    pthread_rwlock_rdlock(&this->rwlock);
+    tcp_client = this->LookUpClientDB(ip_addr, port_no);
+    if (tcp_client)
+        tcp_client->Reference();
+    pthread_rwlock_unlock(&this->rwlock);
+
+    return tcp_client;
+}
+
+/**
+ * @brief 向数据库中加入一个客户端(线程安全), 数据库持有客户端的一个引用
+ *
+ * @param tcp_client 要加入的 TcpClient 指针
+ */
+void TcpClientDbManager::AddClientToDB(TcpClient *tcp_client)
+{
+    pthread_rwlock_wrlock(&this->rwlock);
+
+    if (!this->tcp_client_db.Insert(tcp_client->ip_addr, tcp_client->port_no, tcp_client))
+    {
+        pthread_rwlock_unlock(&this->rwlock);
+        printf("%s() Error : client already exist in DB\n", __FUNCTION__);
+        return;
+    }
+
+    tcp_client->Reference();
+    pthread_rwlock_unlock(&this->rwlock);
+}
+
 /**
  * @brief 从数据库中移除一个客户端(线程安全)
  *
@@ -64,7 +97,15 @@ TcpClient *TcpClientDbManager::LookUpClientDB_ThreadSafe(uint32_t ip_addr, uint1
 void TcpClientDbManager::RemoveClientFromDB(TcpClient *tcp_client)
 {
     pthread_rwlock_wrlock(&this->rwlock);
-    this->tcp_client_db.remove(tcp_client);
+
+    // 只有数据库中确实是此客户端时才释放数据库持有的引用
+    if (this->tcp_client_db.Lookup(tcp_client->ip_addr, tcp_client->port_no) != tcp_client)
+    {
+        pthread_rwlock_unlock(&this->rwlock);
+        return;
+    }
+
+    this->tcp_client_db.Remove(tcp_client->ip_addr, tcp_client->port_no);
     tcp_client->Dereference();
     pthread_rwlock_unlock(&this->rwlock);
 }
@@ -81,7 +122,7 @@ TcpClient *TcpClientDbManager::RemoveClientFromDB(uint32_t ip_addr, uint16_t por
     TcpClient *tcp_client;
 
     pthread_rwlock_wrlock(&this->rwlock);
-    tcp_client = this->LookUpClientDB(ip_addr, port_no);
+    tcp_client = this->tcp_client_db.Remove(ip_addr, port_no);
 
     if (!tcp_client)
     {
@@ -89,14 +130,13 @@ TcpClient *TcpClientDbManager::RemoveClientFromDB(uint32_t ip_addr, uint16_t por
         return nullptr;
     }
 
-    this->tcp_client_db.remove(tcp_client);
     tcp_client = tcp_client->Dereference();
 
     pthread_rwlock_unlock(&this->rwlock);
     return tcp_client;
 }
 
-void TcpClientDbManager ::UpdateClient(TcpClient *tcp_client)
+void TcpClientDbManager ::UpdateClient(TcpClient * /*tcp_client*/)
 {
 }
 
@@ -106,22 +146,26 @@ void TcpClientDbManager ::UpdateClient(TcpClient *tcp_client)
  */
 void TcpClientDbManager::Purge()
 {
-    std::list<TcpClient *>::iterator it;
-    TcpClient *tcp_client, *next_tcp_client;
+    uint32_t slot;
+    TcpClient *tcp_client;
 
     pthread_rwlock_wrlock(&this->rwlock);
 
-    for (it = this->tcp_client_db.begin(), tcp_client = *it; it != this->tcp_client_db.end(); tcp_client = next_tcp_client)
+    for (slot = 0; slot < this->tcp_client_db.GetSlotCount(); slot++)
     {
-        next_tcp_client = *(++it);
+        tcp_client = this->tcp_client_db.GetSlotClient(slot);
 
-        if (tcp_client_db.remove(tcp_client))
+        if (!tcp_client)
+            continue;
+
+        if (tcp_client->client_thread)
             tcp_client->StopThread();
 
-        this->tcp_client_db.remove(tcp_client);
         tcp_client->Dereference();
     }
 
+    this->tcp_client_db.Clear();
+
     pthread_rwlock_unlock(&this->rwlock);
 }
 
@@ -131,15 +175,17 @@ void TcpClientDbManager::Purge()
  */
 void TcpClientDbManager::DisplayClientDB()
 {
-    std::list<TcpClient *>::iterator it;
+    uint32_t slot;
     TcpClient *tcp_client;
 
     pthread_rwlock_rdlock(&this->rwlock);
 
-    for (it = tcp_client_db.begin(); it != tcp_client_db.end(); ++it)
+    for (slot = 0; slot < this->tcp_client_db.GetSlotCount(); slot++)
     {
-        tcp_client = *it;
-        tcp_client->Display();
+        tcp_client = this->tcp_client_db.GetSlotClient(slot);
+
+        if (tcp_client)
+            tcp_client->Display();
     }
 
     pthread_rwlock_unlock(&this->rwlock);
@@ -152,13 +198,17 @@ void TcpClientDbManager::DisplayClientDB()
  */
 void TcpClientDbManager::CopyAllClientsTolist(std::list<TcpClient *> *list)
 {
-    std::list<TcpClient *>::iterator it;
+    uint32_t slot;
     TcpClient *tcp_client;
 
     pthread_rwlock_rdlock(&this->rwlock);
-    for (it = this->tcp_client_db.begin(); it != this->tcp_client_db.end(); ++it)
+    for (slot = 0; slot < this->tcp_client_db.GetSlotCount(); slot++)
     {
-        tcp_client = *it;
+        tcp_client = this->tcp_client_db.GetSlotClient(slot);
+
+        if (!tcp_client)
+            continue;
+
         list->push_back(tcp_client);
         tcp_client->Reference();
     }
@@ -6,6 +6,7 @@
 #include <stdint.h>
 #include <pthread.h>
 #include <vector>
+#include "TcpClientHashIndex.h"
 
 class TcpClient;
 class TcpServerController;
@@ -26,12 +27,14 @@ class TcpServerController;
  * 这是服务器中用于追踪“在线客户端”的核心模块。
  *
  * 使用 pthread_rwlock 保护客户端列表，使得读操作可并行，写操作独占。
+ *
+ * 客户端按 (ip, port) 保存在开放寻址哈希表中, 查找/添加/删除均为 O(1)。
  */
 class TcpClientDbManager
 {
 private:
     pthread_rwlock_t rwlock;              // 客户端数据库的读写锁
-    std::list<TcpClient *> tcp_client_db; // 所有 TcpClient 对象的数据库(链表)
+    TcpClientHashIndex tcp_client_db;     // 所有 TcpClient 对象的数据库(按 ip/port 哈希索引)
 
 public:
     TcpServerController *tcp_ctrlr;
@@ -47,6 +50,7 @@ public:
     void UpdateClient(TcpClient *);                                           // 更新客户端信息
     TcpClient *LookUpClientDB(uint32_t, uint16_t);                            // 根据 IP / 端口 查找客户端 (非线程安全版本)
     TcpClient *LookUpClientDB_ThreadSafe(uint32_t ip_addr, uint16_t port_no); // 根据 IP/端口 查找客户端(线程安全版本)
+    TcpClient *LookUpClientDB_Reference(uint32_t ip_addr, uint16_t port_no);  // 根据 IP/端口 查找客户端并增加引用计数(线程安全版本)
     void DisplayClientDB();                                                   // 展示客户端数据库
     void CopyAllClientsTolist(std::list<TcpClient *> *list);                  // 当前所有客户端复制到另一个 list 中(用于遍历)
 };
@@ -0,0 +1,209 @@
+#include <stdlib.h>
+#include <memory.h>
+#include <assert.h>
+#include "TcpClientHashIndex.h"
+
+#define HASH_SLOT_EMPTY UINT64_MAX            // 空槽位, 查找到此停止
+#define HASH_SLOT_TOMBSTONE (UINT64_MAX - 1)  // 删除标记, 查找时跳过, 插入时可复用
+
+static inline uint64_t HashKey(uint32_t ip_addr, uint16_t port_no)
+{
+    return ((uint64_t)ip_addr << 16) | port_no;
+}
+
+/**
+ * @brief 64 位混合函数(murmur3 fmix64), 同一网段/连续端口的 key 也能均匀分布
+ */
+static inline uint64_t HashMix(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+TcpClientHashIndex::TcpClientHashIndex(uint32_t expected_clients)
+{
+    uint32_t n_slots = TCP_CLIENT_HASH_INDEX_MIN_SLOTS;
+
+    // 负载因子不超过 1/2
+    while (n_slots < expected_clients * 2)
+        n_slots <<= 1;
+
+    this->slots = nullptr;
+    this->n_slots = 0;
+    this->n_clients = 0;
+    this->n_tombstones = 0;
+    this->Rehash(n_slots);
+}
+
+TcpClientHashIndex::~TcpClientHashIndex()
+{
+    free(this->slots);
+}
+
+/**
+ * @brief 按新的槽位数重建哈希表
+ *
+ * @param n_slots 新的槽位数(2 的幂)
+ */
+void TcpClientHashIndex::Rehash(uint32_t n_slots)
+{
+    uint32_t i, slot;
+    uint32_t old_n_slots = this->n_slots;
+    TcpClientHashSlot_t *old_slots = this->slots;
+
+    this->slots = (TcpClientHashSlot_t *)calloc(n_slots, sizeof(TcpClientHashSlot_t));
+    this->n_slots = n_slots;
+    this->n_tombstones = 0;
+
+    for (i = 0; i < n_slots; i++)
+        this->slots[i].key = HASH_SLOT_EMPTY;
+
+    for (i = 0; i < old_n_slots; i++)
+    {
+        if (old_slots[i].key >= HASH_SLOT_TOMBSTONE)
+            continue;
+
+        slot = HashMix(old_slots[i].key) & (n_slots - 1);
+
+        while (this->slots[slot].key != HASH_SLOT_EMPTY)
+            slot = (slot + 1) & (n_slots - 1);
+
+        this->slots[slot] = old_slots[i];
+    }
+
+    free(old_slots);
+}
+
+uint32_t TcpClientHashIndex::FindSlot(uint64_t key)
+{
+    uint32_t slot = HashMix(key) & (this->n_slots - 1);
+
+    while (this->slots[slot].key != HASH_SLOT_EMPTY)
+    {
+        if (this->slots[slot].key == key)
+            return slot;
+
+        slot = (slot + 1) & (this->n_slots - 1);
+    }
+
+    return this->n_slots;
+}
+
+/**
+ * @brief 插入客户端
+ *
+ * @param ip_addr 客户端 IP 地址
+ * @param port_no 客户端 port
+ * @param tcp_client 客户端对象
+ * @return true 插入成功
+ * @return false key 已经存在
+ */
+bool TcpClientHashIndex::Insert(uint32_t ip_addr, uint16_t port_no, TcpClient *tcp_client)
+{
+    uint32_t slot, tombstone;
+    uint64_t key = HashKey(ip_addr, port_no);
+
+    // 已使用的槽位(包括删除标记)超过一半: 客户端多则扩容, 否则只清除删除标记
+    if ((this->n_clients + this->n_tombstones + 1) * 2 > this->n_slots)
+        this->Rehash((this->n_clients + 1) * 4 > this->n_slots ? this->n_slots * 2 : this->n_slots);
+
+    slot = HashMix(key) & (this->n_slots - 1);
+    tombstone = this->n_slots;
+
+    while (this->slots[slot].key != HASH_SLOT_EMPTY)
+    {
+        if (this->slots[slot].key == key)
+            return false;
+
+        // 记录第一个删除标记, 确认 key 不存在后复用
+        if (this->slots[slot].key == HASH_SLOT_TOMBSTONE && tombstone == this->n_slots)
+            tombstone = slot;
+
+        slot = (slot + 1) & (this->n_slots - 1);
+    }
+
+    if (tombstone != this->n_slots)
+    {
+        slot = tombstone;
+        this->n_tombstones--;
+    }
+
+    this->slots[slot].key = key;
+    this->slots[slot].tcp_client = tcp_client;
+    this->n_clients++;
+    return true;
+}
+
+TcpClient *TcpClientHashIndex::Lookup(uint32_t ip_addr, uint16_t port_no)
+{
+    uint32_t slot = this->FindSlot(HashKey(ip_addr, port_no));
+
+    if (slot == this->n_slots)
+        return nullptr;
+
+    return this->slots[slot].tcp_client;
+}
+
+TcpClient *TcpClientHashIndex::Remove(uint32_t ip_addr, uint16_t port_no)
+{
+    TcpClient *tcp_client;
+    uint32_t slot = this->FindSlot(HashKey(ip_addr, port_no));
+
+    if (slot == this->n_slots)
+        return nullptr;
+
+    tcp_client = this->slots[slot].tcp_client;
+
+    // 下一个槽位为空时不会打断任何探测链, 可以直接置空
+    if (this->slots[(slot + 1) & (this->n_slots - 1)].key == HASH_SLOT_EMPTY)
+    {
+        this->slots[slot].key = HASH_SLOT_EMPTY;
+    }
+    else
+    {
+        this->slots[slot].key = HASH_SLOT_TOMBSTONE;
+        this->n_tombstones++;
+    }
+
+    this->slots[slot].tcp_client = nullptr;
+    this->n_clients--;
+    return tcp_client;
+}
+
+void TcpClientHashIndex::Clear()
+{
+    uint32_t i;
+
+    for (i = 0; i < this->n_slots; i++)
+    {
+        this->slots[i].key = HASH_SLOT_EMPTY;
+        this->slots[i].tcp_client = nullptr;
+    }
+
+    this->n_clients = 0;
+    this->n_tombstones = 0;
+}
+
+uint32_t TcpClientHashIndex::GetSize()
+{
+    return this->n_clients;
+}
+
+uint32_t TcpClientHashIndex::GetSlotCount()
+{
+    return this->n_slots;
+}
+
+TcpClient *TcpClientHashIndex::GetSlotClient(uint32_t slot)
+{
+    assert(slot < this->n_slots);
+
+    if (this->slots[slot].key >= HASH_SLOT_TOMBSTONE)
+        return nullptr;
+
+    return this->slots[slot].tcp_client;
+}
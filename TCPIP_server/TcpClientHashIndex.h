@@ -0,0 +1,53 @@
+#ifndef TCPCLIENTHASHINDEX_H_
+#define TCPCLIENTHASHINDEX_H_
+
+#include <stdint.h>
+
+#define TCP_CLIENT_HASH_INDEX_MIN_SLOTS 64 // 最小槽位数(2 的幂)
+
+class TcpClient;
+
+/**
+ * @brief 哈希表的一个槽位, key 为 48 位的 (ip, port), 高位全 1 的值用于表示空槽位和删除标记
+ */
+typedef struct TcpClientHashSlot_
+{
+    uint64_t key;          // (ip << 16) | port
+    TcpClient *tcp_client; // 客户端对象
+} TcpClientHashSlot_t;
+
+/**
+ * @brief 按 (ip, port) 索引 TcpClient 的开放寻址哈希表
+ *
+ * 1.线性探测, 槽位数为 2 的幂, 已使用槽位(包括删除标记)超过一半时扩容/重建, 查找/插入/删除均为 O(1)
+ *
+ * 2.删除只留下删除标记(tombstone), 不移动其他元素, 因此遍历槽位的过程中可以安全地删除客户端
+ *
+ * 3.不加锁, 由使用者保证互斥(TcpClientDbManager 的读写锁 / DRS 线程独占)
+ */
+class TcpClientHashIndex
+{
+private:
+    TcpClientHashSlot_t *slots; // 槽位数组
+    uint32_t n_slots;           // 槽位数(2 的幂)
+    uint32_t n_clients;         // 客户端数量
+    uint32_t n_tombstones;      // 删除标记数量
+
+    uint32_t FindSlot(uint64_t key); // 查找 key 所在的槽位, 没有找到返回 n_slots
+    void Rehash(uint32_t n_slots);   // 重建哈希表, 同时清除所有删除标记
+
+public:
+    TcpClientHashIndex(uint32_t expected_clients = 0);
+    ~TcpClientHashIndex();
+
+    bool Insert(uint32_t ip_addr, uint16_t port_no, TcpClient *); // 插入客户端, key 已存在时返回 false
+    TcpClient *Lookup(uint32_t ip_addr, uint16_t port_no);        // 查找客户端
+    TcpClient *Remove(uint32_t ip_addr, uint16_t port_no);        // 删除并返回客户端
+    void Clear();                                                 // 清空哈希表
+
+    uint32_t GetSize();                  // 客户端数量
+    uint32_t GetSlotCount();             // 槽位数, 用于遍历
+    TcpClient *GetSlotClient(uint32_t);  // 槽位中的客户端, 空槽位/删除标记返回 nullptr
+};
+
+#endif
@@ -0,0 +1,727 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <errno.h>
+#include <assert.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "TcpClientOutQueue.h"
+#include "TcpClient.h"
+#include "TcpClientServiceManager.h"
+#include "TcpServerController.h"
+#include "TcpMemPool.h"
+#include "TcpMetrics.h"
+
+static void tcp_out_frame_list_free(TcpOutFrame_t *frame)
+{
+    TcpOutFrame_t *next_frame;
+
+    for (; frame; frame = next_frame)
+    {
+        next_frame = frame->next;
+        free(frame);
+    }
+}
+
+/**
+ * @brief 将消息拷贝到链表尾部
+ *
+ */
+static void tcp_out_frame_append(TcpOutFrame_t **head, TcpOutFrame_t **tail, const unsigned char *msg, uint32_t msg_size)
+{
+    TcpOutFrame_t *frame = (TcpOutFrame_t *)malloc(sizeof(TcpOutFrame_t) + msg_size);
+
+    frame->next = nullptr;
+    frame->size = msg_size;
+    frame->offset = 0;
+    memcpy(frame->data, msg, msg_size);
+
+    if (*tail)
+        (*tail)->next = frame;
+    else
+        *head = frame;
+
+    *tail = frame;
+}
+
+TcpClientOutQueue::TcpClientOutQueue()
+{
+    pthread_mutex_init(&this->mutex, nullptr);
+    this->head = nullptr;
+    this->tail = nullptr;
+    this->queued_bytes = 0;
+    this->cork_depth = 0;
+    this->above_high_wm = false;
+    this->error = 0;
+    this->n_syscalls = 0;
+    this->n_frames_sent = 0;
+    this->async_send = false;
+    this->async_req = nullptr;
+    this->n_async_sends = 0;
+    this->shm_head = nullptr;
+    this->shm_tail = nullptr;
+    this->n_shm_waits = 0;
+}
+
+TcpClientOutQueue::~TcpClientOutQueue()
+{
+    tcp_out_frame_list_free(this->head);
+    tcp_out_frame_list_free(this->shm_head);
+
+    if (this->async_req)
+        TcpMemPoolFree(this->async_req);
+
+    pthread_mutex_destroy(&this->mutex);
+}
+
+/**
+ * @brief (持锁) 将消息拷贝到队尾
+ *
+ */
+void TcpClientOutQueue::Append(const unsigned char *msg, uint32_t msg_size)
+{
+    tcp_out_frame_append(&this->head, &this->tail, msg, msg_size);
+    this->queued_bytes += msg_size;
+}
+
+/**
+ * @brief (持锁) 将消息拷贝到 shm 队列的队尾
+ *
+ */
+void TcpClientOutQueue::AppendShm(const unsigned char *msg, uint32_t msg_size)
+{
+    tcp_out_frame_append(&this->shm_head, &this->shm_tail, msg, msg_size);
+    this->queued_bytes += msg_size;
+}
+
+/**
+ * @brief (持锁) 释放已经发送的字节, 最后一条消息可能只发送了一部分
+ *
+ */
+void TcpClientOutQueue::Consume(TcpClient *tcp_client, size_t sent)
+{
+    TcpOutFrame_t *frame;
+    uint64_t n_frames = 0;
+    TcpReactorMetrics_t *metrics = tcp_client->tcp_ctrlr->GetClientMetricsShard(tcp_client);
+
+    this->queued_bytes -= sent;
+    tcp_client->conn.bytes_sent += sent;
+    TcpMetricAdd(&metrics->bytes_sent, sent);
+
+    while (sent)
+    {
+        frame = this->head;
+
+        if (sent < frame->size - frame->offset)
+        {
+            frame->offset += sent;
+            break;
+        }
+
+        sent -= frame->size - frame->offset;
+        this->head = frame->next;
+        if (!this->head)
+            this->tail = nullptr;
+
+        this->n_frames_sent++;
+        n_frames++;
+        free(frame);
+    }
+
+    if (n_frames)
+        TcpMetricAdd(&metrics->frames_sent, n_frames);
+}
+
+/**
+ * @brief (持锁) 用 sendmsg() 批量发送队列中的消息, 直到队列为空或内核缓冲区满
+ *
+ * 异步发送模式下或者有异步发送尚未完成时不发送, 由 DRS 线程提交
+ *
+ * @return int 0: 队列已清空; 1: 内核缓冲区满(或等待 DRS 发送), 仍有数据等待发送; -1: 发送出错(errno)
+ */
+int TcpClientOutQueue::FlushInternal(TcpClient *tcp_client)
+{
+    int n_iov;
+    ssize_t rc;
+    TcpOutFrame_t *frame;
+    struct iovec iov[TCP_OUT_QUEUE_MAX_IOV];
+    struct msghdr msg;
+
+    if (this->async_send || this->async_req)
+        return this->head ? 1 : 0;
+
+    while (this->head)
+    {
+        n_iov = 0;
+        for (frame = this->head; frame && n_iov < TCP_OUT_QUEUE_MAX_IOV; frame = frame->next)
+        {
+            iov[n_iov].iov_base = frame->data + frame->offset;
+            iov[n_iov].iov_len = frame->size - frame->offset;
+            n_iov++;
+        }
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n_iov;
+
+        // 对端关闭时不产生 SIGPIPE, 由返回值报告错误
+        rc = sendmsg(tcp_client->comm_fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        this->n_syscalls++;
+        TcpMetricAdd(&tcp_client->tcp_ctrlr->GetClientMetricsShard(tcp_client)->send_calls, 1);
+
+        if (rc < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 1;
+
+            this->error = errno;
+            return -1;
+        }
+
+        this->Consume(tcp_client, (size_t)rc);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief (持锁, 队列为空) 直接发送一条消息, 内核缓冲区满时剩余部分入队
+ *
+ * @return int 0: 已全部发送; 1: 剩余部分已入队; -1: 发送出错(errno)
+ */
+int TcpClientOutQueue::SendDirect(TcpClient *tcp_client, const unsigned char *msg, uint32_t msg_size)
+{
+    ssize_t rc;
+    TcpReactorMetrics_t *metrics = tcp_client->tcp_ctrlr->GetClientMetricsShard(tcp_client);
+
+    do
+    {
+        rc = send(tcp_client->comm_fd, msg, msg_size, MSG_DONTWAIT | MSG_NOSIGNAL);
+    } while (rc < 0 && errno == EINTR);
+
+    this->n_syscalls++;
+    TcpMetricAdd(&metrics->send_calls, 1);
+
+    if (rc < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            this->error = errno;
+            return -1;
+        }
+
+        rc = 0;
+    }
+
+    tcp_client->conn.bytes_sent += rc;
+    TcpMetricAdd(&metrics->bytes_sent, rc);
+
+    if ((uint32_t)rc == msg_size)
+    {
+        this->n_frames_sent++;
+        TcpMetricAdd(&metrics->frames_sent, 1);
+        return 0;
+    }
+
+    this->Append(msg + rc, msg_size - rc);
+    return 1;
+}
+
+/**
+ * @brief (持锁) 根据积压字节数更新水位状态
+ *
+ * @return TcpOutQueueWmEvent 需要通知应用层的水位变化
+ */
+TcpOutQueueWmEvent TcpClientOutQueue::CheckWatermark(TcpClient *tcp_client)
+{
+    TcpServerController *tcp_ctrlr = tcp_client->tcp_ctrlr;
+
+    if (!tcp_ctrlr)
+        return TCP_OUT_QUEUE_WM_NONE;
+
+    if (!this->above_high_wm && this->queued_bytes > tcp_ctrlr->send_high_wm)
+    {
+        this->above_high_wm = true;
+        return TCP_OUT_QUEUE_WM_HIGH;
+    }
+
+    if (this->above_high_wm && this->queued_bytes <= tcp_ctrlr->send_low_wm)
+    {
+        this->above_high_wm = false;
+        return TCP_OUT_QUEUE_WM_LOW;
+    }
+
+    return TCP_OUT_QUEUE_WM_NONE;
+}
+
+/**
+ * @brief (不持锁) 将水位变化通知应用层, 应用层可以在回调中继续调用 SendMsg()
+ *
+ */
+void TcpClientOutQueue::NotifyWatermark(TcpClient *tcp_client, TcpOutQueueWmEvent wm_event)
+{
+    TcpServerController *tcp_ctrlr = tcp_client->tcp_ctrlr;
+
+    if (wm_event == TCP_OUT_QUEUE_WM_NONE || !tcp_ctrlr || !tcp_ctrlr->client_send_wm)
+        return;
+
+    tcp_ctrlr->client_send_wm(tcp_ctrlr, tcp_client, wm_event == TCP_OUT_QUEUE_WM_HIGH);
+}
+
+/**
+ * @brief 发送一条消息, 不会阻塞
+ *
+ * 队列为空且未 cork 时直接发送; 否则(或者内核缓冲区已满)消息拷贝到队尾, 由之后的 Flush 发送
+ *
+ * @param tcp_client 所属的客户端
+ * @param msg 消息内容, 返回后调用方可以重用
+ * @param msg_size 消息长度
+ * @return int 成功返回 msg_size(已发送或已入队), 连接出错返回 -1(errno)
+ */
+int TcpClientOutQueue::Send(TcpClient *tcp_client, const unsigned char *msg, uint32_t msg_size)
+{
+    int rc = 0, err;
+    TcpOutQueueWmEvent wm_event;
+
+    pthread_mutex_lock(&this->mutex);
+
+    if (this->error)
+    {
+        err = this->error;
+        pthread_mutex_unlock(&this->mutex);
+        errno = err;
+        return -1;
+    }
+
+    // 队列中有数据时, 说明正在等待可写事件或 Uncork(), 只入队
+    if (this->cork_depth || this->head)
+    {
+        this->Append(msg, msg_size);
+    }
+    else
+    {
+        // 直接从调用方的缓冲区发送, 只拷贝未发送的部分
+        rc = this->SendDirect(tcp_client, msg, msg_size);
+    }
+
+    err = this->error;
+    wm_event = this->CheckWatermark(tcp_client);
+    pthread_mutex_unlock(&this->mutex);
+
+    this->NotifyWatermark(tcp_client, wm_event);
+
+    if (rc < 0)
+    {
+        errno = err;
+        return -1;
+    }
+
+    if (rc > 0)
+        this->WatchWrite(tcp_client);
+
+    return msg_size;
+}
+
+/**
+ * @brief 尽可能发送队列中的消息, 处于 cork 状态时不发送
+ *
+ * @return int 0: 队列已清空或处于 cork 状态(由 Uncork() 发送); 1: 内核缓冲区满, 仍有数据等待发送; -1: 发送出错(errno)
+ */
+int TcpClientOutQueue::Flush(TcpClient *tcp_client)
+{
+    int rc = 0, err;
+    TcpOutQueueWmEvent wm_event;
+
+    pthread_mutex_lock(&this->mutex);
+
+    if (this->error)
+        rc = -1;
+    else if (this->cork_depth)
+        rc = 0;
+    else
+        rc = this->FlushInternal(tcp_client);
+
+    err = this->error;
+    wm_event = this->CheckWatermark(tcp_client);
+    pthread_mutex_unlock(&this->mutex);
+
+    this->NotifyWatermark(tcp_client, wm_event);
+
+    if (rc < 0)
+        errno = err;
+
+    return rc;
+}
+
+/**
+ * @brief 暂停发送, 可以嵌套(例如 DRS 线程和线程池同时处理同一客户端)
+ *
+ */
+void TcpClientOutQueue::Cork()
+{
+    pthread_mutex_lock(&this->mutex);
+    this->cork_depth++;
+    pthread_mutex_unlock(&this->mutex);
+}
+
+/**
+ * @brief 恢复发送, 最外层的 Uncork() 把 cork 期间积压的消息一次发送
+ *
+ */
+void TcpClientOutQueue::Uncork(TcpClient *tcp_client)
+{
+    bool flush;
+
+    pthread_mutex_lock(&this->mutex);
+    assert(this->cork_depth > 0);
+    this->cork_depth--;
+    flush = !this->cork_depth && this->head;
+    pthread_mutex_unlock(&this->mutex);
+
+    if (flush && this->Flush(tcp_client) > 0)
+        this->WatchWrite(tcp_client);
+}
+
+/**
+ * @brief 内核缓冲区已满, 请求监听此客户端的 DRS 在 socket 可写后继续发送
+ *
+ */
+void TcpClientOutQueue::WatchWrite(TcpClient *tcp_client)
+{
+    // 只读取一次, DRS 线程可能同时注销此客户端
+    TcpClientServiceManager *svc_mgr = tcp_client->svc_mgr;
+
+    // 尚未被监听的客户端在加入监听集合时会检查发送队列
+    if (svc_mgr)
+        svc_mgr->ClientFDWatchWrite(tcp_client);
+}
+
+/**
+ * @brief 开启/关闭异步发送模式, 由 io_uring DRS 在客户端加入/移出监听集合时调用
+ *
+ */
+void TcpClientOutQueue::SetAsyncSend(bool async_send)
+{
+    pthread_mutex_lock(&this->mutex);
+    this->async_send = async_send;
+    pthread_mutex_unlock(&this->mutex);
+}
+
+/**
+ * @brief (DRS 线程) 把队首的一批消息(最多 TCP_OUT_QUEUE_MAX_IOV 条)填入 msghdr, 用于提交一次异步 sendmsg
+ *
+ * 完成之前其他线程的 Send() 只会追加到队尾, 不会修改已提交的消息
+ *
+ * @return struct msghdr* 已填好的 msghdr, 在 AsyncSendComplete() 之前有效; 队列为空/处于 cork 状态/
+ *         已有未完成的发送/连接出错时返回 nullptr
+ */
+struct msghdr *TcpClientOutQueue::AsyncSendPrepare()
+{
+    int n_iov = 0;
+    TcpOutFrame_t *frame;
+    TcpOutAsyncSend_t *req;
+
+    pthread_mutex_lock(&this->mutex);
+
+    if (!this->head || this->cork_depth || this->async_req || this->error)
+    {
+        pthread_mutex_unlock(&this->mutex);
+        return nullptr;
+    }
+
+    req = (TcpOutAsyncSend_t *)TcpMemPoolAlloc(sizeof(TcpOutAsyncSend_t));
+
+    for (frame = this->head; frame && n_iov < TCP_OUT_QUEUE_MAX_IOV; frame = frame->next)
+    {
+        req->iov[n_iov].iov_base = frame->data + frame->offset;
+        req->iov[n_iov].iov_len = frame->size - frame->offset;
+        n_iov++;
+    }
+
+    memset(&req->msg, 0, sizeof(req->msg));
+    req->msg.msg_iov = req->iov;
+    req->msg.msg_iovlen = n_iov;
+
+    this->async_req = req;
+    this->n_async_sends++;
+    pthread_mutex_unlock(&this->mutex);
+
+    return &req->msg;
+}
+
+/**
+ * @brief (DRS 线程) 异步发送完成, 释放已经发送的消息
+ *
+ * @param tcp_client 所属的客户端
+ * @param res 发送结果: >= 0 发送的字节数, < 0 为 -errno; -ECANCELED(客户端被移出监听集合)不视为错误
+ * @return int 1: 队列中还有数据需要继续提交; 0: 没有需要提交的数据; -1: 发送出错
+ */
+int TcpClientOutQueue::AsyncSendComplete(TcpClient *tcp_client, int res)
+{
+    int rc;
+    TcpOutQueueWmEvent wm_event;
+
+    pthread_mutex_lock(&this->mutex);
+
+    assert(this->async_req);
+    TcpMemPoolFree(this->async_req);
+    this->async_req = nullptr;
+
+    if (res > 0)
+        this->Consume(tcp_client, (size_t)res);
+    else if (res < 0 && res != -ECANCELED && res != -EINTR && res != -EAGAIN)
+        this->error = -res;
+
+    if (this->error)
+        rc = -1;
+    else
+        rc = (this->head && this->async_send && !this->cork_depth) ? 1 : 0;
+
+    wm_event = this->CheckWatermark(tcp_client);
+    pthread_mutex_unlock(&this->mutex);
+
+    this->NotifyWatermark(tcp_client, wm_event);
+
+    return rc;
+}
+
+/**
+ * @brief (持锁) 按顺序把 shm 队列中的消息写入 tx 环
+ *
+ * 超过 TCP_SHM_MSG_MAX 的消息逐个片段写入, frame->offset 记录已写入的字节数, 写完之前不会开始下一条消息;
+ * tx 环放不下队首的消息(片段)时设置 blocked, 对端释放空间后会唤醒共享内存传输线程, 由 DRS 调用 FlushShm()
+ *
+ * @return int 0: 队列已清空; 1: tx 环已满, 等待对端释放空间; -1: 通道已关闭(errno)
+ */
+int TcpClientOutQueue::FlushShmInternal(TcpShmChannel_t *shm)
+{
+    TcpOutFrame_t *frame;
+    uint32_t chunk_size;
+    bool chunked;
+    int rc;
+
+    while ((frame = this->shm_head))
+    {
+        chunked = frame->size > TCP_SHM_MSG_MAX;
+        chunk_size = chunked ? frame->size - frame->offset : frame->size;
+        if (chunk_size > TCP_SHM_MSG_MAX)
+            chunk_size = TCP_SHM_MSG_MAX;
+
+        if (chunked)
+            rc = TcpShmChannelSendChunk(shm, frame->data + frame->offset, chunk_size, frame->offset, frame->size);
+        else
+            rc = TcpShmChannelSend(shm, frame->data, frame->size);
+
+        if (rc < 0)
+        {
+            if (errno != EAGAIN)
+            {
+                this->error = errno;
+                return -1;
+            }
+
+            // 设置 blocked 之前对端可能已经释放了空间, 此时直接重试
+            if (TcpShmChannelSendWaitArm(shm, chunk_size, chunked))
+            {
+                this->n_shm_waits++;
+                return 1;
+            }
+
+            continue;
+        }
+
+        frame->offset += chunk_size;
+        this->queued_bytes -= chunk_size;
+
+        if (frame->offset < frame->size)
+            continue;
+
+        this->shm_head = frame->next;
+        if (!this->shm_head)
+            this->shm_tail = nullptr;
+
+        free(frame);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 通过共享内存通道发送一条消息, 不会阻塞
+ *
+ * shm 队列为空时直接写入 tx 环; tx 环已满, 之前的消息还在排队, 或者消息超过 TCP_SHM_MSG_MAX(分片段写入)时
+ * 拷贝到 shm 队列, 保证顺序不变, 积压字节数与 TCP 队列一样计入高/低水位
+ *
+ * @param tcp_client 所属的客户端
+ * @param shm 客户端的共享内存通道
+ * @param msg 消息内容, 返回后调用方可以重用
+ * @param msg_size 消息长度
+ * @return int 成功返回 msg_size(已写入或已入队), 通道已关闭返回 -1(errno)
+ */
+int TcpClientOutQueue::SendShm(TcpClient *tcp_client, TcpShmChannel_t *shm, const unsigned char *msg, uint32_t msg_size)
+{
+    int rc = 0, err;
+    TcpOutQueueWmEvent wm_event;
+
+    pthread_mutex_lock(&this->mutex);
+
+    if (this->error)
+    {
+        err = this->error;
+        pthread_mutex_unlock(&this->mutex);
+        errno = err;
+        return -1;
+    }
+
+    if (this->shm_head || msg_size > TCP_SHM_MSG_MAX || TcpShmChannelSend(shm, msg, msg_size) < 0)
+    {
+        if (!this->shm_head && msg_size <= TCP_SHM_MSG_MAX && errno != EAGAIN)
+        {
+            this->error = errno;
+            rc = -1;
+        }
+        else
+        {
+            this->AppendShm(msg, msg_size);
+            rc = this->FlushShmInternal(shm);
+        }
+    }
+
+    err = this->error;
+    wm_event = this->CheckWatermark(tcp_client);
+    pthread_mutex_unlock(&this->mutex);
+
+    this->NotifyWatermark(tcp_client, wm_event);
+
+    if (rc < 0)
+    {
+        errno = err;
+        return -1;
+    }
+
+    return msg_size;
+}
+
+/**
+ * @brief (DRS 线程) 对端释放了 tx 环的空间, 继续写入 shm 队列中的消息
+ *
+ * @return int 0: 队列已清空; 1: tx 环仍然已满; -1: 通道已关闭(errno)
+ */
+int TcpClientOutQueue::FlushShm(TcpClient *tcp_client, TcpShmChannel_t *shm)
+{
+    int rc = 0, err;
+    TcpOutQueueWmEvent wm_event;
+
+    pthread_mutex_lock(&this->mutex);
+
+    if (this->error)
+        rc = -1;
+    else if (this->shm_head)
+        rc = this->FlushShmInternal(shm);
+
+    err = this->error;
+    wm_event = this->CheckWatermark(tcp_client);
+    pthread_mutex_unlock(&this->mutex);
+
+    this->NotifyWatermark(tcp_client, wm_event);
+
+    if (rc < 0)
+        errno = err;
+
+    return rc;
+}
+
+bool TcpClientOutQueue::HasPending()
+{
+    bool pending;
+
+    pthread_mutex_lock(&this->mutex);
+    pending = this->head != nullptr;
+    pthread_mutex_unlock(&this->mutex);
+
+    return pending;
+}
+
+/**
+ * @brief 获取发送统计
+ *
+ * @param bytes_sent 发送的字节数
+ * @param frames_sent 发送完成的消息数
+ * @param send_calls 发送使用的系统调用次数(包括异步发送)
+ * @param queued_bytes 队列中尚未发送的字节数
+ */
+void TcpClientOutQueue::GetStats(TcpClient *tcp_client, uint64_t *bytes_sent, uint64_t *frames_sent,
+                                 uint64_t *send_calls, uint64_t *queued_bytes)
+{
+    pthread_mutex_lock(&this->mutex);
+    *bytes_sent = tcp_client->conn.bytes_sent;
+    *frames_sent = this->n_frames_sent;
+    *send_calls = this->n_syscalls + this->n_async_sends;
+    *queued_bytes = this->queued_bytes;
+    pthread_mutex_unlock(&this->mutex);
+}
+
+uint64_t TcpClientOutQueue::GetQueuedBytes()
+{
+    uint64_t queued_bytes;
+
+    pthread_mutex_lock(&this->mutex);
+    queued_bytes = this->queued_bytes;
+    pthread_mutex_unlock(&this->mutex);
+
+    return queued_bytes;
+}
+
+/**
+ * @brief (主动连接) 换用新的 socket, 所有发送路径都在队列锁内使用 comm_fd, 替换期间不会有线程向旧的 socket 发送
+ *
+ * 旧连接积压的数据属于已经断开的连接, 直接丢弃(有未完成的异步发送时内核仍在引用队首的消息, 保留队列);
+ * 清除错误状态, new_fd < 0 表示正在等待重连, 之后的发送以 ENOTCONN 失败
+ *
+ * @param tcp_client 所属的客户端
+ * @param new_fd 新的 socket, -1 表示没有
+ * @return int 旧的 fd, 由调用方关闭
+ */
+int TcpClientOutQueue::ResetConnection(TcpClient *tcp_client, int new_fd)
+{
+    int old_fd;
+    TcpOutQueueWmEvent wm_event;
+
+    pthread_mutex_lock(&this->mutex);
+
+    old_fd = tcp_client->comm_fd;
+    tcp_client->comm_fd = new_fd;
+
+    if (!this->async_req)
+    {
+        tcp_out_frame_list_free(this->head);
+        this->head = nullptr;
+        this->tail = nullptr;
+        this->queued_bytes = 0;
+    }
+
+    this->error = new_fd < 0 ? ENOTCONN : 0;
+    wm_event = this->CheckWatermark(tcp_client);
+    pthread_mutex_unlock(&this->mutex);
+
+    this->NotifyWatermark(tcp_client, wm_event);
+
+    return old_fd;
+}
+
+void TcpClientOutQueue::Display()
+{
+    pthread_mutex_lock(&this->mutex);
+    printf("Out Queue : queued = %lu bytes, frames sent = %lu, syscalls = %lu, async sends = %lu, shm waits = %lu%s%s\n",
+           (unsigned long)this->queued_bytes,
+           (unsigned long)this->n_frames_sent,
+           (unsigned long)this->n_syscalls,
+           (unsigned long)this->n_async_sends,
+           (unsigned long)this->n_shm_waits,
+           this->above_high_wm ? ", above high watermark" : "",
+           this->error ? ", error" : "");
+    pthread_mutex_unlock(&this->mutex);
+}
@@ -0,0 +1,122 @@
+#ifndef TCPCLIENTOUTQUEUE_H_
+#define TCPCLIENTOUTQUEUE_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "TcpShmChannel.h"
+
+#define TCP_OUT_QUEUE_MAX_IOV 64                 // 单次 sendmsg() 最多合并的消息数
+#define TCP_OUT_QUEUE_HIGH_WM (256 * 1024)       // 默认高水位: 积压超过此值时通知应用层暂停发送
+#define TCP_OUT_QUEUE_LOW_WM (64 * 1024)         // 默认低水位: 积压回落到此值以下时通知应用层恢复发送
+
+class TcpClient;
+
+/**
+ * @brief 等待发送的一条消息
+ */
+typedef struct TcpOutFrame_
+{
+    struct TcpOutFrame_ *next; // 下一条消息
+    uint32_t size;             // 消息长度
+    uint32_t offset;           // 已经发送的字节数(部分发送)
+    unsigned char data[];      // 消息内容
+} TcpOutFrame_t;
+
+/**
+ * @brief 一次异步发送(io_uring sendmsg)引用的 iovec, 在完成之前必须保持有效
+ */
+typedef struct TcpOutAsyncSend_
+{
+    struct msghdr msg;
+    struct iovec iov[TCP_OUT_QUEUE_MAX_IOV];
+} TcpOutAsyncSend_t;
+
+/**
+ * @brief 水位变化通知, 在释放队列锁之后回调应用层
+ */
+typedef enum
+{
+    TCP_OUT_QUEUE_WM_NONE,  // 水位状态未变化
+    TCP_OUT_QUEUE_WM_HIGH,  // 积压超过高水位
+    TCP_OUT_QUEUE_WM_LOW    // 积压回落到低水位以下
+} TcpOutQueueWmEvent;
+
+/**
+ * @brief 客户端的发送队列
+ *
+ * 1.队列为空且未 cork 时消息直接发送, 内核缓冲区满时剩余部分进入队列, 不会阻塞调用线程
+ *
+ * 2.队列中的消息通过 sendmsg() 批量发送(一次系统调用最多 TCP_OUT_QUEUE_MAX_IOV 条)
+ *
+ * 3.内核缓冲区再次可写时由 DRS 线程继续发送(epoll 的 EPOLLOUT / select 的写集合)
+ *
+ * 4.Cork()/Uncork() 之间产生的消息只入队, Uncork() 时一次发送, 用于合并同一批接收消息产生的回复
+ *
+ * 5.积压字节数越过高/低水位时通过 TcpServerController::client_send_wm 回调通知应用层
+ *
+ * 6.主动连接的客户端重连时通过 ResetConnection() 在队列锁内替换 comm_fd, 与并发的发送互斥
+ *
+ * 7.异步发送模式(io_uring DRS)下队列中的数据不再由 sendmsg() 发送, 而是由 DRS 线程通过
+ *   AsyncSendPrepare()/AsyncSendComplete() 提交, 发送完成之前队首的消息保持不变
+ *
+ * 8.已协商共享内存的客户端的所有消息由 SendShm() 写 s2c 环, 超过 TCP_SHM_MSG_MAX 的消息拆成片段;
+ *   环满时消息进入单独的 shm 队列(计入水位), 对端释放空间后由客户端所在的 DRS 调用 FlushShm() 继续写入
+ *
+ * 可以被任意线程调用(DRS 线程, 线程池, 应用线程)
+ */
+class TcpClientOutQueue
+{
+private:
+    pthread_mutex_t mutex;  // 保护以下字段
+    TcpOutFrame_t *head;    // 最早入队的消息
+    TcpOutFrame_t *tail;    // 最后入队的消息
+    uint64_t queued_bytes;  // 队列中尚未发送的字节数
+    uint32_t cork_depth;    // Cork() 嵌套深度, 大于 0 时不发送
+    bool above_high_wm;     // 是否处于高水位状态
+    int error;              // 发送出错时的 errno, 之后的发送直接失败
+    uint64_t n_syscalls;    // 发送使用的系统调用次数
+    uint64_t n_frames_sent; // 已经发送完成的消息数
+    bool async_send;        // 队列中的数据由 DRS 异步提交发送(io_uring)
+    TcpOutAsyncSend_t *async_req; // 尚未完成的异步发送, 非空时队首的消息不能修改
+    uint64_t n_async_sends; // 提交的异步发送次数
+    TcpOutFrame_t *shm_head; // 等待写入共享内存通道的第一条消息
+    TcpOutFrame_t *shm_tail; // 等待写入共享内存通道的最后一条消息
+    uint64_t n_shm_waits;   // 共享内存通道的 tx 环满, 等待对端释放空间的次数
+
+    void Append(const unsigned char *msg, uint32_t msg_size); // 消息拷贝到队尾
+    void AppendShm(const unsigned char *msg, uint32_t msg_size); // 消息拷贝到 shm 队列的队尾
+    int FlushShmInternal(TcpShmChannel_t *);                  // 写入 shm 队列中的消息, 直到队列为空或 tx 环满
+    int FlushInternal(TcpClient *);                           // 发送队列中的消息, 直到队列为空或内核缓冲区满
+    void Consume(TcpClient *, size_t sent);                   // 释放已经发送的字节
+    int SendDirect(TcpClient *, const unsigned char *, uint32_t); // 队列为空时直接发送, 剩余部分入队
+    TcpOutQueueWmEvent CheckWatermark(TcpClient *);           // 更新水位状态
+    void NotifyWatermark(TcpClient *, TcpOutQueueWmEvent);    // (不持锁) 回调应用层
+    void WatchWrite(TcpClient *);                             // (不持锁) 请求 DRS 在 socket 可写后继续发送
+
+public:
+    TcpClientOutQueue();
+    ~TcpClientOutQueue();
+
+    int Send(TcpClient *, const unsigned char *msg, uint32_t msg_size); // 发送或入队一条消息
+    int Flush(TcpClient *);                                             // 尽可能发送队列中的消息
+    void Cork();                                                        // 暂停发送, 之后的消息只入队
+    void Uncork(TcpClient *);                                           // 恢复发送, 最外层 Uncork() 时发送积压的消息
+    bool HasPending();                                                  // 队列中是否有未发送的数据
+
+    // 共享内存通道
+    int SendShm(TcpClient *, TcpShmChannel_t *, const unsigned char *msg, uint32_t msg_size); // 写入或入队一条消息
+    int FlushShm(TcpClient *, TcpShmChannel_t *);                                             // 对端释放空间后继续写入
+    uint64_t GetQueuedBytes();
+    int ResetConnection(TcpClient *, int new_fd);                       // (主动连接) 换用新的 socket, 丢弃积压的数据, 返回旧的 fd
+    void GetStats(TcpClient *, uint64_t *bytes_sent, uint64_t *frames_sent, uint64_t *send_calls, uint64_t *queued_bytes);
+
+    // io_uring DRS 使用, 只在 DRS 线程中调用
+    void SetAsyncSend(bool);                               // 开启/关闭异步发送模式
+    struct msghdr *AsyncSendPrepare();                     // 取出队首的一批消息提交发送, 没有可发送的数据时返回 nullptr
+    int AsyncSendComplete(TcpClient *, int res);           // 异步发送完成, 返回 1 表示队列中还有数据需要继续提交
+    void Display();
+};
+
+#endif
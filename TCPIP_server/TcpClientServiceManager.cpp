@@ -8,479 +8,1551 @@
 #include <errno.h>
 #include <netdb.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <vector>
 
 #include "TcpClientServiceManager.h"
 #include "TcpServerController.h"
 #include "TcpClient.h"
+#include "TcpMsgDemarcar.h"
 #include "network_utils.h"
 
-#define CLIENT_RECV_BUFFER_SIZE 1024
-static unsigned char common_recv_buffer[CLIENT_RECV_BUFFER_SIZE];
+TcpClientServiceManager::TcpClientServiceManager(TcpServerController *tcp_ctrlr, uint16_t reactor_id, int cpu_core)
+{
+    this->tcp_ctrlr = tcp_ctrlr;
+    this->mx_type = tcp_ctrlr->mx_type;
+    this->reactor_id = reactor_id;
+    this->cpu_core = cpu_core;
+    this->n_clients = 0;
+    this->epoll_fd = -1;
+    this->uring = nullptr;
+    this->thread_running = false;
+    memset(&this->metrics, 0, sizeof(this->metrics));
+    this->rand_state = (TcpMetricsNowNs() ^ ((uint64_t)reactor_id << 48)) | 1;
+
+    // 其他线程通过此 eventfd 唤醒阻塞在 epoll_wait()/select() 中的 DRS 线程
+    this->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (this->event_fd < 0)
+    {
+        printf("Eventfd Creation Failed, error = %d\n", errno);
+        exit(0);
+    }
+
+    this->max_fd = this->event_fd;
+
+    if (this->mx_type == TCP_MULTIPLEX_EPOLL)
+    {
+        this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+        if (this->epoll_fd < 0)
+        {
+            printf("Epoll Instance Creation Failed, error = %d\n", errno);
+            exit(0);
+        }
+
+        // data.ptr 为 nullptr 的事件表示命令队列中有新命令
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;
+        epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->event_fd, &ev);
+    }
+
+    if (this->mx_type == TCP_MULTIPLEX_IO_URING)
+        this->UringInit();
+
+    FD_ZERO(&active_fd_set);
+    FD_ZERO(&backup_fd_set);
+    FD_ZERO(&active_wr_fd_set);
+    FD_ZERO(&backup_wr_fd_set);
+
+    client_svc_mgr_thread = (pthread_t *)calloc(1, sizeof(pthread_t));
+    sem_init(&this->wait_for_thread_operation_to_complete, 0, 0);
+    pthread_mutex_init(&this->cmdq_mutex, nullptr);
+}
+
+TcpClientServiceManager::~TcpClientServiceManager()
+{
+    assert(this->tcp_client_db.GetSize() == 0);
+    assert(this->connect_pending.empty());
+    assert(this->cmdQ.empty());
+    assert(this->event_fd < 0);
+}
+
+/**
+ * @brief 从 DB 中移除客户端, 并释放 DB 持有的引用
+ *
+ * @param tcp_client
+ */
+void TcpClientServiceManager::RemoveClientFromDB(TcpClient *tcp_client)
+{
+    this->timer_wheel.Remove(&tcp_client->liveness_timer);
+    this->tcp_client_db.Remove(tcp_client->ip_addr, tcp_client->port_no);
+    this->n_clients--;
+    TcpMetricAdd(&this->metrics.clients_removed, 1);
+    tcp_client->svc_mgr = nullptr;
+    tcp_client->UnSetState(TCP_CLIENT_STATE_MULTIPLEX_LISTEN);
+    tcp_client->Dereference();
+}
+
+/**
+ * @brief 将客户端加入 DB, 接管命令队列中持有的引用
+ *
+ * @param tcp_client
+ */
+void TcpClientServiceManager::AddClientToDB(TcpClient *tcp_client)
+{
+    this->tcp_client_db.Insert(tcp_client->ip_addr, tcp_client->port_no, tcp_client);
+    TcpMetricAdd(&this->metrics.clients_added, 1);
+}
+
+void TcpClientServiceManager::CopyClientFDtoFDSet(fd_set *fdset)
+{
+    uint32_t slot;
+    TcpClient *tcp_client;
+
+    for (slot = 0; slot < this->tcp_client_db.GetSlotCount(); slot++)
+    {
+        tcp_client = this->tcp_client_db.GetSlotClient(slot);
+
+        if (tcp_client)
+            FD_SET(tcp_client->comm_fd, fdset);
+    }
+}
+
+// old implemention
+void TcpClientServiceManager::StartTcpClientServiceManagerThreadInternal2()
+{
+}
+
+TcpMultiplexType TcpClientServiceManager::GetMultiplexType()
+{
+    return this->mx_type;
+}
+
+uint16_t TcpClientServiceManager::GetReactorId()
+{
+    return this->reactor_id;
+}
+
+uint32_t TcpClientServiceManager::GetClientCount()
+{
+    return this->n_clients.load(std::memory_order_relaxed);
+}
+
+TcpReactorMetrics_t *TcpClientServiceManager::GetMetrics()
+{
+    return &this->metrics;
+}
+
+/**
+ * @brief 从客户端 socket 读取一次数据, 交给分帧器或直接回调应用层
+ *
+ * 有分帧器时数据直接读入客户端自己的环形缓冲区, 否则读入客户端的 recv_buffer,
+ * 不再经过所有客户端共用的接收缓冲区.
+ *
+ * @param tcp_client 就绪的客户端
+ * @return int recv() 的返回值: >0 读取的字节数, 0 对端关闭, -1 出错(errno)
+ */
+int TcpClientServiceManager::ClientFDRecv(TcpClient *tcp_client)
+{
+    int rcv_bytes;
+
+    tcp_client->conn.recv_calls++;
+    TcpMetricAdd(&this->metrics.recv_calls, 1);
+
+    // 根据客户端的 MsgDemarcar, 应用其对应的拆包逻辑
+    if (tcp_client->msgd)
+    {
+        rcv_bytes = tcp_client->msgd->RecvFromSocket(tcp_client);
+
+        if (rcv_bytes > 0)
+        {
+            tcp_client->conn.bytes_recvd += rcv_bytes;
+            TcpMetricAdd(&this->metrics.bytes_recvd, rcv_bytes);
+            // 只记录时间, 定时器到期时才根据此时间重新调度, 收到数据不需要操作时间轮
+            tcp_client->last_active_tick = this->timer_wheel.GetCurrentTick();
+        }
+
+        return rcv_bytes;
+    }
+
+    rcv_bytes = recv(tcp_client->comm_fd, tcp_client->recv_buffer, MAX_CLIENT_BUFFER_SIZE, 0);
+
+    if (rcv_bytes <= 0)
+        return rcv_bytes;
+
+    tcp_client->conn.recv_ns = TcpMetricsNowNs();
+    tcp_client->conn.bytes_recvd += rcv_bytes;
+    TcpMetricAdd(&this->metrics.bytes_recvd, rcv_bytes);
+    tcp_client->last_active_tick = this->timer_wheel.GetCurrentTick();
+
+    // 直接交给上层应用(或线程池)
+    this->tcp_ctrlr->ClientMsgRecvd(tcp_client, tcp_client->recv_buffer, rcv_bytes);
+
+    return rcv_bytes;
+}
+
+/**
+ * @brief (epoll) 边沿触发模式下必须一次把 socket 读空, 直到 recv() 返回 EAGAIN
+ *
+ * @param tcp_client 就绪的客户端
+ * @return true  数据已读空, 连接正常
+ * @return false 对端关闭或读出错, 需要断开此客户端
+ */
+bool TcpClientServiceManager::ClientFDDrain(TcpClient *tcp_client)
+{
+    int rcv_bytes;
+
+    while (true)
+    {
+        rcv_bytes = this->ClientFDRecv(tcp_client);
+
+        // 线程池积压过多时剩下的数据留在内核缓冲区, 恢复时再读取
+        if (rcv_bytes > 0)
+        {
+            if (this->ClientFDReadThrottled(tcp_client))
+                return true;
+            continue;
+        }
+
+        if (rcv_bytes < 0 && errno == EINTR)
+            continue;
+
+        // 内核缓冲区已读空, 等待下一次边沿事件
+        if (rcv_bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return true;
+
+        // rcv_bytes == 0 对端关闭; ENOBUFS 表示消息超过了分帧器缓冲区容量, 无法继续分帧; EPROTO 表示分帧协议错误
+
+        return false;
+    }
+}
+
+/**
+ * @brief 处理客户端的一批接收数据
+ *
+ * 处理期间发送队列处于 cork 状态, 应用层对这一批消息的回复在结束时通过一次 sendmsg() 发送;
+ * 暂停读取的客户端(线程池积压过多)不读取, 数据留在内核缓冲区, 对端的 TCP 窗口随之关闭
+ *
+ * @param tcp_client 就绪的客户端
+ * @param drain true: (epoll) 读空 socket; false: (select) 只读取一次
+ * @return true 连接正常
+ * @return false 对端关闭或读出错, 需要断开此客户端
+ */
+bool TcpClientServiceManager::ClientFDReadBatch(TcpClient *tcp_client, bool drain)
+{
+    bool ok;
+
+    if (tcp_client->read_paused)
+        return true;
+
+    tcp_client->out_queue.Cork();
+
+    if (drain)
+    {
+        ok = this->ClientFDDrain(tcp_client);
+    }
+    else
+    {
+        ok = this->ClientFDRecv(tcp_client) > 0;
+        if (ok)
+            this->ClientFDReadThrottled(tcp_client);
+    }
+
+    tcp_client->out_queue.Uncork(tcp_client);
+
+    return ok;
+}
+
+/**
+ * @brief (DRS 线程) 客户端 socket 可写, 继续发送发送队列中积压的数据
+ *
+ * @param tcp_client 可写的客户端
+ */
+void TcpClientServiceManager::ClientFDWritable(TcpClient *tcp_client)
+{
+    // 发送出错时不在这里断开, 读事件会报告同样的错误
+    if (tcp_client->out_queue.Flush(tcp_client) <= 0 && this->mx_type == TCP_MULTIPLEX_SELECT)
+        FD_CLR(tcp_client->comm_fd, &this->backup_wr_fd_set);
+}
+
+/**
+ * @brief (DRS 线程) 每次读取之后检查线程池中此客户端的积压, 达到高水位时暂停读取
+ *
+ * epoll: 不再读取, 之后的可读事件也忽略; select: 移出读集合; io_uring: 取消 multishot recv.
+ * 工作线程处理到低水位以下时通过 ClientFDResumeRead() 恢复
+ *
+ * @param tcp_client 刚读取过数据的客户端
+ * @return true 已暂停读取
+ */
+bool TcpClientServiceManager::ClientFDReadThrottled(TcpClient *tcp_client)
+{
+    if (tcp_client->read_paused || !tcp_client->strand.IsThrottled())
+        return tcp_client->read_paused;
+
+    tcp_client->read_paused = true;
+
+    if (this->mx_type == TCP_MULTIPLEX_SELECT)
+        FD_CLR(tcp_client->comm_fd, &this->backup_fd_set);
+    else if (this->mx_type == TCP_MULTIPLEX_IO_URING)
+        this->UringClientRecvStop(tcp_client);
+
+    return true;
+}
+
+/**
+ * @brief 线程池积压回落后恢复读取客户端 socket(异步), 可以被任意线程调用
+ *
+ * @param tcp_client 被暂停读取的客户端
+ */
+void TcpClientServiceManager::ClientFDResumeRead(TcpClient *tcp_client)
+{
+    if (!this->thread_running || this->IsDrsThread())
+    {
+        this->ClientFDResumeReadInternal(tcp_client);
+        return;
+    }
+
+    // 命令队列持有一个引用, 执行后释放
+    tcp_client->Reference();
+    this->EnqueCmd(DRS_CMD_CLIENT_RESUME_READ, tcp_client, nullptr);
+}
+
+/**
+ * @brief 共享内存通道可读(异步), 由共享内存传输的唤醒线程调用
+ *
+ * 通道中的消息在 DRS 线程中交付, 与同一客户端的 TCP 数据不会并发
+ *
+ * @param tcp_client 调用方持有引用的客户端
+ */
+void TcpClientServiceManager::ClientShmReadable(TcpClient *tcp_client)
+{
+    // 命令队列持有一个引用, 执行后释放
+    tcp_client->Reference();
+    this->EnqueCmd(DRS_CMD_CLIENT_SHM_READ, tcp_client, nullptr);
+}
+
+/**
+ * @brief (DRS 线程) 取出客户端共享内存通道中的消息
+ *
+ * @param tcp_client 已协商共享内存的客户端
+ */
+void TcpClientServiceManager::ClientShmReadableInternal(TcpClient *tcp_client)
+{
+    // 客户端已经被移出监听集合, 随后会被删除
+    if (tcp_client->svc_mgr != this)
+        return;
+
+    this->tcp_ctrlr->ClientShmDrain(tcp_client);
+}
+
+/**
+ * @brief (DRS 线程) 恢复读取被暂停的客户端
+ *
+ * @param tcp_client 被暂停读取的客户端
+ */
+void TcpClientServiceManager::ClientFDResumeReadInternal(TcpClient *tcp_client)
+{
+    // 客户端可能已经被注销, 或者工作线程在 DRS 暂停读取之前就处理完了积压
+    if (tcp_client->svc_mgr != this || !tcp_client->read_paused)
+        return;
+
+    tcp_client->read_paused = false;
+
+    if (this->mx_type == TCP_MULTIPLEX_SELECT)
+    {
+        FD_SET(tcp_client->comm_fd, &this->backup_fd_set);
+        return;
+    }
 
-TcpClientServiceManager::TcpClientServiceManager(TcpServerController *tcp_ctrlr)
+    if (this->mx_type == TCP_MULTIPLEX_IO_URING)
+    {
+        // 取消还没有完成时, 最后一个完成事件会重新提交
+        if (!tcp_client->recv_armed)
+            this->UringClientRecvArm(tcp_client);
+        return;
+    }
+
+    // 边沿触发: 暂停期间已经到达的数据不会再产生可读事件, 立即读取
+    if (!this->ClientFDReadBatch(tcp_client, true))
+        this->ClientFDDisconnected(tcp_client);
+}
+
+/**
+ * @brief 使用 epoll(边沿触发) 处理多个 tcpClient 的读写事件
+ *
+ * epoll_event.data.ptr 中直接保存 TcpClient 指针, 每轮只处理就绪的客户端(O(ready)),
+ * 也不再受 FD_SETSIZE 的限制. data.ptr 为 nullptr 的事件来自命令队列的 eventfd.
+ *
+ * 客户端 fd 同时以边沿触发注册 EPOLLOUT, 内核发送缓冲区从满变为可写时才会产生可写事件,
+ * 不需要在发送队列积压时修改 epoll 注册.
+ */
+void TcpClientServiceManager::StartTcpClientServiceManagerThreadInternalEpoll()
+{
+    int i, n_events, cancel_state;
+    bool cmd_pending;
+    TcpClient *tcp_client;
+    struct epoll_event events[TCP_EPOLL_MAX_EVENTS];
+
+    // 信号量 +1; 唤醒(通知)外部线程当前线程已经启动完成
+    sem_post(&this->wait_for_thread_operation_to_complete);
+
+    while (true)
+    {
+        pthread_testcancel();
+
+        // 阻塞等待任一 client_fd 就绪或下一个时间轮 tick(epoll_wait 是取消点)
+        n_events = epoll_wait(this->epoll_fd, events, TCP_EPOLL_MAX_EVENTS,
+                              this->timer_wheel.GetTimeoutMs(TcpTimerWheel::NowMs()));
+        TcpMetricAdd(&this->metrics.wait_calls, 1);
+
+        if (n_events < 0)
+        {
+            if (errno != EINTR)
+                printf("%s() epoll_wait failed, error = %d\n", __FUNCTION__, errno);
+            continue;
+        }
+
+        // 处理一批事件期间禁止取消, 保证 DB 与 epoll 实例的一致性
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+
+        cmd_pending = false;
+        for (i = 0; i < n_events; i++)
+        {
+            tcp_client = (TcpClient *)events[i].data.ptr;
+
+            if (!tcp_client)
+            {
+                cmd_pending = true;
+                continue;
+            }
+
+            // 正在主动连接的 socket 只注册了可写事件, 连接成功或失败都会产生
+            if (tcp_client->IsStateSet(TCP_CLIENT_STATE_CONNECT_IN_PROGRESS))
+            {
+                this->ClientConnectWritable(tcp_client);
+            }
+            else if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                // 读完这一批数据后会发送积压的数据, 不需要再处理 EPOLLOUT
+                if (!this->ClientFDReadBatch(tcp_client, true))
+                    this->ClientFDDisconnected(tcp_client);
+            }
+            else if (events[i].events & EPOLLOUT)
+            {
+                this->ClientFDWritable(tcp_client);
+            }
+        }
+
+        // 命令可能注销本批次中的其他客户端, 所以放在本批次事件之后执行
+        if (cmd_pending)
+            this->ProcessCmdQ();
+
+        // 到期回调可能断开并释放客户端, 而 events[] 中还保存着本批次客户端的指针, 所以在本批次事件之后推进时间轮;
+        // 本批次收到数据的客户端记录的是推进之前的 tick, 空闲判断最多提前一个 tick
+        this->timer_wheel.Advance(TcpTimerWheel::NowMs());
+
+        pthread_setcancelstate(cancel_state, nullptr);
+    } // while ends
+}
+
+/**
+ * @brief 使用 select() 模式处理多个 tcpClient 的读写事件(简单实现)
+ *
+ */
+void TcpClientServiceManager::StartTcpClientServiceManagerThreadInternalSimple()
+{
+    int rc, cancel_state, timeout_ms;
+    uint32_t slot;
+    size_t i;
+    TcpClient *tcp_client;
+    struct timeval timeout;
+    std::vector<TcpClient *> connect_ready;
+    std::unordered_set<TcpClient *>::iterator it;
+
+    // 初始化 fd_set 备份, 用于每轮 select 复制
+    FD_ZERO(&this->backup_fd_set);
+    FD_ZERO(&this->backup_wr_fd_set);
+    FD_SET(this->event_fd, &this->backup_fd_set);
+    this->CopyClientFDtoFDSet(&this->backup_fd_set);
+    this->max_fd = this->GetMaxFdSimple();
+
+    // 信号量 +1; 唤醒(通知)外部线程当前线程已经启动完成
+    sem_post(&this->wait_for_thread_operation_to_complete);
+
+    while (true)
+    {
+        pthread_testcancel();
+
+        // 每轮 select() 前都复制 fd_set，因为 select 会修改 active_fd_set
+        memcpy(&this->active_fd_set, &this->backup_fd_set, sizeof(fd_set));
+        memcpy(&this->active_wr_fd_set, &this->backup_wr_fd_set, sizeof(fd_set));
+        // 阻塞等待任一 client_fd 上有读事件, 或发送队列有积压的 client_fd 可写, 或下一个时间轮 tick
+        timeout_ms = this->timer_wheel.GetTimeoutMs(TcpTimerWheel::NowMs());
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_usec = (timeout_ms % 1000) * 1000;
+        rc = select(this->max_fd + 1, &this->active_fd_set, &this->active_wr_fd_set, nullptr,
+                    timeout_ms < 0 ? nullptr : &timeout);
+        TcpMetricAdd(&this->metrics.wait_calls, 1);
+
+        if (rc < 0)
+        {
+            if (errno != EINTR)
+                printf("%s() select failed, error = %d\n", __FUNCTION__, errno);
+            continue;
+        }
+
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+
+        // 遍历所有客户端, 删除只留下删除标记, 遍历过程中可以安全删除当前客户端
+        for (slot = 0; slot < this->tcp_client_db.GetSlotCount(); slot++)
+        {
+            tcp_client = this->tcp_client_db.GetSlotClient(slot);
+
+            if (!tcp_client)
+                continue;
+
+            if (FD_ISSET(tcp_client->comm_fd, &this->active_wr_fd_set))
+                this->ClientFDWritable(tcp_client);
+
+            // 如果此客户端有数据可读
+            if (!FD_ISSET(tcp_client->comm_fd, &this->active_fd_set))
+                continue;
+
+            // 接受信息出现错误
+            if (!this->ClientFDReadBatch(tcp_client, false))
+            {
+                this->ClientFDDisconnected(tcp_client);
+            }
+        }
+
+        // 连接完成会修改 connect_pending(应用层回调中还可能放弃其他连接), 先取出所有可写的 socket
+        for (it = this->connect_pending.begin(); it != this->connect_pending.end(); ++it)
+        {
+            tcp_client = *it;
+
+            if (tcp_client->connect_inflight && FD_ISSET(tcp_client->comm_fd, &this->active_wr_fd_set))
+            {
+                tcp_client->Reference();
+                connect_ready.push_back(tcp_client);
+            }
+        }
+
+        for (i = 0; i < connect_ready.size(); i++)
+        {
+            tcp_client = connect_ready[i];
+
+            if (tcp_client->svc_mgr == this && tcp_client->connect_inflight)
+                this->ClientConnectWritable(tcp_client);
+
+            tcp_client->Dereference();
+        }
+        connect_ready.clear();
+
+        if (FD_ISSET(this->event_fd, &this->active_fd_set))
+            this->ProcessCmdQ();
+
+        // 与 epoll 相同, 就绪的 fd 处理完之后才处理到期的定时器
+        this->timer_wheel.Advance(TcpTimerWheel::NowMs());
+
+        pthread_setcancelstate(cancel_state, nullptr);
+    } // while ends
+}
+
+/**
+ * @brief
+ *
+ * @param arg
+ * @return void*
+ */
+static void *tcp_client_svc_manager_thread_fn(void *arg)
+{
+    TcpClientServiceManager *svc_mgr = (TcpClientServiceManager *)arg;
+
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, nullptr);
+    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, nullptr);
+
+    if (svc_mgr->GetMultiplexType() == TCP_MULTIPLEX_EPOLL)
+        svc_mgr->StartTcpClientServiceManagerThreadInternalEpoll();
+    else if (svc_mgr->GetMultiplexType() == TCP_MULTIPLEX_IO_URING)
+        svc_mgr->StartTcpClientServiceManagerThreadInternalUring();
+    else
+        svc_mgr->StartTcpClientServiceManagerThreadInternalSimple();
+
+    return nullptr;
+}
+
+/**
+ * @brief
+ *
+ */
+void TcpClientServiceManager::StartTcpClientServiceManagerThread()
+{
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+    if (!this->client_svc_mgr_thread)
+    {
+        this->client_svc_mgr_thread = (pthread_t *)calloc(1, sizeof(pthread_t));
+    }
+
+    pthread_create(this->client_svc_mgr_thread, &attr, tcp_client_svc_manager_thread_fn, (void *)(this));
+    this->thread_running = true;
+
+    // 将分片线程绑定到指定核心, 避免线程在核心间迁移导致缓存失效
+    if (this->cpu_core >= 0)
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(this->cpu_core, &cpuset);
+
+        if (pthread_setaffinity_np(*this->client_svc_mgr_thread, sizeof(cpu_set_t), &cpuset))
+            printf("%s() Failed to pin DRS %u to core %d\n", __FUNCTION__, this->reactor_id, this->cpu_core);
+    }
+
+    sem_wait(&this->wait_for_thread_operation_to_complete);
+    printf("Service started: TcpClientServiceMangerThread [%u]\n", this->reactor_id);
+}
+
+/**
+ * @brief 按照 IP地址和端口查找客户端
+ *
+ * @param ip_addr
+ * @param port_no
+ * @return TcpClient*
+ */
+TcpClient *TcpClientServiceManager::LookUpClientDB(uint32_t ip_addr, uint16_t port_no)
+{
+    return this->tcp_client_db.Lookup(ip_addr, port_no);
+}
+
+/**
+ * @brief 命令入队, 并通过 eventfd 唤醒 DRS 线程
+ *
+ * @param code       命令类型
+ * @param tcp_client 命令作用的客户端
+ * @param zero_sema  非空时, DRS 线程执行完命令后 sem_post()
+ */
+void TcpClientServiceManager::EnqueCmd(DrsCmdCode code, TcpClient *tcp_client, sem_t *zero_sema)
+{
+    uint64_t one = 1;
+    DrsCmd_t cmd;
+
+    cmd.code = code;
+    cmd.tcp_client = tcp_client;
+    cmd.zero_sema = zero_sema;
+    cmd.enq_ns = TcpMetricsNowNs();
+
+    pthread_mutex_lock(&this->cmdq_mutex);
+    this->cmdQ.push_back(cmd);
+    pthread_mutex_unlock(&this->cmdq_mutex);
+
+    // eventfd 是计数器, 多次写入会被合并为一次唤醒
+    if (write(this->event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        printf("%s() eventfd write failed, error = %d\n", __FUNCTION__, errno);
+}
+
+/**
+ * @brief (DRS 线程) 取出命令队列中的全部命令并依次执行
+ *
+ */
+void TcpClientServiceManager::ProcessCmdQ()
+{
+    uint64_t counter, now_ns;
+    DrsCmd_t *cmd;
+    std::list<DrsCmd_t> cmds;
+    std::list<DrsCmd_t>::iterator it;
+
+    // 清零 eventfd 计数器
+    if (read(this->event_fd, &counter, sizeof(counter)) < 0 && errno != EAGAIN)
+        printf("%s() eventfd read failed, error = %d\n", __FUNCTION__, errno);
+
+    // 只在交换队列时持锁, 命令在锁外执行
+    pthread_mutex_lock(&this->cmdq_mutex);
+    cmds.swap(this->cmdQ);
+    pthread_mutex_unlock(&this->cmdq_mutex);
+
+    now_ns = TcpMetricsNowNs();
+
+    for (it = cmds.begin(); it != cmds.end(); ++it)
+    {
+        cmd = &(*it);
+
+        TcpHistogramRecord(&this->metrics.cmd_q_lat, now_ns - cmd->enq_ns);
+
+        switch (cmd->code)
+        {
+        case DRS_CMD_CLIENT_START_LISTEN:
+            this->ClientFDStartListenInternal(cmd->tcp_client);
+            break;
+        case DRS_CMD_CLIENT_STOP_LISTEN:
+            this->ClientFDStopListenInternal(cmd->tcp_client);
+            break;
+        case DRS_CMD_CLIENT_WATCH_WRITE:
+            this->ClientFDWatchWriteInternal(cmd->tcp_client);
+            cmd->tcp_client->Dereference();
+            break;
+        case DRS_CMD_ACCEPT_STOP:
+            this->AcceptFDStopInternal();
+            break;
+        case DRS_CMD_CLIENT_CONNECT:
+            this->ClientConnectStartInternal(cmd->tcp_client);
+            break;
+        case DRS_CMD_CLIENT_RESUME_READ:
+            this->ClientFDResumeReadInternal(cmd->tcp_client);
+            cmd->tcp_client->Dereference();
+            break;
+        case DRS_CMD_CLIENT_SHM_READ:
+            this->ClientShmReadableInternal(cmd->tcp_client);
+            cmd->tcp_client->Dereference();
+            break;
+        case DRS_CMD_STOP_LISTEN_ALL:
+            this->StopListenAllInternal();
+            break;
+        default:
+            break;
+        }
+
+        if (cmd->zero_sema)
+            sem_post(cmd->zero_sema);
+    }
+}
+
+/**
+ * @brief 判断当前线程是否是本分片的 DRS 线程
+ *
+ * @return true
+ * @return false
+ */
+bool TcpClientServiceManager::IsDrsThread()
+{
+    return this->thread_running && pthread_equal(pthread_self(), *this->client_svc_mgr_thread);
+}
+
+/**
+ * @brief 将客户端加入监听集合(异步)
+ *
+ * 客户端立即归属于本分片(svc_mgr / TCP_CLIENT_STATE_MULTIPLEX_LISTEN), fd 的注册由 DRS 线程在事件循环中完成,
+ * 同一分片的命令按顺序执行, 所以紧接着的 ClientFDStopListen() 总能看到已注册的客户端.
+ *
+ * @param tcp_client 指向要加入监听的客户端对象
+ */
+void TcpClientServiceManager::ClientFDStartListen(TcpClient *tcp_client)
+{
+    assert(!tcp_client->IsStateSet(TCP_CLIENT_STATE_MULTIPLEX_LISTEN));
+
+    // 命令队列持有一个引用, 执行后转交给 DB
+    tcp_client->Reference();
+    tcp_client->svc_mgr = this;
+    tcp_client->SetState(TCP_CLIENT_STATE_MULTIPLEX_LISTEN);
+    this->n_clients++;
+
+    if (!this->thread_running || this->IsDrsThread())
+    {
+        this->ClientFDStartListenInternal(tcp_client);
+        return;
+    }
+
+    this->EnqueCmd(DRS_CMD_CLIENT_START_LISTEN, tcp_client, nullptr);
+}
+
+/**
+ * @brief 将客户端从监听集合中移除(同步)
+ *
+ * 在 DRS 线程(例如应用回调)中调用时直接执行, 否则等待 DRS 线程执行完成后返回,
+ * 返回后 DRS 线程不会再访问此客户端
+ *
+ * @param tcp_client 指向要停止监听的客户端对象
+ */
+void TcpClientServiceManager::ClientFDStopListen(TcpClient *tcp_client)
+{
+    sem_t sem;
+
+    if (!this->thread_running || this->IsDrsThread())
+    {
+        this->ClientFDStopListenInternal(tcp_client);
+        return;
+    }
+
+    sem_init(&sem, 0, 0);
+    this->EnqueCmd(DRS_CMD_CLIENT_STOP_LISTEN, tcp_client, &sem);
+    sem_wait(&sem);
+    sem_destroy(&sem);
+}
+
+/**
+ * @brief 服务停止时将所有客户端移出监听集合(同步)
+ *
+ * 返回后 DRS 线程仍在运行, 但不再读取任何 socket, 不会再向线程池或消息队列投递消息;
+ * 工作线程和消息线程此后对本分片的调用都会看到客户端已经被注销
+ */
+void TcpClientServiceManager::StopListenAll()
+{
+    sem_t sem;
+
+    if (!this->thread_running || this->IsDrsThread())
+    {
+        this->StopListenAllInternal();
+        return;
+    }
+
+    sem_init(&sem, 0, 0);
+    this->EnqueCmd(DRS_CMD_STOP_LISTEN_ALL, nullptr, &sem);
+    sem_wait(&sem);
+    sem_destroy(&sem);
+}
+
+/**
+ * @brief 客户端的发送队列因内核缓冲区满而积压, 请求 DRS 在 socket 可写后继续发送(异步)
+ *
+ * epoll 模式下 EPOLLOUT 始终注册, 不需要任何操作; io_uring 模式下由 DRS 线程在本轮循环结束时提交发送
+ *
+ * @param tcp_client 发送队列有积压的客户端
+ */
+void TcpClientServiceManager::ClientFDWatchWrite(TcpClient *tcp_client)
+{
+    if (this->mx_type == TCP_MULTIPLEX_EPOLL)
+        return;
+
+    if (!this->thread_running || this->IsDrsThread())
+    {
+        this->ClientFDWatchWriteInternal(tcp_client);
+        return;
+    }
+
+    // 命令队列持有一个引用, 执行后释放
+    tcp_client->Reference();
+    this->EnqueCmd(DRS_CMD_CLIENT_WATCH_WRITE, tcp_client, nullptr);
+}
+
+/**
+ * @brief (DRS 线程) select: 将客户端 fd 加入写集合; io_uring: 加入本轮的发送列表
+ *
+ * @param tcp_client 发送队列有积压的客户端
+ */
+void TcpClientServiceManager::ClientFDWatchWriteInternal(TcpClient *tcp_client)
+{
+    // 客户端可能已经被注销; 正在连接的 socket 已经在等待可写, 连接成功加入监听集合时会检查发送队列
+    if (tcp_client->svc_mgr != this || tcp_client->IsStateSet(TCP_CLIENT_STATE_CONNECT_IN_PROGRESS))
+        return;
+
+    if (this->mx_type == TCP_MULTIPLEX_IO_URING)
+    {
+        this->UringClientSend(tcp_client);
+        return;
+    }
+
+    FD_SET(tcp_client->comm_fd, &this->backup_wr_fd_set);
+}
+
+/**
+ * @brief (DRS 线程) 将客户端 fd 加入 epoll 实例 / fd_set
+ *
+ * @param tcp_client 指向要加入监听的客户端对象
+ */
+void TcpClientServiceManager::ClientFDStartListenInternal(TcpClient *tcp_client)
+{
+    // 此客户端不应该已经存在（防御性检查）
+    assert(!this->LookUpClientDB(tcp_client->ip_addr, tcp_client->port_no));
+
+    this->AddClientToDB(tcp_client);
+    tcp_client->read_paused = false;
+
+    if (this->mx_type == TCP_MULTIPLEX_EPOLL)
+    {
+        struct epoll_event ev;
+
+        // 边沿触发要求 fd 非阻塞, 否则读空 socket 时会阻塞 DRS 线程
+        // accept4(SOCK_NONBLOCK) 接受的连接已经是非阻塞的
+        int fl = fcntl(tcp_client->comm_fd, F_GETFL, 0);
+        if (!(fl & O_NONBLOCK))
+            fcntl(tcp_client->comm_fd, F_SETFL, fl | O_NONBLOCK);
+
+        memset(&ev, 0, sizeof(ev));
+        // 注册时 socket 已经可写会立即产生一次 EPOLLOUT, 加入监听前积压的数据在此时发送
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = (void *)tcp_client;
+
+        if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, tcp_client->comm_fd, &ev) < 0)
+        {
+            printf("%s() epoll_ctl ADD failed for fd %d, error = %d\n", __FUNCTION__, tcp_client->comm_fd, errno);
+            this->RemoveClientFromDB(tcp_client);
+            return;
+        }
+
+        this->ClientTimerStart(tcp_client);
+        return;
+    }
+
+    if (this->mx_type == TCP_MULTIPLEX_IO_URING)
+    {
+        this->UringClientStart(tcp_client);
+        this->ClientTimerStart(tcp_client);
+        return;
+    }
+
+    if (tcp_client->comm_fd >= FD_SETSIZE)
+    {
+        printf("%s() fd %d exceeds FD_SETSIZE, use TCP_MULTIPLEX_EPOLL\n", __FUNCTION__, tcp_client->comm_fd);
+        this->RemoveClientFromDB(tcp_client);
+        return;
+    }
+
+    // update FDs
+    if (this->max_fd < tcp_client->comm_fd)
+        this->max_fd = tcp_client->comm_fd;
+
+    FD_SET(tcp_client->comm_fd, &this->backup_fd_set);
+
+    // 加入监听前积压的数据(例如 Welcome 消息)
+    if (tcp_client->out_queue.HasPending())
+        FD_SET(tcp_client->comm_fd, &this->backup_wr_fd_set);
+
+    this->ClientTimerStart(tcp_client);
+}
+
+/**
+ * @brief 时间轮回调, 定时器到期时客户端一定仍在 arg 对应的 DRS 中(注销时会删除定时器)
+ *
+ */
+static void tcp_client_liveness_timer_fn(TcpTimer * /*timer*/, void *arg)
+{
+    TcpClient *tcp_client = (TcpClient *)arg;
+
+    tcp_client->svc_mgr->ClientTimerExpired(tcp_client);
+}
+
+/**
+ * @brief (DRS 线程) 客户端加入监听集合时启动 keepalive/空闲定时器
+ *
+ * 启用 keepalive 时定时器周期为 keepalive 间隔, 否则为空闲超时; 两者都未启用时不启动定时器
+ *
+ * @param tcp_client 刚加入监听集合的客户端
+ */
+void TcpClientServiceManager::ClientTimerStart(TcpClient *tcp_client)
+{
+    uint32_t period_ms;
+
+    tcp_client->last_active_tick = this->timer_wheel.GetCurrentTick();
+    tcp_client->ka_missed = 0;
+
+    if (this->tcp_ctrlr->ka_interval_ms)
+        tcp_client->SetState(TCP_CLIENT_STATE_KA_BASED);
+
+    period_ms = tcp_client->IsStateSet(TCP_CLIENT_STATE_KA_BASED) ? this->tcp_ctrlr->ka_interval_ms : this->tcp_ctrlr->idle_timeout_ms;
+
+    if (!period_ms)
+        return;
+
+    tcp_client->liveness_timer.cb = tcp_client_liveness_timer_fn;
+    tcp_client->liveness_timer.arg = (void *)tcp_client;
+    this->timer_wheel.AddAfterMs(&tcp_client->liveness_timer, period_ms);
+}
+
+/**
+ * @brief (DRS 线程) 客户端定时器到期
+ *
+ * 收到数据时只记录 last_active_tick, 在这里才根据它判断是否真的空闲, 仍然活跃的客户端从最近一次收到数据的时间重新计时.
+ *
+ * 1.空闲超过 idle_timeout_ms: 断开
+ *
+ * 2.keepalive: 一个间隔内没有收到数据时回调 client_ka_pending 并标记 TCP_CLIENT_STATE_KA_EXPIRED,
+ *   之后收到任何数据都视为响应; 连续 ka_max_missed 次未响应时断开
+ *
+ * @param tcp_client 定时器到期的客户端
+ */
+void TcpClientServiceManager::ClientTimerExpired(TcpClient *tcp_client)
 {
-    this->tcp_ctrlr = tcp_ctrlr;
-    this->udp_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    TcpServerController *tcp_ctrlr = this->tcp_ctrlr;
+    uint64_t now = this->timer_wheel.GetCurrentTick();
+    uint64_t idle_ticks = now - tcp_client->last_active_tick;
+    uint64_t idle_limit = this->timer_wheel.MsToTicks(tcp_ctrlr->idle_timeout_ms);
+    uint64_t ka_period = this->timer_wheel.MsToTicks(tcp_ctrlr->ka_interval_ms);
 
-    if (this->udp_fd < 0)
+    if (tcp_ctrlr->idle_timeout_ms && idle_ticks >= idle_limit)
     {
-        printf("UDP Socket Creation Failed, error = %d\n", errno);
-        exit(0);
+        this->ClientFDDisconnected(tcp_client);
+        return;
     }
 
-    this->max_fd = this->udp_fd;
-
-    struct sockaddr_in server_addr;
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(this->tcp_ctrlr->port_no + 1);
-    server_addr.sin_addr.s_addr = htonl(this->tcp_ctrlr->ip_addr);
+    if (!tcp_client->IsStateSet(TCP_CLIENT_STATE_KA_BASED) || !ka_period)
+    {
+        this->timer_wheel.Add(&tcp_client->liveness_timer, tcp_client->last_active_tick + idle_limit);
+        return;
+    }
 
-    if (bind(this->udp_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1)
+    // 最近一个间隔内收到过数据
+    if (idle_ticks < ka_period)
     {
-        printf("Error: UDP socket bind failed [%s(0x%x), %d], error = %d\n",
-               network_convert_ip_n_to_p(tcp_ctrlr->ip_addr, 0),
-               tcp_ctrlr->ip_addr,
-               tcp_ctrlr->port_no,
-               errno);
-        exit(0);
+        if (tcp_client->ka_missed)
+        {
+            tcp_client->conn.ka_recvd++;
+            tcp_client->ka_missed = 0;
+            tcp_client->UnSetState(TCP_CLIENT_STATE_KA_EXPIRED);
+        }
 
-        FD_ZERO(&active_fd_set);
-        FD_ZERO(&backup_fd_set);
+        this->timer_wheel.Add(&tcp_client->liveness_timer, tcp_client->last_active_tick + ka_period);
+        return;
+    }
 
-        client_svc_mgr_thread = (pthread_t *)calloc(1, sizeof(pthread_t));
-        sem_init(&this->wait_for_thread_operation_to_complete, 0, 0);
-        sem_init(&sem0_1, 0, 0);
-        sem_init(&sem0_2, 0, 0);
-        pthread_rwlock_init(&this->rwlock, nullptr);
+    if (tcp_client->ka_missed >= tcp_ctrlr->ka_max_missed)
+    {
+        this->ClientFDDisconnected(tcp_client);
+        return;
     }
-}
 
-TcpClientServiceManager::~TcpClientServiceManager()
-{
-    assert(this->tcp_client_db.empty());
-    assert(this->udp_fd);
-    assert(this->client_svc_mgr_thread);
-}
+    tcp_client->ka_missed++;
+    tcp_client->conn.ka_sent++;
+    tcp_client->SetState(TCP_CLIENT_STATE_KA_EXPIRED);
 
-void TcpClientServiceManager::RemoveClientFromDB(TcpClient *tcp_client)
-{
-    this->tcp_client_db.remove(tcp_client);
-    tcp_client->Dereference();
-}
+    // 应用层可能在回调中删除此客户端
+    tcp_client->Reference();
 
-void TcpClientServiceManager::AddClientToDB(TcpClient *tcp_client)
-{
-    this->tcp_client_db.push_back(tcp_client);
+    if (tcp_ctrlr->client_ka_pending)
+        tcp_ctrlr->client_ka_pending(tcp_ctrlr, tcp_client);
+
+    if (tcp_client->svc_mgr == this)
+        this->timer_wheel.Add(&tcp_client->liveness_timer, now + ka_period);
+
+    tcp_client->Dereference();
 }
 
-void TcpClientServiceManager::CopyClientFDtoFDSet(fd_set *fdset)
+/**
+ * @brief (DRS 线程) 注销所有客户端并放弃所有正在进行的主动连接
+ *
+ */
+void TcpClientServiceManager::StopListenAllInternal()
 {
+    uint32_t slot;
     TcpClient *tcp_client;
-    std::list<TcpClient *>::iterator it;
 
-    for (it = this->tcp_client_db.begin(); it != this->tcp_client_db.end(); ++it)
+    // 删除只留下删除标记, 遍历过程中可以安全删除
+    for (slot = 0; slot < this->tcp_client_db.GetSlotCount(); slot++)
     {
-        tcp_client = *it;
-        FD_SET(tcp_client->comm_fd, fdset);
+        tcp_client = this->tcp_client_db.GetSlotClient(slot);
+
+        if (tcp_client)
+            this->ClientFDStopListenInternal(tcp_client);
     }
-}
 
-// old implemention
-void TcpClientServiceManager::StartTcpClientServiceManagerThreadInternal2()
-{
+    while (!this->connect_pending.empty())
+        this->ClientConnectCancel(*this->connect_pending.begin());
 }
 
 /**
- * @brief 使用 select() 模式处理多个 tcpClient 的读事件(简单实现)
+ * @brief (DRS 线程) 将客户端 fd 从 epoll 实例 / fd_set 中移除, 重复调用是安全的
  *
+ * @param tcp_client 指向要停止监听的客户端对象
  */
-void TcpClientServiceManager::StartTcpClientServiceManagerThreadInternalSimple()
+void TcpClientServiceManager::ClientFDStopListenInternal(TcpClient *tcp_client)
 {
-    int rcv_bytes;
-    TcpClient *tcp_client, *next_tcp_client;
-    struct sockaddr_in client_addr;
-    std::list<TcpClient *>::iterator it;
-
-    socklen_t addr_len = sizeof(client_addr);
+    // DRS 线程可能已经因为连接断开而注销了此客户端
+    if (tcp_client->svc_mgr != this)
+        return;
 
-    // 如果不是“仅服务器端不监听客户端”，就复制所有客户端到本地 list
-    if (!this->tcp_ctrlr->IsBitSet(TCP_SERVER_NOT_LISTENING_CLIENT))
+    if (this->connect_pending.count(tcp_client))
     {
-        this->tcp_ctrlr->CopyAllClientsTolist(&this->tcp_client_db);
+        this->ClientConnectCancel(tcp_client);
+        return;
     }
 
-    this->max_fd = this->GetMaxFdSimple();
-
-    // 初始化 fd_set 备份, 用于每轮 select 复制
-    FD_ZERO(&this->backup_fd_set);
-    this->CopyClientFDtoFDSet(&this->backup_fd_set);
-
-    // 信号量 +1; 唤醒(通知)外部线程当前线程已经启动完成
-    sem_post(&this->wait_for_thread_operation_to_complete);
-
-    while (true)
+    if (this->mx_type == TCP_MULTIPLEX_EPOLL)
     {
-        pthread_testcancel();
-
-        // 每轮 select() 前都复制 fd_set，因为 select 会修改 active_fd_set
-        memcpy(&this->active_fd_set, &this->backup_fd_set, sizeof(fd_set));
-        // 阻塞等待任一 client_fd 上有读事件
-        select(this->max_fd + 1, &this->active_fd_set, nullptr, nullptr, nullptr);
+        epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, tcp_client->comm_fd, nullptr);
+    }
+    else if (this->mx_type == TCP_MULTIPLEX_IO_URING)
+    {
+        this->UringClientStop(tcp_client);
+    }
+    else
+    {
+        FD_CLR(tcp_client->comm_fd, &this->backup_fd_set);
+        FD_CLR(tcp_client->comm_fd, &this->backup_wr_fd_set);
+    }
 
-        // iterate so that we can delete the current element while travering
-        // 遍历所有客户端
-        for (it = this->tcp_client_db.begin(), tcp_client = *it; it != this->tcp_client_db.end(); tcp_client = next_tcp_client)
-        {
-            next_tcp_client = *(++it);
+    this->RemoveClientFromDB(tcp_client);
 
-            // 如果此客户端有数据可读
-            if (FD_ISSET(tcp_client->comm_fd, &this->active_fd_set))
-            {
-                rcv_bytes = recvfrom(tcp_client->comm_fd,
-                                     common_recv_buffer,
-                                     CLIENT_RECV_BUFFER_SIZE,
-                                     0,
-                                     (struct sockaddr *)&client_addr,
-                                     &addr_len);
-
-                // 接受信息出现错误
-                if (rcv_bytes == 0 || rcv_bytes == 65535 || rcv_bytes < 0)
-                {
-                    this->tcp_ctrlr->client_disconnected(this->tcp_ctrlr, tcp_client);
-
-                    FD_CLR(tcp_client->comm_fd, &this->backup_fd_set);                                       // 移除 此 fd_set
-                    this->max_fd = this->GetMaxFdSimple();                                                   // 更新 max_fd
-                    this->tcp_ctrlr->EnqueMsg(CTRLR_ACTION_TCP_CLIENT_RECONNECT, (void *)tcp_client, false); // 通知tcp_ctrlr, 需要重新链接此客户端
-                }
-                else // 正常接收数据
-                {
-                    // if client has TcpMsgDemarcar, then push the data to Demarcar, else notify the application straightaway
-                    tcp_client->conn.bytes_recvd += rcv_bytes;
-                    // 根据客户端的 MsgDemarcar, 应用其对应的拆包逻辑
-                    if (tcp_client->msgd)
-                    {
-                        tcp_client->msgd->ProcessMsg(tcp_client, common_recv_buffer, rcv_bytes);
-                    }
-                    // 直接回调给上层应用
-                    else if (this->tcp_ctrlr->client_msg_recvd)
-                    {
-                        this->tcp_ctrlr->client_msg_recvd(this->tcp_ctrlr, tcp_client, common_recv_buffer, rcv_bytes);
-                    }
-                }
-            }
-        }
-    } // while ends
+    if (this->mx_type == TCP_MULTIPLEX_SELECT)
+        this->max_fd = this->GetMaxFdSimple();
 }
 
 /**
- * @brief
+ * @brief (DRS 线程) 对端关闭或读出错, 注销客户端并通知 Controller
  *
- * @param arg
- * @return void*
+ * @param tcp_client 断开的客户端
  */
-static void *tcp_client_svc_manager_thread_fn(void *arg)
+void TcpClientServiceManager::ClientFDDisconnected(TcpClient *tcp_client)
 {
-    TcpClientServiceManager *svc_mgr = (TcpClientServiceManager *)arg;
+    tcp_client->Reference();
+    this->ClientFDStopListenInternal(tcp_client);
 
-    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, nullptr);
-    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, nullptr);
+    if (this->tcp_ctrlr->client_disconnected)
+        this->tcp_ctrlr->client_disconnected(this->tcp_ctrlr, tcp_client);
 
-    svc_mgr->StartTcpClientServiceManagerThreadInternalSimple();
+    // 主动连接的客户端需要重连, 被动连接的客户端直接删除
+    // 消息持有一个引用: 上面已经释放了 DRS 的引用, 应用层也可能在 Controller 处理消息之前删除客户端
+    tcp_client->Reference();
+    if (tcp_client->IsStateSet(TCP_CLIENT_STATE_ACTIVE_OPENER))
+        this->tcp_ctrlr->EnqueMsg(CTRLR_ACTION_TCP_CLIENT_RECONNECT, (void *)tcp_client, false);
+    else
+        this->tcp_ctrlr->EnqueMsg(CTRLR_ACTION_TCP_CLIENT_DELETE, (void *)tcp_client, false);
 
-    return nullptr;
+    tcp_client->Dereference();
 }
 
 /**
- * @brief
+ * @brief 开始主动连接(异步), 客户端立即归属于本分片(svc_mgr), connect() 由 DRS 线程发起
  *
+ * 连接成功后客户端加入本分片的监听集合并通知 Controller; 失败或超时后等待
+ * min(connect_backoff_max_ms, connect_backoff_min_ms * 2^(n-1)) 毫秒(随机取其 1/2 ~ 1 倍)后重试, 直到成功或被放弃
+ *
+ * @param tcp_client 主动连接的客户端, 不在任何监听集合中
+ * @param backoff true: 先等待一个退避时间(连接断开后的重连, 避免大量客户端同时重连); false: 立即连接
  */
-void TcpClientServiceManager::StartTcpClientServiceManagerThread()
+void TcpClientServiceManager::ClientConnectStart(TcpClient *tcp_client, bool backoff)
 {
-    pthread_attr_t attr;
+    assert(!tcp_client->svc_mgr);
 
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+    // 命令队列持有一个引用, 执行后转交给 connect_pending
+    tcp_client->Reference();
+    tcp_client->svc_mgr = this;
+    tcp_client->SetState(TCP_CLIENT_STATE_CONNECT_IN_PROGRESS);
+    tcp_client->connect_attempts = backoff ? 1 : 0;
+    tcp_client->connect_inflight = false;
+    this->n_clients++;
 
-    if (!this->client_svc_mgr_thread)
+    if (!this->thread_running || this->IsDrsThread())
     {
-        this->client_svc_mgr_thread = (pthread_t *)calloc(1, sizeof(pthread_t));
+        this->ClientConnectStartInternal(tcp_client);
+        return;
     }
 
-    pthread_create(this->client_svc_mgr_thread, &attr, tcp_client_svc_manager_thread_fn, (void *)(this));
-
-    sem_wait(&this->wait_for_thread_operation_to_complete);
-    printf("Service started: TcpClientServiceMangerThread\n");
+    this->EnqueCmd(DRS_CMD_CLIENT_CONNECT, tcp_client, nullptr);
 }
 
 /**
- * @brief 按照 IP地址和端口查找客户端
+ * @brief 时间轮回调, 定时器到期时客户端一定仍在 arg 对应的 DRS 的 connect_pending 中(放弃连接时会删除定时器)
  *
- * @param ip_addr
- * @param port_no
- * @return TcpClient*
  */
-TcpClient *TcpClientServiceManager::LookUpClientDB(uint32_t ip_addr, uint16_t port_no)
+static void tcp_client_connect_timer_fn(TcpTimer * /*timer*/, void *arg)
 {
-    TcpClient *tcp_client;
-    std::list<TcpClient *>::iterator it;
-
-    for (it = this->tcp_client_db.begin(); it != this->tcp_client_db.end(); ++it)
-    {
-        tcp_client = *it;
+    TcpClient *tcp_client = (TcpClient *)arg;
 
-        if (tcp_client->ip_addr == ip_addr && tcp_client->port_no == port_no)
-            return tcp_client;
-    }
-
-    return nullptr;
+    tcp_client->svc_mgr->ClientConnectTimerExpired(tcp_client);
 }
 
 /**
- * @brief 将一个 tcp_client 客户端 添加到服务管理器的监听合计中
+ * @brief (DRS 线程) 接管主动连接的客户端, connect_attempts 为 0 时立即连接, 否则等待一个退避时间
  *
- * @param tcp_client 指向要加入监听的客户端对象
+ * @param tcp_client 主动连接的客户端
  */
-void TcpClientServiceManager::ClientFDStartListenSimple(TcpClient *tcp_client)
+void TcpClientServiceManager::ClientConnectStartInternal(TcpClient *tcp_client)
 {
-    // 如果服务管理线程正在运行，先停掉以便安全更新 FD 集合
-    if (!this->tcp_ctrlr->IsBitSet(TCP_SERVER_NOT_LISTENING_CLIENT))
-    {
-        this->StopTcpClientServiceManagerThread();
-        printf("Client Svc Mgr thread Cancalled\n");
-    }
+    this->connect_pending.insert(tcp_client);
 
-    // 此客户端不应该已经存在（防御性检查）
-    assert(!this->LookUpClientDB(tcp_client->ip_addr, tcp_client->port_no));
+    // 连接期间 liveness_timer 用作连接超时/重试定时器, 加入监听集合时恢复为 keepalive/空闲定时器
+    tcp_client->liveness_timer.cb = tcp_client_connect_timer_fn;
+    tcp_client->liveness_timer.arg = (void *)tcp_client;
 
-    // 添加到监听数据库
-    this->AddClientToDB(tcp_client);
-    tcp_client->SetState(TCP_CLIENT_STATE_MULTIPLEX_LISTEN);
+    if (!tcp_client->connect_attempts)
+    {
+        this->ClientConnectAttempt(tcp_client);
+        return;
+    }
 
-    // 如果系统处于“监听客户端”状态，重新启动线程
-    if (!this->tcp_ctrlr->IsBitSet(TCP_SERVER_NOT_LISTENING_CLIENT))
-        this->StartTcpClientServiceManagerThread();
+    this->timer_wheel.AddAfterMs(&tcp_client->liveness_timer, this->ConnectBackoffMs(tcp_client->connect_attempts));
 }
 
 /**
- * @brief 将一个 TcpClient客户端 从监听集合中移除。
- * @param tcp_client 指向要停止监听的客户端对象
+ * @brief 连续失败 attempts 次后的退避时间
+ *
+ * 退避时间 d 从 connect_backoff_min_ms 开始每次翻倍, 不超过 connect_backoff_max_ms;
+ * 实际等待时间在 [d/2, d] 中随机选取, 同时断开的大量客户端的重连被分散开, 不会同时冲击对端
+ *
+ * @param attempts 连续失败的次数(>= 1)
+ * @return uint32_t 等待的毫秒数
  */
-void TcpClientServiceManager::ClientFDStopListenSimple(TcpClient *tcp_client)
+uint32_t TcpClientServiceManager::ConnectBackoffMs(uint32_t attempts)
 {
-    // 若线程正在执行 select/epoll，需要先停掉
-    if (!this->tcp_ctrlr->IsBitSet(TCP_SERVER_NOT_LISTENING_CLIENT))
-        this->StopTcpClientServiceManagerThread();
+    uint64_t delay_ms = this->tcp_ctrlr->connect_backoff_min_ms;
+    uint32_t shift = attempts > 21 ? 20 : attempts - 1;
 
-    // 客户端必须存在于监听数据库中（防御性检查）
-    assert(this->LookUpClientDB(tcp_client->ip_addr, tcp_client->port_no));
+    delay_ms <<= shift;
+    if (delay_ms > this->tcp_ctrlr->connect_backoff_max_ms)
+        delay_ms = this->tcp_ctrlr->connect_backoff_max_ms;
 
-    // 从监听数据库中移除，并更新状态
-    this->RemoveClientFromDB(tcp_client);
-    tcp_client->UnSetState(TCP_CLIENT_STATE_MULTIPLEX_LISTEN);
+    // xorshift64, 只由 DRS 线程访问
+    this->rand_state ^= this->rand_state << 13;
+    this->rand_state ^= this->rand_state >> 7;
+    this->rand_state ^= this->rand_state << 17;
 
-    // 如果系统允许监听，更新完成后重新启动线程
-    if (this->tcp_ctrlr->IsBitSet(TCP_SERVER_NOT_LISTENING_CLIENT))
-        this->StartTcpClientServiceManagerThread();
+    return (uint32_t)(delay_ms / 2 + this->rand_state % (delay_ms - delay_ms / 2 + 1));
 }
 
 /**
- * @brief  将一个 TcpClient 加入到监听 FD 集合 (Adv)
+ * @brief (DRS 线程) 创建非阻塞 socket 并发起 connect(), 连接结果由事件循环中的可写事件报告
  *
- * 设计思路: 双信号量临界区保护
- * select() 线程 ---> (sem0_1) ---> main 线程可以修改 FD.
- *  main()线程   ---> (sem0_2) ---> select() 线程继续工作
- * @param tcp_client
+ * 新的 socket 通过发送队列替换 comm_fd, 上一次尝试(或断开的连接)的 socket 在这里关闭;
+ * 连接期间应用层的发送进入发送队列, 连接成功后发送
+ *
+ * @param tcp_client 主动连接的客户端
  */
-void TcpClientServiceManager::ClientFDStartListenAdv(TcpClient *tcp_client)
+void TcpClientServiceManager::ClientConnectAttempt(TcpClient *tcp_client)
 {
-    // select() 调用会阻塞，所以无法直接在运行期间修改 fd_set
-    // 调用 ForceUnblockSelect() 唤醒 select，使其退出阻塞
-    ForceUnblockSelect();
+    int fd, err, old_fd;
+    struct sockaddr_in server_addr;
 
-    // 等待线程确认, 可以修改 FD集合
-    sem_wait(&this->sem0_1);
+    TcpMetricAdd(&this->metrics.connect_attempts, 1);
 
-    assert(!this->LookUpClientDB(tcp_client->ip_addr, tcp_client->port_no));
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+    err = errno;
 
-    // 添加到监听数据库(DB), 并设置监听状态
-    this->AddClientToDB(tcp_client);
-    tcp_client->SetState(TCP_CLIENT_STATE_MULTIPLEX_LISTEN);
+    old_fd = tcp_client->out_queue.ResetConnection(tcp_client, fd);
+    if (old_fd >= 0)
+        close(old_fd);
 
-    // update FDs
-    if (this->max_fd < tcp_client->comm_fd)
-        this->max_fd = tcp_client->comm_fd;
+    if (fd < 0)
+    {
+        this->ClientConnectFailed(tcp_client, err);
+        return;
+    }
 
-    // 将 客户端tcp_client的fd 加入到 FD 集合
-    FD_SET(tcp_client->comm_fd, &this->backup_fd_set);
+    if (this->mx_type == TCP_MULTIPLEX_SELECT && fd >= FD_SETSIZE)
+    {
+        this->ClientConnectFailed(tcp_client, EMFILE);
+        return;
+    }
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(tcp_client->server_port_no);
+    server_addr.sin_addr.s_addr = htonl(tcp_client->server_ip_addr);
+
+    if (connect(fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) == 0)
+    {
+        this->ClientConnected(tcp_client);
+        return;
+    }
+
+    // EINTR: 连接在后台继续进行, 与 EINPROGRESS 相同
+    if (errno != EINPROGRESS && errno != EINTR)
+    {
+        this->ClientConnectFailed(tcp_client, errno);
+        return;
+    }
+
+    if (this->mx_type == TCP_MULTIPLEX_EPOLL)
+    {
+        struct epoll_event ev;
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLOUT | EPOLLET;
+        ev.data.ptr = (void *)tcp_client;
+
+        if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+        {
+            this->ClientConnectFailed(tcp_client, errno);
+            return;
+        }
+    }
+    else if (this->mx_type == TCP_MULTIPLEX_IO_URING)
+    {
+        this->UringClientConnectArm(tcp_client);
+    }
+    else
+    {
+        FD_SET(fd, &this->backup_wr_fd_set);
+        if (this->max_fd < fd)
+            this->max_fd = fd;
+    }
 
-    // 唤醒正在等待的其他线程,修改结束
-    sem_post(&sem0_2);
+    tcp_client->connect_inflight = true;
+
+    if (this->tcp_ctrlr->connect_timeout_ms)
+        this->timer_wheel.AddAfterMs(&tcp_client->liveness_timer, this->tcp_ctrlr->connect_timeout_ms);
 }
 
 /**
- * @brief 根据 ip 和 port 停止监听某个客户端（Adv 模式）
+ * @brief (DRS 线程) 正在连接的 socket 可写(或出错), 检查连接结果
  *
- * @param ip_addr  客户端 IP
- * @param port_no  客户端端口
- * @return TcpClient* 返回被移除的 client 指针；客户端不存在返回 nullptr
+ * @param tcp_client 正在连接的客户端
  */
-TcpClient *TcpClientServiceManager::ClientFDStopListListenAdv(uint32_t ip_addr, uint16_t port_no)
+void TcpClientServiceManager::ClientConnectWritable(TcpClient *tcp_client)
 {
-    TcpClient *tcp_client;
-    ForceUnblockSelect();
+    int err = 0;
+    socklen_t len = sizeof(err);
+    struct sockaddr_in peer_addr;
 
-    // 等待 select() 线程发送"可以修改 FD集合"信号
-    sem_wait(&this->sem0_1);
+    if (getsockopt(tcp_client->comm_fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+        err = errno;
 
-    tcp_client = this->LookUpClientDB(ip_addr, port_no);
+    if (err)
+    {
+        this->ClientConnectFailed(tcp_client, err);
+        return;
+    }
 
-    // 未找到则无需操作，直接让 select 线程继续工作
-    if (!tcp_client)
+    len = sizeof(peer_addr);
+    if (getpeername(tcp_client->comm_fd, (struct sockaddr *)&peer_addr, &len) < 0)
     {
-        sem_post(&this->sem0_2);
-        return nullptr;
+        // 没有错误也没有对端地址: 虚假的可写事件, 连接仍在进行
+        if (errno != ENOTCONN)
+            this->ClientConnectFailed(tcp_client, errno);
+        return;
     }
 
-    // 从 DB 移除并清除监听状态
-    this->RemoveClientFromDB(tcp_client);
-    tcp_client->UnSetState(TCP_CLIENT_STATE_MULTIPLEX_LISTEN);
+    this->ClientConnected(tcp_client);
+}
 
-    // update FDs
-    max_fd = GetMaxFdSimple();
+/**
+ * @brief (DRS 线程) 时间轮回调: 正在连接时表示连接超时, 否则表示退避时间已到, 开始下一次连接
+ *
+ * @param tcp_client 主动连接的客户端
+ */
+void TcpClientServiceManager::ClientConnectTimerExpired(TcpClient *tcp_client)
+{
+    if (tcp_client->connect_inflight)
+    {
+        this->ClientConnectFailed(tcp_client, ETIMEDOUT);
+        return;
+    }
+
+    this->ClientConnectAttempt(tcp_client);
+}
+
+/**
+ * @brief (DRS 线程) 连接失败或超时: 关闭 socket, 之后的发送以 ENOTCONN 失败, 按退避时间安排下一次连接
+ *
+ * 只在新客户端的第一次连接失败时打印错误, 对端长时间不可用时不会刷屏
+ * (断线重连从 connect_attempts = 1 开始, 断开已经由 client_disconnected 回调通知)
+ *
+ * @param tcp_client 主动连接的客户端
+ * @param err 失败原因(errno)
+ */
+void TcpClientServiceManager::ClientConnectFailed(TcpClient *tcp_client, int err)
+{
+    int old_fd;
+    char ip_str[16];
+
+    this->ClientConnectUnwatch(tcp_client);
+    this->timer_wheel.Remove(&tcp_client->liveness_timer);
+    TcpMetricAdd(&this->metrics.connect_failures, 1);
 
-    // 从 FD 集合中移除当前tcp_client 的 FD
-    FD_CLR(tcp_client->comm_fd, &this->backup_fd_set);
-    this->tcp_ctrlr->client_disconnected(this->tcp_ctrlr, tcp_client); // 通知控制器断开当前客户端的连接
+    old_fd = tcp_client->out_queue.ResetConnection(tcp_client, -1);
+    if (old_fd >= 0)
+        close(old_fd);
 
-    // 发送信号, 当前线程工作完成,其他线程可以继续工作
-    sem_post(&this->sem0_2);
+    tcp_client->connect_attempts++;
+
+    if (tcp_client->connect_attempts == 1)
+    {
+        printf("%s() DRS [%u] : connect to %s:%u failed, error = %d, retrying\n", __FUNCTION__, this->reactor_id,
+               network_convert_ip_n_to_p(tcp_client->server_ip_addr, ip_str), tcp_client->server_port_no, err);
+    }
 
-    return tcp_client;
+    this->timer_wheel.AddAfterMs(&tcp_client->liveness_timer, this->ConnectBackoffMs(tcp_client->connect_attempts));
 }
 
 /**
- * @brief 根据tcp_client客户端对象停止监听客户端（Adv 模式），
+ * @brief (DRS 线程) 连接成功: 客户端以本地地址加入本分片的监听集合, 然后通知 Controller
  *
- * @param tcp_client 要停止监听的客户端对象
+ * @param tcp_client 主动连接的客户端
  */
-void TcpClientServiceManager::ClientFDStopListenAdv(TcpClient *tcp_client)
+void TcpClientServiceManager::ClientConnected(TcpClient *tcp_client)
 {
-    ForceUnblockSelect();
+    struct sockaddr_in local_addr;
+    socklen_t len = sizeof(local_addr);
 
-    // 等待 select() 线程发送"可以修改 FD集合"信号
-    sem_wait(&this->sem0_1);
+    this->ClientConnectUnwatch(tcp_client);
+    this->timer_wheel.Remove(&tcp_client->liveness_timer);
 
-    assert(tcp_client == this->LookUpClientDB(tcp_client->ip_addr, tcp_client->port_no));
+    if (getsockname(tcp_client->comm_fd, (struct sockaddr *)&local_addr, &len) < 0)
+    {
+        this->ClientConnectFailed(tcp_client, errno);
+        return;
+    }
 
-    // 从 DB 中删除
-    this->RemoveClientFromDB(tcp_client);
-    tcp_client->UnSetState(TCP_CLIENT_STATE_MULTIPLEX_LISTEN);
+    // DB 以 (ip, port) 为键: 连接到本服务器自身时, 本分片接受的另一端以相同的地址为键, 无法同时监听, 视为失败
+    if (this->LookUpClientDB(ntohl(local_addr.sin_addr.s_addr), ntohs(local_addr.sin_port)))
+    {
+        this->ClientConnectFailed(tcp_client, EADDRINUSE);
+        return;
+    }
 
-    // update FDs
-    max_fd = GetMaxFdSimple();
+    tcp_client->ip_addr = ntohl(local_addr.sin_addr.s_addr);
+    tcp_client->port_no = ntohs(local_addr.sin_port);
+    tcp_client->connect_attempts = 0;
+    this->connect_pending.erase(tcp_client);
 
-    FD_CLR(tcp_client->comm_fd, &this->backup_fd_set);
-    this->tcp_ctrlr->client_disconnected(this->tcp_ctrlr, tcp_client);
+    // 先设置 TCP_CLIENT_STATE_MULTIPLEX_LISTEN 再清除 TCP_CLIENT_STATE_CONNECT_IN_PROGRESS,
+    // ProcessClientDelete() 在任何时刻都能看到其中一个并停止监听
+    tcp_client->SetState(TCP_CLIENT_STATE_CONNECTED);
+    tcp_client->SetState(TCP_CLIENT_STATE_MULTIPLEX_LISTEN);
+    tcp_client->UnSetState(TCP_CLIENT_STATE_CONNECT_IN_PROGRESS);
 
-    // 发送信号, 当前线程工作完成,其他线程可以继续工作
-    sem_post(&this->sem0_2);
+    // connect_pending 的引用转交给 DB; 应用层可能在回调中删除此客户端
+    tcp_client->Reference();
+    this->ClientFDStartListenInternal(tcp_client);
+    this->tcp_ctrlr->ActiveClientConnected(tcp_client);
+    tcp_client->Dereference();
 }
 
 /**
- * @brief
+ * @brief (DRS 线程) 停止等待正在连接的 socket 可写, 返回后调用方可以关闭 socket
  *
- * @return int
+ * @param tcp_client 主动连接的客户端
  */
-int TcpClientServiceManager::GetMaxFdSimple()
+void TcpClientServiceManager::ClientConnectUnwatch(TcpClient *tcp_client)
 {
-    int max_fd_lcl = 0;
-    TcpClient *tcp_client;
-    std::list<TcpClient *>::iterator it;
+    if (!tcp_client->connect_inflight)
+        return;
+
+    tcp_client->connect_inflight = false;
 
-    for (it = this->tcp_client_db.begin(); it != this->tcp_client_db.end(); ++it)
+    if (this->mx_type == TCP_MULTIPLEX_EPOLL)
     {
-        tcp_client = *it;
-        if (tcp_client->comm_fd > max_fd_lcl)
-            max_fd_lcl = tcp_client->comm_fd;
+        epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, tcp_client->comm_fd, nullptr);
+    }
+    else if (this->mx_type == TCP_MULTIPLEX_IO_URING)
+    {
+        this->UringClientConnectStop(tcp_client);
+    }
+    else
+    {
+        FD_CLR(tcp_client->comm_fd, &this->backup_wr_fd_set);
+        this->max_fd = this->GetMaxFdSimple();
     }
-
-    return max_fd_lcl;
 }
 
-// unused
-int TcpClientServiceManager::GetMaxFdAdv()
+/**
+ * @brief (DRS 线程) 放弃主动连接, 释放 connect_pending 持有的引用; 客户端保留 TCP_CLIENT_STATE_CONNECT_IN_PROGRESS,
+ *        socket 在客户端销毁时关闭
+ *
+ * @param tcp_client 主动连接的客户端
+ */
+void TcpClientServiceManager::ClientConnectCancel(TcpClient *tcp_client)
 {
+    this->ClientConnectUnwatch(tcp_client);
+    this->timer_wheel.Remove(&tcp_client->liveness_timer);
+    this->connect_pending.erase(tcp_client);
+    this->n_clients--;
+    tcp_client->svc_mgr = nullptr;
+    tcp_client->Dereference();
 }
 
 /**
  * @brief
  *
+ * @return int
  */
-void TcpClientServiceManager::ForceUnblockSelect()
+int TcpClientServiceManager::GetMaxFdSimple()
 {
-    int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    int max_fd_lcl = this->event_fd;
+    uint32_t slot;
+    TcpClient *tcp_client;
 
-    if (fd < 0)
+    std::unordered_set<TcpClient *>::iterator it;
+
+    for (slot = 0; slot < this->tcp_client_db.GetSlotCount(); slot++)
     {
-        printf("%s() Socket Creation Failed \n", __FUNCTION__);
-        return;
+        tcp_client = this->tcp_client_db.GetSlotClient(slot);
+        if (tcp_client && tcp_client->comm_fd > max_fd_lcl)
+            max_fd_lcl = tcp_client->comm_fd;
     }
 
-    unsigned char dummy_data;
-    struct sockaddr_in server_addr;
-
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(this->tcp_ctrlr->port_no);
-    server_addr.sin_addr.s_addr = htonl(this->tcp_ctrlr->ip_addr);
-
-    int rc = sendto(fd, (unsigned char *)dummy_data, 1, 0, (struct sockaddr *)&server_addr, sizeof(server_addr));
+    // 正在连接的 socket 在写集合中
+    for (it = this->connect_pending.begin(); it != this->connect_pending.end(); ++it)
+    {
+        tcp_client = *it;
+        if (tcp_client->connect_inflight && tcp_client->comm_fd > max_fd_lcl)
+            max_fd_lcl = tcp_client->comm_fd;
+    }
 
-    if (rc < 0)
-        printf("%s() Sending Data to UDP Socket Failed\n", __FUNCTION__);
+    return max_fd_lcl;
+}
 
-    close(fd);
+// unused
+int TcpClientServiceManager::GetMaxFdAdv()
+{
 }
 
 /**
- * @brief
+ * @brief 清除所有客户端, 调用前 DRS 线程必须已经停止
  *
  */
 void TcpClientServiceManager::Purge()
 {
-    std::list<TcpClient *>::iterator it;
-    TcpClient *tcp_client, *next_tcp_client;
+    uint32_t slot;
+    TcpClient *tcp_client;
 
     // This fn assumes that Svc mgr thread is already cancelled, hence no need to lock anything
-    assert(this->client_svc_mgr_thread = nullptr);
+    assert(!this->thread_running);
 
-    for (it = this->tcp_client_db.begin(), tcp_client = *it; it != this->tcp_client_db.end(); tcp_client = next_tcp_client)
+    // 删除只留下删除标记, 遍历过程中可以安全删除
+    for (slot = 0; slot < this->tcp_client_db.GetSlotCount(); slot++)
     {
-        next_tcp_client = *(++it);
+        tcp_client = this->tcp_client_db.GetSlotClient(slot);
 
-        this->tcp_client_db.remove(tcp_client);
-        tcp_client->UnSetState(TCP_CLIENT_STATE_MULTIPLEX_LISTEN);
-        tcp_client->Dereference();
+        if (tcp_client)
+            this->RemoveClientFromDB(tcp_client);
     }
+
+    // 放弃所有正在进行的主动连接, ClientConnectCancel() 会修改 connect_pending
+    while (!this->connect_pending.empty())
+        this->ClientConnectCancel(*this->connect_pending.begin());
 }
 
 void TcpClientServiceManager::Stop()
 {
     this->StopTcpClientServiceManagerThread();
-    close(this->udp_fd);
-    this->udp_fd = 0;
+
+    // 执行线程退出前尚未处理的命令, 唤醒等待中的同步调用者
+    this->ProcessCmdQ();
     this->Purge();
+
+    // 客户端已经全部注销, 取消剩余的 io_uring 请求并回收它们持有的引用
+    if (this->uring)
+        this->UringDestroy();
+
+    if (this->epoll_fd >= 0)
+    {
+        close(this->epoll_fd);
+        this->epoll_fd = -1;
+    }
+
+    close(this->event_fd);
+    this->event_fd = -1;
+    pthread_mutex_destroy(&this->cmdq_mutex);
     delete this;
 }
 
 void TcpClientServiceManager::StopTcpClientServiceManagerThread()
 {
-    if (!this->client_svc_mgr_thread)
+    if (!this->thread_running)
         return;
 
     pthread_cancel(*this->client_svc_mgr_thread);
+
+    // io_uring_enter() 不是取消点, 唤醒 DRS 线程使其执行到 pthread_testcancel()
+    if (this->mx_type == TCP_MULTIPLEX_IO_URING)
+    {
+        uint64_t one = 1;
+
+        if (write(this->event_fd, &one, sizeof(one)) < 0)
+            printf("%s() eventfd write failed, error = %d\n", __FUNCTION__, errno);
+    }
+
     pthread_join(*this->client_svc_mgr_thread, nullptr);
     free(this->client_svc_mgr_thread);
     this->client_svc_mgr_thread = nullptr;
+    this->thread_running = false;
 
-    printf("Service stopped : TcpClientServiceManagerThread\n");
-}
\ No newline at end of file
+    printf("Service stopped : TcpClientServiceManagerThread [%u]\n", this->reactor_id);
+}
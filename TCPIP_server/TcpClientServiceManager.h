@@ -4,71 +4,200 @@
 #include <semaphore.h>
 #include <pthread.h>
 #include <stdint.h>
+#include <sys/select.h>
 #include <list>
+#include <unordered_set>
+#include <atomic>
+#include "TcpClientHashIndex.h"
+#include "TcpTimerWheel.h"
+#include "TcpMetrics.h"
 
-#define MAX_CLIENT_SUPPTORTED 127
+#define MAX_CLIENT_SUPPTORTED 127 // select() 模式下支持的最大客户端数量(受 FD_SETSIZE 限制)
+#define TCP_EPOLL_MAX_EVENTS 256  // epoll_wait() 单次最多返回的就绪事件数
+#define TCP_URING_ENTRIES 1024    // io_uring 提交队列长度
+#define TCP_URING_N_BUFS 1024     // provided buffer ring 中的接收缓冲区数量(2 的幂)
+#define TCP_URING_BUF_SIZE 4096   // 每个接收缓冲区的长度
+
+typedef enum
+{
+    TCP_MULTIPLEX_SELECT,  // select() 多路复用(兼容模式), 每轮重建 fd_set 并遍历全部客户端
+    TCP_MULTIPLEX_EPOLL,   // epoll 边沿触发多路复用, 只分发就绪的客户端
+    TCP_MULTIPLEX_IO_URING // io_uring(make URING=1): multishot accept/recv + provided buffer ring, 发送在每轮循环中批量提交,
+                           // 编译时未启用或内核不支持时退回 epoll
+} TcpMultiplexType;
+
+typedef enum
+{
+    TCP_REACTOR_SHARD_LEAST_LOAD, // 新客户端分配给当前客户端数最少的 DRS
+    TCP_REACTOR_SHARD_HASH,       // 按 (ip, port) 哈希分配, 同一客户端总是落在同一个 DRS
+    TCP_REACTOR_SHARD_ACCEPTOR    // 第 i 个 accept 线程接受的客户端交给第 i % n 个 DRS, 其它来源按最小负载分配
+} TcpReactorShardPolicy;
 
 class TcpServerController;
 class TcpClient;
+struct TcpAcceptorShard_;
+struct TcpUringEngine_;
+struct io_uring_cqe;
+
+typedef enum
+{
+    DRS_CMD_CLIENT_START_LISTEN, // 将客户端加入监听集合
+    DRS_CMD_CLIENT_STOP_LISTEN,  // 将客户端移出监听集合
+    DRS_CMD_CLIENT_WATCH_WRITE,  // (select) 等待客户端 socket 可写, 继续发送发送队列中的数据; (io_uring) 提交发送
+    DRS_CMD_ACCEPT_STOP,         // (io_uring) 停止 multishot accept 并关闭监听 socket
+    DRS_CMD_CLIENT_CONNECT,      // 开始主动连接, 连接成功后加入监听集合
+    DRS_CMD_CLIENT_RESUME_READ,  // 线程池积压回落, 恢复读取客户端 socket
+    DRS_CMD_CLIENT_SHM_READ,     // 共享内存通道有新消息(或对端释放了发送空间), 在本 DRS 中取出并交付
+    DRS_CMD_STOP_LISTEN_ALL      // 服务停止: 将所有客户端移出监听集合并放弃主动连接
+} DrsCmdCode;
+
+/**
+ * @brief 发送给 DRS 线程的控制命令, 由 DRS 线程在事件循环中执行
+ */
+typedef struct DrsCmd_
+{
+    DrsCmdCode code;       // 命令类型
+    TcpClient *tcp_client; // 命令作用的客户端
+    sem_t *zero_sema;      // 非空时, 命令执行完成后唤醒发送方(同步命令)
+    uint64_t enq_ns;       // 入队时间(TcpMetricsNowNs), 用于统计命令队列延迟
+} DrsCmd_t;
 
 /**
  * @brief 负责多路复用监听所有已连接 TcpClient 的 socket, 是服务器的 “数据接收与事件分发(DRS)” 服务模块.
  *
  * 1.管理所有客户端的 fd（socket）
  *
- * 2.使用 select() 监听多个客户端的数据到达事件
+ * 2.使用 epoll(默认) 或 select()(兼容模式) 监听多个客户端的数据到达事件
  *
  * 3.当有客户端可读/可写时，将事件通知 Controller 或回调
  *
  * 4.管理客户端的添加、删除、迁移（到多线程客户端）
  *
- * 5.提供简单模式 / 高级模式 两种监听方式
+ * 5.其他线程通过 eventfd 命令队列请求添加/移除客户端, 由 DRS 线程在事件循环中执行,
+ *   tcp_client_db 和 fd 集合只会被 DRS 线程修改, 不需要加锁也不需要重启线程
+ *
+ * 6.管理内部线程，独立执行 epoll/select 轮询
+ *
+ * 7.epoll 模式下可以创建多个实例(reactor 分片), 每个实例拥有自己的线程、epoll 实例和一部分客户端
  *
- * 6.管理内部线程，独立执行 select 轮询
+ * 8.io_uring 模式下每个分片拥有自己的 io_uring 实例, 接收数据直接落在内核选择的 provided buffer 中,
+ *   每轮循环只调用一次 io_uring_enter() 提交接收/发送请求并等待完成事件; 分片还可以通过 multishot accept
+ *   直接接受自己的 SO_REUSEPORT 监听 socket 上的连接
+ *
+ * 9.主动连接(ClientConnectStart)使用非阻塞 connect(), 由事件循环等待 socket 可写, 连接超时和失败后的重试
+ *   (指数退避 + 随机抖动)由时间轮驱动, 不占用额外的线程; 连接成功后客户端直接加入本分片的监听集合
  *
  */
 class TcpClientServiceManager
 {
 private:
     int max_fd;                           // 当前所有客户端的最大值
-    int udp_fd;                           //  一个 UDP_fd
-    std::list<TcpClient *> tcp_client_db; // 客户端服务器数据
+    int event_fd;                         // 命令队列的唤醒 eventfd
+    int epoll_fd;                         // epoll 实例(仅 TCP_MULTIPLEX_EPOLL 模式)
+    TcpMultiplexType mx_type;             // 多路复用后端
+    uint16_t reactor_id;                  // 分片编号
+    int cpu_core;                         // 线程绑定的 CPU 核心, -1 表示不绑定
+    std::atomic<uint32_t> n_clients;      // 当前分片中的客户端数量(用于最小负载分配)
+    TcpClientHashIndex tcp_client_db;     // 客户端服务器数据(按 ip/port 哈希索引), 只由 DRS 线程修改
     fd_set active_fd_set;                 // 当前使用的 fd_set
     fd_set backup_fd_set;                 // 备份的 fd_set
+    fd_set active_wr_fd_set;              // (select) 当前使用的写 fd_set
+    fd_set backup_wr_fd_set;              // (select) 发送队列中有积压数据的客户端
+    TcpTimerWheel timer_wheel;            // 客户端 keepalive/空闲超时定时器, 只由 DRS 线程访问
+    struct TcpUringEngine_ *uring;        // io_uring 实例及其缓冲区(仅 TCP_MULTIPLEX_IO_URING 模式)
+    TcpReactorMetrics_t metrics;          // 本分片的计数器和延迟直方图
+    std::unordered_set<TcpClient *> connect_pending; // 正在主动连接(或等待重试)的客户端, 各持有一个引用, 只由 DRS 线程访问
+    uint64_t rand_state;                  // 退避抖动使用的 xorshift 随机数状态, 只由 DRS 线程访问
 
     int GetMaxFdSimple(); // 获取最大 fd (simple)
     int GetMaxFdAdv();    // 获取最大 fd (Advance)
 
     pthread_t *client_svc_mgr_thread;            // 多路复用服务线程
+    bool thread_running;                         // DRS 线程是否正在运行
     sem_t wait_for_thread_operation_to_complete; // 信号量: 等待操作完成
-    sem_t sem0_1, sem0_2;                        // 用于线程启动/线程停止
-    pthread_rwlock_t rwlock;                     // tcp_client_db 读写锁
 
-    void ForceUnblockSelect();                // 从 Select() 强制唤醒
+    std::list<DrsCmd_t> cmdQ;   // 命令队列
+    pthread_mutex_t cmdq_mutex; // 命令队列锁, 只保护入队/出队
+
     void TcpClientMigrate(TcpClient *);       // 将客户端迁移到多线程模式
     void Purge();                             // 清除所有客户端
     void CopyClientFDtoFDSet(fd_set *fd_set); // 将所有 client 的 Fd 填入fd_set
 
+    void EnqueCmd(DrsCmdCode, TcpClient *, sem_t *);           // 命令入队并通过 eventfd 唤醒 DRS 线程
+    void ProcessCmdQ();                                        // (DRS 线程) 执行队列中的全部命令
+    bool IsDrsThread();                                        // 当前线程是否是本分片的 DRS 线程
+    void ClientFDStartListenInternal(TcpClient *);             // (DRS 线程) 将客户端 fd 加入监听集合
+    void ClientFDStopListenInternal(TcpClient *);              // (DRS 线程) 将客户端 fd 移出监听集合
+    void StopListenAllInternal();                              // (DRS 线程) 将所有客户端移出监听集合
+    void ClientFDDisconnected(TcpClient *);                    // (DRS 线程) 对端断开, 注销并通知 Controller
+    int ClientFDRecv(TcpClient *);                             // 读取客户端数据到其自身的缓冲区, 交给分帧器或应用层
+    bool ClientFDDrain(TcpClient *);                           // (epoll) 读空客户端 socket, 返回 false 表示连接已断开
+    bool ClientFDReadBatch(TcpClient *, bool drain);           // 处理一批接收数据, 期间产生的回复合并发送
+    void ClientFDWatchWriteInternal(TcpClient *);              // (DRS 线程, select) 将客户端 fd 加入写集合
+    void ClientFDWritable(TcpClient *);                        // (DRS 线程) socket 可写, 继续发送积压的数据
+    bool ClientFDReadThrottled(TcpClient *);                   // (DRS 线程) 线程池积压过多时暂停读取, 返回 true 表示已暂停
+    void ClientFDResumeReadInternal(TcpClient *);              // (DRS 线程) 恢复读取被暂停的客户端
+    void ClientShmReadableInternal(TcpClient *);               // (DRS 线程) 处理客户端的共享内存通道
+    void ClientTimerStart(TcpClient *);                        // (DRS 线程) 客户端加入监听集合时启动 keepalive/空闲定时器
+    void ClientConnectStartInternal(TcpClient *);              // (DRS 线程) 接管主动连接的客户端, 立即连接或等待重试
+    void ClientConnectAttempt(TcpClient *);                    // (DRS 线程) 创建非阻塞 socket 并发起 connect()
+    void ClientConnectWritable(TcpClient *);                   // (DRS 线程) 正在连接的 socket 可写, 检查连接结果
+    void ClientConnectFailed(TcpClient *, int err);            // (DRS 线程) 连接失败或超时, 按退避时间安排重试
+    void ClientConnected(TcpClient *);                         // (DRS 线程) 连接成功, 加入监听集合并通知 Controller
+    void ClientConnectUnwatch(TcpClient *);                    // (DRS 线程) 停止等待正在连接的 socket 可写
+    void ClientConnectCancel(TcpClient *);                     // (DRS 线程) 放弃连接, 释放 connect_pending 的引用
+    uint32_t ConnectBackoffMs(uint32_t attempts);              // 第 attempts 次失败后的退避时间(带抖动)
+
+    // io_uring 后端(TcpClientServiceManagerUring.cpp)
+    void UringInit();                                   // 创建 io_uring 实例和 provided buffer ring
+    void UringDestroy();                                // 取消所有请求并释放 io_uring 实例
+    void UringClientStart(TcpClient *);                 // (DRS 线程) 提交 multishot recv
+    void UringClientStop(TcpClient *);                  // (DRS 线程) 取消客户端 fd 上的所有请求
+    void UringClientSend(TcpClient *);                  // (DRS 线程) 本轮循环结束时提交发送队列中的数据
+    void UringClientConnectArm(TcpClient *);            // (DRS 线程) 等待正在连接的 socket 可写
+    void UringClientConnectStop(TcpClient *);           // (DRS 线程) 取消等待, 返回后可以关闭 socket
+    void UringSubmitSends();                            // (DRS 线程) 为本轮积累的客户端准备 sendmsg 请求
+    void UringProcessCqe(struct io_uring_cqe *);        // (DRS 线程) 处理一个完成事件
+    bool UringClientRecvd(TcpClient *, unsigned char *, uint32_t); // (DRS 线程) 接收的数据交给分帧器或应用层
+    void UringClientRecvArm(TcpClient *);               // (DRS 线程) 提交(或重新提交) multishot recv
+    void UringClientRecvStop(TcpClient *);              // (DRS 线程) 暂停读取: 只取消 multishot recv
+    void UringAcceptArm();                              // (DRS 线程) 提交(或重新提交) multishot accept
+    void AcceptFDStopInternal();                        // (DRS 线程) 停止 multishot accept
+
 public:
     TcpServerController *tcp_ctrlr;
 
-    TcpClientServiceManager(TcpServerController *);
+    TcpClientServiceManager(TcpServerController *, uint16_t reactor_id = 0, int cpu_core = -1);
     ~TcpClientServiceManager();
 
     // 启动 Service Manager 的监听线程(两种模式)
     void StartTcpClientServiceManagerThread();
     void StartTcpClientServiceManagerThreadInternalSimple();
     void StartTcpClientServiceManagerThreadInternal2();
+    void StartTcpClientServiceManagerThreadInternalEpoll();
+    void StartTcpClientServiceManagerThreadInternalUring();
+    static bool IsIoUringSupported(); // 编译时启用了 io_uring 且内核支持所需的特性
+    TcpMultiplexType GetMultiplexType();
+    uint16_t GetReactorId();
+    uint32_t GetClientCount();
+    TcpReactorMetrics_t *GetMetrics();    // 本分片的计数器, 可以被任意线程读取和更新
+    void ClientTimerExpired(TcpClient *); // (DRS 线程) 时间轮回调: 检查 keepalive/空闲超时
+    void ClientConnectTimerExpired(TcpClient *); // (DRS 线程) 时间轮回调: 连接超时或开始重试
 
-    void StopTcpClientServiceManagerThread();                 // 停止监听线程
-    void ClientFDStartListenSimple(TcpClient *);              // Simple 模式添加客户端到监听 FD 集合
-    void ClientFDStartListenAdv(TcpClient *);                 // Advanced 模式添加客户端到监听 FD 集合
-    void RemoveClientFromDB(TcpClient *);                     // 从 DB 移除到客户端
-    void AddClientToDB(TcpClient *);                          // 向 DB 添加客户端
-    TcpClient *ClientFDStopListListenAdv(uint32_t, uint16_t); // Advanced 模式停止添加客户端(通过 ip/port 查找)
-    void ClientFDStopListenAdv(TcpClient *);                  // Advanced 模式停止监听客户端
-    void ClientFDStopListenSimple(TcpClient *);               // Simple 模式停止添加客户端
-    TcpClient *LookUpClientDB(uint32_t, uint16_t);            // 按 ip/port 查找客户端
-    void Stop();                                              // 停止整个服务
+    void StopTcpClientServiceManagerThread();      // 停止监听线程
+    void ClientFDStartListen(TcpClient *);         // 添加客户端到监听集合(异步)
+    void ClientFDStopListen(TcpClient *);          // 将客户端从监听集合移除或放弃主动连接(同步, 返回后 DRS 不再访问此客户端)
+    void StopListenAll();                          // 将所有客户端移出监听集合(同步, 返回后 DRS 不再读取任何 socket)
+    void ClientConnectStart(TcpClient *, bool backoff); // 开始主动连接(异步), backoff 为 true 时先等待一个退避时间
+    void ClientFDWatchWrite(TcpClient *);          // 发送队列有积压时请求 DRS 在 socket 可写后继续发送(异步)
+    void ClientFDResumeRead(TcpClient *);          // 线程池积压回落后恢复读取客户端 socket(异步)
+    void ClientShmReadable(TcpClient *);           // 共享内存通道可读, 由本 DRS 取出消息(异步)
+    void RemoveClientFromDB(TcpClient *);          // 从 DB 移除到客户端
+    void AddClientToDB(TcpClient *);               // 向 DB 添加客户端
+    TcpClient *LookUpClientDB(uint32_t, uint16_t); // 按 ip/port 查找客户端
+    void AcceptFDStart(struct TcpAcceptorShard_ *);  // (io_uring) 在本分片中以 multishot accept 接受连接(异步)
+    void AcceptFDStop();                             // (io_uring) 停止接受连接并关闭监听 socket(同步)
+    void DisplayUringStats();                        // (io_uring) 打印系统调用与完成事件统计
+    void Stop();                                   // 停止整个服务
 };
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,776 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <memory.h>
+#include <assert.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/utsname.h>
+#include <netinet/in.h>
+
+#include "TcpClientServiceManager.h"
+#include "TcpServerController.h"
+#include "TcpNewConnectionAcceptor.h"
+#include "TcpClient.h"
+#include "TcpMsgDemarcar.h"
+
+/*
+ * io_uring 后端, 只在 make URING=1 (定义 TCP_HAVE_LIBURING, 链接 liburing) 时编译,
+ * 否则 IsIoUringSupported() 返回 false, TcpServerController 在启动时退回 epoll.
+ */
+
+#ifdef TCP_HAVE_LIBURING
+
+#include <vector>
+#include <liburing.h>
+
+#define TCP_URING_BUF_GROUP 0     // provided buffer ring 的组号
+#define TCP_URING_OP_MASK 7ULL    // user_data 低 3 位保存请求类型, 其余位保存对象指针
+
+/**
+ * @brief 请求类型, 与对象指针一起保存在 user_data 中, user_data 为 0 的请求(取消)不需要处理完成事件
+ */
+typedef enum
+{
+    TCP_URING_OP_CMD = 1, // eventfd 上的 multishot poll, 命令队列中有新命令
+    TCP_URING_OP_ACCEPT,  // 监听 socket 上的 multishot accept
+    TCP_URING_OP_RECV,    // 客户端 fd 上的 multishot recv, 持有客户端的一个引用
+    TCP_URING_OP_SEND,    // 客户端发送队列的一次 sendmsg, 持有客户端的一个引用
+    TCP_URING_OP_POLLOUT, // sendmsg 返回 -EAGAIN 后等待 socket 可写, 持有客户端的一个引用
+    TCP_URING_OP_CONNECT  // 主动连接: 等待正在连接的 socket 可写(连接完成或失败), 持有客户端的一个引用
+} TcpUringOp;
+
+/**
+ * @brief 一个 DRS 分片的 io_uring 实例及其接收缓冲区, 只由 DRS 线程访问
+ */
+typedef struct TcpUringEngine_
+{
+    struct io_uring ring;               // io_uring 实例
+    struct io_uring_buf_ring *buf_ring; // provided buffer ring, 内核从中为 multishot recv 选择缓冲区
+    unsigned char *bufs;                // TCP_URING_N_BUFS 个接收缓冲区
+    std::vector<TcpClient *> send_list; // 本轮循环结束时需要提交发送的客户端, 每个元素持有一个引用
+    TcpAcceptorShard_t *accept_shard;   // multishot accept 使用的监听分片, nullptr 表示未启用
+    uint32_t n_inflight;                // 尚未结束的请求数(multishot 请求在最后一个完成事件时结束)
+    bool cmd_pending;                   // 本批完成事件中是否有命令队列的唤醒
+    bool stopping;                      // 正在销毁, 完成事件只回收引用, 不再重新提交请求
+
+    uint64_t n_enters;        // 事件循环的 io_uring_enter() 次数
+    uint64_t n_extra_submits; // 提交队列已满时额外的 io_uring_submit() 次数
+    uint64_t n_cqes;          // 处理的完成事件数
+    uint64_t n_recvs;         // 收到数据的 recv 完成事件数
+    uint64_t n_sends;         // 提交的 sendmsg 请求数
+    uint64_t n_buf_shortages; // provided buffer 耗尽(-ENOBUFS)次数
+} TcpUringEngine_t;
+
+static inline uint64_t tcp_uring_tag(void *ptr, TcpUringOp op)
+{
+    return (uint64_t)(uintptr_t)ptr | (uint64_t)op;
+}
+
+/**
+ * @brief 获取一个空闲的 SQE, 提交队列已满时先提交已经准备好的请求
+ */
+static struct io_uring_sqe *tcp_uring_get_sqe(TcpUringEngine_t *uring)
+{
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&uring->ring);
+
+    if (sqe)
+        return sqe;
+
+    io_uring_submit(&uring->ring);
+    uring->n_extra_submits++;
+
+    sqe = io_uring_get_sqe(&uring->ring);
+    assert(sqe);
+    return sqe;
+}
+
+/**
+ * @brief 编译时启用了 io_uring, 且内核支持 multishot recv(6.0) 和 provided buffer ring
+ *
+ * 只检测一次, 结果在进程内缓存
+ */
+static bool tcp_uring_probe()
+{
+    int rc, major = 0, minor = 0;
+    struct utsname uts;
+    struct io_uring ring;
+    struct io_uring_buf_ring *buf_ring;
+
+    if (uname(&uts) < 0 || sscanf(uts.release, "%d.%d", &major, &minor) != 2 || major < 6)
+        return false;
+
+    if (io_uring_queue_init(8, &ring, 0) < 0)
+        return false;
+
+    buf_ring = io_uring_setup_buf_ring(&ring, 8, TCP_URING_BUF_GROUP, 0, &rc);
+
+    if (buf_ring)
+        io_uring_free_buf_ring(&ring, buf_ring, 8, TCP_URING_BUF_GROUP);
+
+    io_uring_queue_exit(&ring);
+    return buf_ring != nullptr;
+}
+
+bool TcpClientServiceManager::IsIoUringSupported()
+{
+    static const bool supported = tcp_uring_probe();
+
+    return supported;
+}
+
+/**
+ * @brief 创建 io_uring 实例, 注册 provided buffer ring, 并在 eventfd 上提交 multishot poll
+ *
+ */
+void TcpClientServiceManager::UringInit()
+{
+    int i, rc;
+    struct io_uring_params params;
+    struct io_uring_sqe *sqe;
+    TcpUringEngine_t *uring = new TcpUringEngine_t();
+
+    // multishot recv 一次提交会产生大量完成事件, 完成队列比提交队列大
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = TCP_URING_ENTRIES * 4;
+
+    rc = io_uring_queue_init_params(TCP_URING_ENTRIES, &uring->ring, &params);
+
+    if (rc == -EINVAL)
+    {
+        // 旧内核不支持 IORING_SETUP_COOP_TASKRUN
+        params.flags &= ~IORING_SETUP_COOP_TASKRUN;
+        rc = io_uring_queue_init_params(TCP_URING_ENTRIES, &uring->ring, &params);
+    }
+
+    if (rc < 0)
+    {
+        printf("%s() io_uring creation failed, error = %d\n", __FUNCTION__, -rc);
+        exit(0);
+    }
+
+    uring->buf_ring = io_uring_setup_buf_ring(&uring->ring, TCP_URING_N_BUFS, TCP_URING_BUF_GROUP, 0, &rc);
+
+    if (!uring->buf_ring)
+    {
+        printf("%s() provided buffer ring registration failed, error = %d\n", __FUNCTION__, -rc);
+        exit(0);
+    }
+
+    if (posix_memalign((void **)&uring->bufs, 4096, (size_t)TCP_URING_N_BUFS * TCP_URING_BUF_SIZE))
+    {
+        printf("%s() receive buffer allocation failed\n", __FUNCTION__);
+        exit(0);
+    }
+
+    for (i = 0; i < TCP_URING_N_BUFS; i++)
+    {
+        io_uring_buf_ring_add(uring->buf_ring, uring->bufs + (size_t)i * TCP_URING_BUF_SIZE, TCP_URING_BUF_SIZE, i,
+                              io_uring_buf_ring_mask(TCP_URING_N_BUFS), i);
+    }
+
+    io_uring_buf_ring_advance(uring->buf_ring, TCP_URING_N_BUFS);
+
+    // 命令队列的 eventfd 每次被写入都会产生一个完成事件, 在 DRS 线程的第一次 io_uring_enter() 时提交
+    sqe = tcp_uring_get_sqe(uring);
+    io_uring_prep_poll_multishot(sqe, this->event_fd, POLLIN);
+    io_uring_sqe_set_data64(sqe, tcp_uring_tag(this, TCP_URING_OP_CMD));
+    uring->n_inflight++;
+
+    this->uring = uring;
+}
+
+/**
+ * @brief 取消所有请求并回收它们持有的客户端引用, 然后释放 io_uring 实例, 调用前 DRS 线程必须已经停止
+ *
+ */
+void TcpClientServiceManager::UringDestroy()
+{
+    unsigned head, n_cqes;
+    struct io_uring_cqe *cqe;
+    struct io_uring_sqe *sqe;
+    struct __kernel_timespec ts;
+    TcpUringEngine_t *uring = this->uring;
+    size_t i;
+
+    assert(!this->thread_running);
+
+    this->AcceptFDStopInternal();
+    uring->stopping = true;
+
+    for (i = 0; i < uring->send_list.size(); i++)
+        uring->send_list[i]->Dereference();
+    uring->send_list.clear();
+
+    sqe = tcp_uring_get_sqe(uring);
+    io_uring_prep_cancel64(sqe, 0, IORING_ASYNC_CANCEL_ANY);
+    io_uring_sqe_set_data64(sqe, 0);
+    io_uring_submit(&uring->ring);
+
+    // 被取消的请求很快就会完成, 超时说明剩余的请求无法取消, 放弃回收它们持有的引用
+    ts.tv_sec = 0;
+    ts.tv_nsec = 100 * 1000 * 1000;
+
+    while (uring->n_inflight)
+    {
+        if (io_uring_wait_cqe_timeout(&uring->ring, &cqe, &ts) < 0)
+        {
+            printf("%s() DRS [%u] : %u io_uring requests not cancelled\n", __FUNCTION__, this->reactor_id, uring->n_inflight);
+            break;
+        }
+
+        n_cqes = 0;
+        io_uring_for_each_cqe(&uring->ring, head, cqe)
+        {
+            this->UringProcessCqe(cqe);
+            n_cqes++;
+        }
+
+        io_uring_cq_advance(&uring->ring, n_cqes);
+    }
+
+    // 取消后完成的 sendmsg 可能又把客户端放入了发送列表
+    for (i = 0; i < uring->send_list.size(); i++)
+        uring->send_list[i]->Dereference();
+
+    io_uring_free_buf_ring(&uring->ring, uring->buf_ring, TCP_URING_N_BUFS, TCP_URING_BUF_GROUP);
+    io_uring_queue_exit(&uring->ring);
+    free(uring->bufs);
+    delete uring;
+    this->uring = nullptr;
+}
+
+/**
+ * @brief (DRS 线程) 客户端加入监听集合: 发送队列改为异步提交, 提交 multishot recv
+ *
+ * @param tcp_client 刚加入监听集合的客户端
+ */
+void TcpClientServiceManager::UringClientStart(TcpClient *tcp_client)
+{
+    tcp_client->out_queue.SetAsyncSend(true);
+    this->UringClientRecvArm(tcp_client);
+
+    // 加入监听前积压的数据(例如 Welcome 消息)
+    if (tcp_client->out_queue.HasPending())
+        this->UringClientSend(tcp_client);
+}
+
+/**
+ * @brief (DRS 线程) 提交 multishot recv, 内核在数据到达时从 provided buffer ring 中选择缓冲区
+ *
+ * 请求持有客户端的一个引用, 在最后一个完成事件(没有 IORING_CQE_F_MORE)时释放
+ *
+ * @param tcp_client 监听中的客户端
+ */
+void TcpClientServiceManager::UringClientRecvArm(TcpClient *tcp_client)
+{
+    struct io_uring_sqe *sqe = tcp_uring_get_sqe(this->uring);
+
+    io_uring_prep_recv_multishot(sqe, tcp_client->comm_fd, nullptr, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = TCP_URING_BUF_GROUP;
+    io_uring_sqe_set_data64(sqe, tcp_uring_tag(tcp_client, TCP_URING_OP_RECV));
+
+    tcp_client->Reference();
+    tcp_client->recv_armed = true;
+    this->uring->n_inflight++;
+}
+
+/**
+ * @brief (DRS 线程) 暂停读取: 只取消客户端的 multishot recv, 发送不受影响
+ *
+ * 取消之前已经完成的接收仍会交付; 最后一个完成事件(-ECANCELED)到达时如果已经恢复读取则重新提交
+ *
+ * @param tcp_client 线程池积压过多的客户端
+ */
+void TcpClientServiceManager::UringClientRecvStop(TcpClient *tcp_client)
+{
+    struct io_uring_sqe *sqe = tcp_uring_get_sqe(this->uring);
+
+    io_uring_prep_cancel64(sqe, tcp_uring_tag(tcp_client, TCP_URING_OP_RECV), 0);
+    io_uring_sqe_set_data64(sqe, 0);
+}
+
+/**
+ * @brief (DRS 线程) 客户端移出监听集合: 取消 fd 上的所有请求, 发送队列恢复同步发送
+ *
+ * 被取消的请求仍会产生完成事件, 届时释放它们持有的引用; 已经提交的 sendmsg 完成之前发送队列不会同步发送
+ *
+ * @param tcp_client 要移出监听集合的客户端
+ */
+void TcpClientServiceManager::UringClientStop(TcpClient *tcp_client)
+{
+    struct io_uring_sqe *sqe = tcp_uring_get_sqe(this->uring);
+
+    io_uring_prep_cancel_fd(sqe, tcp_client->comm_fd, IORING_ASYNC_CANCEL_ALL);
+    io_uring_sqe_set_data64(sqe, 0);
+
+    tcp_client->out_queue.SetAsyncSend(false);
+}
+
+/**
+ * @brief (DRS 线程) 发送队列中有数据, 在本轮循环结束时提交 sendmsg
+ *
+ * 同一客户端在一轮中可能被加入多次, 只有第一次能取出数据, 其余直接释放引用
+ *
+ * @param tcp_client 发送队列中有数据的客户端
+ */
+void TcpClientServiceManager::UringClientSend(TcpClient *tcp_client)
+{
+    tcp_client->Reference();
+    this->uring->send_list.push_back(tcp_client);
+}
+
+/**
+ * @brief (DRS 线程) 主动连接: 等待正在连接的 socket 可写, 请求持有客户端的一个引用
+ *
+ * @param tcp_client 正在连接的客户端
+ */
+void TcpClientServiceManager::UringClientConnectArm(TcpClient *tcp_client)
+{
+    struct io_uring_sqe *sqe = tcp_uring_get_sqe(this->uring);
+
+    io_uring_prep_poll_add(sqe, tcp_client->comm_fd, POLLOUT);
+    io_uring_sqe_set_data64(sqe, tcp_uring_tag(tcp_client, TCP_URING_OP_CONNECT));
+
+    tcp_client->Reference();
+    this->uring->n_inflight++;
+}
+
+/**
+ * @brief (DRS 线程) 主动连接: 取消 socket 上的等待, 被取消的请求完成时释放引用
+ *
+ * 按 fd 取消需要 fd 仍然有效, 立即提交, 返回后调用方可以关闭 socket
+ *
+ * @param tcp_client 正在连接的客户端
+ */
+void TcpClientServiceManager::UringClientConnectStop(TcpClient *tcp_client)
+{
+    struct io_uring_sqe *sqe = tcp_uring_get_sqe(this->uring);
+
+    io_uring_prep_cancel_fd(sqe, tcp_client->comm_fd, IORING_ASYNC_CANCEL_ALL);
+    io_uring_sqe_set_data64(sqe, 0);
+    io_uring_submit(&this->uring->ring);
+}
+
+/**
+ * @brief (DRS 线程) 为本轮积累的客户端准备 sendmsg 请求, 和下一次等待一起通过一次 io_uring_enter() 提交
+ *
+ */
+void TcpClientServiceManager::UringSubmitSends()
+{
+    size_t i;
+    TcpClient *tcp_client;
+    struct msghdr *msg;
+    struct io_uring_sqe *sqe;
+    TcpUringEngine_t *uring = this->uring;
+
+    for (i = 0; i < uring->send_list.size(); i++)
+    {
+        tcp_client = uring->send_list[i];
+        msg = tcp_client->svc_mgr == this ? tcp_client->out_queue.AsyncSendPrepare() : nullptr;
+
+        if (!msg)
+        {
+            tcp_client->Dereference();
+            continue;
+        }
+
+        // 发送列表中的引用转交给 sendmsg 请求
+        sqe = tcp_uring_get_sqe(uring);
+        io_uring_prep_sendmsg(sqe, tcp_client->comm_fd, msg, MSG_NOSIGNAL);
+        io_uring_sqe_set_data64(sqe, tcp_uring_tag(tcp_client, TCP_URING_OP_SEND));
+        uring->n_inflight++;
+        uring->n_sends++;
+        TcpMetricAdd(&this->metrics.send_calls, 1);
+    }
+
+    uring->send_list.clear();
+}
+
+/**
+ * @brief (DRS 线程) 把一个 provided buffer 中的数据交给分帧器或应用层
+ *
+ * 处理期间发送队列处于 cork 状态, 产生的回复在本轮循环结束时和其他客户端的回复一起提交
+ *
+ * @return true 连接正常
+ * @return false 消息超过了分帧器缓冲区容量, 需要断开此客户端
+ */
+bool TcpClientServiceManager::UringClientRecvd(TcpClient *tcp_client, unsigned char *data, uint32_t size)
+{
+    bool ok = true;
+
+    tcp_client->conn.recv_ns = TcpMetricsNowNs();
+    tcp_client->conn.bytes_recvd += size;
+    TcpMetricAdd(&this->metrics.bytes_recvd, size);
+    tcp_client->last_active_tick = this->timer_wheel.GetCurrentTick();
+
+    tcp_client->out_queue.Cork();
+
+    if (tcp_client->msgd)
+        ok = tcp_client->msgd->RecvFromBuffer(tcp_client, data, size) == 0;
+    else
+        this->tcp_ctrlr->ClientMsgRecvd(tcp_client, data, (uint16_t)size);
+
+    tcp_client->out_queue.Uncork(tcp_client);
+
+    return ok;
+}
+
+/**
+ * @brief (DRS 线程) 提交监听 socket 上的 multishot accept
+ *
+ */
+void TcpClientServiceManager::UringAcceptArm()
+{
+    struct io_uring_sqe *sqe = tcp_uring_get_sqe(this->uring);
+
+    io_uring_prep_multishot_accept(sqe, this->uring->accept_shard->accept_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    io_uring_sqe_set_data64(sqe, tcp_uring_tag(nullptr, TCP_URING_OP_ACCEPT));
+    this->uring->n_inflight++;
+}
+
+/**
+ * @brief (DRS 线程) 处理一个完成事件
+ *
+ * @param cqe 完成事件
+ */
+void TcpClientServiceManager::UringProcessCqe(struct io_uring_cqe *cqe)
+{
+    int res = cqe->res;
+    bool more = cqe->flags & IORING_CQE_F_MORE;
+    uint64_t user_data = io_uring_cqe_get_data64(cqe);
+    TcpUringOp op = (TcpUringOp)(user_data & TCP_URING_OP_MASK);
+    TcpClient *tcp_client = (TcpClient *)(uintptr_t)(user_data & ~TCP_URING_OP_MASK);
+    TcpUringEngine_t *uring = this->uring;
+    TcpAcceptorShard_t *shard;
+    unsigned char *buf = nullptr;
+    uint16_t bid = 0;
+    bool listening, ok = true;
+
+    uring->n_cqes++;
+
+    if (!more && user_data)
+        uring->n_inflight--;
+
+    switch (op)
+    {
+    case TCP_URING_OP_CMD:
+        uring->cmd_pending = true;
+
+        // 被内核终止的 multishot poll 需要重新提交
+        if (!more && !uring->stopping)
+        {
+            struct io_uring_sqe *sqe = tcp_uring_get_sqe(uring);
+            io_uring_prep_poll_multishot(sqe, this->event_fd, POLLIN);
+            io_uring_sqe_set_data64(sqe, tcp_uring_tag(this, TCP_URING_OP_CMD));
+            uring->n_inflight++;
+        }
+        break;
+
+    case TCP_URING_OP_ACCEPT:
+        shard = uring->accept_shard;
+
+        if (res >= 0)
+        {
+            struct sockaddr_in client_addr;
+            socklen_t addr_len = sizeof(client_addr);
+
+            // 已经停止接受连接
+            if (!shard || getpeername(res, (struct sockaddr *)&client_addr, &addr_len) < 0)
+                close(res);
+            else
+                shard->acceptor->HandleNewConnection(shard, res, &client_addr);
+        }
+
+        if (!more && uring->accept_shard && res != -ECANCELED)
+        {
+            if (res < 0)
+                printf("%s() DRS [%u] : accept failed, error = %d\n", __FUNCTION__, this->reactor_id, -res);
+
+            this->UringAcceptArm();
+        }
+        break;
+
+    case TCP_URING_OP_RECV:
+        if (cqe->flags & IORING_CQE_F_BUFFER)
+        {
+            bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            buf = uring->bufs + (size_t)bid * TCP_URING_BUF_SIZE;
+        }
+
+        // 重连期间客户端也属于本分片, 断开的连接上被取消的 recv 不能交付或重新提交
+        listening = tcp_client->svc_mgr == this && !tcp_client->IsStateSet(TCP_CLIENT_STATE_CONNECT_IN_PROGRESS);
+
+        if (!more)
+            tcp_client->recv_armed = false;
+
+        if (res > 0 && listening)
+        {
+            uring->n_recvs++;
+            tcp_client->conn.recv_calls++;
+            TcpMetricAdd(&this->metrics.recv_calls, 1);
+            ok = this->UringClientRecvd(tcp_client, buf, (uint32_t)res);
+
+            // 线程池积压过多时取消 recv(已经结束的 recv 不会被找到), 恢复时重新提交
+            if (ok)
+                this->ClientFDReadThrottled(tcp_client);
+        }
+
+        // 数据已经交给分帧器(拷贝)或应用层(同步回调), 缓冲区立即还给内核
+        if (buf)
+        {
+            io_uring_buf_ring_add(uring->buf_ring, buf, TCP_URING_BUF_SIZE, bid, io_uring_buf_ring_mask(TCP_URING_N_BUFS), 0);
+            io_uring_buf_ring_advance(uring->buf_ring, 1);
+        }
+
+        if (res == -ENOBUFS)
+            uring->n_buf_shortages++;
+
+        if (listening && tcp_client->svc_mgr == this)
+        {
+            // res == 0 对端关闭; -ENOBUFS 只是缓冲区暂时耗尽, 重新提交即可; -ECANCELED 是暂停读取取消的 recv
+            if (!ok || res == 0 || (res < 0 && res != -ENOBUFS && res != -ECANCELED))
+                this->ClientFDDisconnected(tcp_client);
+            else if (!more && !tcp_client->read_paused)
+                this->UringClientRecvArm(tcp_client);
+        }
+
+        if (!more)
+            tcp_client->Dereference();
+        break;
+
+    case TCP_URING_OP_SEND:
+        // 发送出错时不在这里断开, recv 会报告同样的错误
+        if (tcp_client->out_queue.AsyncSendComplete(tcp_client, res) > 0 && tcp_client->svc_mgr == this)
+        {
+            if (res == -EAGAIN)
+            {
+                struct io_uring_sqe *sqe = tcp_uring_get_sqe(uring);
+                io_uring_prep_poll_add(sqe, tcp_client->comm_fd, POLLOUT);
+                io_uring_sqe_set_data64(sqe, tcp_uring_tag(tcp_client, TCP_URING_OP_POLLOUT));
+                uring->n_inflight++;
+            }
+            else
+            {
+                uring->send_list.push_back(tcp_client);
+            }
+
+            // 请求持有的引用转交给下一次发送
+            break;
+        }
+
+        tcp_client->Dereference();
+        break;
+
+    case TCP_URING_OP_POLLOUT:
+        if (res >= 0 && tcp_client->svc_mgr == this)
+        {
+            uring->send_list.push_back(tcp_client);
+            break;
+        }
+
+        tcp_client->Dereference();
+        break;
+
+    case TCP_URING_OP_CONNECT:
+        // 已经超时或被放弃的连接(-ECANCELED)只释放引用
+        if (res >= 0 && tcp_client->svc_mgr == this && tcp_client->connect_inflight)
+        {
+            this->ClientConnectWritable(tcp_client);
+
+            // 虚假唤醒, 连接仍在进行
+            if (tcp_client->svc_mgr == this && tcp_client->connect_inflight)
+                this->UringClientConnectArm(tcp_client);
+        }
+
+        tcp_client->Dereference();
+        break;
+
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief 使用 io_uring 处理多个 tcpClient 的读写事件
+ *
+ * 每轮循环只调用一次 io_uring_enter(): 提交上一轮准备好的请求(重新提交的 recv, 批量的 sendmsg, 取消),
+ * 同时等待至少一个完成事件或下一个时间轮 tick. 数据由内核直接写入 provided buffer, 不再需要 recv()/readv(),
+ * 回复在处理完一批完成事件后统一提交.
+ *
+ * io_uring_enter() 不是取消点, 停止线程时 StopTcpClientServiceManagerThread() 会写 eventfd 唤醒本线程
+ */
+void TcpClientServiceManager::StartTcpClientServiceManagerThreadInternalUring()
+{
+    int rc, cancel_state, timeout_ms;
+    unsigned head, n_cqes;
+    struct io_uring_cqe *cqe;
+    struct __kernel_timespec ts;
+    TcpUringEngine_t *uring = this->uring;
+
+    // 信号量 +1; 唤醒(通知)外部线程当前线程已经启动完成
+    sem_post(&this->wait_for_thread_operation_to_complete);
+
+    while (true)
+    {
+        pthread_testcancel();
+
+        timeout_ms = this->timer_wheel.GetTimeoutMs(TcpTimerWheel::NowMs());
+
+        if (timeout_ms < 0)
+        {
+            rc = io_uring_submit_and_wait(&uring->ring, 1);
+        }
+        else
+        {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000 * 1000;
+            rc = io_uring_submit_and_wait_timeout(&uring->ring, &cqe, 1, &ts, nullptr);
+        }
+
+        uring->n_enters++;
+        TcpMetricAdd(&this->metrics.wait_calls, 1);
+
+        if (rc < 0 && rc != -ETIME && rc != -EINTR && rc != -EAGAIN && rc != -EBUSY)
+            printf("%s() io_uring_enter failed, error = %d\n", __FUNCTION__, -rc);
+
+        // 处理一批完成事件期间禁止取消, 保证 DB 与 io_uring 请求的一致性
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+
+        uring->cmd_pending = false;
+        n_cqes = 0;
+
+        io_uring_for_each_cqe(&uring->ring, head, cqe)
+        {
+            this->UringProcessCqe(cqe);
+            n_cqes++;
+        }
+
+        io_uring_cq_advance(&uring->ring, n_cqes);
+
+        // 命令可能注销本批次中的其他客户端, 所以放在本批次事件之后执行
+        if (uring->cmd_pending)
+            this->ProcessCmdQ();
+
+        // 与 epoll 相同, 本批次完成事件处理完之后才处理到期的定时器, 到期断开产生的取消请求随下一次等待一起提交
+        this->timer_wheel.Advance(TcpTimerWheel::NowMs());
+
+        this->UringSubmitSends();
+
+        pthread_setcancelstate(cancel_state, nullptr);
+    }
+}
+
+/**
+ * @brief 由本分片通过 multishot accept 接受监听分片上的连接, 必须在 DRS 线程启动之前调用
+ *
+ * 新连接在 DRS 线程中创建 TcpClient, 使用 TCP_REACTOR_SHARD_ACCEPTOR 策略时直接在本分片中监听
+ *
+ * @param shard 监听分片, 本分片负责在停止时关闭其监听 socket
+ */
+void TcpClientServiceManager::AcceptFDStart(TcpAcceptorShard_t *shard)
+{
+    assert(this->uring && !this->thread_running);
+    assert(!this->uring->accept_shard);
+
+    shard->svc_mgr = this;
+    this->uring->accept_shard = shard;
+    this->UringAcceptArm();
+}
+
+/**
+ * @brief (DRS 线程) 取消 multishot accept 并关闭监听 socket, 之后完成的 accept 直接关闭新连接
+ *
+ */
+void TcpClientServiceManager::AcceptFDStopInternal()
+{
+    struct io_uring_sqe *sqe;
+    TcpAcceptorShard_t *shard = this->uring->accept_shard;
+
+    if (!shard)
+        return;
+
+    // 按 fd 取消需要 fd 仍然有效, 先提交再关闭
+    sqe = tcp_uring_get_sqe(this->uring);
+    io_uring_prep_cancel_fd(sqe, shard->accept_fd, IORING_ASYNC_CANCEL_ALL);
+    io_uring_sqe_set_data64(sqe, 0);
+    io_uring_submit(&this->uring->ring);
+
+    close(shard->accept_fd);
+    shard->accept_fd = -1;
+    shard->svc_mgr = nullptr;
+    this->uring->accept_shard = nullptr;
+}
+
+void TcpClientServiceManager::DisplayUringStats()
+{
+    TcpUringEngine_t *uring = this->uring;
+
+    if (!uring)
+        return;
+
+    printf("  DRS[%u] io_uring : enters = %lu, cqes = %lu, recvs = %lu, sends = %lu, buffer shortages = %lu, extra submits = %lu\n",
+           this->reactor_id,
+           (unsigned long)uring->n_enters,
+           (unsigned long)uring->n_cqes,
+           (unsigned long)uring->n_recvs,
+           (unsigned long)uring->n_sends,
+           (unsigned long)uring->n_buf_shortages,
+           (unsigned long)uring->n_extra_submits);
+}
+
+#else /* TCP_HAVE_LIBURING */
+
+bool TcpClientServiceManager::IsIoUringSupported()
+{
+    return false;
+}
+
+void TcpClientServiceManager::UringInit()
+{
+    printf("%s() io_uring backend not compiled in, rebuild with make URING=1\n", __FUNCTION__);
+    exit(0);
+}
+
+void TcpClientServiceManager::UringDestroy() {}
+void TcpClientServiceManager::UringClientStart(TcpClient *) {}
+void TcpClientServiceManager::UringClientRecvArm(TcpClient *) {}
+void TcpClientServiceManager::UringClientRecvStop(TcpClient *) {}
+void TcpClientServiceManager::UringClientStop(TcpClient *) {}
+void TcpClientServiceManager::UringClientSend(TcpClient *) {}
+void TcpClientServiceManager::UringClientConnectArm(TcpClient *) {}
+void TcpClientServiceManager::UringClientConnectStop(TcpClient *) {}
+void TcpClientServiceManager::UringSubmitSends() {}
+void TcpClientServiceManager::UringProcessCqe(struct io_uring_cqe *) {}
+bool TcpClientServiceManager::UringClientRecvd(TcpClient *, unsigned char *, uint32_t) { return false; }
+void TcpClientServiceManager::UringAcceptArm() {}
+void TcpClientServiceManager::StartTcpClientServiceManagerThreadInternalUring() {}
+void TcpClientServiceManager::AcceptFDStart(TcpAcceptorShard_t *) {}
+void TcpClientServiceManager::AcceptFDStopInternal() {}
+void TcpClientServiceManager::DisplayUringStats() {}
+
+#endif /* TCP_HAVE_LIBURING */
+
+/**
+ * @brief 停止本分片的 multishot accept 并关闭监听 socket(同步), 返回后本分片不再访问监听分片
+ *
+ */
+void TcpClientServiceManager::AcceptFDStop()
+{
+    sem_t sem;
+
+    if (!this->thread_running || this->IsDrsThread())
+    {
+        this->AcceptFDStopInternal();
+        return;
+    }
+
+    sem_init(&sem, 0, 0);
+    this->EnqueCmd(DRS_CMD_ACCEPT_STOP, nullptr, &sem);
+    sem_wait(&sem);
+    sem_destroy(&sem);
+}
@@ -0,0 +1,19 @@
+#include "TcpConn.h"
+
+TcpConn::TcpConn()
+{
+    this->conn_type = tcp_conn_none;
+    this->ka_sent = 0;
+    this->ka_recvd = 0;
+    this->bytes_sent = 0;
+    this->bytes_recvd = 0;
+    this->frames_recvd = 0;
+    this->recv_calls = 0;
+    this->partial_reads = 0;
+    this->ring_hwm = 0;
+    this->recv_ns = 0;
+}
+
+TcpConn::~TcpConn()
+{
+}
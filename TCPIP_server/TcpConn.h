@@ -17,8 +17,13 @@ public:
     tcp_connection_type_t conn_type;
     uint32_t ka_sent;
     uint32_t ka_recvd;
-    uint32_t bytes_sent;
-    uint32_t bytes_recvd;
+    uint64_t bytes_sent;    // 发送的字节数
+    uint64_t bytes_recvd;   // 接收的字节数
+    uint64_t frames_recvd;  // 交给应用层(或线程池)的消息数
+    uint64_t recv_calls;    // recv() 调用次数(io_uring: recv 完成事件数)
+    uint64_t partial_reads; // 读取后分帧器中仍留有不完整消息的次数
+    uint64_t ring_hwm;      // 分帧器环形缓冲区积压字节数的最大值
+    uint64_t recv_ns;       // 最近一次读取数据的时间(TcpMetricsNowNs), 用于统计 读取 -> 回调 的延迟
 
     TcpConn();
     ~TcpConn();
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <errno.h>
+#include "TcpConnPool.h"
+#include "TcpServerController.h"
+#include "TcpClient.h"
+#include "network_utils.h"
+
+/**
+ * @brief 创建 n_conns 个到上游服务器的主动连接, 连接在 DRS 中异步建立, 返回时可能尚未连接
+ *
+ */
+TcpConnPool::TcpConnPool(TcpServerController *tcp_ctrlr, uint32_t server_ip_addr, uint16_t server_port_no, uint16_t n_conns)
+{
+    uint16_t i;
+    TcpClient *tcp_client;
+
+    this->tcp_ctrlr = tcp_ctrlr;
+    this->server_ip_addr = server_ip_addr;
+    this->server_port_no = server_port_no;
+    this->next = 0;
+
+    for (i = 0; i < n_conns; i++)
+    {
+        tcp_client = tcp_ctrlr->CreateActiveClient(server_ip_addr, server_port_no);
+        tcp_client->Reference();
+        this->clients.push_back(tcp_client);
+    }
+}
+
+/**
+ * @brief 删除所有连接(放弃正在进行的连接, 断开已建立的连接), 然后释放连接池持有的引用
+ *
+ */
+TcpConnPool::~TcpConnPool()
+{
+    size_t i;
+
+    for (i = 0; i < this->clients.size(); i++)
+    {
+        this->tcp_ctrlr->ProcessClientDelete(this->clients[i]);
+        this->clients[i]->Dereference();
+    }
+
+    this->clients.clear();
+}
+
+/**
+ * @brief 轮询选择一个已连接的客户端发送一条消息
+ *
+ * 从轮询起点开始依次尝试, 跳过未连接的客户端; 选中的连接恰好断开(发送出错)时继续尝试下一个
+ *
+ * @param msg 消息内容, 返回后调用方可以重用
+ * @param msg_size 消息长度
+ * @return int 成功返回 msg_size, 没有可用的连接时返回 -1(errno, 全部未连接时为 ENOTCONN)
+ */
+int TcpConnPool::SendMsg(char *msg, uint32_t msg_size)
+{
+    int rc = -1, err = ENOTCONN;
+    uint32_t i, start, n = this->clients.size();
+    TcpClient *tcp_client;
+
+    start = __atomic_fetch_add(&this->next, 1, __ATOMIC_RELAXED);
+
+    for (i = 0; i < n; i++)
+    {
+        tcp_client = this->clients[(start + i) % n];
+
+        if (!tcp_client->IsStateSet(TCP_CLIENT_STATE_CONNECTED))
+            continue;
+
+        rc = tcp_client->SendMsg(msg, msg_size);
+
+        if (rc >= 0)
+            return rc;
+
+        err = errno;
+    }
+
+    errno = err;
+    return -1;
+}
+
+TcpClient *TcpConnPool::GetClient(uint16_t index)
+{
+    return index < this->clients.size() ? this->clients[index] : nullptr;
+}
+
+uint16_t TcpConnPool::GetSize()
+{
+    return (uint16_t)this->clients.size();
+}
+
+uint16_t TcpConnPool::GetConnectedCount()
+{
+    size_t i;
+    uint16_t n_connected = 0;
+
+    for (i = 0; i < this->clients.size(); i++)
+    {
+        if (this->clients[i]->IsStateSet(TCP_CLIENT_STATE_CONNECTED))
+            n_connected++;
+    }
+
+    return n_connected;
+}
+
+void TcpConnPool::Display()
+{
+    char ip_str[16];
+
+    printf("Conn pool -> %s:%u : connections = %u, connected = %u\n",
+           network_convert_ip_n_to_p(this->server_ip_addr, ip_str), this->server_port_no,
+           this->GetSize(), this->GetConnectedCount());
+}
@@ -0,0 +1,39 @@
+#ifndef TCPCONNPOOL_H_
+#define TCPCONNPOOL_H_
+
+#include <stdint.h>
+#include <vector>
+
+class TcpServerController;
+class TcpClient;
+
+/**
+ * @brief 到同一上游服务器的一组主动连接, 由 TcpServerController::CreateConnPool() 创建
+ *
+ * 1.每个连接都是普通的主动连接客户端: 由 DRS 异步连接, 断开后按退避时间自动重连, 重连时复用同一个客户端对象
+ *
+ * 2.SendMsg() 按轮询顺序选择一个已连接的客户端发送, 跳过正在(重新)连接的客户端, 可以被任意线程调用
+ *
+ * 3.上游的回复与其他客户端的消息一样通过 Controller 的回调交给应用层
+ */
+class TcpConnPool
+{
+private:
+    TcpServerController *tcp_ctrlr;
+    uint32_t server_ip_addr;          // 上游服务器地址
+    uint16_t server_port_no;          // 上游服务器端口
+    std::vector<TcpClient *> clients; // 连接池中的客户端, 各持有一个引用, 创建后不再改变
+    uint32_t next;                    // 下一次轮询的起点(原子访问)
+
+public:
+    TcpConnPool(TcpServerController *, uint32_t server_ip_addr, uint16_t server_port_no, uint16_t n_conns);
+    ~TcpConnPool(); // 删除所有连接, Controller 停止之前调用
+
+    int SendMsg(char *msg, uint32_t msg_size); // 轮询选择一个已连接的客户端发送, 没有已连接的客户端时返回 -1(ENOTCONN)
+    TcpClient *GetClient(uint16_t index);      // 第 index 个连接
+    uint16_t GetSize();                        // 连接数
+    uint16_t GetConnectedCount();              // 当前已连接的连接数
+    void Display();
+};
+
+#endif
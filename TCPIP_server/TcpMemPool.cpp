@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <assert.h>
+#include <pthread.h>
+#include "TcpMemPool.h"
+
+#define TCP_MEM_POOL_HDR_SIZE 16       // 块头部长度, 保证返回地址 16 字节对齐
+#define TCP_MEM_POOL_LARGE UINT32_MAX  // 头部中的大小类编号: 超过最大大小类, 直接使用 malloc()
+#define TCP_MEM_POOL_MAX_CLASSES 32
+
+/**
+ * @brief 块头部, 块在空闲链表中时 next 有效
+ */
+typedef struct TcpMemPoolHdr_
+{
+    uint32_t size_class;         // 大小类编号
+    uint32_t pad;
+    struct TcpMemPoolHdr_ *next; // 空闲链表中的下一个块
+} TcpMemPoolHdr_t;
+
+/**
+ * @brief 一个大小类
+ */
+typedef struct TcpMemPoolClass_
+{
+    pthread_mutex_t mutex;
+    size_t size;                // 块长度(不含头部)
+    TcpMemPoolHdr_t *free_list; // 空闲块
+    uint32_t n_free;            // 空闲块数量
+    uint32_t max_free;          // 空闲块数量上限
+    uint64_t n_allocs;          // 分配次数
+    uint64_t n_hits;            // 从空闲链表分配的次数
+    uint64_t n_released;        // 因空闲链表已满而还给系统的块数
+} TcpMemPoolClass_t;
+
+static TcpMemPoolClass_t mem_pool_classes[TCP_MEM_POOL_MAX_CLASSES];
+static uint32_t mem_pool_n_classes;
+static pthread_once_t mem_pool_once = PTHREAD_ONCE_INIT;
+
+static_assert(sizeof(TcpMemPoolHdr_t) == TCP_MEM_POOL_HDR_SIZE, "TcpMemPoolHdr_t must keep 16-byte alignment");
+
+/**
+ * @brief 初始化大小类表: 2^k 与 1.5 * 2^k
+ *
+ */
+static void tcp_mem_pool_init()
+{
+    size_t size;
+    TcpMemPoolClass_t *cls;
+
+    for (size = TCP_MEM_POOL_MIN_SIZE; size <= TCP_MEM_POOL_MAX_SIZE; size *= 2)
+    {
+        cls = &mem_pool_classes[mem_pool_n_classes++];
+        cls->size = size;
+
+        if (size + size / 2 <= TCP_MEM_POOL_MAX_SIZE)
+        {
+            cls = &mem_pool_classes[mem_pool_n_classes++];
+            cls->size = size + size / 2;
+        }
+    }
+
+    assert(mem_pool_n_classes <= TCP_MEM_POOL_MAX_CLASSES);
+
+    for (uint32_t i = 0; i < mem_pool_n_classes; i++)
+    {
+        cls = &mem_pool_classes[i];
+        pthread_mutex_init(&cls->mutex, nullptr);
+        cls->free_list = nullptr;
+        cls->max_free = TCP_MEM_POOL_CLASS_CACHE_BYTES / cls->size;
+
+        if (cls->max_free < TCP_MEM_POOL_CLASS_MIN_CACHED)
+            cls->max_free = TCP_MEM_POOL_CLASS_MIN_CACHED;
+    }
+}
+
+/**
+ * @brief 查找能容纳 size 字节的最小大小类
+ *
+ * @return uint32_t 超过最大大小类时返回 TCP_MEM_POOL_LARGE
+ */
+static uint32_t tcp_mem_pool_size_class(size_t size)
+{
+    uint32_t i;
+
+    for (i = 0; i < mem_pool_n_classes; i++)
+    {
+        if (size <= mem_pool_classes[i].size)
+            return i;
+    }
+
+    return TCP_MEM_POOL_LARGE;
+}
+
+void *TcpMemPoolAlloc(size_t size)
+{
+    uint32_t size_class;
+    TcpMemPoolHdr_t *hdr = nullptr;
+    TcpMemPoolClass_t *cls;
+
+    pthread_once(&mem_pool_once, tcp_mem_pool_init);
+
+    size_class = tcp_mem_pool_size_class(size);
+
+    if (size_class == TCP_MEM_POOL_LARGE)
+    {
+        hdr = (TcpMemPoolHdr_t *)malloc(TCP_MEM_POOL_HDR_SIZE + size);
+        if (!hdr)
+            return nullptr;
+
+        hdr->size_class = TCP_MEM_POOL_LARGE;
+        return (unsigned char *)hdr + TCP_MEM_POOL_HDR_SIZE;
+    }
+
+    cls = &mem_pool_classes[size_class];
+
+    pthread_mutex_lock(&cls->mutex);
+    cls->n_allocs++;
+
+    if (cls->free_list)
+    {
+        hdr = cls->free_list;
+        cls->free_list = hdr->next;
+        cls->n_free--;
+        cls->n_hits++;
+    }
+
+    pthread_mutex_unlock(&cls->mutex);
+
+    // 空闲链表为空, 按大小类的长度分配, 释放后可以被同一大小类的任何请求复用
+    if (!hdr)
+    {
+        hdr = (TcpMemPoolHdr_t *)malloc(TCP_MEM_POOL_HDR_SIZE + cls->size);
+        if (!hdr)
+            return nullptr;
+    }
+
+    hdr->size_class = size_class;
+    hdr->next = nullptr;
+    return (unsigned char *)hdr + TCP_MEM_POOL_HDR_SIZE;
+}
+
+void *TcpMemPoolCalloc(size_t size)
+{
+    void *ptr = TcpMemPoolAlloc(size);
+
+    if (ptr)
+        memset(ptr, 0, size);
+
+    return ptr;
+}
+
+void TcpMemPoolFree(void *ptr)
+{
+    TcpMemPoolHdr_t *hdr;
+    TcpMemPoolClass_t *cls;
+
+    if (!ptr)
+        return;
+
+    hdr = (TcpMemPoolHdr_t *)((unsigned char *)ptr - TCP_MEM_POOL_HDR_SIZE);
+
+    if (hdr->size_class == TCP_MEM_POOL_LARGE)
+    {
+        free(hdr);
+        return;
+    }
+
+    assert(hdr->size_class < mem_pool_n_classes);
+    cls = &mem_pool_classes[hdr->size_class];
+
+    pthread_mutex_lock(&cls->mutex);
+
+    if (cls->n_free < cls->max_free)
+    {
+        hdr->next = cls->free_list;
+        cls->free_list = hdr;
+        cls->n_free++;
+        hdr = nullptr;
+    }
+    else
+    {
+        cls->n_released++;
+    }
+
+    pthread_mutex_unlock(&cls->mutex);
+
+    // 空闲链表已满, 还给系统
+    if (hdr)
+        free(hdr);
+}
+
+void TcpMemPoolGetStats(uint64_t *n_allocs, uint64_t *n_hits)
+{
+    uint32_t i;
+
+    *n_allocs = 0;
+    *n_hits = 0;
+
+    pthread_once(&mem_pool_once, tcp_mem_pool_init);
+
+    for (i = 0; i < mem_pool_n_classes; i++)
+    {
+        pthread_mutex_lock(&mem_pool_classes[i].mutex);
+        *n_allocs += mem_pool_classes[i].n_allocs;
+        *n_hits += mem_pool_classes[i].n_hits;
+        pthread_mutex_unlock(&mem_pool_classes[i].mutex);
+    }
+}
+
+void TcpMemPoolDisplay()
+{
+    uint32_t i;
+    TcpMemPoolClass_t *cls;
+
+    pthread_once(&mem_pool_once, tcp_mem_pool_init);
+
+    printf("Mem Pool :\n");
+
+    for (i = 0; i < mem_pool_n_classes; i++)
+    {
+        cls = &mem_pool_classes[i];
+        pthread_mutex_lock(&cls->mutex);
+
+        if (cls->n_allocs)
+        {
+            printf("  %6zu bytes : allocs = %lu, hit rate = %.1f%%, cached = %u, released = %lu\n",
+                   cls->size, (unsigned long)cls->n_allocs,
+                   cls->n_hits * 100.0 / cls->n_allocs,
+                   cls->n_free, (unsigned long)cls->n_released);
+        }
+
+        pthread_mutex_unlock(&cls->mutex);
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef TCPMEMPOOL_H_
+#define TCPMEMPOOL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TCP_MEM_POOL_MIN_SIZE 32                  // 最小的大小类
+#define TCP_MEM_POOL_MAX_SIZE (64 * 1024)         // 最大的大小类, 更大的请求直接使用 malloc()
+#define TCP_MEM_POOL_CLASS_CACHE_BYTES (4 << 20)  // 每个大小类最多缓存的空闲内存
+#define TCP_MEM_POOL_CLASS_MIN_CACHED 16          // 每个大小类至少可以缓存的空闲块数
+
+/**
+ * @brief 按大小类分配的空闲链表内存池, 用于连接建立/断开时反复创建的对象
+ *
+ * 1.大小类为 2^k 与 1.5 * 2^k (32, 48, 64, 96, ... 48K, 64K), 最多浪费 1/3 的空间
+ *
+ * 2.释放的块进入对应大小类的空闲链表, 下次分配直接复用; 空闲链表超过上限时才还给系统
+ *
+ * 3.每个块前有 16 字节的头部记录大小类, 释放时不需要传入长度, 返回的地址 16 字节对齐
+ *
+ * 4.每个大小类一把锁, 线程安全
+ *
+ * TcpClient / TcpMsgDemarcar 通过类的 operator new/delete 使用内存池, 引用计数归零时回收
+ */
+void *TcpMemPoolAlloc(size_t size);      // 分配 size 字节, 内容未初始化
+void *TcpMemPoolCalloc(size_t size);     // 分配 size 字节并清零
+void TcpMemPoolFree(void *ptr);          // 释放 TcpMemPoolAlloc/TcpMemPoolCalloc 分配的内存, ptr 可以为 NULL
+void TcpMemPoolGetStats(uint64_t *n_allocs, uint64_t *n_hits); // 所有大小类的分配次数与命中空闲链表的次数
+void TcpMemPoolDisplay();                // 打印每个大小类的命中率
+
+#endif
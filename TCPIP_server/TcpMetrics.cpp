@@ -0,0 +1,392 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <assert.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "TcpMetrics.h"
+#include "TcpServerController.h"
+#include "network_utils.h"
+
+/**
+ * @brief 获取单调时钟(纳秒), 通过 vDSO 完成, 不进入内核
+ *
+ */
+uint64_t TcpMetricsNowNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief 值所在的桶: 小于 TCP_HIST_SUB_BUCKETS 的值直接作为下标,
+ * 否则由最高位的位置确定区间, 最高位之后的 TCP_HIST_SUB_BITS 位确定子桶
+ */
+static inline uint32_t tcp_hist_bucket(uint64_t value)
+{
+    uint32_t msb, shift;
+
+    if (value < TCP_HIST_SUB_BUCKETS)
+        return (uint32_t)value;
+
+    msb = 63 - __builtin_clzll(value);
+    shift = msb - TCP_HIST_SUB_BITS;
+
+    return ((shift + 1) << TCP_HIST_SUB_BITS) + (uint32_t)((value >> shift) & (TCP_HIST_SUB_BUCKETS - 1));
+}
+
+/**
+ * @brief 桶中最大的值
+ */
+static uint64_t tcp_hist_bucket_upper(uint32_t bucket)
+{
+    uint32_t shift;
+
+    if (bucket < TCP_HIST_SUB_BUCKETS)
+        return bucket;
+
+    shift = (bucket >> TCP_HIST_SUB_BITS) - 1;
+
+    return (((uint64_t)(TCP_HIST_SUB_BUCKETS | (bucket & (TCP_HIST_SUB_BUCKETS - 1))) + 1) << shift) - 1;
+}
+
+/**
+ * @brief 记录一个值, 可以被多个线程同时调用
+ *
+ */
+void TcpHistogramRecord(TcpHistogram_t *hist, uint64_t value)
+{
+    TcpMetricAdd(&hist->buckets[tcp_hist_bucket(value)], 1);
+    TcpMetricAdd(&hist->count, 1);
+    TcpMetricAdd(&hist->sum, value);
+    TcpMetricMax(&hist->max, value);
+}
+
+/**
+ * @brief dst += src, src 可能正在被其他线程记录, dst 只属于调用者
+ *
+ */
+void TcpHistogramAccumulate(TcpHistogram_t *dst, const TcpHistogram_t *src)
+{
+    uint32_t i;
+    uint64_t max;
+
+    for (i = 0; i < TCP_HIST_N_BUCKETS; i++)
+        dst->buckets[i] += TcpMetricGet(&src->buckets[i]);
+
+    dst->count += TcpMetricGet(&src->count);
+    dst->sum += TcpMetricGet(&src->sum);
+
+    max = TcpMetricGet(&src->max);
+    if (max > dst->max)
+        dst->max = max;
+}
+
+/**
+ * @brief 计算百分位数
+ *
+ * 计数按桶累加, 快照期间仍在记录时 count 与各桶之和可能略有差异, 以各桶之和为准
+ *
+ * @param percentile 0 ~ 100
+ * @return uint64_t 百分位所在桶的上界(不超过记录的最大值), 没有记录时返回 0
+ */
+uint64_t TcpHistogramPercentile(const TcpHistogram_t *hist, double percentile)
+{
+    uint32_t i;
+    uint64_t total = 0, rank, seen = 0, upper;
+
+    for (i = 0; i < TCP_HIST_N_BUCKETS; i++)
+        total += hist->buckets[i];
+
+    if (total == 0)
+        return 0;
+
+    rank = (uint64_t)(percentile / 100.0 * total + 0.5);
+    if (rank == 0)
+        rank = 1;
+    if (rank > total)
+        rank = total;
+
+    for (i = 0; i < TCP_HIST_N_BUCKETS; i++)
+    {
+        seen += hist->buckets[i];
+
+        if (seen >= rank)
+            break;
+    }
+
+    upper = tcp_hist_bucket_upper(i);
+    return upper < hist->max ? upper : hist->max;
+}
+
+/**
+ * @brief dst += src, 计数器相加, 高水位取最大值
+ *
+ */
+void TcpReactorMetricsAccumulate(TcpReactorMetrics_t *dst, const TcpReactorMetrics_t *src)
+{
+    uint64_t hwm;
+
+    dst->bytes_recvd += TcpMetricGet(&src->bytes_recvd);
+    dst->bytes_sent += TcpMetricGet(&src->bytes_sent);
+    dst->frames_recvd += TcpMetricGet(&src->frames_recvd);
+    dst->frames_sent += TcpMetricGet(&src->frames_sent);
+    dst->recv_calls += TcpMetricGet(&src->recv_calls);
+    dst->send_calls += TcpMetricGet(&src->send_calls);
+    dst->wait_calls += TcpMetricGet(&src->wait_calls);
+    dst->partial_reads += TcpMetricGet(&src->partial_reads);
+    dst->clients_added += TcpMetricGet(&src->clients_added);
+    dst->clients_removed += TcpMetricGet(&src->clients_removed);
+    dst->protocol_errors += TcpMetricGet(&src->protocol_errors);
+    dst->connect_attempts += TcpMetricGet(&src->connect_attempts);
+    dst->connect_failures += TcpMetricGet(&src->connect_failures);
+
+    hwm = TcpMetricGet(&src->ring_hwm);
+    if (hwm > dst->ring_hwm)
+        dst->ring_hwm = hwm;
+
+    TcpHistogramAccumulate(&dst->recv_to_cb, &src->recv_to_cb);
+    TcpHistogramAccumulate(&dst->cmd_q_lat, &src->cmd_q_lat);
+}
+
+TcpMetricsDumper::TcpMetricsDumper(TcpServerController *tcp_ctrlr, uint32_t interval_ms)
+{
+    assert(interval_ms);
+
+    this->tcp_ctrlr = tcp_ctrlr;
+    this->interval_ms = interval_ms;
+    this->fd = -1;
+    this->is_udp = false;
+    this->buffer = (char *)malloc(TCP_METRICS_DUMP_BUFFER_SIZE);
+}
+
+TcpMetricsDumper::~TcpMetricsDumper()
+{
+    if (this->fd >= 0)
+        close(this->fd);
+
+    free(this->buffer);
+}
+
+/**
+ * @brief 打开输出目标
+ *
+ * @param target "file:<path>" 追加写入文件; "udp:<ip>:<port>" 每次快照一个 UDP 报文
+ * @return true 成功
+ * @return false 格式错误或打开失败
+ */
+bool TcpMetricsDumper::Open(const char *target)
+{
+    char ip[INET_ADDRSTRLEN];
+    const char *colon;
+    struct sockaddr_in addr;
+
+    assert(this->fd < 0);
+
+    if (strncmp(target, "file:", 5) == 0)
+    {
+        this->fd = open(target + 5, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+        if (this->fd < 0)
+        {
+            printf("%s() open %s failed, error = %d\n", __FUNCTION__, target + 5, errno);
+            return false;
+        }
+
+        return true;
+    }
+
+    if (strncmp(target, "udp:", 4) != 0 || !(colon = strrchr(target + 4, ':')) ||
+        colon - (target + 4) >= (long)sizeof(ip) || atoi(colon + 1) <= 0)
+    {
+        printf("%s() invalid metrics target %s\n", __FUNCTION__, target);
+        return false;
+    }
+
+    memcpy(ip, target + 4, colon - (target + 4));
+    ip[colon - (target + 4)] = '\0';
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)atoi(colon + 1));
+    addr.sin_addr.s_addr = htonl(network_convert_ip_p_to_n(ip));
+
+    this->fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+
+    if (this->fd < 0 || connect(this->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        printf("%s() udp target %s failed, error = %d\n", __FUNCTION__, target, errno);
+
+        if (this->fd >= 0)
+            close(this->fd);
+
+        this->fd = -1;
+        return false;
+    }
+
+    this->is_udp = true;
+    return true;
+}
+
+/**
+ * @brief 追加一个直方图的摘要: 次数, 平均值, p50/p90/p99/p99.9, 最大值(微秒)
+ */
+static int tcp_metrics_format_hist(char *buf, int size, const char *name, const TcpHistogram_t *hist)
+{
+    return snprintf(buf, size,
+                    "\"%s\":{\"count\":%lu,\"mean_us\":%.3f,\"p50_us\":%.3f,\"p90_us\":%.3f,\"p99_us\":%.3f,\"p999_us\":%.3f,\"max_us\":%.3f}",
+                    name, (unsigned long)hist->count,
+                    hist->count ? hist->sum / 1000.0 / hist->count : 0.0,
+                    TcpHistogramPercentile(hist, 50) / 1000.0,
+                    TcpHistogramPercentile(hist, 90) / 1000.0,
+                    TcpHistogramPercentile(hist, 99) / 1000.0,
+                    TcpHistogramPercentile(hist, 99.9) / 1000.0,
+                    hist->max / 1000.0);
+}
+
+/**
+ * @brief 追加一组分片计数器
+ */
+static int tcp_metrics_format_reactor(char *buf, int size, const TcpReactorMetrics_t *m)
+{
+    int len;
+
+    len = snprintf(buf, size,
+                   "\"bytes_recvd\":%lu,\"bytes_sent\":%lu,\"frames_recvd\":%lu,\"frames_sent\":%lu,"
+                   "\"recv_calls\":%lu,\"send_calls\":%lu,\"wait_calls\":%lu,\"partial_reads\":%lu,"
+                   "\"ring_hwm\":%lu,\"clients_added\":%lu,\"clients_removed\":%lu,\"protocol_errors\":%lu,"
+                   "\"connect_attempts\":%lu,\"connect_failures\":%lu,",
+                   (unsigned long)m->bytes_recvd, (unsigned long)m->bytes_sent,
+                   (unsigned long)m->frames_recvd, (unsigned long)m->frames_sent,
+                   (unsigned long)m->recv_calls, (unsigned long)m->send_calls,
+                   (unsigned long)m->wait_calls, (unsigned long)m->partial_reads,
+                   (unsigned long)m->ring_hwm, (unsigned long)m->clients_added,
+                   (unsigned long)m->clients_removed, (unsigned long)m->protocol_errors,
+                   (unsigned long)m->connect_attempts, (unsigned long)m->connect_failures);
+
+    if (len >= size)
+        return size;
+
+    len += tcp_metrics_format_hist(buf + len, size - len, "recv_to_cb", &m->recv_to_cb);
+    if (len >= size)
+        return size;
+
+    len += snprintf(buf + len, size - len, ",");
+    if (len >= size)
+        return size;
+
+    len += tcp_metrics_format_hist(buf + len, size - len, "cmd_q", &m->cmd_q_lat);
+    return len < size ? len : size;
+}
+
+/**
+ * @brief 把快照格式化为一行 JSON, 超出缓冲区时截断分片列表
+ *
+ * @return int 长度(包括结尾的换行符)
+ */
+int TcpMetricsDumper::Format(const TcpMetricsSnapshot_t *snapshot)
+{
+    size_t i;
+    int len, size = TCP_METRICS_DUMP_BUFFER_SIZE - 2; // 保留 "}\n"
+    char *buf = this->buffer;
+
+    len = snprintf(buf, size, "{\"ts_ms\":%lu,\"server\":\"%s\",\"clients\":%u,",
+                   (unsigned long)snapshot->timestamp_ms, this->tcp_ctrlr->name.c_str(), snapshot->n_clients);
+
+    len += tcp_metrics_format_reactor(buf + len, size - len, &snapshot->total);
+    len += snprintf(buf + len, size - len, ",");
+    len += tcp_metrics_format_hist(buf + len, size - len, "ctrl_q", &snapshot->ctrl_q_lat);
+    len += snprintf(buf + len, size - len, ",\"reactors\":[");
+
+    for (i = 0; i < snapshot->reactors.size() && len < size - 1024; i++)
+    {
+        len += snprintf(buf + len, size - len, "%s{", i ? "," : "");
+        len += tcp_metrics_format_reactor(buf + len, size - len, &snapshot->reactors[i]);
+        len += snprintf(buf + len, size - len, "}");
+    }
+
+    if (len > size - 1)
+        len = size - 1;
+
+    len += snprintf(buf + len, size + 2 - len, "]}\n");
+    return len;
+}
+
+/**
+ * @brief 立即输出一次快照
+ *
+ */
+void TcpMetricsDumper::DumpOnce()
+{
+    int len;
+    ssize_t rc;
+    TcpMetricsSnapshot_t *snapshot = new TcpMetricsSnapshot_t();
+
+    this->tcp_ctrlr->GetMetricsSnapshot(snapshot);
+    len = this->Format(snapshot);
+    delete snapshot;
+
+    if (this->fd < 0)
+        return;
+
+    // 文件以 O_APPEND 打开, 一次 write 写入完整的一行; UDP 报文不会部分发送
+    rc = this->is_udp ? send(this->fd, this->buffer, len, MSG_DONTWAIT | MSG_NOSIGNAL)
+                      : write(this->fd, this->buffer, len);
+
+    // UDP 对端未监听(ECONNREFUSED)或缓冲区满时丢弃本次快照
+    if (rc < 0 && !this->is_udp)
+        printf("%s() metrics write failed, error = %d\n", __FUNCTION__, errno);
+}
+
+static void *tcp_metrics_dumper_thread_fn(void *arg)
+{
+    TcpMetricsDumper *dumper = (TcpMetricsDumper *)arg;
+
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, nullptr);
+    pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, nullptr);
+
+    dumper->ThreadFn();
+    return nullptr;
+}
+
+/**
+ * @brief 线程函数: 每 interval_ms 输出一次快照, 只在睡眠时(取消点)响应取消
+ *
+ */
+void TcpMetricsDumper::ThreadFn()
+{
+    int cancel_state;
+    struct timespec ts;
+
+    ts.tv_sec = this->interval_ms / 1000;
+    ts.tv_nsec = (long)(this->interval_ms % 1000) * 1000 * 1000;
+
+    while (true)
+    {
+        nanosleep(&ts, nullptr);
+
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+        this->DumpOnce();
+        pthread_setcancelstate(cancel_state, nullptr);
+    }
+}
+
+void TcpMetricsDumper::Start()
+{
+    pthread_create(&this->thread, nullptr, tcp_metrics_dumper_thread_fn, (void *)this);
+}
+
+void TcpMetricsDumper::Stop()
+{
+    pthread_cancel(this->thread);
+    pthread_join(this->thread, nullptr);
+
+    this->DumpOnce();
+}
@@ -0,0 +1,138 @@
+#ifndef TCPMETRICS_H_
+#define TCPMETRICS_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <vector>
+
+#define TCP_HIST_SUB_BITS 3 // 每个 2 的幂区间分为 8 个子桶, 相对误差不超过 12.5%
+#define TCP_HIST_SUB_BUCKETS (1 << TCP_HIST_SUB_BITS)
+#define TCP_HIST_N_BUCKETS ((64 - TCP_HIST_SUB_BITS + 1) << TCP_HIST_SUB_BITS) // 覆盖整个 uint64_t 范围
+#define TCP_METRICS_DUMP_BUFFER_SIZE 65536 // 一次输出的最大长度(也是 UDP 报文的上限)
+
+class TcpServerController;
+
+/**
+ * @brief HDR 风格的对数-线性直方图(单位由使用者决定, 延迟统计使用纳秒)
+ *
+ * 小于 8 的值每个值一个桶, 之后每个 2 的幂区间等分为 8 个子桶; 记录只需几次位运算和一次原子加法,
+ * 可以被多个线程同时记录, 读取时得到的是近似一致的快照
+ */
+typedef struct TcpHistogram_
+{
+    uint64_t buckets[TCP_HIST_N_BUCKETS]; // 各桶的计数(原子访问)
+    uint64_t count;                       // 记录的值的个数(原子访问)
+    uint64_t sum;                         // 记录的值之和(原子访问)
+    uint64_t max;                         // 记录的最大值(原子访问)
+} TcpHistogram_t;
+
+/**
+ * @brief 一个 DRS 分片的计数器, 由该分片的 DRS 线程(接收)和任意发送线程更新, 所有字段原子访问
+ *
+ * 按 cache line 对齐, 不同分片的计数器不会互相干扰
+ */
+typedef struct TcpReactorMetrics_
+{
+    uint64_t bytes_recvd;      // 接收的字节数
+    uint64_t bytes_sent;       // 发送的字节数
+    uint64_t frames_recvd;     // 交给应用层(或线程池)的消息数
+    uint64_t frames_sent;      // 发送完成的消息数
+    uint64_t recv_calls;       // recv() 调用次数(io_uring: recv 完成事件数)
+    uint64_t send_calls;       // send()/sendmsg() 调用次数(io_uring: 提交的 sendmsg 请求数)
+    uint64_t wait_calls;       // epoll_wait()/select()/io_uring_enter() 调用次数
+    uint64_t partial_reads;    // 读取后分帧器中仍留有不完整消息的次数
+    uint64_t ring_hwm;         // 分帧器环形缓冲区积压字节数的最大值
+    uint64_t clients_added;    // 加入监听集合的客户端数
+    uint64_t clients_removed;  // 移出监听集合的客户端数
+    uint64_t protocol_errors;  // 分帧协议错误(消息头非法/消息过长)而断开的客户端数
+    uint64_t connect_attempts; // 主动连接发起的 connect() 次数
+    uint64_t connect_failures; // 主动连接失败(拒绝/超时/出错)的次数
+    TcpHistogram_t recv_to_cb; // 数据从 socket 读出到应用层回调开始的延迟(纳秒), 包括在线程池中排队的时间
+    TcpHistogram_t cmd_q_lat;  // DRS 命令队列 入队 -> 执行 的延迟(纳秒)
+} __attribute__((aligned(64))) TcpReactorMetrics_t;
+
+/**
+ * @brief 单个客户端的计数器快照, 见 TcpClient::GetMetrics()
+ */
+typedef struct TcpClientMetrics_
+{
+    uint64_t bytes_recvd;   // 接收的字节数
+    uint64_t bytes_sent;    // 发送的字节数
+    uint64_t frames_recvd;  // 交给应用层的消息数
+    uint64_t frames_sent;   // 发送完成的消息数
+    uint64_t recv_calls;    // recv() 调用次数
+    uint64_t send_calls;    // 发送使用的系统调用次数
+    uint64_t partial_reads; // 读取后留有不完整消息的次数
+    uint64_t ring_hwm;      // 分帧器环形缓冲区积压字节数的最大值
+    uint64_t queued_bytes;  // 发送队列中尚未发送的字节数
+} TcpClientMetrics_t;
+
+/**
+ * @brief 服务器的指标快照, 见 TcpServerController::GetMetricsSnapshot()
+ */
+typedef struct TcpMetricsSnapshot_
+{
+    uint64_t timestamp_ms;                     // CLOCK_REALTIME 毫秒
+    uint32_t n_clients;                        // 所有分片中的客户端数
+    TcpReactorMetrics_t total;                 // 所有分片之和(ring_hwm 取最大值)
+    std::vector<TcpReactorMetrics_t> reactors; // 每个 DRS 分片, 最后一项为不在任何分片中的客户端(例如 DRS 停止后的发送)
+    TcpHistogram_t ctrl_q_lat;                 // Controller 消息队列 入队 -> 处理 的延迟(纳秒)
+} TcpMetricsSnapshot_t;
+
+static inline void TcpMetricAdd(uint64_t *counter, uint64_t value)
+{
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t TcpMetricGet(const uint64_t *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief 只在新值更大时更新(高水位), 绝大多数调用只有一次读取
+ */
+static inline void TcpMetricMax(uint64_t *counter, uint64_t value)
+{
+    uint64_t cur = __atomic_load_n(counter, __ATOMIC_RELAXED);
+
+    while (value > cur && !__atomic_compare_exchange_n(counter, &cur, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+uint64_t TcpMetricsNowNs(); // CLOCK_MONOTONIC 纳秒, 用于延迟统计
+
+void TcpHistogramRecord(TcpHistogram_t *, uint64_t value);
+void TcpHistogramAccumulate(TcpHistogram_t *dst, const TcpHistogram_t *src); // dst += src(读取 src 的快照)
+uint64_t TcpHistogramPercentile(const TcpHistogram_t *, double percentile);  // 百分位数(桶的上界), 没有记录时返回 0
+void TcpReactorMetricsAccumulate(TcpReactorMetrics_t *dst, const TcpReactorMetrics_t *src);
+
+/**
+ * @brief 周期性地把指标快照以 JSON 行的格式写入本地文件(追加)或发送到 UDP 端点
+ *
+ * 目标格式: "file:/path/to/metrics.log" 或 "udp:127.0.0.1:9125"
+ */
+class TcpMetricsDumper
+{
+private:
+    TcpServerController *tcp_ctrlr; // 指标来源
+    uint32_t interval_ms;           // 输出间隔
+    int fd;                         // 文件或 UDP socket
+    bool is_udp;                    // fd 是 UDP socket(已 connect 到目标)
+    char *buffer;                   // 格式化缓冲区
+    pthread_t thread;               // 输出线程
+
+    int Format(const TcpMetricsSnapshot_t *); // 格式化为一行 JSON, 返回长度
+
+public:
+    TcpMetricsDumper(TcpServerController *, uint32_t interval_ms);
+    ~TcpMetricsDumper();
+
+    bool Open(const char *target); // 打开输出目标, 格式错误或打开失败时返回 false
+    void Start();                  // 启动输出线程
+    void Stop();                   // 停止输出线程, 停止前输出最后一次快照
+    void DumpOnce();               // 立即输出一次快照
+    void ThreadFn();               // 线程函数
+};
+
+#endif
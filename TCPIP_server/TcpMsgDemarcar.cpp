@@ -2,23 +2,81 @@
 #include <stdlib.h>
 #include <memory.h>
 #include <assert.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <new>
 
 #include "TcpClient.h"
 #include "TcpMsgDemarcar.h"
 #include "TcpMsgFixedSizeDemarcar.h"
 #include "TcpMsgVariableSizeDemarcar.h"
+#include "TcpMsgPatternDemarcar.h"
 #include "ByteCircularBuffer.h"
+#include "MirroredCircularBuffer.h"
+#include "TcpMemPool.h"
+#include "TcpMetrics.h"
+#include "TcpServerController.h"
 
-TcpMsgDemarcar::TcpMsgDemarcar(uint16_t circular_buffer_size)
+/**
+ * @brief 创建分帧器使用的环形缓冲区
+ *
+ * @param circular_buffer_size 环形缓冲区长度, bcb 最大 64 KiB, mcb 会向上取整为页大小
+ * @param ring_type 环形缓冲区实现, 镜像缓冲区创建失败时退回 bcb
+ */
+TcpMsgDemarcar::TcpMsgDemarcar(uint64_t circular_buffer_size, TcpMsgDemarcarRingType ring_type)
 {
-    this->bcb = BCBCreateNew(circular_buffer_size);
-    this->buffer = (unsigned char *)calloc(MAX_CLIENT_BUFFER_SIZE, sizeof(unsigned char));
+    this->ring_type = ring_type;
+    this->bcb = nullptr;
+    this->mcb = nullptr;
+    this->buffer = nullptr;
+    this->error = TCP_DEMARCAR_OK;
+
+    if (ring_type == TCP_DEMARCAR_RING_MIRRORED)
+    {
+        this->mcb = MCBCreateNew(circular_buffer_size);
+
+        if (this->mcb)
+            return;
+
+        printf("%s() Mirrored ring buffer unavailable, fall back to ByteCircularBuffer\n", __FUNCTION__);
+        this->ring_type = TCP_DEMARCAR_RING_BCB;
+    }
+
+    if (circular_buffer_size > UINT16_MAX)
+        circular_buffer_size = UINT16_MAX;
+
+    this->bcb = BCBCreateNew((uint16_t)circular_buffer_size);
+    // 跨越末尾的消息最长可以等于整个环形缓冲区
+    this->buffer = (unsigned char *)TcpMemPoolAlloc(circular_buffer_size);
 }
 
 TcpMsgDemarcar::TcpMsgDemarcar()
+    : TcpMsgDemarcar(DEFAULT_CBC_SIZE)
+{
+}
+
+TcpMsgDemarcar::~TcpMsgDemarcar()
+{
+    this->TcpMsgDemarcar::Destroy();
+}
+
+/**
+ * @brief 分帧器对象从内存池分配, 不同子类按各自的大小落入对应的大小类
+ *
+ */
+void *TcpMsgDemarcar::operator new(size_t size)
 {
-    this->bcb = BCBCreateNew(DEFAULT_CBC_SIZE);
-    this->buffer = (unsigned char *)calloc(MAX_CLIENT_BUFFER_SIZE, sizeof(unsigned char));
+    void *ptr = TcpMemPoolAlloc(size);
+
+    if (!ptr)
+        throw std::bad_alloc();
+
+    return ptr;
+}
+
+void TcpMsgDemarcar::operator delete(void *ptr)
+{
+    TcpMemPoolFree(ptr);
 }
 
 void TcpMsgDemarcar::Destroy()
@@ -29,21 +87,159 @@ void TcpMsgDemarcar::Destroy()
         this->bcb = nullptr;
     }
 
+    if (this->mcb)
+    {
+        MCBFree(this->mcb);
+        this->mcb = nullptr;
+    }
+
     if (this->buffer)
     {
-        free(this->buffer);
+        TcpMemPoolFree(this->buffer);
         this->buffer = nullptr;
     }
 }
 
-uint16_t TcpMsgDemarcar::GetTotalMsgSize()
+TcpMsgDemarcarRingType TcpMsgDemarcar::GetRingType()
+{
+    return this->ring_type;
+}
+
+TcpMsgDemarcarError TcpMsgDemarcar::GetError()
 {
+    return this->error;
+}
+
+uint64_t TcpMsgDemarcar::GetTotalMsgSize()
+{
+    return this->RingDataSize();
+}
+
+uint64_t TcpMsgDemarcar::RingDataSize()
+{
+    if (this->ring_type == TCP_DEMARCAR_RING_MIRRORED)
+        return this->mcb->current_size;
+
     return this->bcb->current_size;
 }
 
+uint64_t TcpMsgDemarcar::RingCapacity()
+{
+    if (this->ring_type == TCP_DEMARCAR_RING_MIRRORED)
+        return this->mcb->buffer_size;
+
+    return this->bcb->buffer_size;
+}
+
+/**
+ * @brief 原地读取环形缓冲区中从读位置偏移 offset 开始的 size 字节
+ *
+ * mcb 的数据总是连续的; bcb 的数据跨越缓冲区末尾时拷贝到 buffer 中
+ *
+ * @return unsigned char* 数据指针, 数据不足时返回 NULL
+ */
+unsigned char *TcpMsgDemarcar::RingPeek(uint64_t offset, uint64_t size)
+{
+    if (this->ring_type == TCP_DEMARCAR_RING_MIRRORED)
+        return MCBPeek(this->mcb, offset, size);
+
+    if (offset + size > this->bcb->current_size)
+        return NULL;
+
+    return BCBPeek(this->bcb, (uint16_t)offset, (uint16_t)size, this->buffer);
+}
+
+void TcpMsgDemarcar::RingConsume(uint64_t size)
+{
+    if (this->ring_type == TCP_DEMARCAR_RING_MIRRORED)
+        MCBConsume(this->mcb, size);
+    else
+        BCBConsume(this->bcb, (uint16_t)size);
+}
+
+bool TcpMsgDemarcar::RingWrite(unsigned char *data, uint64_t size)
+{
+    if (this->ring_type == TCP_DEMARCAR_RING_MIRRORED)
+        return MCBWrite(this->mcb, data, size) == size;
+
+    if (size > UINT16_MAX)
+        return false;
+
+    return BCBWrite(this->bcb, data, (uint16_t)size) == size;
+}
+
+/**
+ * @brief 获取环形缓冲区的空闲区域, 写入后调用 RingCommitWrite()
+ *
+ * @param iov 输出, 空闲区域, 按写入先后顺序排列
+ * @return int 区域段数: 0 表示缓冲区已满; mcb 总是 1 段; bcb 空闲区域跨越末尾时为 2 段
+ */
+int TcpMsgDemarcar::RingWritableRegions(struct iovec iov[2])
+{
+    uint64_t writable_size;
+
+    // 镜像缓冲区的空闲区域总是连续的一段
+    if (this->ring_type == TCP_DEMARCAR_RING_MIRRORED)
+    {
+        iov[0].iov_base = MCBWritePtr(this->mcb, &writable_size);
+        iov[0].iov_len = writable_size;
+        return writable_size ? 1 : 0;
+    }
+
+    return BCBWritableRegions(this->bcb, iov);
+}
+
+void TcpMsgDemarcar::RingCommitWrite(uint64_t size)
+{
+    if (this->ring_type == TCP_DEMARCAR_RING_MIRRORED)
+        MCBCommitWrite(this->mcb, size);
+    else
+        BCBCommitWrite(this->bcb, (uint16_t)size);
+}
+
+/**
+ * @brief 获取环形缓冲区中未处理数据所在的内存区域, 用于在缓冲区中原地扫描
+ *
+ * @param iov 输出, 数据区域, 按数据先后顺序排列
+ * @return int 区域段数: 0 表示没有数据; mcb 总是 1 段; bcb 数据跨越末尾时为 2 段
+ */
+int TcpMsgDemarcar::RingDataRegions(struct iovec iov[2])
+{
+    uint16_t leading_size;
+
+    if (this->RingDataSize() == 0)
+        return 0;
+
+    if (this->ring_type == TCP_DEMARCAR_RING_MIRRORED)
+    {
+        iov[0].iov_base = MCB(this->mcb, this->mcb->rear);
+        iov[0].iov_len = this->mcb->current_size;
+        return 1;
+    }
+
+    leading_size = this->bcb->buffer_size - this->bcb->rear;
+
+    iov[0].iov_base = BCB(this->bcb, this->bcb->rear);
+
+    if (this->bcb->current_size <= leading_size)
+    {
+        iov[0].iov_len = this->bcb->current_size;
+        return 1;
+    }
+
+    iov[0].iov_len = leading_size;
+    iov[1].iov_base = BCB(this->bcb, 0);
+    iov[1].iov_len = this->bcb->current_size - leading_size;
+    return 2;
+}
+
 void TcpMsgDemarcar::ProcessMsg(TcpClient *tcp_client, unsigned char *msg_recvd, uint16_t msg_size)
 {
-    assert(BCBWrite(this->bcb, msg_recvd, msg_size));
+    // 出现协议错误之后的数据没有意义
+    if (this->error != TCP_DEMARCAR_OK)
+        return;
+
+    assert(this->RingWrite(msg_recvd, msg_size));
 
     if (!this->IsBufferReadyToFlush())
         return;
@@ -51,21 +247,136 @@ void TcpMsgDemarcar::ProcessMsg(TcpClient *tcp_client, unsigned char *msg_recvd,
     this->ProcessClientMsg(tcp_client);
 }
 
+/**
+ * @brief 直接从客户端 socket 读入环形缓冲区的空闲区域(readv), 再对完整消息分帧
+ *
+ * 相比 ProcessMsg(), 数据不再经过 DRS 的公共接收缓冲区, 少一次拷贝;
+ * 分帧器交给应用层的消息在连续时直接指向环形缓冲区, 只有跨越缓冲区末尾时才拷贝.
+ *
+ * @param tcp_client 数据来源的客户端
+ * @return int 读取的字节数, 0 表示对端关闭, -1 表示出错(errno), 缓冲区已满时 errno = ENOBUFS,
+ *             协议错误(GetError())时 errno = EPROTO
+ */
+int TcpMsgDemarcar::RecvFromSocket(TcpClient *tcp_client)
+{
+    int n_iov;
+    ssize_t rcv_bytes;
+    uint64_t ring_level;
+    struct iovec iov[2];
+
+    n_iov = this->RingWritableRegions(iov);
+
+    // 缓冲区已满但仍不足一条完整消息, 消息长度超过了环形缓冲区
+    if (n_iov == 0)
+    {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    rcv_bytes = readv(tcp_client->comm_fd, iov, n_iov);
+
+    if (rcv_bytes <= 0)
+        return (int)rcv_bytes;
+
+    tcp_client->conn.recv_ns = TcpMetricsNowNs();
+    this->RingCommitWrite(rcv_bytes);
+    ring_level = this->RingDataSize();
+
+    if (this->IsBufferReadyToFlush())
+        this->ProcessClientMsg(tcp_client);
+
+    this->RecordRecvStats(tcp_client, ring_level);
+
+    if (this->error != TCP_DEMARCAR_OK)
+    {
+        errno = EPROTO;
+        return -1;
+    }
+
+    return (int)rcv_bytes;
+}
+
+/**
+ * @brief 将已经由内核放入 data 的接收数据拷贝到环形缓冲区并分帧(io_uring provided buffer)
+ *
+ * data 超过环形缓冲区的空闲空间时分多次拷贝, 每次拷贝后先处理完整消息腾出空间
+ *
+ * @param tcp_client 数据来源的客户端
+ * @param data 接收到的数据, 返回后调用方可以重用
+ * @param size 数据长度
+ * @return int 0 成功, -1 消息长度超过了环形缓冲区(errno = ENOBUFS)或协议错误(errno = EPROTO)
+ */
+int TcpMsgDemarcar::RecvFromBuffer(TcpClient *tcp_client, const unsigned char *data, uint64_t size)
+{
+    int i, n_iov;
+    uint64_t len, copied, ring_level = 0;
+    struct iovec iov[2];
+
+    while (size)
+    {
+        n_iov = this->RingWritableRegions(iov);
+
+        if (n_iov == 0)
+        {
+            errno = ENOBUFS;
+            return -1;
+        }
+
+        for (i = 0, copied = 0; i < n_iov && size; i++)
+        {
+            len = iov[i].iov_len < size ? iov[i].iov_len : size;
+            memcpy(iov[i].iov_base, data, len);
+            data += len;
+            size -= len;
+            copied += len;
+        }
+
+        this->RingCommitWrite(copied);
+
+        if (this->RingDataSize() > ring_level)
+            ring_level = this->RingDataSize();
+
+        if (this->IsBufferReadyToFlush())
+            this->ProcessClientMsg(tcp_client);
+
+        if (this->error != TCP_DEMARCAR_OK)
+        {
+            errno = EPROTO;
+            return -1;
+        }
+    }
+
+    this->RecordRecvStats(tcp_client, ring_level);
+
+    return 0;
+}
+
 TcpMsgDemarcar *TcpMsgDemarcar::InstantiateTcpMsgDemarcar(TcpMsgDemarcarType masg_type,
                                                           uint16_t fixed_size,
                                                           unsigned char start_pattern[],
                                                           uint8_t statr_pattern_size,
                                                           unsigned char end_pattern[],
-                                                          uint8_t end_pattern_size)
+                                                          uint8_t end_pattern_size,
+                                                          TcpMsgDemarcarRingType ring_type)
 {
     switch (masg_type)
     {
     case TCP_DEMARCAR_FIXED_SIZE:
-        return new TcpMsgFixedSizeDemarcar(fixed_size);
+        return new TcpMsgFixedSizeDemarcar(fixed_size, ring_type);
     case TCP_DEMARCAR_VARIABLE_SIZE:
-        return new TcpMsgVariableSizeDemarcar();
+        return new TcpMsgVariableSizeDemarcar(ring_type);
     case TCP_DEMARCAR_PATTERN:
-        return NULL;
+        // 至少需要结束标记才能确定消息边界
+        if (!end_pattern || !end_pattern_size)
+        {
+            printf("%s() Error : TCP_DEMARCAR_PATTERN requires an end pattern\n", __FUNCTION__);
+            return nullptr;
+        }
+        return new TcpMsgPatternDemarcar(start_pattern, statr_pattern_size, end_pattern, end_pattern_size, ring_type);
+    case TCP_DEMARCAR_LENGTH_PREFIX:
+        // 需要 TcpLengthPrefixConfig_t, 由 TcpServerController::CreateClientMsgDemarcar() 直接创建
+        printf("%s() Error : TCP_DEMARCAR_LENGTH_PREFIX is created with its config, not by this factory\n", __FUNCTION__);
+        return nullptr;
     case TCP_DEMARCAR_NONE:
         return nullptr;
 
@@ -74,4 +385,66 @@ TcpMsgDemarcar *TcpMsgDemarcar::InstantiateTcpMsgDemarcar(TcpMsgDemarcarType mas
     }
 
     return nullptr;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief 把一批完整消息交给 TcpServerController, 模板分帧器通过它交付消息, 不需要包含控制器的头文件
+ *
+ * @param tcp_client 消息来源的客户端
+ * @param spans 消息, 只在本次调用期间有效
+ * @param n_spans 消息数
+ */
+void TcpMsgDemarcar::DeliverBatch(TcpClient *tcp_client, TcpMsgSpan_t *spans, uint32_t n_spans)
+{
+    tcp_client->tcp_ctrlr->ClientMsgBatchRecvd(tcp_client, spans, n_spans);
+}
+
+/**
+ * @brief 把大消息的一个片段交给 TcpServerController(流式交付)
+ *
+ * @param tcp_client 消息来源的客户端
+ * @param chunk 片段数据, 只在本次调用期间有效
+ * @param chunk_size 片段长度
+ * @param frame_offset 片段在整条消息(包括消息头)中的偏移
+ * @param frame_size 整条消息的长度
+ */
+void TcpMsgDemarcar::DeliverChunk(TcpClient *tcp_client, unsigned char *chunk, uint16_t chunk_size,
+                                  uint64_t frame_offset, uint64_t frame_size)
+{
+    tcp_client->tcp_ctrlr->ClientMsgChunkRecvd(tcp_client, chunk, chunk_size, frame_offset, frame_size);
+}
+
+/**
+ * @brief 通知 TcpServerController 客户端的协议错误, 之后 RecvFromSocket()/RecvFromBuffer() 返回 EPROTO, DRS 断开客户端
+ *
+ * @param tcp_client 出错的客户端
+ * @param error 错误类型
+ * @param frame_size 出错的消息头中的消息长度(消息头非法时为 0)
+ */
+void TcpMsgDemarcar::DeliverError(TcpClient *tcp_client, TcpMsgDemarcarError error, uint64_t frame_size)
+{
+    tcp_client->tcp_ctrlr->ClientProtocolError(tcp_client, error, frame_size);
+}
+
+/**
+ * @brief (DRS 线程) 一次读取处理完之后更新统计: 环形缓冲区高水位, 以及是否留下了不完整的消息
+ *
+ * @param tcp_client 数据来源的客户端
+ * @param ring_level 本次读取写入之后(分帧之前)环形缓冲区中的字节数
+ */
+void TcpMsgDemarcar::RecordRecvStats(TcpClient *tcp_client, uint64_t ring_level)
+{
+    TcpReactorMetrics_t *metrics = tcp_client->tcp_ctrlr->GetClientMetricsShard(tcp_client);
+
+    // 客户端的接收计数器只由监听它的 DRS 线程修改
+    if (ring_level > tcp_client->conn.ring_hwm)
+        tcp_client->conn.ring_hwm = ring_level;
+
+    TcpMetricMax(&metrics->ring_hwm, ring_level);
+
+    if (this->RingDataSize())
+    {
+        tcp_client->conn.partial_reads++;
+        TcpMetricAdd(&metrics->partial_reads, 1);
+    }
+}
@@ -2,18 +2,74 @@
 #define TCPMSGDEMARCAR_H_
 
 #include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
 #define DEFAULT_CBC_SIZE (10240)
+#define TCP_MSG_BATCH_MAX 64 // 一次批量交付的最大消息数
 
 typedef enum
 {
     TCP_DEMARCAR_NONE,          // 不做分帧
     TCP_DEMARCAR_FIXED_SIZE,    // 固定长度分帧
     TCP_DEMARCAR_VARIABLE_SIZE, // 变长分帧
-    TCP_DEMARCAR_PATTERN        // 根据起始/结束模式匹配分帧
+    TCP_DEMARCAR_PATTERN,       // 根据起始/结束模式匹配分帧
+    TCP_DEMARCAR_LENGTH_PREFIX  // 可配置的长度前缀分帧(TcpLengthPrefixConfig_t)
 } TcpMsgDemarcarType;
 
+typedef enum
+{
+    TCP_DEMARCAR_RING_BCB,     // ByteCircularBuffer, 跨越末尾的消息需要拷贝到临时缓冲区(最大 64 KiB)
+    TCP_DEMARCAR_RING_MIRRORED // MirroredCircularBuffer, memfd 双重映射, 消息总是连续的, 可原地解析
+} TcpMsgDemarcarRingType;
+
+/**
+ * @brief 长度头的字节序
+ */
+typedef enum
+{
+    TCP_FRAME_LITTLE_ENDIAN,
+    TCP_FRAME_BIG_ENDIAN // 网络字节序
+} TcpFrameByteOrder;
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define TCP_FRAME_HOST_ORDER TCP_FRAME_BIG_ENDIAN
+#else
+#define TCP_FRAME_HOST_ORDER TCP_FRAME_LITTLE_ENDIAN
+#endif
+
+/**
+ * @brief 分帧器遇到的协议错误, 出错后分帧器丢弃之后的所有数据, DRS 断开客户端
+ */
+typedef enum
+{
+    TCP_DEMARCAR_OK,                 // 没有错误
+    TCP_DEMARCAR_ERR_BAD_HEADER,     // 消息头非法(包括长度头的长度小于长度头本身)
+    TCP_DEMARCAR_ERR_FRAME_TOO_LARGE // 消息长度超过 max_frame_size, 或超过环形缓冲区而应用层没有注册流式回调
+} TcpMsgDemarcarError;
+
+/**
+ * @brief TCP_DEMARCAR_LENGTH_PREFIX 的配置: | 长度(header_size 字节, byte_order 字节序) | 消息体 |
+ */
+typedef struct TcpLengthPrefixConfig_
+{
+    uint8_t header_size;          // 长度头字节数, 1/2/4/8
+    TcpFrameByteOrder byte_order; // 长度头的字节序
+    bool includes_header;         // 长度的值是否包括长度头本身
+    uint64_t max_frame_size;      // 消息(包括长度头)的最大长度, 0 表示不限制
+} TcpLengthPrefixConfig_t;
+
+/**
+ * @brief 一条完整消息的位置, 通常直接指向分帧器的环形缓冲区, 只在回调期间有效
+ */
+typedef struct TcpMsgSpan_
+{
+    unsigned char *data;
+    uint16_t size;
+} TcpMsgSpan_t;
+
 class TcpClient;
 typedef struct ByteCircularBuffer_ ByteCircularBuffer_t;
+typedef struct MirroredCircularBuffer_ MirroredCircularBuffer_t;
 
 /**
  * @brief TCP 消息分帧器(Message Demarcar)
@@ -24,8 +80,27 @@ class TcpMsgDemarcar
 {
 private:
 protected:
-    ByteCircularBuffer_t *bcb; // 字节环形缓冲区, 用于存储未解析完的字节流
-    unsigned char *buffer;     // 临时缓冲区, 存放提取出的完整消息
+    TcpMsgDemarcarRingType ring_type; // 使用的环形缓冲区实现
+    ByteCircularBuffer_t *bcb;        // 字节环形缓冲区, 用于存储未解析完的字节流(TCP_DEMARCAR_RING_BCB)
+    MirroredCircularBuffer_t *mcb;    // 镜像环形缓冲区(TCP_DEMARCAR_RING_MIRRORED)
+    unsigned char *buffer;            // 临时缓冲区, 存放跨越 bcb 末尾的完整消息
+    TcpMsgDemarcarError error;        // 协议错误, 出错后不再分帧
+
+    // 子类通过以下接口访问环形缓冲区, 不关心具体实现
+    uint64_t RingDataSize();                                 // 环形缓冲区中未处理的字节数
+    unsigned char *RingPeek(uint64_t offset, uint64_t size); // 原地读取(不删除), 数据不足返回 NULL
+    void RingConsume(uint64_t size);                         // 删除已处理的字节
+    bool RingWrite(unsigned char *data, uint64_t size);      // 写入数据, 空间不足返回 false
+    int RingDataRegions(struct iovec iov[2]);                // 未处理数据所在的内存区域(bcb 跨越末尾时为两段)
+    int RingWritableRegions(struct iovec iov[2]);            // 空闲区域, 写入后调用 RingCommitWrite()
+    void RingCommitWrite(uint64_t size);                     // 提交写入空闲区域的字节
+    uint64_t RingCapacity();                                 // 环形缓冲区的容量
+    void RecordRecvStats(TcpClient *, uint64_t ring_level);  // 更新环形缓冲区高水位和不完整读取计数
+
+    static void DeliverBatch(TcpClient *, TcpMsgSpan_t *spans, uint32_t n_spans); // 把一批完整消息交给 TcpServerController
+    static void DeliverChunk(TcpClient *, unsigned char *chunk, uint16_t chunk_size,
+                             uint64_t frame_offset, uint64_t frame_size);           // 把大消息的一个片段交给 TcpServerController
+    static void DeliverError(TcpClient *, TcpMsgDemarcarError, uint64_t frame_size); // 通知 TcpServerController 协议错误
 
 public:
     /**
@@ -37,25 +112,34 @@ public:
      * @param start_pattern_size  起始标记长度
      * @param end_pattern         结束标记（模式匹配模式使用）
      * @param end_pattern_size    结束标记长度
+     * @param ring_type           环形缓冲区实现
      */
     static TcpMsgDemarcar *InstantiateTcpMsgDemarcar(TcpMsgDemarcarType,
                                                      uint16_t fixed_size,
                                                      unsigned char start_pattern[],
                                                      uint8_t start_pattern_size,
                                                      unsigned char end_pattern[],
-                                                     uint8_t end_pattern_size);
+                                                     uint8_t end_pattern_size,
+                                                     TcpMsgDemarcarRingType ring_type = TCP_DEMARCAR_RING_BCB);
 
     // to be implemented by derieved classes
     virtual bool IsBufferReadyToFlush() = 0;                  // 纯虚函数, 判断环形缓冲区中的字节是否足够组成一个完整消息
     virtual void ProcessClientMsg(TcpClient *tcp_client) = 0; // 纯虚函数, 解析环形缓冲区中的数据, 并处理完整消息
 
-    TcpMsgDemarcar(uint16_t circular_buffer_len);
+    TcpMsgDemarcar(uint64_t circular_buffer_len, TcpMsgDemarcarRingType ring_type = TCP_DEMARCAR_RING_BCB);
     TcpMsgDemarcar();
-    ~TcpMsgDemarcar();
+    virtual ~TcpMsgDemarcar(); // 释放环形缓冲区, 通过基类指针 delete 时也会调用子类的析构函数
+
+    static void *operator new(size_t size); // 从内存池分配
+    static void operator delete(void *ptr); // 放回内存池
 
-    uint16_t GetTotalMsgSize();                                                // 返回当前完整消息的长度
+    uint64_t GetTotalMsgSize();                                                // 返回当前完整消息的长度
     void Destroy();                                                            // 删除对象
     void ProcessMsg(TcpClient *, unsigned char *msg_recvd, uint16_t msg_size); // 将接收到的消息写入环形缓冲区
+    int RecvFromSocket(TcpClient *);                                           // 直接从客户端 socket 读入环形缓冲区并分帧
+    int RecvFromBuffer(TcpClient *, const unsigned char *data, uint64_t size); // 拷贝已经收到的数据(io_uring provided buffer)并分帧
+    TcpMsgDemarcarRingType GetRingType();                                      // 返回实际使用的环形缓冲区实现
+    TcpMsgDemarcarError GetError();                                            // 返回分帧器遇到的协议错误
 };
 
 #endif
\ No newline at end of file
@@ -3,21 +3,21 @@
 
 #include <stdint.h>
 #include "TcpMsgDemarcar.h"
+#include "TcpMsgFramedDemarcar.h"
 
 class TcpClient;
-class TcpMsgFixedSizeDemarcar : TcpMsgDemarcar
+
+/**
+ * @brief 固定长度分帧, 分帧逻辑见 TcpMsgFramedDemarcar
+ */
+class TcpMsgFixedSizeDemarcar : public TcpMsgFramedDemarcar<TcpFixedSizeFraming>
 {
 private:
-    uint16_t msg_fixed_size;
-
 public:
-    bool IsBufferReadyToFlush() override;
-    void ProcessClientMsg(TcpClient *) override;
-
-    TcpMsgFixedSizeDemarcar(uint16_t fixed_size);
+    TcpMsgFixedSizeDemarcar(uint16_t fixed_size, TcpMsgDemarcarRingType ring_type = TCP_DEMARCAR_RING_BCB);
     ~TcpMsgFixedSizeDemarcar();
 
     void Destroy();
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,337 @@
+#ifndef TCPMSGFRAMEDDEMARCAR_H_
+#define TCPMSGFRAMEDDEMARCAR_H_
+
+#include <stdint.h>
+#include <string.h>
+#include "TcpMsgDemarcar.h"
+
+class TcpClient;
+
+static inline uint8_t TcpFrameByteSwap(uint8_t value) { return value; }
+static inline uint16_t TcpFrameByteSwap(uint16_t value) { return __builtin_bswap16(value); }
+static inline uint32_t TcpFrameByteSwap(uint32_t value) { return __builtin_bswap32(value); }
+static inline uint64_t TcpFrameByteSwap(uint64_t value) { return __builtin_bswap64(value); }
+
+/**
+ * @brief 读取 order 字节序的长度头
+ */
+template <typename LenT>
+static inline uint64_t TcpFrameReadLength(const unsigned char *hdr, TcpFrameByteOrder order)
+{
+    LenT len;
+
+    memcpy(&len, hdr, sizeof(LenT));
+
+    if (order != TCP_FRAME_HOST_ORDER)
+        len = TcpFrameByteSwap(len);
+
+    return len;
+}
+
+/**
+ * @brief 长度头的值转换为整条消息(包括长度头)的长度
+ *
+ * @return uint64_t 消息长度, 0 表示长度头非法(长度小于长度头本身, 或加上长度头后溢出)
+ */
+static inline uint64_t TcpFrameSizeFromLength(uint64_t len, uint32_t header_size, bool includes_header)
+{
+    if (!includes_header)
+        return len > UINT64_MAX - header_size ? 0 : len + header_size;
+
+    return len < header_size ? 0 : len;
+}
+
+/**
+ * @brief 固定长度分帧策略, 没有消息头
+ */
+class TcpFixedSizeFraming
+{
+public:
+    static const uint32_t header_size = 0;
+    uint16_t frame_size; // 每条消息的长度
+
+    TcpFixedSizeFraming(uint16_t frame_size = 1) : frame_size(frame_size) {}
+
+    uint64_t FrameSize(const unsigned char *) const
+    {
+        return this->frame_size;
+    }
+};
+
+/**
+ * @brief 长度前缀分帧策略: | 长度(LenT, ORDER 字节序) | 消息体 |
+ *
+ * @tparam LenT 长度字段类型, uint8_t/uint16_t/uint32_t/uint64_t
+ * @tparam ORDER 长度字段的字节序
+ * @tparam INCLUDES_HEADER 长度字段的值是否包括长度字段本身
+ */
+template <typename LenT, TcpFrameByteOrder ORDER, bool INCLUDES_HEADER>
+class TcpLengthPrefixFraming
+{
+public:
+    static const uint32_t header_size = sizeof(LenT);
+
+    /**
+     * @brief 根据消息头计算整条消息(包括消息头)的长度
+     *
+     * @return uint64_t 消息长度, 0 表示消息头非法(长度小于消息头本身)
+     */
+    uint64_t FrameSize(const unsigned char *hdr) const
+    {
+        return TcpFrameSizeFromLength(TcpFrameReadLength<LenT>(hdr, ORDER), sizeof(LenT), INCLUDES_HEADER);
+    }
+};
+
+/**
+ * @brief 运行时配置的长度前缀分帧策略(TcpLengthPrefixConfig_t), 新连接按服务器配置创建
+ *
+ * 长度头的宽度在运行时确定, 每条消息多一次可预测的分支
+ */
+class TcpLengthPrefixRuntimeFraming
+{
+public:
+    uint32_t header_size;         // 长度头字节数, 1/2/4/8
+    TcpFrameByteOrder byte_order; // 长度头的字节序
+    bool includes_header;         // 长度的值是否包括长度头本身
+
+    TcpLengthPrefixRuntimeFraming(uint32_t header_size = 2, TcpFrameByteOrder byte_order = TCP_FRAME_HOST_ORDER,
+                                  bool includes_header = true)
+        : header_size(header_size), byte_order(byte_order), includes_header(includes_header) {}
+
+    uint64_t FrameSize(const unsigned char *hdr) const
+    {
+        uint64_t len;
+
+        switch (this->header_size)
+        {
+        case 1:
+            len = TcpFrameReadLength<uint8_t>(hdr, this->byte_order);
+            break;
+        case 2:
+            len = TcpFrameReadLength<uint16_t>(hdr, this->byte_order);
+            break;
+        case 4:
+            len = TcpFrameReadLength<uint32_t>(hdr, this->byte_order);
+            break;
+        default:
+            len = TcpFrameReadLength<uint64_t>(hdr, this->byte_order);
+            break;
+        }
+
+        return TcpFrameSizeFromLength(len, this->header_size, this->includes_header);
+    }
+};
+
+/**
+ * @brief 分帧策略在编译期确定的分帧器
+ *
+ * 1.ParseFrames() 不经过虚函数: 每条消息只读一次消息头, 消息在环形缓冲区中连续时原地交付,
+ *   只有跨越 bcb 末尾的那一条拷贝到 buffer(一次扫描的数据少于整个环形缓冲区, 最多跨越一次末尾)
+ *
+ * 2.完整消息按批(最多 TCP_MSG_BATCH_MAX 条)交给 sink.Frames(spans, n_spans), 返回之后才删除这一批数据,
+ *   因此一批中所有 span 在回调期间同时有效
+ *
+ * 3.超过 stream_threshold(环形缓冲区容量, 且不超过 UINT16_MAX)的消息不等待完整, 启用流式交付时
+ *   按到达的数据逐段交给 sink.Chunk(), 每段直接指向环形缓冲区, 环形缓冲区不需要容纳整条消息
+ *
+ * 4.消息头非法, 超过 max_frame_size, 或者超过 stream_threshold 而没有启用流式交付时调用 sink.Error(),
+ *   记录协议错误并丢弃之后的所有数据
+ *
+ * 5.IsBufferReadyToFlush()/ProcessClientMsg() 只是适配 TcpMsgDemarcar 虚接口的薄封装,
+ *   每次读取只有这两次虚调用, 与消息数无关
+ *
+ * @tparam Framing 分帧策略, 提供 header_size 和 FrameSize(hdr)
+ */
+template <typename Framing>
+class TcpMsgFramedDemarcar : public TcpMsgDemarcar
+{
+protected:
+    Framing framing;           // 分帧策略
+    uint64_t max_frame_size;   // 消息的最大长度, 超过时为协议错误
+    uint64_t stream_threshold; // 超过此长度的消息流式交付
+    bool stream_frames;        // 是否启用流式交付, 不启用时超过 stream_threshold 的消息为协议错误
+    uint64_t stream_frame_size; // 正在流式交付的消息的长度
+    uint64_t stream_remaining;  // 正在流式交付的消息尚未交付的字节数, 0 表示没有
+
+    /**
+     * @brief 交给 TcpServerController 的 sink(线程池或应用层回调)
+     */
+    class ControllerSink
+    {
+    public:
+        TcpClient *tcp_client;
+
+        ControllerSink(TcpClient *tcp_client) : tcp_client(tcp_client) {}
+
+        void Frames(TcpMsgSpan_t *spans, uint32_t n_spans)
+        {
+            TcpMsgDemarcar::DeliverBatch(this->tcp_client, spans, n_spans);
+        }
+
+        void Chunk(unsigned char *chunk, uint16_t chunk_size, uint64_t frame_offset, uint64_t frame_size)
+        {
+            TcpMsgDemarcar::DeliverChunk(this->tcp_client, chunk, chunk_size, frame_offset, frame_size);
+        }
+
+        void Error(TcpMsgDemarcarError error, uint64_t frame_size)
+        {
+            TcpMsgDemarcar::DeliverError(this->tcp_client, error, frame_size);
+        }
+    };
+
+    /**
+     * @brief 消息头(已经在缓冲区中)所描述的消息不能按普通消息交付: 非法, 超过限制, 或需要流式交付
+     */
+    bool IsOversizedFrame(uint64_t frame_size)
+    {
+        return frame_size == 0 || frame_size > this->max_frame_size || frame_size > this->stream_threshold;
+    }
+
+public:
+    TcpMsgFramedDemarcar(const Framing &framing, TcpMsgDemarcarRingType ring_type = TCP_DEMARCAR_RING_BCB)
+        : TcpMsgDemarcar(DEFAULT_CBC_SIZE, ring_type), framing(framing)
+    {
+        this->max_frame_size = UINT64_MAX;
+        this->stream_threshold = this->RingCapacity() < UINT16_MAX ? this->RingCapacity() : UINT16_MAX;
+        this->stream_frames = false;
+        this->stream_frame_size = 0;
+        this->stream_remaining = 0;
+    }
+
+    /**
+     * @brief 设置消息长度限制, 在交付第一条消息之前调用
+     *
+     * @param max_frame_size 消息(包括消息头)的最大长度, 0 表示不限制
+     * @param stream_frames 超过环形缓冲区的消息是否流式交付(sink.Chunk)
+     */
+    void SetFrameLimits(uint64_t max_frame_size, bool stream_frames)
+    {
+        this->max_frame_size = max_frame_size ? max_frame_size : UINT64_MAX;
+        this->stream_frames = stream_frames;
+    }
+
+    /**
+     * @brief 取出环形缓冲区中所有完整的消息, 按批交给 sink; 大消息按片段交给 sink
+     *
+     * 协议错误之后丢弃缓冲区中的所有数据, 不再分帧
+     *
+     * @param sink 对象, 提供 Frames(spans, n_spans), Chunk(chunk, chunk_size, frame_offset, frame_size)
+     *             和 Error(error, frame_size)
+     */
+    template <typename Sink>
+    void ParseFrames(Sink &sink)
+    {
+        TcpMsgSpan_t spans[TCP_MSG_BATCH_MAX];
+        uint32_t n_spans = 0;
+        uint64_t offset = 0, frame_size, chunk_size;
+        uint64_t data_size = this->RingDataSize();
+        struct iovec iov[2];
+
+        while (this->error == TCP_DEMARCAR_OK)
+        {
+            // 正在流式交付的大消息: 交付环形缓冲区中连续的一段, 不拷贝
+            if (this->stream_remaining)
+            {
+                if (!this->RingDataRegions(iov))
+                    return;
+
+                chunk_size = iov[0].iov_len;
+
+                if (chunk_size > this->stream_remaining)
+                    chunk_size = this->stream_remaining;
+
+                if (chunk_size > UINT16_MAX)
+                    chunk_size = UINT16_MAX;
+
+                sink.Chunk((unsigned char *)iov[0].iov_base, (uint16_t)chunk_size,
+                           this->stream_frame_size - this->stream_remaining, this->stream_frame_size);
+                this->RingConsume(chunk_size);
+                this->stream_remaining -= chunk_size;
+                data_size -= chunk_size;
+                continue;
+            }
+
+            if (data_size - offset < this->framing.header_size + (this->framing.header_size ? 0 : 1))
+                break;
+
+            frame_size = this->framing.FrameSize(this->framing.header_size ? this->RingPeek(offset, this->framing.header_size) : NULL);
+
+            if (this->IsOversizedFrame(frame_size))
+            {
+                // 先交付之前的完整消息, 保证顺序
+                if (n_spans)
+                {
+                    sink.Frames(spans, n_spans);
+                    this->RingConsume(offset);
+                    data_size -= offset;
+                    offset = 0;
+                    n_spans = 0;
+                }
+
+                if (frame_size == 0)
+                    this->error = TCP_DEMARCAR_ERR_BAD_HEADER;
+                else if (frame_size > this->max_frame_size || !this->stream_frames)
+                    this->error = TCP_DEMARCAR_ERR_FRAME_TOO_LARGE;
+
+                if (this->error != TCP_DEMARCAR_OK)
+                {
+                    sink.Error(this->error, frame_size);
+                    this->RingConsume(data_size);
+                    return;
+                }
+
+                this->stream_frame_size = frame_size;
+                this->stream_remaining = frame_size;
+                continue;
+            }
+
+            if (frame_size > data_size - offset)
+                break;
+
+            spans[n_spans].data = this->RingPeek(offset, frame_size);
+            spans[n_spans].size = (uint16_t)frame_size;
+            n_spans++;
+            offset += frame_size;
+
+            if (n_spans == TCP_MSG_BATCH_MAX)
+            {
+                sink.Frames(spans, n_spans);
+                this->RingConsume(offset);
+                data_size -= offset;
+                offset = 0;
+                n_spans = 0;
+            }
+        }
+
+        if (n_spans)
+        {
+            sink.Frames(spans, n_spans);
+            this->RingConsume(offset);
+        }
+    }
+
+    bool IsBufferReadyToFlush() override
+    {
+        uint64_t frame_size, data_size = this->RingDataSize();
+
+        if (data_size < this->framing.header_size || data_size == 0 || this->error != TCP_DEMARCAR_OK)
+            return false;
+
+        if (this->stream_remaining)
+            return true;
+
+        frame_size = this->framing.FrameSize(this->framing.header_size ? this->RingPeek(0, this->framing.header_size) : NULL);
+
+        return frame_size <= data_size || this->IsOversizedFrame(frame_size);
+    }
+
+    void ProcessClientMsg(TcpClient *tcp_client) override
+    {
+        // 把消息批交给 TcpServerController(线程池或应用层的批量/单条回调)
+        ControllerSink sink(tcp_client);
+
+        this->ParseFrames(sink);
+    }
+};
+
+#endif
@@ -0,0 +1,33 @@
+#include <assert.h>
+#include "TcpMsgDemarcar.h"
+#include "TcpMsgLengthPrefixDemarcar.h"
+#include "TcpClient.h"
+#include "TcpServerController.h"
+
+// 分帧逻辑见 TcpMsgFramedDemarcar
+
+/**
+ * @brief 按配置创建长度前缀分帧器
+ *
+ * @param config 长度头的宽度/字节序/是否包括长度头, 以及消息的最大长度
+ * @param stream_frames 超过环形缓冲区的消息是否流式交付(应用层注册了 client_msg_chunk_recvd)
+ * @param ring_type 环形缓冲区实现
+ */
+TcpMsgLengthPrefixDemarcar::TcpMsgLengthPrefixDemarcar(const TcpLengthPrefixConfig_t *config, bool stream_frames,
+                                                       TcpMsgDemarcarRingType ring_type)
+    : TcpMsgFramedDemarcar<TcpLengthPrefixRuntimeFraming>(
+          TcpLengthPrefixRuntimeFraming(config->header_size, config->byte_order, config->includes_header), ring_type)
+{
+    assert(config->header_size == 1 || config->header_size == 2 || config->header_size == 4 || config->header_size == 8);
+
+    this->SetFrameLimits(config->max_frame_size, stream_frames);
+}
+
+TcpMsgLengthPrefixDemarcar::~TcpMsgLengthPrefixDemarcar()
+{
+}
+
+void TcpMsgLengthPrefixDemarcar::Destroy()
+{
+    this->TcpMsgDemarcar::Destroy();
+}
@@ -0,0 +1,21 @@
+#ifndef TCPMSGLENGTHPREFIXDEMARCAR_H_
+#define TCPMSGLENGTHPREFIXDEMARCAR_H_
+
+#include <stdint.h>
+
+#include "TcpMsgDemarcar.h"
+#include "TcpMsgFramedDemarcar.h"
+
+// | 长度(1/2/4/8 字节, 大端或小端, 可以包括长度头本身) | 消息体 |, 配置见 TcpLengthPrefixConfig_t
+
+class TcpClient;
+class TcpMsgLengthPrefixDemarcar : public TcpMsgFramedDemarcar<TcpLengthPrefixRuntimeFraming>
+{
+private:
+public:
+    TcpMsgLengthPrefixDemarcar(const TcpLengthPrefixConfig_t *config, bool stream_frames,
+                               TcpMsgDemarcarRingType ring_type = TCP_DEMARCAR_RING_BCB);
+    ~TcpMsgLengthPrefixDemarcar();
+    void Destroy();
+};
+#endif
@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <assert.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "TcpMsgDemarcar.h"
+#include "TcpMsgPatternDemarcar.h"
+#include "TcpClient.h"
+#include "TcpServerController.h"
+
+/**
+ * @brief 标量查找: memchr 定位首字节, 再比较剩余字节
+ */
+static const unsigned char *PatternScanScalar(const unsigned char *hay, uint64_t len,
+                                              const unsigned char *pattern, uint8_t pattern_size)
+{
+    const unsigned char *p = hay;
+    const unsigned char *last = hay + len - pattern_size; // 最后一个可能的起始位置
+
+    while (p <= last)
+    {
+        p = (const unsigned char *)memchr(p, pattern[0], last - p + 1);
+
+        if (!p)
+            return NULL;
+
+        if (memcmp(p + 1, pattern + 1, pattern_size - 1) == 0)
+            return p;
+
+        p++;
+    }
+
+    return NULL;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/**
+ * @brief SSE2 查找: 每次比较 16 个候选位置的首字节和尾字节, 两者都匹配的位置再用 memcmp 确认
+ *
+ * @return const unsigned char* 第一个匹配位置, 没有找到返回 NULL
+ */
+__attribute__((target("sse2"))) static const unsigned char *PatternScanSSE2(const unsigned char *hay, uint64_t len,
+                                                                            const unsigned char *pattern, uint8_t pattern_size)
+{
+    uint64_t i = 0;
+    uint32_t mask;
+    const __m128i first = _mm_set1_epi8((char)pattern[0]);
+    const __m128i last = _mm_set1_epi8((char)pattern[pattern_size - 1]);
+
+    // 保证 hay[i + pattern_size - 1 + 15] 不越界
+    for (; i + pattern_size - 1 + 16 <= len; i += 16)
+    {
+        __m128i block_first = _mm_loadu_si128((const __m128i *)(hay + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i *)(hay + i + pattern_size - 1));
+
+        mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first),
+                                               _mm_cmpeq_epi8(block_last, last)));
+
+        while (mask)
+        {
+            uint32_t bit = __builtin_ctz(mask);
+
+            if (memcmp(hay + i + bit + 1, pattern + 1, pattern_size - 2) == 0)
+                return hay + i + bit;
+
+            mask &= mask - 1;
+        }
+    }
+
+    if (i + pattern_size > len)
+        return NULL;
+
+    return PatternScanScalar(hay + i, len - i, pattern, pattern_size);
+}
+
+/**
+ * @brief AVX2 查找, 与 PatternScanSSE2() 相同, 每次比较 32 个候选位置
+ */
+__attribute__((target("avx2"))) static const unsigned char *PatternScanAVX2(const unsigned char *hay, uint64_t len,
+                                                                            const unsigned char *pattern, uint8_t pattern_size)
+{
+    uint64_t i = 0;
+    uint32_t mask;
+    const __m256i first = _mm256_set1_epi8((char)pattern[0]);
+    const __m256i last = _mm256_set1_epi8((char)pattern[pattern_size - 1]);
+
+    for (; i + pattern_size - 1 + 32 <= len; i += 32)
+    {
+        __m256i block_first = _mm256_loadu_si256((const __m256i *)(hay + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i *)(hay + i + pattern_size - 1));
+
+        mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(block_first, first),
+                                                               _mm256_cmpeq_epi8(block_last, last)));
+
+        while (mask)
+        {
+            uint32_t bit = __builtin_ctz(mask);
+
+            if (memcmp(hay + i + bit + 1, pattern + 1, pattern_size - 2) == 0)
+                return hay + i + bit;
+
+            mask &= mask - 1;
+        }
+    }
+
+    if (i + pattern_size > len)
+        return NULL;
+
+    return PatternScanSSE2(hay + i, len - i, pattern, pattern_size);
+}
+
+#endif
+
+/**
+ * @brief 在连续内存 hay[0, len) 中查找 pattern, 按 CPU 支持的指令集选择实现
+ *
+ * @return const unsigned char* 第一个匹配位置, 没有找到返回 NULL
+ */
+static const unsigned char *PatternScan(const unsigned char *hay, uint64_t len,
+                                        const unsigned char *pattern, uint8_t pattern_size)
+{
+    if (len < pattern_size)
+        return NULL;
+
+    // 单字节标记(例如 '\n'), libc 的 memchr 已经是向量化实现
+    if (pattern_size == 1)
+        return (const unsigned char *)memchr(hay, pattern[0], len);
+
+#if defined(__x86_64__) || defined(__i386__)
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+
+    if (has_avx2)
+        return PatternScanAVX2(hay, len, pattern, pattern_size);
+
+    return PatternScanSSE2(hay, len, pattern, pattern_size);
+#else
+    return PatternScanScalar(hay, len, pattern, pattern_size);
+#endif
+}
+
+TcpMsgPatternDemarcar::TcpMsgPatternDemarcar(unsigned char start_pattern[],
+                                             uint8_t start_pattern_size,
+                                             unsigned char end_pattern[],
+                                             uint8_t end_pattern_size,
+                                             TcpMsgDemarcarRingType ring_type)
+    : TcpMsgDemarcar(DEFAULT_CBC_SIZE, ring_type)
+{
+    assert(end_pattern && end_pattern_size);
+
+    this->start_pattern = nullptr;
+    this->start_pattern_size = 0;
+
+    if (start_pattern && start_pattern_size)
+    {
+        this->start_pattern = (unsigned char *)calloc(start_pattern_size, sizeof(unsigned char));
+        memcpy(this->start_pattern, start_pattern, start_pattern_size);
+        this->start_pattern_size = start_pattern_size;
+    }
+
+    this->end_pattern = (unsigned char *)calloc(end_pattern_size, sizeof(unsigned char));
+    memcpy(this->end_pattern, end_pattern, end_pattern_size);
+    this->end_pattern_size = end_pattern_size;
+
+    this->start_found = false;
+    this->scan_offset = 0;
+}
+
+TcpMsgPatternDemarcar::~TcpMsgPatternDemarcar()
+{
+    this->Destroy();
+}
+
+void TcpMsgPatternDemarcar::Destroy()
+{
+    if (this->start_pattern)
+    {
+        free(this->start_pattern);
+        this->start_pattern = nullptr;
+    }
+
+    if (this->end_pattern)
+    {
+        free(this->end_pattern);
+        this->end_pattern = nullptr;
+    }
+
+    this->TcpMsgDemarcar::Destroy();
+}
+
+/**
+ * @brief 在环形缓冲区 [from, 末尾) 中查找标记
+ *
+ * 1.数据所在的每一段连续内存使用向量化查找
+ *
+ * 2.bcb 数据跨越末尾时, 起始于第一段最后 pattern_size - 1 个字节的标记会跨越两段, 逐字节比较
+ *
+ * @param from 开始查找的位置(相对于缓冲区读位置)
+ * @param pattern 要查找的标记
+ * @param pattern_size 标记长度
+ * @return uint64_t 标记的位置(相对于缓冲区读位置), 没有找到返回 TCP_PATTERN_NOT_FOUND
+ */
+uint64_t TcpMsgPatternDemarcar::FindPattern(uint64_t from, unsigned char *pattern, uint8_t pattern_size)
+{
+    int n_iov;
+    uint64_t i, j, len0, len1, start;
+    const unsigned char *p, *seg0, *seg1;
+    struct iovec iov[2];
+
+    n_iov = this->RingDataRegions(iov);
+
+    if (n_iov == 0)
+        return TCP_PATTERN_NOT_FOUND;
+
+    seg0 = (const unsigned char *)iov[0].iov_base;
+    len0 = iov[0].iov_len;
+    seg1 = n_iov == 2 ? (const unsigned char *)iov[1].iov_base : nullptr;
+    len1 = n_iov == 2 ? iov[1].iov_len : 0;
+
+    if (from + pattern_size > len0 + len1)
+        return TCP_PATTERN_NOT_FOUND;
+
+    if (from < len0)
+    {
+        // 1.完全位于第一段中的标记
+        p = PatternScan(seg0 + from, len0 - from, pattern, pattern_size);
+
+        if (p)
+            return p - seg0;
+
+        // 2.跨越两段的标记
+        start = len0 - from >= pattern_size ? len0 - pattern_size + 1 : from;
+
+        for (i = start; n_iov == 2 && i < len0 && i + pattern_size <= len0 + len1; i++)
+        {
+            for (j = 0; j < pattern_size; j++)
+            {
+                if ((i + j < len0 ? seg0[i + j] : seg1[i + j - len0]) != pattern[j])
+                    break;
+            }
+
+            if (j == pattern_size)
+                return i;
+        }
+
+        from = len0;
+    }
+
+    if (n_iov == 1)
+        return TCP_PATTERN_NOT_FOUND;
+
+    // 3.完全位于第二段中的标记
+    p = PatternScan(seg1 + (from - len0), len1 - (from - len0), pattern, pattern_size);
+
+    if (p)
+        return len0 + (p - seg1);
+
+    return TCP_PATTERN_NOT_FOUND;
+}
+
+/**
+ * @brief 取出缓冲区开头的一条完整消息(不删除), 处理完后需要 RingConsume(frame_size)
+ *
+ * 查找失败时记录扫描停止的位置, 下一次从该位置继续
+ *
+ * @param frame_size 输出, 消息长度(包含起始和结束标记)
+ * @return unsigned char* 消息指针, 没有完整消息返回 NULL
+ */
+unsigned char *TcpMsgPatternDemarcar::ExtractFrame(uint64_t *frame_size)
+{
+    uint64_t pos, data_size = this->RingDataSize();
+
+    if (!this->start_found)
+    {
+        if (!this->start_pattern_size)
+        {
+            this->start_found = true;
+            this->scan_offset = 0;
+        }
+        else
+        {
+            pos = this->FindPattern(this->scan_offset, this->start_pattern, this->start_pattern_size);
+
+            if (pos == TCP_PATTERN_NOT_FOUND)
+            {
+                // 丢弃不属于任何消息的字节, 只保留可能是起始标记前缀的末尾部分
+                if (data_size >= this->start_pattern_size)
+                    this->RingConsume(data_size - this->start_pattern_size + 1);
+
+                this->scan_offset = 0;
+                return NULL;
+            }
+
+            // 丢弃起始标记之前的字节, 使消息位于缓冲区开头
+            this->RingConsume(pos);
+            this->start_found = true;
+            this->scan_offset = this->start_pattern_size;
+            data_size -= pos;
+        }
+    }
+
+    pos = this->FindPattern(this->scan_offset, this->end_pattern, this->end_pattern_size);
+
+    if (pos == TCP_PATTERN_NOT_FOUND)
+    {
+        // 结束标记可能只收到了一部分, 从可能的前缀处继续扫描
+        if (data_size >= this->scan_offset + this->end_pattern_size)
+            this->scan_offset = data_size - this->end_pattern_size + 1;
+
+        return NULL;
+    }
+
+    *frame_size = pos + this->end_pattern_size;
+    this->start_found = false;
+    this->scan_offset = 0;
+
+    return this->RingPeek(0, *frame_size);
+}
+
+/**
+ * @brief 是否有尚未扫描的新数据
+ *
+ * 扫描本身在 ProcessClientMsg() 中完成, 这里只比较扫描位置, 避免对同一段数据扫描两次
+ *
+ * @return true
+ * @return false
+ */
+bool TcpMsgPatternDemarcar::IsBufferReadyToFlush()
+{
+    return this->RingDataSize() > this->scan_offset;
+}
+
+/**
+ * @brief 从环形缓冲区中解析并处理所有完整的 "模式分帧" 消息
+ *
+ * @param tcp_client 发来消息的客户端对象
+ */
+void TcpMsgPatternDemarcar::ProcessClientMsg(TcpClient *tcp_client)
+{
+    unsigned char *msg;
+    uint64_t frame_size;
+
+    while ((msg = this->ExtractFrame(&frame_size)))
+    {
+        // 将一条完整消息交给应用层处理
+        tcp_client->tcp_ctrlr->ClientMsgRecvd(tcp_client, msg, (uint16_t)frame_size);
+
+        this->RingConsume(frame_size);
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef TCPMSGPATTERNDEMARCAR_H_
+#define TCPMSGPATTERNDEMARCAR_H_
+
+#include <stdint.h>
+#include "TcpMsgDemarcar.h"
+
+#define TCP_PATTERN_NOT_FOUND UINT64_MAX
+
+class TcpClient;
+
+/**
+ * @brief 按 起始标记/结束标记 分帧的 TCP 消息分帧器(例如按行分割的文本协议)
+ *
+ * 1.一条消息为 [start_pattern ... end_pattern], 交给应用层的消息包含起始和结束标记;
+ *   没有起始标记时, 消息从上一条消息之后开始
+ *
+ * 2.起始标记之前的字节不属于任何消息, 直接丢弃
+ *
+ * 3.使用向量化查找(SSE2/AVX2 同时比较标记的首尾字节, 单字节标记使用 memchr)在环形缓冲区中原地扫描,
+ *   标记跨越 bcb 末尾时逐字节比较
+ *
+ * 4.记录上一次扫描停止的位置(scan_offset), 新数据到达后从该位置继续扫描, 不会重复扫描整个缓冲区
+ */
+class TcpMsgPatternDemarcar : public TcpMsgDemarcar
+{
+private:
+    unsigned char *start_pattern; // 起始标记, 可以为空
+    uint8_t start_pattern_size;   // 起始标记长度
+    unsigned char *end_pattern;   // 结束标记
+    uint8_t end_pattern_size;     // 结束标记长度
+    bool start_found;             // 当前消息的起始标记已经位于缓冲区开头
+    uint64_t scan_offset;         // 下一次扫描的起始位置(相对于缓冲区读位置)
+
+    uint64_t FindPattern(uint64_t from, unsigned char *pattern, uint8_t pattern_size); // 在缓冲区 [from, 末尾) 中查找标记
+
+protected:
+    unsigned char *ExtractFrame(uint64_t *frame_size); // 取出缓冲区开头的完整消息(不删除), 没有完整消息返回 NULL
+
+public:
+    bool IsBufferReadyToFlush() override;
+    void ProcessClientMsg(TcpClient *) override;
+
+    TcpMsgPatternDemarcar(unsigned char start_pattern[],
+                          uint8_t start_pattern_size,
+                          unsigned char end_pattern[],
+                          uint8_t end_pattern_size,
+                          TcpMsgDemarcarRingType ring_type = TCP_DEMARCAR_RING_BCB);
+    ~TcpMsgPatternDemarcar();
+
+    void Destroy();
+};
+
+#endif
@@ -4,19 +4,20 @@
 #include <stdint.h>
 
 #include "TcpMsgDemarcar.h"
+#include "TcpMsgFramedDemarcar.h"
 
 #define VARIABLE_SIZE_MAX_BUFFER 256
 
+// 2字节消息长度(uint16_t, 本机字节序, 包括长度字段本身) | 消息体
+typedef TcpLengthPrefixFraming<uint16_t, TCP_FRAME_HOST_ORDER, true> TcpVariableSizeFraming;
+
 class Tcpclient;
-class TcpMsgVariableSizeDemarcar : TcpMsgDemarcar
+class TcpMsgVariableSizeDemarcar : public TcpMsgFramedDemarcar<TcpVariableSizeFraming>
 {
 private:
 public:
-    bool IsBufferReadyToFlush() override;
-    void ProcessClientMsg(TcpClient *) override;
-
-    TcpMsgVariableSizeDemarcar();
+    TcpMsgVariableSizeDemarcar(TcpMsgDemarcarRingType ring_type = TCP_DEMARCAR_RING_BCB);
     ~TcpMsgVariableSizeDemarcar();
     void Destroy();
 };
-#endif
\ No newline at end of file
+#endif
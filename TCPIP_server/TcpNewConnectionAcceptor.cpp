@@ -13,24 +13,24 @@
 #include "TcpNewConnectionAcceptor.h"
 #include "TcpClientDbManager.h"
 #include "TcpClient.h"
+#include "TcpClientServiceManager.h"
 #include "network_utils.h"
 
 /**
  * @brief Construct a new Tcp New Connection Acceptor:: Tcp New Connection Acceptor object
  *
+ * 监听 socket 在启动线程时按配置的分片数量创建
+ *
  * @param TcpServerController
  */
 TcpNewConnectionAcceptor::TcpNewConnectionAcceptor(TcpServerController *TcpServerController)
 {
-    this->accept_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-
-    if (this->accept_fd < 0)
-    {
-        printf("Error : Could not create Accept FD\n");
-        exit(0);
-    }
+    this->shards = nullptr;
+    this->n_shards = 0;
+    this->n_acceptors = 0;
+    this->backlog = TCP_ACCEPTOR_DEFAULT_BACKLOG;
+    this->use_accept4 = true;
 
-    this->accept_new_conn_thread = (pthread_t *)calloc(1, sizeof(pthread_t));
     sem_init(&this->wait_for_thread_operation_to_complete, 0, 0);
     pthread_rwlock_init(&this->rwlock, nullptr);
     this->accept_new_conn = true;
@@ -39,58 +39,69 @@ TcpNewConnectionAcceptor::TcpNewConnectionAcceptor(TcpServerController *TcpServe
 
 TcpNewConnectionAcceptor::~TcpNewConnectionAcceptor()
 {
-    assert(this->accept_fd == 0);
-    assert(this->accept_new_conn_thread);
+    assert(!this->shards);
 }
 
 /**
- * @brief 线程主函数, 用于监听新的 TCP 客户端连接并将其交给 TcpServerController 处理
- *
- * 此函数运行在独立线程中:
- *
- * 1. 配置监听 socket（reuseaddr、bind、listen）
- *
- * 2. 循环 accept() 新连接
- *
- * 3. 根据服务器控制器状态决定是否接受连接
+ * @brief 设置 accept 分片数量和监听参数, 必须在 StartTcpNewConnectionAcceptorThread() 之前调用
  *
- * 4. 为每个连接创建一个 TcpClient 对象
- *
- * 5. 初始化 TcpClient 状态、文件描述符、IP/端口等
+ * @param n_acceptors accept 线程数, 0 表示与 DRS 分片数量相同
+ * @param backlog     每个监听 socket 的 listen() backlog, <= 0 表示 TCP_ACCEPTOR_DEFAULT_BACKLOG
+ * @param use_accept4 是否使用 accept4(SOCK_NONBLOCK | SOCK_CLOEXEC), 省去 DRS 设置非阻塞的系统调用
+ */
+void TcpNewConnectionAcceptor::SetListenConfig(uint16_t n_acceptors, int backlog, bool use_accept4)
+{
+    assert(!this->shards);
+
+    this->n_acceptors = n_acceptors;
+    this->backlog = backlog > 0 ? backlog : TCP_ACCEPTOR_DEFAULT_BACKLOG;
+    this->use_accept4 = use_accept4;
+}
+
+/**
+ * @brief 创建一个绑定到服务器 ip/port 的监听 socket
  *
- * 6. 发送欢迎消息
+ * 所有分片的 socket 都设置 SO_REUSEPORT 并绑定同一个地址, 内核按四元组哈希把新连接分散到各个 socket 的
+ * accept 队列上, accept 线程之间不再竞争同一个队列
  *
- * 7. 将新连接通过消息队列交给 TcpServerController 进一步处理
+ * @return int 监听 socket
  */
-void TcpNewConnectionAcceptor::StartTcpNewConnectionAcceptorThreadInternal()
+int TcpNewConnectionAcceptor::CreateListenSocket()
 {
     int opt = 1;
-    bool accept_new_conn;
-    bool create_multi_thread_client;
-    tcp_server_msg_code_t ctrlr_code = (tcp_server_msg_code_t)0;
+    int accept_fd;
+
+    accept_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, IPPROTO_TCP);
+
+    if (accept_fd < 0)
+    {
+        printf("Error : Could not create Accept FD\n");
+        exit(0);
+    }
 
     // 1.设置服务监听地址(IP + port)
     struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = htons(this->tcp_ctrlr->ip_addr);
-    server_addr.sin_port = htonl(this->tcp_ctrlr->port_no);
+    server_addr.sin_addr.s_addr = htonl(this->tcp_ctrlr->ip_addr);
+    server_addr.sin_port = htons(this->tcp_ctrlr->port_no);
 
     // 设置地址复用
-    if (setsockopt(this->accept_fd, SOL_SOCKET, SO_REUSEADDR, (char *)&opt, sizeof(opt)) < 0)
+    if (setsockopt(accept_fd, SOL_SOCKET, SO_REUSEADDR, (char *)&opt, sizeof(opt)) < 0)
     {
         printf("setsockopt Failed\n");
         exit(0);
     }
 
-    // 设置端口复用
-    if (setsockopt(this->accept_fd, SOL_SOCKET, SO_REUSEPORT, (char *)&opt, sizeof(opt)) < 0)
+    // 设置端口复用, 多个分片绑定同一个端口
+    if (setsockopt(accept_fd, SOL_SOCKET, SO_REUSEPORT, (char *)&opt, sizeof(opt)) < 0)
     {
         printf("setsockopt Failed\n");
         exit(0);
     }
 
     // 绑定 IP 和 端口
-    if (bind(this->accept_fd, (struct sockaddr *)&server_addr, sizeof(struct sockaddr)) == -1)
+    if (bind(accept_fd, (struct sockaddr *)&server_addr, sizeof(struct sockaddr)) == -1)
     {
         printf("Error: Acceptor socket bind failed [%s(0x%x), %d], error = %d\n",
                network_convert_ip_n_to_p(tcp_ctrlr->ip_addr, 0),
@@ -101,17 +112,93 @@ void TcpNewConnectionAcceptor::StartTcpNewConnectionAcceptorThreadInternal()
     }
 
     // 开始监听
-    if (listen(this->accept_fd, 5) < 0)
+    if (listen(accept_fd, this->backlog) < 0)
     {
         printf("listen failed\n");
         exit(0);
     }
 
+    return accept_fd;
+}
+
+/**
+ * @brief 为新连接创建 TcpClient 对象, 并直接交给 TcpServerController 分配到 DRS 分片
+ *
+ * 在 accept 线程中执行, 不经过控制器消息队列: 加入 DB 由 DBM 的读写锁保护,
+ * 加入监听集合通过 DRS 的 eventfd 命令队列完成
+ *
+ * @param shard          接受连接的分片
+ * @param comm_socket_fd 新连接的 socket
+ * @param client_addr    对端地址
+ */
+void TcpNewConnectionAcceptor::HandleNewConnection(TcpAcceptorShard_t *shard, int comm_socket_fd,
+                                                   struct sockaddr_in *client_addr)
+{
+    bool accept_new_conn;
+
+    // 检查服务器是否允许接受新连接
+    pthread_rwlock_rdlock(&this->rwlock);
+    accept_new_conn = this->accept_new_conn;
+    pthread_rwlock_unlock(&this->rwlock);
+
+    if (!accept_new_conn)
+    {
+        close(comm_socket_fd); // 不接受关闭服务器
+        return;
+    }
+
+    // 为新连接创建 一个 TcpClient 对象
+    TcpClient *tcp_client = new TcpClient;
+    tcp_client->comm_fd = comm_socket_fd;
+    tcp_client->ip_addr = htonl(client_addr->sin_addr.s_addr);
+    tcp_client->port_no = htons(client_addr->sin_port);
+    tcp_client->tcp_ctrlr = this->tcp_ctrlr;
+    tcp_client->server_ip_addr = this->tcp_ctrlr->ip_addr;
+    tcp_client->server_port_no = this->tcp_ctrlr->port_no;
+    tcp_client->SetState(TCP_CLIENT_STATE_CONNECTED | TCP_CLIENT_STATE_PASSIVE_OPENER); // 设置客户端连接状态为 已连接|被动连接(服务器accept)
+    tcp_client->SetConnectionType(tcp_conn_via_accept);                                 // 设置连接来源为 "accept"
+
+    // 如果用户注册了连接回调,则调用
+    if (this->tcp_ctrlr->client_connected)
+    {
+        this->tcp_ctrlr->client_connected(this->tcp_ctrlr, tcp_client);
+    }
+
+    // 向客户端发送欢迎消息
+    tcp_client->SendMsg("Welcome\n", strlen("Welcome\n"));
+    // 按服务器配置创建分帧器, 默认 TCP_DEMARCAR_NONE 不处理消息分界, 直接传递
+    tcp_client->SetTcpMsgDemarcar(this->tcp_ctrlr->CreateClientMsgDemarcar());
+
+    __atomic_add_fetch(&shard->n_accepted, 1, __ATOMIC_RELAXED);
+
+    // 根据服务器配置(单线程/多线程)选择处理client, 分片编号作为 TCP_REACTOR_SHARD_ACCEPTOR 策略的提示
+    this->tcp_ctrlr->ProcessNewClient(tcp_client, shard->acceptor_id);
+}
+
+/**
+ * @brief 线程主函数, 用于监听新的 TCP 客户端连接并将其交给 TcpServerController 处理
+ *
+ * 此函数运行在独立线程中:
+ *
+ * 1. 循环 accept() 本分片监听 socket 上的新连接
+ *
+ * 2. 根据服务器控制器状态决定是否接受连接
+ *
+ * 3. 为每个连接创建一个 TcpClient 对象, 初始化状态、文件描述符、IP/端口等
+ *
+ * 4. 发送欢迎消息
+ *
+ * 5. 直接交给 TcpServerController 加入 DB 并分配 DRS 分片
+ *
+ * @param shard 本线程的分片
+ */
+void TcpNewConnectionAcceptor::StartTcpNewConnectionAcceptorThreadInternal(TcpAcceptorShard_t *shard)
+{
     struct sockaddr_in client_addr;
-    socklen_t addr_len = sizeof(client_addr);
+    socklen_t addr_len;
     int comm_socket_fd;
 
-    // 信号量+1, 通知外部当前函数(线程)已经完成初始化(bind + listen)
+    // 信号量+1, 通知外部当前线程已经开始运行
     sem_post(&this->wait_for_thread_operation_to_complete);
 
     // 主循环: 等待客户端连接
@@ -119,60 +206,34 @@ void TcpNewConnectionAcceptor::StartTcpNewConnectionAcceptorThreadInternal()
     {
         pthread_testcancel(); // 支持 pthread_cancel 中断
 
-        // 阻塞等待一个新客户端连接
-        comm_socket_fd = accept(this->accept_fd, (struct sockaddr *)&client_addr, &addr_len);
-
-        if (comm_socket_fd < 0)
-        {
-            printf("Error in Accepting New Connections\n");
-            continue;
-        }
+        // 阻塞等待一个新客户端连接, accept()/accept4() 是取消点
+        addr_len = sizeof(client_addr);
 
-        // 检查服务器是否允许接受新连接
-        pthread_rwlock_rdlock(&rwlock);
-        accept_new_conn = this->accept_new_conn;
+        if (this->use_accept4)
+            comm_socket_fd = accept4(shard->accept_fd, (struct sockaddr *)&client_addr, &addr_len,
+                                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+        else
+            comm_socket_fd = accept(shard->accept_fd, (struct sockaddr *)&client_addr, &addr_len);
 
-        if (!accept_new_conn)
+        if (comm_socket_fd < 0)
         {
-            close(comm_socket_fd); // 不接受关闭服务器
-            continue;
-        }
+            // 对端在 accept 之前已经断开, 或被信号打断
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
 
-        // send welcome msg to client
-        // 为新连接创建 一个 TcpClient 对象
-        TcpClient *tcp_client = new TcpClient;
-        tcp_client->comm_fd = comm_socket_fd;
-        tcp_client->ip_addr = htonl(client_addr.sin_addr.s_addr);
-        tcp_client->port_no = htons(client_addr.sin_port);
-        tcp_client->tcp_ctrlr = this->tcp_ctrlr;
-        tcp_client->server_ip_addr = this->tcp_ctrlr->ip_addr;
-        tcp_client->server_port_no = this->tcp_ctrlr->port_no;
-        tcp_client->SetState(TCP_CLIENT_STATE_CONNECTED | TCP_CLIENT_STATE_PASSIVE_OPENER); // 设置客户端连接状态为 已连接|被动连接(服务器accept)
-        tcp_client->SetConnectionType(tcp_conn_via_accept);                                 // 设置连接来源为 "accept"
-
-        // 如果用户注册了连接回调,则调用
-        if (this->tcp_ctrlr->client_connected)
-        {
-            this->tcp_ctrlr->client_connected(this->tcp_ctrlr, tcp_client);
-        }
+            printf("Error in Accepting New Connections, acceptor %u, error = %d\n", shard->acceptor_id, errno);
 
-        // 向客户端发送欢迎消息
-        tcp_client->SendMsg("Welcome\n", strlen("Welcome\n"));
-        // 不处理消息分界, 直接传递
-        tcp_client->SetTcpMsgDemarcar(TcpMsgDemarcar::InstantiateTcpMsgDemarcar(TCP_DEMARCAR_NONE, 0, 0, 0, 0, 0));
+            // fd 耗尽时 accept 会立即失败, 稍后重试避免空转
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+                usleep(10 * 1000);
 
-        // 根据服务器配置(单线程/多线程)选择处理client
-        if (this->tcp_ctrlr->IsBitSet(TCP_SERVER_CREATE_MULTI_THREADED_CLIENT))
-        {
-            ctrlr_code = CTRLR_ACTION_TCP_CLIENT_CREATE_THREADED;
-        }
-        else
-        {
-            ctrlr_code = CTRLR_ACTION_TCP_CLIENT_MULTIPLEX_LISTEN;
+            continue;
         }
 
-        // 将 client 交给 TcpServerController 的消息队列处理
-        this->tcp_ctrlr->EnqueMsg((tcp_server_msg_code_t)(CTRLR_ACTION_TCP_CLIENT_PROCESS_NEW | ctrlr_code), tcp_client, false);
+        // 处理新连接期间(持有 DB 锁、调用用户回调)不响应取消, 否则锁和客户端对象会泄漏
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, nullptr);
+        this->HandleNewConnection(shard, comm_socket_fd, &client_addr);
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, nullptr);
     }
 }
 
@@ -180,45 +241,89 @@ void TcpNewConnectionAcceptor::StartTcpNewConnectionAcceptorThreadInternal()
  * @brief 静态函数, pthread 的线程入口函数
  *
  * pthread_create 只能接受普通函数指针，不能直接接受成员函数，
- * 所以这里用一个 static 函数包装，并把 this 指针传进去。
+ * 所以这里用一个 static 函数包装，并把分片指针传进去。
  *
  * @param arg 线程函数参数
  * @return void*
  */
 static void *tcp_listen_for_new_connections(void *arg)
 {
-    TcpNewConnectionAcceptor *tcp_new_conn_acc = (TcpNewConnectionAcceptor *)arg;
+    TcpAcceptorShard_t *shard = (TcpAcceptorShard_t *)arg;
 
     // 设置为线程可取消
     pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, nullptr);
     pthread_setcanceltype(PTHREAD_CANCEL_DEFERRED, nullptr);
 
     // 进入真正的线程逻辑
-    tcp_new_conn_acc->StartTcpNewConnectionAcceptorThread();
+    shard->acceptor->StartTcpNewConnectionAcceptorThreadInternal(shard);
 
     return nullptr;
 }
 
 /**
- * @brief 新线程创建, 启动新连接监听线程
+ * @brief 创建所有分片的监听 socket 并启动 accept 线程
  *
+ * 所有 socket 在调用线程中完成 bind + listen, 返回时端口已经在监听, bind 失败会立即暴露.
+ * io_uring 模式下每个 DRS 分片一个监听 socket, 由该分片的 multishot accept 接受连接, 不创建线程,
+ * 必须在 DRS 线程启动之前调用
  */
 void TcpNewConnectionAcceptor::StartTcpNewConnectionAcceptorThread()
 {
+    uint16_t i, n_shards;
     pthread_attr_t attr;
+    bool in_reactor;
+
+    assert(!this->shards);
+
+    in_reactor = this->tcp_ctrlr->mx_type == TCP_MULTIPLEX_IO_URING &&
+                 !this->tcp_ctrlr->IsBitSet(TCP_SERVER_NOT_LISTENING_CLIENT);
+
+    if (in_reactor)
+        n_shards = this->tcp_ctrlr->GetReactorCount();
+    else
+        n_shards = this->n_acceptors ? this->n_acceptors : this->tcp_ctrlr->GetReactorCount();
+
+    if (n_shards == 0)
+        n_shards = 1;
+
+    this->shards = (TcpAcceptorShard_t *)calloc(n_shards, sizeof(TcpAcceptorShard_t));
+
+    for (i = 0; i < n_shards; i++)
+    {
+        this->shards[i].accept_fd = this->CreateListenSocket();
+        this->shards[i].acceptor_id = i;
+        this->shards[i].acceptor = this;
+    }
+
+    if (in_reactor)
+    {
+        for (i = 0; i < n_shards; i++)
+            this->tcp_ctrlr->GetClientSvcMgr(i)->AcceptFDStart(&this->shards[i]);
+
+        this->n_shards = n_shards;
+        printf("Service started : io_uring multishot accept x %u, backlog %d\n", this->n_shards, this->backlog);
+        return;
+    }
 
     pthread_attr_init(&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE); // 设置线程属性 为 joinable (可被 join 等待)
 
-    if (pthread_create(this->accept_new_conn_thread, &attr, tcp_listen_for_new_connections, (void *)this))
+    for (i = 0; i < n_shards; i++)
     {
-        printf("%s() Thread Creation falied, error = %d\n", __FUNCTION__, errno);
-        exit(0);
+        if (pthread_create(&this->shards[i].thread, &attr, tcp_listen_for_new_connections, (void *)&this->shards[i]))
+        {
+            printf("%s() Thread Creation falied, error = %d\n", __FUNCTION__, errno);
+            exit(0);
+        }
+
+        // 等待线程开始运行
+        sem_wait(&this->wait_for_thread_operation_to_complete);
+        this->n_shards++;
     }
 
-    // 信号量+1, 线程已经完成初始化(bind + listen), 唤醒当前线程
-    sem_wait(&this->wait_for_thread_operation_to_complete);
-    printf("Service started : TcpNewConnectionAcceptThread\n");
+    pthread_attr_destroy(&attr);
+    printf("Service started : TcpNewConnectionAcceptThread x %u, backlog %d%s\n",
+           this->n_shards, this->backlog, this->use_accept4 ? ", accept4" : "");
 }
 
 /**
@@ -233,19 +338,38 @@ void TcpNewConnectionAcceptor::SetAcceptNewConnectionStatus(bool status)
     pthread_rwlock_unlock(&this->rwlock);
 }
 
+/**
+ * @brief 已启动的 accept 线程数
+ */
+uint16_t TcpNewConnectionAcceptor::GetAcceptorCount()
+{
+    return this->n_shards;
+}
+
+/**
+ * @brief 打印每个 accept 分片接受的连接数, 用于观察 SO_REUSEPORT 的负载分布
+ */
+void TcpNewConnectionAcceptor::Display()
+{
+    printf("CAS acceptors : %u, backlog : %d%s\n", this->n_shards, this->backlog,
+           this->n_shards && this->shards[0].svc_mgr ? ", io_uring multishot" : this->use_accept4 ? ", accept4" : "");
+
+    for (uint16_t i = 0; i < this->n_shards; i++)
+    {
+        printf("  CAS[%u] fd : %d, accepted : %lu\n", this->shards[i].acceptor_id, this->shards[i].accept_fd,
+               (unsigned long)__atomic_load_n(&this->shards[i].n_accepted, __ATOMIC_RELAXED));
+    }
+}
+
 /**
  * @brief 停止 TcpNewConnectionAcceptor 服务
  *
  */
 void TcpNewConnectionAcceptor::Stop()
 {
-    // 停止 accept 线程
+    // 停止 accept 线程并关闭监听 socket
     this->StopTcpNewConnectionAcceptorThread();
 
-    // 关闭监听 socket
-    close(accept_fd);
-    this->accept_fd = 0;
-
     // 销毁信号量和读写锁
     sem_destroy(&this->wait_for_thread_operation_to_complete);
     pthread_rwlock_destroy(&this->rwlock);
@@ -255,12 +379,37 @@ void TcpNewConnectionAcceptor::Stop()
 
 void TcpNewConnectionAcceptor::StopTcpNewConnectionAcceptorThread()
 {
-    // 请求取消线程
-    pthread_cancel(*this->accept_new_conn_thread);
-    // 等待线程退出
-    pthread_join(*this->accept_new_conn_thread, nullptr);
-
-    // 释放存放线程局句柄的内存
-    free(this->accept_new_conn_thread);
-    this->accept_new_conn_thread = nullptr;
-}
\ No newline at end of file
+    uint16_t i;
+
+    if (!this->shards)
+        return;
+
+    for (i = 0; i < this->n_shards; i++)
+    {
+        // io_uring 分片由 DRS 取消 accept 并关闭监听 socket, DRS 已经停止时 svc_mgr 已被清空
+        if (this->shards[i].svc_mgr)
+        {
+            this->shards[i].svc_mgr->AcceptFDStop();
+            continue;
+        }
+
+        if (this->shards[i].accept_fd < 0)
+            continue;
+
+        // 请求取消线程
+        pthread_cancel(this->shards[i].thread);
+        // 等待线程退出
+        pthread_join(this->shards[i].thread, nullptr);
+    }
+
+    // 关闭监听 socket
+    for (i = 0; i < this->n_shards; i++)
+    {
+        if (this->shards[i].accept_fd >= 0)
+            close(this->shards[i].accept_fd);
+    }
+
+    free(this->shards);
+    this->shards = nullptr;
+    this->n_shards = 0;
+}
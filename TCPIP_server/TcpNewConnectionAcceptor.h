@@ -3,17 +3,37 @@
 
 #include <pthread.h>
 #include <semaphore.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#define TCP_ACCEPTOR_DEFAULT_BACKLOG SOMAXCONN // listen() 默认 backlog, 实际上限由 net.core.somaxconn 决定
 
 class TcpServerController;
+class TcpNewConnectionAcceptor;
+class TcpClientServiceManager;
+
+/**
+ * @brief 一个 accept 线程及其独立的 SO_REUSEPORT 监听 socket
+ */
+typedef struct TcpAcceptorShard_
+{
+    int accept_fd;                      // 本线程的监听 socket, 与其它分片绑定同一个端口
+    uint16_t acceptor_id;               // 分片编号
+    pthread_t thread;                   // accept 线程
+    TcpNewConnectionAcceptor *acceptor; // 所属的 CAS
+    TcpClientServiceManager *svc_mgr;   // 非空时由此 DRS 分片通过 io_uring multishot accept 接受连接, 没有独立线程
+    uint64_t n_accepted;                // 本分片接受的连接数(原子访问)
+} TcpAcceptorShard_t;
 
 /**
  * @brief 负责监听新的 TCP 客户端连接的接受器类
  *
  * 这个类的主要作用是：
  *
- * 1. 在后台启动一个线程，不停监听 accept()；
+ * 1. 在后台启动 N 个线程, 每个线程拥有自己的 SO_REUSEPORT 监听 socket, 由内核把新连接分散到各个 socket 上；
  *
- * 2. 发现新连接后，把连接信息交给 TcpServerController；
+ * 2. 发现新连接后，直接交给 TcpServerController 加入 DB 并分配到 DRS 分片, 不经过控制器消息队列；
+ *    io_uring 模式下不创建 accept 线程, 每个 DRS 分片在自己的监听 socket 上提交 multishot accept；
  *
  * 3. 可动态开启/关闭是否接受新连接；
  *
@@ -22,26 +42,36 @@ class TcpServerController;
 class TcpNewConnectionAcceptor
 {
 private:
-    int accept_fd;                               // 服务器监听的 socket 的文件描述符
-    pthread_t *accept_new_conn_thread;           // 接受新连接的专用线程指针
+    TcpAcceptorShard_t *shards;                  // accept 分片数组
+    uint16_t n_shards;                           // 已启动的分片数量
+    uint16_t n_acceptors;                        // 配置的分片数量, 0 表示与 DRS 分片数量相同
+    int backlog;                                 // 每个监听 socket 的 listen() backlog
+    bool use_accept4;                            // 使用 accept4(SOCK_NONBLOCK | SOCK_CLOEXEC) 接受连接
     sem_t wait_for_thread_operation_to_complete; // 用于同步线程启动/停止操作的信号量
     pthread_rwlock_t rwlock;                     // 保护共享状态 accept_new_conn 的读写锁
     bool accept_new_conn;                        // 是否运行继续进行新连接
 
+    int CreateListenSocket(); // 创建并绑定一个 SO_REUSEPORT 监听 socket
+
 public:
     TcpServerController *tcp_ctrlr; // back pointer to owing Server
 
     TcpNewConnectionAcceptor(TcpServerController *);
     ~TcpNewConnectionAcceptor();
 
+    void SetListenConfig(uint16_t n_acceptors, int backlog, bool use_accept4); // 必须在启动线程之前调用
+    void HandleNewConnection(TcpAcceptorShard_t *, int comm_socket_fd, struct sockaddr_in *client_addr); // 为新连接创建 TcpClient
+
     void StartTcpNewConnectionAcceptorThread(); // 启动用于接受新连接的后台线程
     void StopTcpNewConnectionAcceptorThread();  // 停止后台的接受连接线程
 
     void SetShareSemaphore(sem_t *); // 共享外部 semaphore
 
-    void StartTcpNewConnectionAcceptorThreadInternal(); // 内部线程执行函数
-    void Stop();                                        // 停止接受新连接
-    void SetAcceptNewConnectionStatus(bool);            // 谁知是否允许接受新连接
+    void StartTcpNewConnectionAcceptorThreadInternal(TcpAcceptorShard_t *); // 内部线程执行函数
+    void Stop();                                                           // 停止接受新连接
+    void SetAcceptNewConnectionStatus(bool);                               // 谁知是否允许接受新连接
+    uint16_t GetAcceptorCount();                                           // 已启动的 accept 线程数
+    void Display();                                                        // 打印每个分片接受的连接数
 };
 
-#endif
\ No newline at end of file
+#endif
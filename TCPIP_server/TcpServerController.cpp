@@ -3,29 +3,75 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/eventfd.h>
 #include "TcpServerController.h"
 #include "TcpNewConnectionAcceptor.h"
 #include "TcpClientDbManager.h"
 #include "TcpClientServiceManager.h"
 #include "TcpMsgDemarcar.h"
+#include "TcpMsgLengthPrefixDemarcar.h"
 #include "network_utils.h"
 #include "TcpClient.h"
+#include "TcpMemPool.h"
+#include "MirroredCircularBuffer.h"
+#include "TcpMetrics.h"
+#include "TcpShmTransport.h"
+#include "TcpConnPool.h"
 
 class TcpMsgDemarcar;
 
-TcpServerController::TcpServerController(std::string ip_addr, uint16_t port_no, std::string name)
+TcpServerController::TcpServerController(std::string ip_addr, uint16_t port_no, std::string name,
+                                         TcpMultiplexType mx_type)
+    : msg_pool(TCP_SERVER_MSG_POOL_SIZE)
 {
     this->ip_addr = network_convert_ip_p_to_n(ip_addr.c_str());
     this->port_no = port_no;
     this->name = name;
+    this->mx_type = mx_type; // DRS 创建时读取, 必须在其之前设置
 
     this->tcp_new_conn_acc = new TcpNewConnectionAcceptor(this);
     this->tcp_client_db_mgr = new TcpClientDbManager(this);
-    this->tcp_client_svc_mgr = new TcpClientServiceManager(this);
-
-    this->msgd_type = TCP_DEMARCAR_FIXED_SIZE;
-    pthread_mutex_init(&this->msgq_mutex, nullptr);
-    pthread_cond_init(&this->msgq_cv, nullptr);
+    // DRS 分片在 Start() 时按配置创建
+    long n_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    this->n_reactors = n_cores > 0 ? (uint16_t)n_cores : 1;
+    this->pin_reactors = true;
+    this->shard_policy = TCP_REACTOR_SHARD_LEAST_LOAD;
+    // 线程池在 Start() 时创建
+    this->tcp_worker_pool = nullptr;
+    this->n_workers = this->n_reactors;
+
+    this->msgd_type = TCP_DEMARCAR_NONE;
+    this->msgd_fixed_size = 0;
+    memset(&this->msgd_length_prefix, 0, sizeof(this->msgd_length_prefix));
+    this->client_send_wm = nullptr;
+    this->client_msg_batch_recvd = nullptr;
+    this->client_msg_chunk_recvd = nullptr;
+    this->client_protocol_error = nullptr;
+    this->send_high_wm = TCP_OUT_QUEUE_HIGH_WM;
+    this->send_low_wm = TCP_OUT_QUEUE_LOW_WM;
+    this->idle_timeout_ms = 0;
+    this->ka_interval_ms = 0;
+    this->ka_max_missed = 0;
+    this->connect_timeout_ms = TCP_CONNECT_TIMEOUT_MS;
+    this->connect_backoff_min_ms = TCP_CONNECT_BACKOFF_MIN_MS;
+    this->connect_backoff_max_ms = TCP_CONNECT_BACKOFF_MAX_MS;
+    // 阻塞模式的 eventfd, 消息线程空闲时阻塞在 read() 上
+    this->msgq_event_fd = eventfd(0, EFD_CLOEXEC);
+    if (this->msgq_event_fd < 0)
+    {
+        printf("Error : Msg Q eventfd creation failed, error = %d\n", errno);
+        exit(0);
+    }
+    this->msgq_thread_idle.store(false);
+    this->msgq_thread_running = false;
+    memset(&this->unsharded_metrics, 0, sizeof(this->unsharded_metrics));
+    memset(&this->ctrl_q_lat, 0, sizeof(this->ctrl_q_lat));
+    this->metrics_dumper = nullptr;
+    this->shm_transport = nullptr;
+    this->shm_enabled = false;
+    this->shm_ring_size = TCP_SHM_RING_SIZE_DEFAULT;
     pthread_rwlock_init(&this->connect_db_rwlock, nullptr);
 
     this->state_flags = 0;
@@ -36,7 +82,9 @@ TcpServerController::~TcpServerController()
 {
     assert(!this->tcp_new_conn_acc);
     assert(!this->tcp_client_db_mgr);
-    assert(!this->tcp_client_svc_mgr);
+    assert(this->tcp_client_svc_mgr.empty());
+    assert(!this->tcp_worker_pool);
+    assert(!this->shm_transport);
 
     assert(this->connectpendingClients.empty());
     assert(this->establishedClient.empty());
@@ -69,7 +117,30 @@ void TcpServerController::Start()
 {
     assert(this->tcp_new_conn_acc);
     assert(this->tcp_client_db_mgr);
-    assert(this->tcp_client_svc_mgr);
+
+    // io_uring 后端是编译时可选的, 内核也可能不支持, 此时退回 epoll
+    if (this->mx_type == TCP_MULTIPLEX_IO_URING && !TcpClientServiceManager::IsIoUringSupported())
+    {
+        printf("io_uring backend unavailable, falling back to epoll\n");
+        this->mx_type = TCP_MULTIPLEX_EPOLL;
+    }
+
+    this->CreateClientSvcMgrs();
+
+    // 线程池必须先于 DRS 启动, DRS 收到的消息可能立即交给线程池
+    this->tcp_worker_pool = new TcpWorkerPool(this, this->n_workers);
+    this->tcp_worker_pool->Start();
+
+    // 共享内存通道的消息由 DRS 交给线程池, 在线程池之后启动; 启动失败时所有客户端使用 TCP
+    if (this->shm_enabled)
+    {
+        this->shm_transport = new TcpShmTransport(this, this->shm_ring_size);
+        if (!this->shm_transport->Start())
+        {
+            delete this->shm_transport;
+            this->shm_transport = nullptr;
+        }
+    }
 
     // 启动新连接接受线程
     if (!this->IsBitSet(TCP_SERVER_NOT_ACCEPTING_NEW_CONNECTIONS))
@@ -80,11 +151,13 @@ void TcpServerController::Start()
     // 启动客户端服务器管理线程
     if (!this->IsBitSet(TCP_SERVER_NOT_LISTENING_CLIENT))
     {
-        this->tcp_client_svc_mgr->StartTcpClientServiceManagerThread();
+        for (size_t i = 0; i < this->tcp_client_svc_mgr.size(); i++)
+            this->tcp_client_svc_mgr[i]->StartTcpClientServiceManagerThread();
     }
 
     // initializing and starting TCP Server Msg Q thread
     pthread_create(&this->msgQ_op_thread, nullptr, tcp_server_msgq_thread_fn, (void *)this);
+    this->msgq_thread_running = true;
 
     this->SetBit(TCP_SERVER_RUNNING);
 
@@ -99,6 +172,16 @@ void TcpServerController::Stop()
 {
     TcpClient *tcp_client;
 
+    // 输出最后一次快照, 之后 DRS 分片被销毁
+    this->StopMetricsDump();
+
+    // 连接池的客户端在 DRS 仍在运行时删除, 正在进行的连接被放弃
+    while (!this->conn_pools.empty())
+    {
+        delete this->conn_pools.front();
+        this->conn_pools.pop_front();
+    }
+
     // 停止 CAS
     if (this->tcp_new_conn_acc)
     {
@@ -107,28 +190,56 @@ void TcpServerController::Stop()
         this->SetBit(TCP_SERVER_NOT_ACCEPTING_NEW_CONNECTIONS);
     }
 
+    // 停止共享内存传输的线程, 之后不会再有通道交给 DRS; DRS 中已经排队的命令可能还在使用它, DRS 停止后才删除
+    if (this->shm_transport)
+        this->shm_transport->Stop();
+
+    // 停止消息线程, 之后不会再有客户端被加入 DRS; DRS 投递的消息留在队列中
+    this->StopMsgQThread();
+
+    // DRS 注销所有客户端, 之后不再读取 socket, 不会再向线程池和消息队列投递消息
+    for (size_t i = 0; i < this->tcp_client_svc_mgr.size(); i++)
+        this->tcp_client_svc_mgr[i]->StopListenAll();
+
+    // 线程池处理完已提交的消息后停止; 工作线程的回复和恢复读取请求仍会访问 DRS, 所以 DRS 在此之后才删除
+    if (this->tcp_worker_pool)
+    {
+        this->tcp_worker_pool->Stop();
+        delete this->tcp_worker_pool;
+        this->tcp_worker_pool = nullptr;
+    }
+
     // 停止 DRMS
-    if (this->tcp_client_svc_mgr)
+    if (!this->tcp_client_svc_mgr.empty())
     {
-        this->tcp_client_svc_mgr->Stop();
-        this->tcp_client_svc_mgr = nullptr;
+        for (size_t i = 0; i < this->tcp_client_svc_mgr.size(); i++)
+            this->tcp_client_svc_mgr[i]->Stop();
+        this->tcp_client_svc_mgr.clear();
         this->SetBit(TCP_SERVER_NOT_LISTENING_CLIENT);
     }
 
+    if (this->shm_transport)
+    {
+        delete this->shm_transport;
+        this->shm_transport = nullptr;
+    }
+
+    this->DiscardMsgQ();
+
     // Stopping the above two services frist ensures that now no thread is alive which could add tcpclient back into DB
     // 停止 DRS
     this->tcp_client_db_mgr->Purge();
     delete this->tcp_client_db_mgr;
     this->tcp_client_db_mgr = nullptr;
 
-    // 使用读写锁,互斥的切断正在等待的客户端
+    // 使用读写锁,互斥的切断正在等待的客户端(DRS 停止时已经放弃了正在进行的连接)
     pthread_rwlock_wrlock(&this->connect_db_rwlock);
     while (!this->connectpendingClients.empty())
     {
         tcp_client = this->connectpendingClients.front();
         assert(tcp_client->IsStateSet(TCP_CLIENT_STATE_CONNECT_IN_PROGRESS));
-        tcp_client->StopConnectorThread();
         this->connectpendingClients.pop_front();
+        tcp_client->ctrlr_list = nullptr;
         tcp_client->Dereference();
     }
 
@@ -137,13 +248,11 @@ void TcpServerController::Stop()
     {
         tcp_client = this->establishedClient.front();
         assert(tcp_client->IsStateSet(TCP_CLIENT_STATE_CONNECTED));
-        if (tcp_client->IsStateSet(TCP_CLIENT_STATE_THREADED))
-        {
-            tcp_client->StopThread();
-        }
         this->establishedClient.pop_front();
+        tcp_client->ctrlr_list = nullptr;
         tcp_client->Dereference();
     }
+    this->established_index.Clear();
 
     // 解锁并删除读写锁
     pthread_rwlock_unlock(&this->connect_db_rwlock);
@@ -172,7 +281,7 @@ uint32_t TcpServerController::GetStateFlags()
 void TcpServerController::SetClientCreationMode(bool status)
 {
     // 如果请求启用多线程模式，但当前已经是多线程模式，则直接返回
-    if (status && !this->IsBitSet(TCP_SERVER_CREATE_MULTI_THREADED_CLIENT))
+    if (status && this->IsBitSet(TCP_SERVER_CREATE_MULTI_THREADED_CLIENT))
         return;
 
     // 如果请求禁用多线程模式，但当前已经是单线程模式，则直接返回
@@ -208,23 +317,356 @@ void TcpServerController::SetServerNotifCallbacks(void (*client_connected)(const
     this->client_ka_pending = client_ka_pending;
 }
 
+/**
+ * @brief 设置批量消息回调, 必须在 Start() 之前调用
+ *
+ * 设置后分帧器一次读取得到的多条完整消息(最多 TCP_MSG_BATCH_MAX 条)通过一次回调交给应用层,
+ * 线程池中的客户端也按 strand 中积压的消息成批回调; 不再调用 client_msg_recvd
+ *
+ * @param client_msg_batch_recvd 批量消息回调, spans 只在回调期间有效
+ */
+void TcpServerController::SetServerMsgBatchCallback(void (*client_msg_batch_recvd)(const TcpServerController *, const TcpClient *, TcpMsgSpan_t *, uint32_t))
+{
+    assert(this->state_flags == TCP_SERVER_INITIALZED);
+    this->client_msg_batch_recvd = client_msg_batch_recvd;
+}
+
+/**
+ * @brief 设置大消息的流式回调, 必须在 Start() 之前调用
+ *
+ * 设置后超过分帧器环形缓冲区的消息不再是协议错误, 而是按到达的数据逐段回调(每段最长 UINT16_MAX),
+ * 同一条消息的片段按顺序交付, frame_offset + chunk_size == frame_size 表示最后一段;
+ * 线程池中的客户端的片段与普通消息一起在 strand 中排队
+ *
+ * @param client_msg_chunk_recvd 片段回调, 数据只在回调期间有效
+ */
+void TcpServerController::SetServerMsgChunkCallback(void (*client_msg_chunk_recvd)(const TcpServerController *, const TcpClient *, unsigned char *, uint16_t,
+                                                                                   uint64_t frame_offset, uint64_t frame_size))
+{
+    assert(this->state_flags == TCP_SERVER_INITIALZED);
+    this->client_msg_chunk_recvd = client_msg_chunk_recvd;
+}
+
+/**
+ * @brief 设置分帧协议错误回调, 必须在 Start() 之前调用
+ *
+ * 在 DRS 线程中回调, 返回之后客户端被断开
+ *
+ * @param client_protocol_error 协议错误回调
+ */
+void TcpServerController::SetProtocolErrorCallback(void (*client_protocol_error)(const TcpServerController *, const TcpClient *, TcpMsgDemarcarError,
+                                                                                 uint64_t frame_size))
+{
+    assert(this->state_flags == TCP_SERVER_INITIALZED);
+    this->client_protocol_error = client_protocol_error;
+}
+
+/**
+ * @brief 设置客户端的空闲超时和 keepalive 参数, 必须在 Start() 之前调用, 由各 DRS 的时间轮驱动
+ *
+ * 启用 keepalive 时所有客户端都标记为 TCP_CLIENT_STATE_KA_BASED, 每 ka_interval_ms 未收到数据时
+ * 回调 client_ka_pending(应用层在回调中发送 keepalive 消息), 连续 ka_max_missed 次之后仍未收到数据则断开客户端
+ *
+ * @param idle_timeout_ms 空闲超时(毫秒), 0 表示不启用
+ * @param ka_interval_ms keepalive 间隔(毫秒), 0 表示不启用
+ * @param ka_max_missed 允许连续未响应的 keepalive 次数
+ */
+void TcpServerController::SetClientTimeouts(uint32_t idle_timeout_ms, uint32_t ka_interval_ms, uint32_t ka_max_missed)
+{
+    assert(!this->IsBitSet(TCP_SERVER_RUNNING));
+    this->idle_timeout_ms = idle_timeout_ms;
+    this->ka_interval_ms = ka_interval_ms;
+    this->ka_max_missed = ka_max_missed;
+}
+
+/**
+ * @brief 设置主动连接的超时和重试退避时间
+ *
+ * 连接失败或超时后第 n 次重试前等待 min(backoff_max_ms, backoff_min_ms * 2^(n-1)) 的 1/2 ~ 1 倍(随机),
+ * 连接断开后的第一次重连也会等待, 由各 DRS 的时间轮驱动(精度 TCP_TIMER_WHEEL_TICK_MS)
+ *
+ * @param connect_timeout_ms 连接超时(毫秒), 0 表示不限制
+ * @param backoff_min_ms 第一次重试的退避时间(毫秒)
+ * @param backoff_max_ms 退避时间上限(毫秒)
+ */
+void TcpServerController::SetActiveConnectConfig(uint32_t connect_timeout_ms, uint32_t backoff_min_ms, uint32_t backoff_max_ms)
+{
+    assert(backoff_min_ms <= backoff_max_ms);
+    this->connect_timeout_ms = connect_timeout_ms;
+    this->connect_backoff_min_ms = backoff_min_ms;
+    this->connect_backoff_max_ms = backoff_max_ms;
+}
+
+/**
+ * @brief 设置客户端发送队列的高/低水位及通知回调
+ *
+ * 积压字节数超过 high_wm 时回调 client_send_wm(..., true), 应用层应暂停向该客户端发送;
+ * 回落到 low_wm 以下时回调 client_send_wm(..., false)
+ *
+ * @param high_wm 高水位(字节)
+ * @param low_wm 低水位(字节), 必须小于 high_wm
+ * @param client_send_wm 水位变化回调, 可以为 nullptr
+ */
+void TcpServerController::SetSendWatermarks(uint32_t high_wm, uint32_t low_wm,
+                                            void (*client_send_wm)(const TcpServerController *, const TcpClient *, bool))
+{
+    assert(low_wm < high_wm);
+    this->send_high_wm = high_wm;
+    this->send_low_wm = low_wm;
+    this->client_send_wm = client_send_wm;
+}
+
 /**
  * @brief 为指定的Tcp客户端创建多线程处理环境
  *
+ * 客户端的 I/O 仍然由 DRS 完成, 分帧后的消息交给工作线程池处理
+ *
  * @param tcp_client 需要启动多线程处理的 TCP客户端
  */
 void TcpServerController::CreateMultiThreadedClient(TcpClient *tcp_client)
 {
-    assert(tcp_client->client_thread == nullptr);
-    tcp_client->StartThread();
+    assert(!tcp_client->IsStateSet(TCP_CLIENT_STATE_POOLED));
+    tcp_client->SetState(TCP_CLIENT_STATE_POOLED);
+
+    if (!tcp_client->IsStateSet(TCP_CLIENT_STATE_MULTIPLEX_LISTEN))
+        this->ClientFDStartListen(tcp_client);
+}
+
+/**
+ * @brief 将一条完整的消息交给应用层: 多线程客户端交给线程池, 否则在 DRS 线程中直接回调
+ *
+ * @param tcp_client 消息来源的客户端
+ * @param msg 消息内容, 只在本次调用期间有效
+ * @param msg_size 消息长度
+ */
+void TcpServerController::ClientMsgRecvd(TcpClient *tcp_client, unsigned char *msg, uint16_t msg_size)
+{
+    TcpMsgSpan_t span;
+
+    span.data = msg;
+    span.size = msg_size;
+
+    this->ClientMsgBatchRecvd(tcp_client, &span, 1);
+}
+
+/**
+ * @brief 将一批完整的消息交给应用层: 多线程客户端逐条交给线程池, 否则在 DRS 线程中直接回调
+ *
+ * 设置了 client_msg_batch_recvd 时整批只回调一次, 否则逐条回调 client_msg_recvd
+ *
+ * @param tcp_client 消息来源的客户端
+ * @param spans 消息, 只在本次调用期间有效
+ * @param n_spans 消息数
+ */
+void TcpServerController::ClientMsgBatchRecvd(TcpClient *tcp_client, TcpMsgSpan_t *spans, uint32_t n_spans)
+{
+    uint32_t i;
+    uint64_t latency;
+    TcpReactorMetrics_t *metrics = this->GetClientMetricsShard(tcp_client);
+
+    tcp_client->conn.frames_recvd += n_spans;
+    TcpMetricAdd(&metrics->frames_recvd, n_spans);
+
+    // 客户端在线程池中时消息由线程池按顺序处理; 中途迁移回内联处理后, 剩下的消息在这里直接回调
+    if (this->tcp_worker_pool)
+    {
+        for (i = 0; i < n_spans && this->tcp_worker_pool->Dispatch(tcp_client, spans[i].data, spans[i].size); i++)
+            ;
+
+        spans += i;
+        n_spans -= i;
+    }
+
+    if (!n_spans || (!this->client_msg_batch_recvd && !this->client_msg_recvd))
+        return;
+
+    // 独立线程的客户端不经过 DRS, 没有读取时间; 一批消息来自同一次读取, 延迟相同
+    if (tcp_client->conn.recv_ns)
+    {
+        latency = TcpMetricsNowNs() - tcp_client->conn.recv_ns;
+
+        for (i = 0; i < n_spans; i++)
+            TcpHistogramRecord(&metrics->recv_to_cb, latency);
+    }
+
+    if (this->client_msg_batch_recvd)
+    {
+        this->client_msg_batch_recvd(this, tcp_client, spans, n_spans);
+        return;
+    }
+
+    for (i = 0; i < n_spans; i++)
+        this->client_msg_recvd(this, tcp_client, spans[i].data, spans[i].size);
+}
+
+/**
+ * @brief 将大消息的一个片段交给应用层: 多线程客户端交给线程池(与普通消息在同一个 strand 中排队), 否则直接回调
+ *
+ * @param tcp_client 消息来源的客户端
+ * @param chunk 片段数据, 只在本次调用期间有效
+ * @param chunk_size 片段长度
+ * @param frame_offset 片段在整条消息中的偏移
+ * @param frame_size 整条消息的长度
+ */
+void TcpServerController::ClientMsgChunkRecvd(TcpClient *tcp_client, unsigned char *chunk, uint16_t chunk_size,
+                                              uint64_t frame_offset, uint64_t frame_size)
+{
+    TcpReactorMetrics_t *metrics = this->GetClientMetricsShard(tcp_client);
+
+    // 最后一段交付时才算收到一条消息
+    if (frame_offset + chunk_size == frame_size)
+    {
+        tcp_client->conn.frames_recvd++;
+        TcpMetricAdd(&metrics->frames_recvd, 1);
+    }
+
+    if (this->tcp_worker_pool && this->tcp_worker_pool->Dispatch(tcp_client, chunk, chunk_size, frame_offset, frame_size))
+        return;
+
+    if (this->client_msg_chunk_recvd)
+        this->client_msg_chunk_recvd(this, tcp_client, chunk, chunk_size, frame_offset, frame_size);
+}
+
+/**
+ * @brief (DRS 线程) 客户端违反了分帧协议, 通知应用层, 之后 DRS 断开客户端
+ *
+ * @param tcp_client 出错的客户端
+ * @param error 错误类型
+ * @param frame_size 消息头中的消息长度
+ */
+void TcpServerController::ClientProtocolError(TcpClient *tcp_client, TcpMsgDemarcarError error, uint64_t frame_size)
+{
+    TcpMetricAdd(&this->GetClientMetricsShard(tcp_client)->protocol_errors, 1);
+
+    if (this->client_protocol_error)
+        this->client_protocol_error(this, tcp_client, error, frame_size);
+}
+
+/**
+ * @brief (工作线程) 线程池中的积压回落到低水位, 恢复读取客户端: TCP 由 DRS 读取, 共享内存通道由接收线程读取
+ *
+ * @param tcp_client 调用方持有引用的客户端
+ */
+void TcpServerController::ClientResumeRead(TcpClient *tcp_client)
+{
+    // svc_mgr 可能同时被 DRS 线程清空, 只读取一次
+    TcpClientServiceManager *svc_mgr = __atomic_load_n(&tcp_client->svc_mgr, __ATOMIC_RELAXED);
+
+    if (svc_mgr)
+        svc_mgr->ClientFDResumeRead(tcp_client);
+
+    if (this->shm_transport)
+        this->shm_transport->ResumeRead(tcp_client);
+}
+
+/**
+ * @brief (DRS 线程) 共享内存通道可读, 在监听该客户端的 DRS 中取出并交付消息
+ *
+ * @param tcp_client 已协商共享内存的客户端
+ */
+void TcpServerController::ClientShmDrain(TcpClient *tcp_client)
+{
+    if (this->shm_transport)
+        this->shm_transport->DrainChannel(tcp_client);
+}
+
+/**
+ * @brief 客户端的计数器记在它当前所属的 DRS 分片中, 不在任何分片中时记在 unsharded_metrics 中
+ *
+ * @param tcp_client 客户端
+ * @return TcpReactorMetrics_t* 计数器, 所有字段都需要原子访问
+ */
+TcpReactorMetrics_t *TcpServerController::GetClientMetricsShard(TcpClient *tcp_client)
+{
+    // svc_mgr 可能同时被 DRS 线程清空, 只读取一次; DRS 分片在 Stop() 之前不会被销毁
+    TcpClientServiceManager *svc_mgr = __atomic_load_n(&tcp_client->svc_mgr, __ATOMIC_RELAXED);
+
+    return svc_mgr ? svc_mgr->GetMetrics() : &this->unsharded_metrics;
+}
+
+/**
+ * @brief 获取服务器的指标快照, 不加锁, 各计数器分别读取, 整体是近似一致的
+ *
+ * 只能在服务器运行期间调用(DRS 分片在 Stop() 中销毁)
+ *
+ * @param snapshot 输出
+ */
+void TcpServerController::GetMetricsSnapshot(TcpMetricsSnapshot_t *snapshot)
+{
+    size_t i, n_reactors = this->tcp_client_svc_mgr.size();
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    snapshot->timestamp_ms = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    snapshot->n_clients = 0;
+
+    memset(&snapshot->total, 0, sizeof(snapshot->total));
+    memset(&snapshot->ctrl_q_lat, 0, sizeof(snapshot->ctrl_q_lat));
+    snapshot->reactors.assign(n_reactors + 1, TcpReactorMetrics_t());
+
+    for (i = 0; i < n_reactors; i++)
+    {
+        TcpReactorMetricsAccumulate(&snapshot->reactors[i], this->tcp_client_svc_mgr[i]->GetMetrics());
+        snapshot->n_clients += this->tcp_client_svc_mgr[i]->GetClientCount();
+    }
+
+    TcpReactorMetricsAccumulate(&snapshot->reactors[n_reactors], &this->unsharded_metrics);
+
+    for (i = 0; i <= n_reactors; i++)
+        TcpReactorMetricsAccumulate(&snapshot->total, &snapshot->reactors[i]);
+
+    TcpHistogramAccumulate(&snapshot->ctrl_q_lat, &this->ctrl_q_lat);
+}
+
+/**
+ * @brief 启动周期性的指标输出, 每 interval_ms 输出一行 JSON
+ *
+ * @param target "file:<path>" 追加写入文件, "udp:<ip>:<port>" 发送 UDP 报文
+ * @param interval_ms 输出间隔(毫秒)
+ * @return true 已启动
+ * @return false 目标格式错误或打开失败
+ */
+bool TcpServerController::StartMetricsDump(const char *target, uint32_t interval_ms)
+{
+    assert(this->IsBitSet(TCP_SERVER_RUNNING));
+    assert(!this->metrics_dumper);
+
+    this->metrics_dumper = new TcpMetricsDumper(this, interval_ms);
+
+    if (!this->metrics_dumper->Open(target))
+    {
+        delete this->metrics_dumper;
+        this->metrics_dumper = nullptr;
+        return false;
+    }
+
+    this->metrics_dumper->Start();
+    return true;
+}
+
+/**
+ * @brief 停止周期性的指标输出, 停止前输出最后一次快照
+ *
+ */
+void TcpServerController::StopMetricsDump()
+{
+    if (!this->metrics_dumper)
+        return;
+
+    this->metrics_dumper->Stop();
+    delete this->metrics_dumper;
+    this->metrics_dumper = nullptr;
 }
 
 /**
  * @brief 处理新连接的TCP客户端
  *
+ * 可能在多个 accept 线程中并发调用: DB 由 DBM 的读写锁保护, 加入监听通过 DRS 的命令队列完成
+ *
  * @param tcp_client
+ * @param shard_hint 接受连接的 accept 分片编号, TCP_REACTOR_SHARD_ACCEPTOR 策略据此选择 DRS, -1 表示没有
  */
-void TcpServerController::ProcessNewClient(TcpClient *tcp_client)
+void TcpServerController::ProcessNewClient(TcpClient *tcp_client, int shard_hint)
 {
     // 将 tcp客户端 添加到 客户端数据库中管理
     this->tcp_client_db_mgr->AddClientToDB(tcp_client);
@@ -232,14 +674,12 @@ void TcpServerController::ProcessNewClient(TcpClient *tcp_client)
     // 根据服务器配置选择客户端处理模式
     if (this->IsBitSet(TCP_SERVER_CREATE_MULTI_THREADED_CLIENT))
     {
-        // 多线程模式: 为客户端创建独立线程进行并发处理
-        this->CreateMultiThreadedClient(tcp_client);
-    }
-    else
-    {
-        // 单线程模式: 使用简单的事件监听机制处理客户端通信
-        this->tcp_client_svc_mgr->ClientFDStartListenSimple(tcp_client);
+        // 多线程模式: 与 CreateMultiThreadedClient() 相同, 消息交给线程池处理
+        tcp_client->SetState(TCP_CLIENT_STATE_POOLED);
     }
+
+    // 由 DRS 分片监听客户端 socket
+    this->ClientFDStartListen(tcp_client, shard_hint);
 }
 
 /**
@@ -258,9 +698,12 @@ void TcpServerController::ProcessClientDelete(uint32_t ip_addr, uint16_t port_no
         return;
     }
 
-    if (!tcp_client->client_thread)
+    if (this->shm_transport)
+        this->shm_transport->Detach(tcp_client);
+
+    if (tcp_client->IsStateSet(TCP_CLIENT_STATE_MULTIPLEX_LISTEN))
     {
-        this->tcp_client_svc_mgr->ClientFDStopListenSimple(tcp_client);
+        this->ClientFDStopListen(tcp_client);
     }
 }
 
@@ -278,57 +721,254 @@ void TcpServerController::ProcessClientDelete(TcpClient *tcp_client)
     if (tcp_client->IsStateSet(TCP_CLIENT_STATE_PASSIVE_OPENER))
         this->tcp_client_db_mgr->RemoveClientFromDB(tcp_client);
 
-    // 停止客户端的多路复用监听（单线程模式）
-    if (tcp_client->IsStateSet(TCP_CLIENT_STATE_MULTIPLEX_LISTEN))
-        this->tcp_client_svc_mgr->ClientFDStopListenSimple(tcp_client);
-
-    // 停止客户端的处理线程（多线程模式）
-    if (tcp_client->client_thread)
-        tcp_client->StopThread();
+    // 停止接收共享内存通道中的消息(必须在移出数据库之后, 与协商中的 TcpShmTransport::Attach() 配合)
+    if (this->shm_transport)
+        this->shm_transport->Detach(tcp_client);
 
     // 处理主动连接端（客户端发起的连接）的清理
+    // 先从列表中移除, 之后 ActiveClientReconnect()/ActiveClientConnected() 找不到此客户端, 不会再开始连接
     if (tcp_client->IsStateSet(TCP_CLIENT_STATE_ACTIVE_OPENER))
     {
         pthread_rwlock_wrlock(&this->connect_db_rwlock);
 
-        // 从已建立连接列表中移除客户端
-        if (tcp_client->IsStateSet(TCP_CLIENT_STATE_CONNECTED))
+        // 从已建立连接列表或连接等待列表中移除客户端
+        if (tcp_client->ctrlr_list)
         {
-            this->establishedClient.remove(tcp_client);
-            tcp_client->Dereference();
-        }
-        else
-        // 从连接等待列表中移除客户端
-        {
-            this->connectpendingClients.remove(tcp_client);
+            if (tcp_client->ctrlr_list == &this->establishedClient)
+                this->EstablishedIndexRemove(tcp_client);
+
+            this->ActiveListRemove(tcp_client);
             tcp_client->Dereference();
         }
         pthread_rwlock_unlock(&this->connect_db_rwlock);
     }
 
+    // 停止客户端的多路复用监听（单线程模式）, 或放弃正在进行的主动连接
+    if (tcp_client->IsStateSet(TCP_CLIENT_STATE_MULTIPLEX_LISTEN) ||
+        tcp_client->IsStateSet(TCP_CLIENT_STATE_CONNECT_IN_PROGRESS))
+        this->ClientFDStopListen(tcp_client);
+
+    // 多线程模式: 不再向线程池提交新消息, 已提交的消息处理完后线程池释放其引用
+    tcp_client->UnSetState(TCP_CLIENT_STATE_POOLED);
+
     // 减少引用计数
     tcp_client->Dereference();
 }
 
 /**
- * @brief 从客户端数据库中移除指定的TCP客户端
+ * @brief 从客户端数据库中移除指定的TCP客户端
+ *
+ * @param tcp_client 需要从数据库中移除的TCP客户端对象指针
+ */
+void TcpServerController::RemoveClientFromDB(TcpClient *tcp_client)
+{
+    this->tcp_client_db_mgr->RemoveClientFromDB(tcp_client);
+}
+
+/**
+ * @brief 启动TCP客户端的事件监听
+ *
+ * @param tcp_client 需要启动事件监听的TCP客户端对象指针
+ * @param shard_hint 接受连接的 accept 分片编号, -1 表示没有
+ *
+ */
+void TcpServerController::ClientFDStartListen(TcpClient *tcp_client, int shard_hint)
+{
+    this->SelectClientSvcMgr(tcp_client, shard_hint)->ClientFDStartListen(tcp_client);
+}
+
+/**
+ * @brief 停止TCP客户端的事件监听, 交给当前监听它的 DRS 分片处理
+ *
+ * @param tcp_client 需要停止事件监听的TCP客户端对象指针
+ */
+void TcpServerController::ClientFDStopListen(TcpClient *tcp_client)
+{
+    TcpClientServiceManager *svc_mgr = tcp_client->svc_mgr;
+
+    if (!svc_mgr)
+        return;
+
+    svc_mgr->ClientFDStopListen(tcp_client);
+}
+
+/**
+ * @brief 设置 DRS 分片数量, 必须在 Start() 之前调用
+ *
+ * select() 后端只支持一个分片, 此时设置会被忽略
+ *
+ * @param n_reactors   分片数量(线程数), 0 表示使用 CPU 核心数
+ * @param pin_to_cores 是否把第 i 个分片线程绑定到第 i 个核心
+ */
+void TcpServerController::SetReactorCount(uint16_t n_reactors, bool pin_to_cores)
+{
+    assert(!this->IsBitSet(TCP_SERVER_RUNNING));
+
+    if (n_reactors == 0)
+    {
+        long n_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        n_reactors = n_cores > 0 ? (uint16_t)n_cores : 1;
+    }
+
+    this->n_reactors = n_reactors;
+    this->pin_reactors = pin_to_cores;
+}
+
+/**
+ * @brief 设置新客户端的 DRS 分片分配策略
+ *
+ * @param policy 最小负载 / (ip, port) 哈希 / 跟随 accept 分片
+ */
+void TcpServerController::SetReactorShardPolicy(TcpReactorShardPolicy policy)
+{
+    this->shard_policy = policy;
+}
+
+/**
+ * @brief DRS 分片数量, Start() 之前返回配置值
+ */
+uint16_t TcpServerController::GetReactorCount()
+{
+    if (!this->tcp_client_svc_mgr.empty())
+        return (uint16_t)this->tcp_client_svc_mgr.size();
+
+    return this->mx_type == TCP_MULTIPLEX_SELECT ? 1 : this->n_reactors;
+}
+
+/**
+ * @brief 按编号获取 DRS 分片, 只在 Start() 之后有效
+ */
+TcpClientServiceManager *TcpServerController::GetClientSvcMgr(uint16_t reactor_id)
+{
+    assert(reactor_id < this->tcp_client_svc_mgr.size());
+
+    return this->tcp_client_svc_mgr[reactor_id];
+}
+
+/**
+ * @brief 设置 accept 线程数量和监听参数, 必须在 Start() 之前调用
+ *
+ * 每个 accept 线程拥有自己的 SO_REUSEPORT 监听 socket, 由内核分散新连接, 新客户端在 accept 线程中
+ * 直接分配到 DRS 分片, 不经过控制器消息队列
+ *
+ * @param n_acceptors accept 线程数, 0 表示与 DRS 分片数量相同
+ * @param backlog     每个监听 socket 的 listen() backlog, 0 表示 SOMAXCONN
+ * @param use_accept4 是否使用 accept4(SOCK_NONBLOCK | SOCK_CLOEXEC)
+ */
+void TcpServerController::SetAcceptorConfig(uint16_t n_acceptors, int backlog, bool use_accept4)
+{
+    assert(!this->IsBitSet(TCP_SERVER_RUNNING));
+    assert(this->tcp_new_conn_acc);
+
+    this->tcp_new_conn_acc->SetListenConfig(n_acceptors, backlog, use_accept4);
+}
+
+/**
+ * @brief 设置多线程客户端的工作线程池大小, 必须在 Start() 之前调用
+ *
+ * @param n_workers 工作线程数, 0 表示使用 CPU 核心数
+ */
+void TcpServerController::SetWorkerPoolSize(uint16_t n_workers)
+{
+    assert(!this->IsBitSet(TCP_SERVER_RUNNING));
+
+    if (n_workers == 0)
+    {
+        long n_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        n_workers = n_cores > 0 ? (uint16_t)n_cores : 1;
+    }
+
+    this->n_workers = n_workers;
+}
+
+/**
+ * @brief 启用同一主机上的客户端的共享内存传输, 必须在 Start() 之前调用
+ *
+ * 客户端通过 TcpShmConnect() 协商成功后消息经过共享内存收发, 仍交给同样的回调;
+ * 未协商的客户端不受影响
+ *
+ * @param enable 是否启用
+ * @param ring_size 每个通道每个方向的环形缓冲区长度
+ */
+void TcpServerController::SetShmTransport(bool enable, uint64_t ring_size)
+{
+    assert(!this->IsBitSet(TCP_SERVER_RUNNING));
+
+    this->shm_enabled = enable;
+    this->shm_ring_size = ring_size;
+}
+
+/**
+ * @brief 查找被动连接的客户端并增加引用计数, 调用方负责 Dereference()
+ *
+ * @param ip_addr 客户端IP地址（主机字节序）
+ * @param port_no 客户端端口号（主机字节序）
+ * @return TcpClient* 不存在时返回 nullptr
+ */
+TcpClient *TcpServerController::LookupPassiveClient(uint32_t ip_addr, uint16_t port_no)
+{
+    return this->tcp_client_db_mgr->LookUpClientDB_Reference(ip_addr, port_no);
+}
+
+/**
+ * @brief 按配置创建 DRS 分片, 由 Start() 调用
  *
- * @param tcp_client 需要从数据库中移除的TCP客户端对象指针
  */
-void TcpServerController::RemoveClientFromDB(TcpClient *tcp_client)
+void TcpServerController::CreateClientSvcMgrs()
 {
-    this->tcp_client_db_mgr->RemoveClientFromDB(tcp_client);
+    uint16_t i, n_reactors;
+    long n_cores;
+
+    if (!this->tcp_client_svc_mgr.empty())
+        return;
+
+    // select() 模式下每个线程都要重建完整的 fd_set, 多分片没有意义
+    n_reactors = this->mx_type == TCP_MULTIPLEX_SELECT ? 1 : this->n_reactors;
+    n_cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for (i = 0; i < n_reactors; i++)
+    {
+        this->tcp_client_svc_mgr.push_back(
+            new TcpClientServiceManager(this, i, (this->pin_reactors && n_cores > 0) ? (int)(i % n_cores) : -1));
+    }
 }
 
 /**
- * @brief 启动TCP客户端的事件监听
- *
- * @param tcp_client 需要启动事件监听的TCP客户端对象指针
+ * @brief 为客户端选择一个 DRS 分片
  *
+ * @param tcp_client 需要被监听的客户端
+ * @param shard_hint 接受连接的 accept 分片编号, -1 表示没有
+ * @return TcpClientServiceManager* 选中的分片
  */
-void TcpServerController::ClientFDStartListen(TcpClient *tcp_client)
+TcpClientServiceManager *TcpServerController::SelectClientSvcMgr(TcpClient *tcp_client, int shard_hint)
 {
-    this->tcp_client_svc_mgr->ClientFDStartListenSimple(tcp_client);
+    size_t i, n_reactors = this->tcp_client_svc_mgr.size();
+    TcpClientServiceManager *svc_mgr;
+
+    assert(n_reactors);
+
+    if (n_reactors == 1)
+        return this->tcp_client_svc_mgr[0];
+
+    if (this->shard_policy == TCP_REACTOR_SHARD_HASH)
+    {
+        uint64_t key = ((uint64_t)tcp_client->ip_addr << 16) | tcp_client->port_no;
+        key *= 0x9E3779B97F4A7C15ULL; // Fibonacci 哈希, 打散相邻的端口号
+        return this->tcp_client_svc_mgr[(key >> 32) % n_reactors];
+    }
+
+    // accept 线程与 DRS 分片一一对应, 连接不需要跨分片移交
+    if (this->shard_policy == TCP_REACTOR_SHARD_ACCEPTOR && shard_hint >= 0)
+        return this->tcp_client_svc_mgr[shard_hint % n_reactors];
+
+    svc_mgr = this->tcp_client_svc_mgr[0];
+    for (i = 1; i < n_reactors; i++)
+    {
+        if (this->tcp_client_svc_mgr[i]->GetClientCount() < svc_mgr->GetClientCount())
+            svc_mgr = this->tcp_client_svc_mgr[i];
+    }
+
+    return svc_mgr;
 }
 
 /**
@@ -345,15 +985,13 @@ void TcpServerController::ProcessClientMigrationToMultiThread(uint32_t ip_addr,
     if (!tcp_client)
         return;
 
-    if (tcp_client->client_thread)
+    if (tcp_client->IsStateSet(TCP_CLIENT_STATE_POOLED))
     {
         printf("Error: Client is already Multi-threaded\n");
         return;
     }
 
-    // 停止客户端的简单监听事件(单线程模式)
-    this->tcp_client_svc_mgr->ClientFDStartListenSimple(tcp_client);
-    // 为客户端创建多线程模式
+    // 客户端继续由 DRS 监听, 之后的消息交给线程池处理
     this->CreateMultiThreadedClient(tcp_client);
 }
 
@@ -370,24 +1008,74 @@ void TcpServerController::ProcessClientMigrationToMultiplex(uint32_t ip_addr, ui
     if (!tcp_client)
         return;
 
-    if (!tcp_client->client_thread)
+    if (!tcp_client->IsStateSet(TCP_CLIENT_STATE_POOLED))
     {
         printf("Error: client is already Multiplexed\n");
         return;
     }
 
-    tcp_client->StopThread();
-    this->tcp_client_svc_mgr->ClientFDStartListenSimple(tcp_client);
+    // 线程池中尚未处理的消息仍由线程池按顺序处理完, 之后的消息才在 DRS 线程中直接处理
+    tcp_client->UnSetState(TCP_CLIENT_STATE_POOLED);
+
+    if (!tcp_client->IsStateSet(TCP_CLIENT_STATE_MULTIPLEX_LISTEN))
+        this->ClientFDStartListen(tcp_client);
 }
 
 /**
- * @brief 设置 TCP 消息定界器类型
+ * @brief 设置新连接使用的 TCP 消息定界器, 只影响之后接受的连接
  *
- * @param msgd_type
+ * @param msgd_type 分帧方式
+ * @param fixed_size TCP_DEMARCAR_FIXED_SIZE 的消息长度
+ * @param start_pattern TCP_DEMARCAR_PATTERN 的起始标记, nullptr 表示没有起始标记
+ * @param end_pattern TCP_DEMARCAR_PATTERN 的结束标记
  */
-void TcpServerController::SetTcpMsgDemarcar(TcpMsgDemarcarType msgd_type)
+void TcpServerController::SetTcpMsgDemarcar(TcpMsgDemarcarType msgd_type, uint16_t fixed_size,
+                                            const char *start_pattern, const char *end_pattern)
 {
+    assert(msgd_type != TCP_DEMARCAR_FIXED_SIZE || fixed_size);
+    assert(msgd_type != TCP_DEMARCAR_PATTERN || (end_pattern && *end_pattern));
+
     this->msgd_type = msgd_type;
+    this->msgd_fixed_size = fixed_size;
+    this->msgd_start_pattern = start_pattern ? start_pattern : "";
+    this->msgd_end_pattern = end_pattern ? end_pattern : "";
+}
+
+/**
+ * @brief 新连接使用可配置的长度前缀分帧器, 只影响之后接受的连接
+ *
+ * 超过环形缓冲区的消息在设置了 client_msg_chunk_recvd 时流式交付, 否则为协议错误
+ *
+ * @param header_size 长度头字节数, 1/2/4/8
+ * @param byte_order 长度头的字节序
+ * @param includes_header 长度的值是否包括长度头本身
+ * @param max_frame_size 消息(包括长度头)的最大长度, 超过时为协议错误, 0 表示不限制
+ */
+void TcpServerController::SetLengthPrefixDemarcar(uint8_t header_size, TcpFrameByteOrder byte_order,
+                                                  bool includes_header, uint64_t max_frame_size)
+{
+    assert(header_size == 1 || header_size == 2 || header_size == 4 || header_size == 8);
+
+    this->msgd_type = TCP_DEMARCAR_LENGTH_PREFIX;
+    this->msgd_length_prefix.header_size = header_size;
+    this->msgd_length_prefix.byte_order = byte_order;
+    this->msgd_length_prefix.includes_header = includes_header;
+    this->msgd_length_prefix.max_frame_size = max_frame_size;
+}
+
+/**
+ * @brief 按服务器配置为新连接创建分帧器, TCP_DEMARCAR_NONE 时返回 nullptr
+ *
+ */
+TcpMsgDemarcar *TcpServerController::CreateClientMsgDemarcar()
+{
+    if (this->msgd_type == TCP_DEMARCAR_LENGTH_PREFIX)
+        return new TcpMsgLengthPrefixDemarcar(&this->msgd_length_prefix, this->client_msg_chunk_recvd != nullptr);
+
+    return TcpMsgDemarcar::InstantiateTcpMsgDemarcar(
+        this->msgd_type, this->msgd_fixed_size,
+        (unsigned char *)this->msgd_start_pattern.data(), (uint8_t)this->msgd_start_pattern.size(),
+        (unsigned char *)this->msgd_end_pattern.data(), (uint8_t)this->msgd_end_pattern.size());
 }
 
 /**
@@ -408,6 +1096,25 @@ void TcpServerController::Dispaly()
     }
 
     printf("Litening on : [%s, %d]\n", network_convert_ip_n_to_p(this->ip_addr, 0), this->port_no);
+    printf("Multiplex : %s, DRS shards : %zu\n",
+           this->mx_type == TCP_MULTIPLEX_EPOLL ? "epoll" : this->mx_type == TCP_MULTIPLEX_IO_URING ? "io_uring" : "select",
+           this->tcp_client_svc_mgr.size());
+
+    for (size_t i = 0; i < this->tcp_client_svc_mgr.size(); i++)
+    {
+        printf("  DRS[%u] clients : %u\n", this->tcp_client_svc_mgr[i]->GetReactorId(), this->tcp_client_svc_mgr[i]->GetClientCount());
+        this->tcp_client_svc_mgr[i]->DisplayUringStats();
+    }
+
+    if (this->tcp_new_conn_acc)
+        this->tcp_new_conn_acc->Display();
+
+    if (this->tcp_worker_pool)
+        this->tcp_worker_pool->Display();
+
+    this->DisplayPoolStats();
+    this->DisplayMetrics();
+    this->DisplayShmStats();
 
     printf("Falgs :  ");
 
@@ -454,6 +1161,78 @@ void TcpServerController::Dispaly()
     }
 
     pthread_rwlock_unlock(&this->connect_db_rwlock);
+
+    for (std::list<TcpConnPool *>::iterator pool_it = this->conn_pools.begin(); pool_it != this->conn_pools.end(); ++pool_it)
+        (*pool_it)->Display();
+}
+
+/**
+ * @brief 打印对象池的命中率: 内存池(TcpClient/分帧器/环形缓冲区), 镜像缓冲区缓存, 控制消息节点池
+ *
+ */
+void TcpServerController::DisplayPoolStats()
+{
+    uint64_t n_allocs, n_hits;
+
+    TcpMemPoolGetStats(&n_allocs, &n_hits);
+    printf("Mem Pool hit rate : %.1f%% (%lu / %lu)\n",
+           n_allocs ? n_hits * 100.0 / n_allocs : 0.0, (unsigned long)n_hits, (unsigned long)n_allocs);
+    TcpMemPoolDisplay();
+
+    MCBCacheStats(&n_allocs, &n_hits);
+    printf("Mirrored ring cache hit rate : %.1f%% (%lu / %lu)\n",
+           n_allocs ? n_hits * 100.0 / n_allocs : 0.0, (unsigned long)n_hits, (unsigned long)n_allocs);
+
+    printf("Msg Pool fallback allocations : %lu\n", (unsigned long)this->msg_pool.GetFallbackCount());
+}
+
+void TcpServerController::DisplayShmStats()
+{
+    if (this->shm_transport)
+        this->shm_transport->Display();
+}
+
+/**
+ * @brief 打印指标快照: 总计数器, 延迟百分位, 以及每个分片的收发统计
+ *
+ */
+void TcpServerController::DisplayMetrics()
+{
+    size_t i;
+    TcpReactorMetrics_t *m;
+    TcpMetricsSnapshot_t *snapshot = new TcpMetricsSnapshot_t();
+
+    this->GetMetricsSnapshot(snapshot);
+    m = &snapshot->total;
+
+    printf("Metrics : recvd %lu bytes / %lu frames, sent %lu bytes / %lu frames\n",
+           (unsigned long)m->bytes_recvd, (unsigned long)m->frames_recvd,
+           (unsigned long)m->bytes_sent, (unsigned long)m->frames_sent);
+    printf("  syscalls : recv = %lu, send = %lu, wait = %lu, partial reads = %lu, ring hwm = %lu bytes\n",
+           (unsigned long)m->recv_calls, (unsigned long)m->send_calls, (unsigned long)m->wait_calls,
+           (unsigned long)m->partial_reads, (unsigned long)m->ring_hwm);
+    printf("  protocol errors = %lu, connect attempts = %lu, connect failures = %lu\n",
+           (unsigned long)m->protocol_errors, (unsigned long)m->connect_attempts, (unsigned long)m->connect_failures);
+    printf("  recv -> callback (us) : p50 = %.1f, p99 = %.1f, p99.9 = %.1f, max = %.1f\n",
+           TcpHistogramPercentile(&m->recv_to_cb, 50) / 1000.0, TcpHistogramPercentile(&m->recv_to_cb, 99) / 1000.0,
+           TcpHistogramPercentile(&m->recv_to_cb, 99.9) / 1000.0, m->recv_to_cb.max / 1000.0);
+    printf("  DRS cmd queue (us) : p50 = %.1f, p99 = %.1f, max = %.1f\n",
+           TcpHistogramPercentile(&m->cmd_q_lat, 50) / 1000.0, TcpHistogramPercentile(&m->cmd_q_lat, 99) / 1000.0,
+           m->cmd_q_lat.max / 1000.0);
+    printf("  Ctrl msg queue (us) : p50 = %.1f, p99 = %.1f, max = %.1f\n",
+           TcpHistogramPercentile(&snapshot->ctrl_q_lat, 50) / 1000.0, TcpHistogramPercentile(&snapshot->ctrl_q_lat, 99) / 1000.0,
+           snapshot->ctrl_q_lat.max / 1000.0);
+
+    for (i = 0; i + 1 < snapshot->reactors.size(); i++)
+    {
+        m = &snapshot->reactors[i];
+        printf("  DRS[%zu] : recvd %lu bytes, sent %lu bytes, frames %lu / %lu, syscalls %lu / %lu / %lu\n",
+               i, (unsigned long)m->bytes_recvd, (unsigned long)m->bytes_sent,
+               (unsigned long)m->frames_recvd, (unsigned long)m->frames_sent,
+               (unsigned long)m->recv_calls, (unsigned long)m->send_calls, (unsigned long)m->wait_calls);
+    }
+
+    delete snapshot;
 }
 
 /**
@@ -471,15 +1250,17 @@ void TcpServerController::ProcessMsgQMsg(TcpServerMsg_t *msg)
     if (msg->code & CTRLR_ACTION_TCP_CLIENT_DELETE)
     {
         this->ProcessClientDelete(tcp_client);
+        // 消息持有的引用
+        tcp_client->Dereference();
         return;
     }
 
     if (msg->code & CTRLR_ACTION_TCP_CLIENT_RECONNECT)
     {
-        uint32_t server_ip_addr = tcp_client->server_ip_addr;
-        uint16_t server_port_no = tcp_client->server_port_no;
-        this->ProcessClientDelete(tcp_client);
-        this->CreateActiveClient(server_ip_addr, server_port_no);
+        this->ActiveClientReconnect(tcp_client);
+        // 消息持有的引用
+        tcp_client->Dereference();
+        return;
     }
 
     if (msg->code & CTRLR_ACTION_TCP_CLIENT_PROCESS_NEW)
@@ -490,38 +1271,27 @@ void TcpServerController::ProcessMsgQMsg(TcpServerMsg_t *msg)
     if (msg->code & CTRLR_ACTION_TCP_CLIENT_MULTIPLEX_LISTEN)
     {
         assert(!tcp_client->IsStateSet(TCP_CLIENT_STATE_MULTIPLEX_LISTEN));
-        this->tcp_client_svc_mgr->ClientFDStartListenSimple(tcp_client);
+        this->ClientFDStartListen(tcp_client);
     }
 
     if (msg->code & CTRLR_ACTION_TCP_CLIENT_MX_TO_MULTITHREADED)
     {
-        if (tcp_client->IsStateSet(TCP_CLIENT_STATE_THREADED))
+        if (tcp_client->IsStateSet(TCP_CLIENT_STATE_POOLED))
             return;
 
-        if (tcp_client->IsStateSet(TCP_CLIENT_STATE_MULTIPLEX_LISTEN))
-        {
-            this->tcp_client_svc_mgr->ClientFDStopListenSimple(tcp_client);
-        }
-
         this->CreateMultiThreadedClient(tcp_client);
     }
 
     if (msg->code & CTRLR_ACTION_TCP_CLIENT_MULTITHREAD_TO_MX)
     {
-        if (tcp_client->IsStateSet(TCP_CLIENT_STATE_MULTIPLEX_LISTEN))
-            return;
+        tcp_client->UnSetState(TCP_CLIENT_STATE_POOLED);
 
-        if (tcp_client->IsStateSet(TCP_CLIENT_STATE_THREADED))
-        {
-            tcp_client->StopThread();
-        }
-
-        this->tcp_client_svc_mgr->ClientFDStartListenSimple(tcp_client);
+        if (!tcp_client->IsStateSet(TCP_CLIENT_STATE_MULTIPLEX_LISTEN))
+            this->ClientFDStartListen(tcp_client);
     }
 
     if (msg->code & CTRLR_ACTION_TCP_CLIENT_CREATE_THREADED)
     {
-        assert(!tcp_client->IsStateSet(TCP_CLIENT_STATE_THREADED));
         this->CreateMultiThreadedClient(tcp_client);
     }
 
@@ -533,9 +1303,8 @@ void TcpServerController::ProcessMsgQMsg(TcpServerMsg_t *msg)
         assert(!tcp_client->IsStateSet(TCP_CLIENT_STATE_PASSIVE_OPENER));
         assert(tcp_client->IsStateSet(TCP_CLIENT_STATE_ACTIVE_OPENER));
         assert(!tcp_client->IsStateSet(TCP_CLIENT_STATE_MULTIPLEX_LISTEN));
-        assert(!tcp_client->IsStateSet(TCP_CLIENT_STATE_THREADED));
+        assert(!tcp_client->IsStateSet(TCP_CLIENT_STATE_POOLED));
 
-        pthread_rwlock_wrlock(&this->connect_db_rwlock);
         if (this->IsBitSet(TCP_SERVER_CREATE_MULTI_THREADED_CLIENT))
         {
             this->CreateMultiThreadedClient(tcp_client);
@@ -545,51 +1314,90 @@ void TcpServerController::ProcessMsgQMsg(TcpServerMsg_t *msg)
             this->ClientFDStartListen(tcp_client);
         }
     }
+}
+
+/**
+ * @brief (消息线程) 取出下一条消息, 每条异步消息之前都先检查同步消息队列
+ *
+ * @return TcpServerMsg_t* 没有可处理的消息返回 nullptr
+ */
+TcpServerMsg_t *TcpServerController::DequeMsg()
+{
+    TcpServerMsg_t *msg = this->msgQ_urgent.Dequeue();
+
+    if (msg)
+        return msg;
 
-    free(msg);
+    return this->msgQ.Dequeue();
+}
+
+bool TcpServerController::IsMsgQEmpty()
+{
+    return this->msgQ_urgent.IsEmpty() && this->msgQ.IsEmpty();
 }
 
 /**
  * @brief 消息队列处理函数(线程函数)
  *
+ * 消息在任何锁之外处理; 两个队列都为空时才阻塞在 eventfd 上, 生产者只有在消息线程空闲时才写 eventfd
  */
 void TcpServerController::MsgQProcessingThreadFn()
 {
+    int cancel_state;
+    uint64_t counter;
+    sem_t *zero_sema;
     TcpServerMsg_t *msg;
+
     while (true)
     {
-        pthread_mutex_lock(&this->msgq_mutex);
-
-        // 等待条件: 当消息队列为空时, 线程在此等待
-        while (this->msgQ.empty())
-        {
-            pthread_cond_wait(&this->msgq_cv, &this->msgq_mutex);
-        }
-
         // 批量处理队列中的所有消息，直到队列为空
-        while (1)
+        while ((msg = this->DequeMsg()))
         {
-            if (this->msgQ.empty())
-                break;
-            msg = this->msgQ.front();
-            this->msgQ.pop_front();
+            // 处理消息期间禁止取消
+            pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancel_state);
+
+            TcpHistogramRecord(&this->ctrl_q_lat, TcpMetricsNowNs() - msg->enq_ns);
             this->ProcessMsgQMsg(msg);
 
+            zero_sema = msg->zero_sema;
+            this->msg_pool.Free(msg);
+
             // 如果消息带有信号量，通知发送方消息已处理完成
             // 用于实现同步的消息处理模式
-            if (msg->zero_sema)
+            if (zero_sema)
             {
-                sem_post(msg->zero_sema); // 信号量+1, 唤醒等待线程(传递消息线程)
+                sem_post(zero_sema); // 信号量+1, 唤醒等待线程(传递消息线程)
             }
+
+            pthread_setcancelstate(cancel_state, nullptr);
+        }
+
+        // 生产者已经入队但还没有完成链接, 稍后即可取出
+        if (!this->IsMsgQEmpty())
+            continue;
+
+        // 先声明空闲再检查队列: 与生产者 入队 -> 检查空闲 的顺序相反, 保证不会错过唤醒
+        this->msgq_thread_idle.store(true);
+
+        if (!this->IsMsgQEmpty())
+        {
+            this->msgq_thread_idle.store(false);
+            continue;
         }
 
-        pthread_mutex_unlock(&this->msgq_mutex);
+        // 阻塞等待唤醒(read 是取消点)
+        if (read(this->msgq_event_fd, &counter, sizeof(counter)) < 0 && errno != EINTR)
+            printf("%s() eventfd read failed, error = %d\n", __FUNCTION__, errno);
+
+        this->msgq_thread_idle.store(false);
     }
 }
 
 /**
  * @brief 向消息队列传递消息(线程函数)
  *
+ * 入队是无锁的, 多个 CAS/DRS 线程可以同时投递消息而互不阻塞
+ *
  * @param code 消息类型代码
  * @param data 消息关联的数据
  * @param block_me 是否阻塞模式: true-同步模式(等待消息处理再返回), false-异步模式(投递消息之后立即返回)
@@ -597,30 +1405,31 @@ void TcpServerController::MsgQProcessingThreadFn()
 void TcpServerController::EnqueMsg(tcp_server_msg_code_t code, void *data, bool block_me)
 {
     sem_t sem;
-    TcpServerMsg_t *msg = (TcpServerMsg_t *)calloc(1, sizeof(TcpServerMsg_t));
+    uint64_t counter = 1;
+    TcpServerMsg_t *msg = this->msg_pool.Alloc();
     msg->code = code;
     msg->data = data;
+    msg->enq_ns = TcpMetricsNowNs();
 
     // 根据阻塞模式配置信号量
     if (block_me)
     {
         sem_init(&sem, 0, 0);
         msg->zero_sema = &sem;
+        this->msgQ_urgent.Enqueue(msg); // 同步消息优先处理
     }
     else
     {
         msg->zero_sema = nullptr;
+        this->msgQ.Enqueue(msg); // 异步消息按顺序处理
     }
 
-    pthread_mutex_lock(&this->msgq_mutex);
-
-    if (block_me)
-        this->msgQ.push_front(msg); // 同步消息放到队列头部优先处理
-    else
-        this->msgQ.push_back(msg); // 异步消息放到队列尾部,按顺序处理
-
-    pthread_cond_signal(&this->msgq_cv); // 通知消息线程有新消息到达
-    pthread_mutex_unlock(&this->msgq_mutex);
+    // 只有消息线程空闲时才需要唤醒, 繁忙时它会在处理完当前批次后看到新消息
+    if (this->msgq_thread_idle.load() && this->msgq_thread_idle.exchange(false))
+    {
+        if (write(this->msgq_event_fd, &counter, sizeof(counter)) < 0)
+            printf("%s() eventfd write failed, error = %d\n", __FUNCTION__, errno);
+    }
 
     // 同步模式,等待消息完成(异步模式信号量设置nullptr, 这里直接跳过)
     if (block_me)
@@ -632,60 +1441,191 @@ void TcpServerController::EnqueMsg(tcp_server_msg_code_t code, void *data, bool
 }
 
 /**
- * @brief 创建主动连接的TCP客户端
+ * @brief 停止消息线程. 正在处理的消息会先处理完, 队列中剩余的消息不再处理
+ *
+ * 此时 CAS 已经停止, DRS 仍在运行, 之后 DRS 投递的消息留在队列中, 由 DiscardMsgQ() 丢弃
+ */
+void TcpServerController::StopMsgQThread()
+{
+    if (!this->msgq_thread_running)
+        return;
+
+    pthread_cancel(this->msgQ_op_thread);
+    pthread_join(this->msgQ_op_thread, nullptr);
+    this->msgq_thread_running = false;
+
+    // 生产者看到线程不空闲, 不再写 eventfd
+    this->msgq_thread_idle.store(false);
+}
+
+/**
+ * @brief 丢弃队列中剩余的消息
+ *
+ * 此时消息线程和 DRS 都已经停止, 剩余消息引用的客户端会在之后的 Purge 中统一清理;
+ * 同步消息的发送方仍然会被唤醒
+ */
+void TcpServerController::DiscardMsgQ()
+{
+    TcpServerMsg_t *msg;
+
+    while (!this->IsMsgQEmpty())
+    {
+        msg = this->DequeMsg();
+
+        if (!msg)
+            continue;
+
+        if (msg->zero_sema)
+            sem_post(msg->zero_sema);
+
+        this->msg_pool.Free(msg);
+    }
+
+    close(this->msgq_event_fd);
+    this->msgq_event_fd = -1;
+}
+
+/**
+ * @brief 创建主动连接的TCP客户端, 必须在 Start() 之后调用
+ *
+ * 连接由 DRS 以非阻塞 connect() 异步建立, 不阻塞调用线程; 失败或超时后按退避时间自动重试,
+ * 连接成功后客户端加入 DRS 的监听集合并回调 client_connected, 之后断开时复用同一个客户端重新连接
  *
  * @param server_ip_addr 要连接的远程服务器IP地址（网络字节序）
  * @param server_port_no 要连接的远程服务器端口号（主机字节序）
+ * @return TcpClient* 新的客户端, 由 Controller 的连接列表持有, 调用方长期使用时需要自行 Reference()
  */
-void TcpServerController::CreateActiveClient(uint32_t server_ip_addr, uint16_t server_port_no)
+TcpClient *TcpServerController::CreateActiveClient(uint32_t server_ip_addr, uint16_t server_port_no)
 {
-    tcp_server_msg_code_t ctrlr_code = (tcp_server_msg_code_t)0;
-
     // 设置客户端连接参数
     TcpClient *tcp_client = new TcpClient();
     tcp_client->server_ip_addr = server_ip_addr;
     tcp_client->server_port_no = server_port_no;
     tcp_client->ip_addr = this->ip_addr;
-    tcp_client->port_no = 0; // Dynamically allocated
+    tcp_client->port_no = 0; // Dynamically allocated, 连接成功后更新为本地地址
     tcp_client->tcp_ctrlr = this;
 
-    // 初始化 线程操作完成 信号量
-    sem_init(&tcp_client->wait_for_thread_operation_to_complete, 0, 0);
-
-    // 配置客户端参数
-    tcp_client->SetTcpMsgDemarcar(nullptr);
+    // 配置客户端参数, 与被动连接使用相同的分帧方式
+    tcp_client->SetTcpMsgDemarcar(this->CreateClientMsgDemarcar());
     tcp_client->SetState(TCP_CLIENT_STATE_ACTIVE_OPENER);
+    tcp_client->SetState(TCP_CLIENT_STATE_CONNECT_IN_PROGRESS);
     tcp_client->conn.conn_type = tcp_conn_via_connect;
 
+    // 增加计数, 由连接等待列表持有
+    tcp_client->Reference();
+
     // 将客户端添加到连接等待列表(线程安全)
     pthread_rwlock_wrlock(&this->connect_db_rwlock);
-    this->connectpendingClients.push_back(tcp_client);
+    this->ActiveListAdd(&this->connectpendingClients, tcp_client);
     pthread_rwlock_unlock(&this->connect_db_rwlock);
 
-    // 增加计数
-    tcp_client->Reference();
+    // 由 DRS 立即发起连接(非阻塞)
+    this->SelectClientSvcMgr(tcp_client, -1)->ClientConnectStart(tcp_client, false);
+
+    return tcp_client;
+}
+
+/**
+ * @brief (DRS 线程) 主动连接成功, 客户端已经加入 DRS 的监听集合: 移入已建立连接列表并通知应用层
+ *
+ * @param tcp_client 连接成功的客户端
+ */
+void TcpServerController::ActiveClientConnected(TcpClient *tcp_client)
+{
+    pthread_rwlock_wrlock(&this->connect_db_rwlock);
 
-    // 尝试建立客户端连接(非阻塞模式)
-    if (tcp_client->TryClientConnect(true) == 0)
+    // 应用层正在删除此客户端(ProcessClientDelete() 随后会停止监听)
+    if (tcp_client->ctrlr_list != &this->connectpendingClients)
     {
-        // 连接成功, 更新客户端
-        pthread_rwlock_wrlock(&this->connect_db_rwlock);
-        {
-            this->connectpendingClients.remove(tcp_client);
-            this->establishedClient.push_back(tcp_client);
-        }
         pthread_rwlock_unlock(&this->connect_db_rwlock);
+        return;
+    }
 
-        // 根据服务器配置(单线程/多线程)选择客户端模式
-        if (this->IsBitSet(TCP_SERVER_CREATE_MULTI_THREADED_CLIENT))
-        {
-            this->CreateMultiThreadedClient(tcp_client);
-        }
-        else
-        {
-            this->ClientFDStartListen(tcp_client);
-        }
+    this->ActiveListRemove(tcp_client);
+    this->ActiveListAdd(&this->establishedClient, tcp_client);
+    this->EstablishedIndexInsert(tcp_client);
+    pthread_rwlock_unlock(&this->connect_db_rwlock);
+
+    // 根据服务器配置(单线程/多线程)选择客户端模式, I/O 都由 DRS 完成
+    if (this->IsBitSet(TCP_SERVER_CREATE_MULTI_THREADED_CLIENT))
+        tcp_client->SetState(TCP_CLIENT_STATE_POOLED);
+
+    if (this->client_connected)
+        this->client_connected(this, tcp_client);
+}
+
+/**
+ * @brief (消息线程) 主动连接断开(DRS 已经停止监听), 复用同一个客户端重新连接
+ *
+ * 断开的 socket 立即关闭, 重连期间的发送以 ENOTCONN 失败; 旧连接中不完整的消息不能与新连接的数据拼接, 分帧器重新创建.
+ * 第一次重连也要等待一个退避时间, 上游重启时大量连接不会同时重连
+ *
+ * @param tcp_client 断开的客户端
+ */
+void TcpServerController::ActiveClientReconnect(TcpClient *tcp_client)
+{
+    int old_fd;
+
+    pthread_rwlock_wrlock(&this->connect_db_rwlock);
+
+    // 应用层已经删除了此客户端, 或者服务器正在停止
+    if (tcp_client->ctrlr_list != &this->establishedClient || this->tcp_client_svc_mgr.empty())
+    {
+        pthread_rwlock_unlock(&this->connect_db_rwlock);
+        return;
+    }
+
+    this->EstablishedIndexRemove(tcp_client);
+    this->ActiveListRemove(tcp_client);
+    this->ActiveListAdd(&this->connectpendingClients, tcp_client);
+
+    tcp_client->UnSetState(TCP_CLIENT_STATE_CONNECTED);
+    tcp_client->UnSetState(TCP_CLIENT_STATE_POOLED);
+
+    old_fd = tcp_client->out_queue.ResetConnection(tcp_client, -1);
+    if (old_fd >= 0)
+        close(old_fd);
+
+    if (tcp_client->msgd)
+    {
+        delete tcp_client->msgd;
+        tcp_client->SetTcpMsgDemarcar(this->CreateClientMsgDemarcar());
     }
+
+    // 在锁内开始连接: 之后的 ProcessClientDelete() 一定能看到 TCP_CLIENT_STATE_CONNECT_IN_PROGRESS 并放弃连接
+    this->SelectClientSvcMgr(tcp_client, -1)->ClientConnectStart(tcp_client, true);
+    pthread_rwlock_unlock(&this->connect_db_rwlock);
+}
+
+/**
+ * @brief 创建到上游服务器的连接池, 必须在 Start() 之后调用
+ *
+ * @param server_ip_addr 上游服务器IP地址（主机字节序）
+ * @param server_port_no 上游服务器端口号
+ * @param n_conns 连接数
+ * @return TcpConnPool* 连接池, 由 Controller 持有, Stop() 时释放, 也可以提前调用 DestroyConnPool()
+ */
+TcpConnPool *TcpServerController::CreateConnPool(uint32_t server_ip_addr, uint16_t server_port_no, uint16_t n_conns)
+{
+    TcpConnPool *pool;
+
+    assert(this->IsBitSet(TCP_SERVER_RUNNING));
+
+    pool = new TcpConnPool(this, server_ip_addr, server_port_no, n_conns);
+    this->conn_pools.push_back(pool);
+
+    return pool;
+}
+
+/**
+ * @brief 删除连接池中的所有连接并释放连接池
+ *
+ * @param pool CreateConnPool() 返回的连接池
+ */
+void TcpServerController::DestroyConnPool(TcpConnPool *pool)
+{
+    this->conn_pools.remove(pool);
+    delete pool;
 }
 
 void TcpServerController::SetBit(uint32_t bit)
@@ -729,9 +1669,10 @@ void TcpServerController::StopClientSvcMgr()
     if (this->IsBitSet(TCP_SERVER_NOT_LISTENING_CLIENT))
         return;
 
-    this->tcp_client_svc_mgr->Stop();
+    for (size_t i = 0; i < this->tcp_client_svc_mgr.size(); i++)
+        this->tcp_client_svc_mgr[i]->Stop();
     this->SetBit(TCP_SERVER_NOT_LISTENING_CLIENT);
-    this->tcp_client_svc_mgr = nullptr;
+    this->tcp_client_svc_mgr.clear();
 }
 
 /**
@@ -754,21 +1695,100 @@ void TcpServerController::CopyAllClientsTolist(std::list<TcpClient *> *list)
 TcpClient *TcpServerController::LookupActiveOpened(uint32_t ip_addr, uint16_t port_no)
 {
     TcpClient *tcp_client;
-    std::list<TcpClient *>::iterator it;
 
     pthread_rwlock_rdlock(&this->connect_db_rwlock);
+    tcp_client = this->established_index.Lookup(ip_addr, port_no);
+    pthread_rwlock_unlock(&this->connect_db_rwlock);
+
+    return tcp_client;
+}
+
+/**
+ * @brief 将客户端加入列表尾部并记录它的位置, 调用方必须持有 connect_db_rwlock 写锁
+ *
+ * @param list connectpendingClients 或 establishedClient
+ * @param tcp_client 不在任何列表中的客户端
+ */
+void TcpServerController::ActiveListAdd(std::list<TcpClient *> *list, TcpClient *tcp_client)
+{
+    assert(!tcp_client->ctrlr_list);
+
+    tcp_client->ctrlr_list = list;
+    tcp_client->ctrlr_list_it = list->insert(list->end(), tcp_client);
+}
+
+/**
+ * @brief 按记录的位置将客户端从所在列表中移除, 调用方必须持有 connect_db_rwlock 写锁
+ *
+ * @param tcp_client 在 connectpendingClients 或 establishedClient 中的客户端
+ */
+void TcpServerController::ActiveListRemove(TcpClient *tcp_client)
+{
+    assert(tcp_client->ctrlr_list);
+
+    tcp_client->ctrlr_list->erase(tcp_client->ctrlr_list_it);
+    tcp_client->ctrlr_list = nullptr;
+}
+
+/**
+ * @brief 将已建立的客户端加入 established_index, 调用方必须持有 connect_db_rwlock 写锁
+ *
+ * 同一服务器有多个已建立的连接时, 索引指向最早建立的一个, 其余的链在它后面
+ *
+ * @param tcp_client 刚加入 establishedClient 的客户端
+ */
+void TcpServerController::EstablishedIndexInsert(TcpClient *tcp_client)
+{
+    TcpClient *head = this->established_index.Lookup(tcp_client->server_ip_addr, tcp_client->server_port_no);
+
+    tcp_client->server_prev = nullptr;
+    tcp_client->server_next = nullptr;
+
+    if (!head)
+    {
+        this->established_index.Insert(tcp_client->server_ip_addr, tcp_client->server_port_no, tcp_client);
+        return;
+    }
+
+    // 插入到表头之后, 索引不变
+    tcp_client->server_prev = head;
+    tcp_client->server_next = head->server_next;
+
+    if (head->server_next)
+        head->server_next->server_prev = tcp_client;
+
+    head->server_next = tcp_client;
+}
+
+/**
+ * @brief 从 established_index 中移除客户端, 调用方必须持有 connect_db_rwlock 写锁
+ *
+ * 移除的是表头时, 由链表中的下一个客户端替代它
+ *
+ * @param tcp_client 仍在 establishedClient 中的客户端
+ */
+void TcpServerController::EstablishedIndexRemove(TcpClient *tcp_client)
+{
+    TcpClient *next = tcp_client->server_next;
+
+    if (tcp_client->server_prev)
+    {
+        tcp_client->server_prev->server_next = next;
+
+        if (next)
+            next->server_prev = tcp_client->server_prev;
+    }
+    else
     {
-        for (it = this->establishedClient.begin(); it != this->establishedClient.end(); ++it)
+        this->established_index.Remove(tcp_client->server_ip_addr, tcp_client->server_port_no);
+
+        if (next)
         {
-            tcp_client = *it;
-            if (tcp_client->server_ip_addr == ip_addr && tcp_client->server_port_no == port_no)
-            {
-                pthread_rwlock_unlock(&this->connect_db_rwlock);
-                return tcp_client;
-            }
+            next->server_prev = nullptr;
+            this->established_index.Insert(next->server_ip_addr, next->server_port_no, next);
         }
     }
-    pthread_rwlock_unlock(&this->connect_db_rwlock);
 
-    return nullptr;
-}
\ No newline at end of file
+    tcp_client->server_prev = nullptr;
+    tcp_client->server_next = nullptr;
+}
@@ -6,12 +6,21 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <list>
+#include <vector>
 #include "TcpMsgDemarcar.h"
+#include "TcpClientServiceManager.h"
+#include "TcpClientHashIndex.h"
+#include "TcpServerMsgQueue.h"
+#include "TcpWorkerPool.h"
+#include "TcpMetrics.h"
+#include "TcpShmChannel.h"
 
 class TcpNewConnectionAcceptor; // CAS = Connection Acceptor Service
 class TcpClientServiceManager;  // DRS = Data Receive Service
 class TcpClientDbManager;       // DBM = (Client) Database Manager
 class TcpClient;
+class TcpShmTransport;           // 同一主机上的客户端的共享内存传输
+class TcpConnPool;               // 到同一上游服务器的一组主动连接
 
 // Server States
 #define TCP_SERVER_INITIALZED 1
@@ -20,6 +29,10 @@ class TcpClient;
 #define TCP_SERVER_NOT_LISTENING_CLIENT 8
 #define TCP_SERVER_CREATE_MULTI_THREADED_CLIENT 16
 
+#define TCP_CONNECT_TIMEOUT_MS 3000      // 主动连接的默认超时
+#define TCP_CONNECT_BACKOFF_MIN_MS 100   // 主动连接失败后第一次重试的默认退避时间, 之后每次翻倍
+#define TCP_CONNECT_BACKOFF_MAX_MS 30000 // 默认退避时间上限
+
 typedef enum tcp_server_msg_code_
 {
     CTRLR_ACTION_TCP_CLIENT_PROCESS_NEW = 1,             // 新客户端连接处理
@@ -35,9 +48,13 @@ typedef enum tcp_server_msg_code_
 
 typedef struct TcpServerMsg_
 {
-    tcp_server_msg_code_t code; // 控制操作类型
-    void *data;                 // 对应的客户端或者其他数据
-    sem_t *zero_sema;           // 传入线程阻塞等待消息完成
+    tcp_server_msg_code_t code;               // 控制操作类型
+    void *data;                               // 对应的客户端或者其他数据
+    sem_t *zero_sema;                         // 传入线程阻塞等待消息完成
+    std::atomic<struct TcpServerMsg_ *> next; // 消息队列中的下一条消息(TcpServerMsgQueue)
+    std::atomic<uint32_t> free_next;          // 节点池空闲栈中的下一个节点索引(TcpServerMsgPool)
+    uint32_t pool_index;                      // 节点在节点池中的索引, TCP_SERVER_MSG_POOL_NONE 表示 calloc 分配
+    uint64_t enq_ns;                          // 入队时间(TcpMetricsNowNs), 用于统计消息队列延迟
 } TcpServerMsg_t;
 
 class TcpServerController
@@ -45,35 +62,94 @@ class TcpServerController
 private:
     TcpNewConnectionAcceptor *tcp_new_conn_acc;
     TcpClientDbManager *tcp_client_db_mgr;
-    TcpClientServiceManager *tcp_client_svc_mgr;
+    std::vector<TcpClientServiceManager *> tcp_client_svc_mgr; // DRS 分片(reactor), 每个分片一个线程
+
+    uint16_t n_reactors;                 // DRS 分片数量, 默认等于 CPU 核心数
+    bool pin_reactors;                   // 是否将分片线程绑定到 CPU 核心
+    TcpReactorShardPolicy shard_policy;  // 新客户端的分片分配策略
+
+    TcpWorkerPool *tcp_worker_pool; // 多线程客户端的消息处理线程池
+    uint16_t n_workers;             // 线程池大小, 默认等于 CPU 核心数
 
     uint32_t state_flags; // 用于保存服务器当前状态位
 
     pthread_rwlock_t connect_db_rwlock;           // 保护客户端列表的读写锁
     std::list<TcpClient *> establishedClient;     // 已经建立连接的客户端列表
+    TcpClientHashIndex established_index;         // 按 服务器 ip/port 索引 establishedClient, 用于 LookupActiveOpened
     std::list<TcpClient *> connectpendingClients; // 刚建立未加入系统的客户端列表
 
+    std::list<TcpConnPool *> conn_pools;          // CreateConnPool() 创建的连接池, Stop() 时释放
+
+    void ActiveListAdd(std::list<TcpClient *> *, TcpClient *); // 将客户端加入列表尾部并记录位置(持有 connect_db_rwlock)
+    void ActiveListRemove(TcpClient *);       // 将客户端从所在列表中移除(持有 connect_db_rwlock)
+    void EstablishedIndexInsert(TcpClient *); // 将客户端加入 established_index(持有 connect_db_rwlock)
+    void EstablishedIndexRemove(TcpClient *); // 从 established_index 中移除客户端(持有 connect_db_rwlock)
+    void ActiveClientReconnect(TcpClient *);  // (消息线程) 主动连接断开, 复用客户端重新连接
+
     // Server Msg Q
-    std::list<TcpServerMsg_t *> msgQ;         // 消息队列
-    pthread_mutex_t msgq_mutex;               // 队列锁
-    pthread_cond_t msgq_cv;                   // 条件变量(当队列有消息)
-    pthread_t msgQ_op_thread;                 // 后台线程,处理消息队列
+    TcpServerMsgQueue msgQ;                 // 异步消息队列(无锁 MPSC), 按顺序处理
+    TcpServerMsgQueue msgQ_urgent;          // 同步(block_me)消息队列, 优先于 msgQ 处理
+    TcpServerMsgPool msg_pool;              // 消息节点池
+    int msgq_event_fd;                      // 消息线程空闲时的唤醒 eventfd
+    std::atomic<bool> msgq_thread_idle;     // 消息线程是否(即将)阻塞在 msgq_event_fd 上
+    pthread_t msgQ_op_thread;               // 后台线程,处理消息队列
+    bool msgq_thread_running;               // 消息线程是否正在运行
     void ProcessMsgQMsg(TcpServerMsg_t *msg); // 消息处理具体逻辑
+    TcpServerMsg_t *DequeMsg();               // (消息线程) 取出下一条消息, 同步消息优先
+    bool IsMsgQEmpty();                       // (消息线程) 两个队列是否都为空
+    void StopMsgQThread();                    // 停止消息线程, 之后入队的消息留在队列中
+    void DiscardMsgQ();                       // 丢弃队列中剩余的消息并关闭 eventfd
+
+    // Metrics
+    TcpReactorMetrics_t unsharded_metrics; // 不在任何 DRS 分片中的客户端的计数器
+    TcpHistogram_t ctrl_q_lat;             // 消息队列 入队 -> 处理 的延迟(纳秒), 只由消息线程记录
+    TcpMetricsDumper *metrics_dumper;      // 周期性输出指标快照, nullptr 表示未启用
+
+    // Shared-memory transport
+    TcpShmTransport *shm_transport; // Start() 时创建, nullptr 表示未启用
+    bool shm_enabled;               // 是否启用共享内存传输
+    uint64_t shm_ring_size;         // 每个通道每个方向的环形缓冲区长度
+
+    void CreateClientSvcMgrs();                                  // 按配置创建 DRS 分片
+    TcpClientServiceManager *SelectClientSvcMgr(TcpClient *, int shard_hint); // 为客户端选择 DRS 分片
 
 public:
     // State variables
     uint32_t ip_addr;             // IP 地址
     uint16_t port_no;             // 端口号
     std::string name;             // 服务器名称
-    TcpMsgDemarcarType msgd_type; // 消息解包方式
+    TcpMsgDemarcarType msgd_type;   // 消息解包方式, 新连接按此创建分帧器
+    uint16_t msgd_fixed_size;       // TCP_DEMARCAR_FIXED_SIZE 的消息长度
+    std::string msgd_start_pattern; // TCP_DEMARCAR_PATTERN 的起始标记(可以为空)
+    std::string msgd_end_pattern;   // TCP_DEMARCAR_PATTERN 的结束标记
+    TcpLengthPrefixConfig_t msgd_length_prefix; // TCP_DEMARCAR_LENGTH_PREFIX 的配置
+    TcpMultiplexType mx_type;     // DRS 多路复用后端(epoll / select / io_uring)
 
     void (*client_connected)(const TcpServerController *, const TcpClient *);                            // 客户端连接成功回调
     void (*client_disconnected)(const TcpServerController *, const TcpClient *);                         // 客户端断开回调
     void (*client_msg_recvd)(const TcpServerController *, const TcpClient *, unsigned char *, uint16_t); // 收到客户端消息回调
+    void (*client_msg_batch_recvd)(const TcpServerController *, const TcpClient *, TcpMsgSpan_t *, uint32_t); // 收到一批客户端消息回调, 设置后代替 client_msg_recvd
+    void (*client_msg_chunk_recvd)(const TcpServerController *, const TcpClient *, unsigned char *, uint16_t,
+                                   uint64_t frame_offset, uint64_t frame_size);                           // 收到大消息的一个片段回调(流式交付)
+    void (*client_protocol_error)(const TcpServerController *, const TcpClient *, TcpMsgDemarcarError,
+                                  uint64_t frame_size);                                                   // 分帧协议错误回调, 之后客户端被断开
     void (*client_ka_pending)(const TcpServerController *, const TcpClient *);                           // 等待或失效回调
+    void (*client_send_wm)(const TcpServerController *, const TcpClient *, bool);                        // 发送队列越过高水位(true)/回落到低水位(false)回调
+
+    uint32_t send_high_wm; // 发送队列高水位(字节)
+    uint32_t send_low_wm;  // 发送队列低水位(字节)
+
+    uint32_t idle_timeout_ms; // 空闲超时, 超过此时间未收到数据的客户端被断开, 0 表示不启用
+    uint32_t ka_interval_ms;  // keepalive 间隔, 0 表示不启用
+    uint32_t ka_max_missed;   // 连续多少次 keepalive 未得到响应后断开客户端
+
+    uint32_t connect_timeout_ms;     // 主动连接超时, 0 表示不限制(由内核的 SYN 重传决定)
+    uint32_t connect_backoff_min_ms; // 主动连接失败后第一次重试的退避时间
+    uint32_t connect_backoff_max_ms; // 退避时间上限
 
     // Constructors and Destructors
-    TcpServerController(std::string ip_addr, uint16_t port_no, std::string name);
+    TcpServerController(std::string ip_addr, uint16_t port_no, std::string name,
+                        TcpMultiplexType mx_type = TCP_MULTIPLEX_EPOLL);
     ~TcpServerController();
 
     //
@@ -86,6 +162,15 @@ public:
     bool IsBitSet(uint32_t bit);
 
     void SetClientCreationMode(bool);
+    void SetServerMsgBatchCallback(void (*client_msg_batch_recvd)(const TcpServerController *, const TcpClient *, TcpMsgSpan_t *, uint32_t));
+    void SetServerMsgChunkCallback(void (*client_msg_chunk_recvd)(const TcpServerController *, const TcpClient *, unsigned char *, uint16_t,
+                                                                  uint64_t frame_offset, uint64_t frame_size));
+    void SetProtocolErrorCallback(void (*client_protocol_error)(const TcpServerController *, const TcpClient *, TcpMsgDemarcarError,
+                                                                uint64_t frame_size));
+    void SetClientTimeouts(uint32_t idle_timeout_ms, uint32_t ka_interval_ms, uint32_t ka_max_missed);
+    void SetActiveConnectConfig(uint32_t connect_timeout_ms, uint32_t backoff_min_ms, uint32_t backoff_max_ms);
+    void SetSendWatermarks(uint32_t high_wm, uint32_t low_wm,
+                           void (*client_send_wm)(const TcpServerController *, const TcpClient *, bool));
     void SetServerNotifCallbacks(void (*client_connected)(const TcpServerController *, const TcpClient *),
                                  void (*client_disconnected)(const TcpServerController *, const TcpClient *),
                                  void (*client_msg_recvd)(const TcpServerController *, const TcpClient *, unsigned char *, uint16_t),
@@ -96,7 +181,7 @@ public:
     void ProcessClientMigrationToMultiplex(uint32_t ip_addr, uint16_t port_no);
 
     // Used by Acceptor Service
-    void ProcessNewClient(TcpClient *tcp_client);
+    void ProcessNewClient(TcpClient *tcp_client, int shard_hint = -1);
 
     // Used by Application
     void ProcessClientDelete(uint32_t ip_addr, uint16_t port_no);
@@ -105,8 +190,34 @@ public:
     // Used by Multiplex Service
     void RemoveClientFromDB(TcpClient *);
 
-    // To Pass the request to Multiplex Service Mgr, this is Synchronous.
-    void ClientFDStartListen(TcpClient *tcp_client);
+    // To Pass the request to Multiplex Service Mgr, start is asynchronous, stop is synchronous.
+    void ClientFDStartListen(TcpClient *tcp_client, int shard_hint = -1);
+    void ClientFDStopListen(TcpClient *tcp_client);
+
+    // DRS sharding, must be configured before Start()
+    void SetReactorCount(uint16_t n_reactors, bool pin_to_cores = true);
+    void SetReactorShardPolicy(TcpReactorShardPolicy policy);
+    uint16_t GetReactorCount();
+    TcpClientServiceManager *GetClientSvcMgr(uint16_t reactor_id);
+
+    // SO_REUSEPORT accept sharding, must be configured before Start()
+    void SetAcceptorConfig(uint16_t n_acceptors, int backlog = 0, bool use_accept4 = true);
+
+    // Worker pool for multi-threaded clients, must be configured before Start()
+    void SetWorkerPoolSize(uint16_t n_workers);
+
+    // Shared-memory transport for co-located clients, must be configured before Start()
+    void SetShmTransport(bool enable, uint64_t ring_size = TCP_SHM_RING_SIZE_DEFAULT);
+    TcpClient *LookupPassiveClient(uint32_t ip_addr, uint16_t port_no); // Used by Shm transport, 返回的客户端已增加引用计数
+
+    // Used by Demarcars/DRS to deliver a complete msg, inline or via the worker pool
+    void ClientMsgRecvd(TcpClient *tcp_client, unsigned char *msg, uint16_t msg_size);
+    void ClientMsgBatchRecvd(TcpClient *tcp_client, TcpMsgSpan_t *spans, uint32_t n_spans);
+    void ClientMsgChunkRecvd(TcpClient *tcp_client, unsigned char *chunk, uint16_t chunk_size,
+                             uint64_t frame_offset, uint64_t frame_size);
+    void ClientProtocolError(TcpClient *tcp_client, TcpMsgDemarcarError error, uint64_t frame_size);
+    void ClientResumeRead(TcpClient *tcp_client); // Used by Worker pool, 积压回落后恢复读取客户端
+    void ClientShmDrain(TcpClient *tcp_client);   // Used by DRS, 取出共享内存通道中的消息
 
     // Used my Multiplex service for client migration
     void CreateMultiThreadedClient(TcpClient *);
@@ -119,15 +230,33 @@ public:
     void StopClientSvcMgr();
     void StartClientSvcMgr();
 
-    void SetTcpMsgDemarcar(TcpMsgDemarcarType);
+    void SetTcpMsgDemarcar(TcpMsgDemarcarType, uint16_t fixed_size = 0,
+                           const char *start_pattern = nullptr, const char *end_pattern = nullptr);
+    void SetLengthPrefixDemarcar(uint8_t header_size, TcpFrameByteOrder byte_order,
+                                 bool includes_header, uint64_t max_frame_size = 0);
+    TcpMsgDemarcar *CreateClientMsgDemarcar(); // Used by Acceptor Service, 按配置为新连接创建分帧器
+
+    // Metrics, snapshot is valid while the server is running
+    TcpReactorMetrics_t *GetClientMetricsShard(TcpClient *tcp_client); // 客户端当前所属 DRS 分片的计数器
+    void GetMetricsSnapshot(TcpMetricsSnapshot_t *snapshot);
+    bool StartMetricsDump(const char *target, uint32_t interval_ms); // "file:<path>" 或 "udp:<ip>:<port>"
+    void StopMetricsDump();
 
     // Print the Tcp Server Details
     void Dispaly();
+    void DisplayPoolStats();
+    void DisplayMetrics();
+    void DisplayShmStats();
     void MsgQProcessingThreadFn();
     void EnqueMsg(tcp_server_msg_code_t code, void *data, bool block_me);
-    void CreateActiveClient(uint32_t server_ip_addr, uint16_t server_port_no);
+    TcpClient *CreateActiveClient(uint32_t server_ip_addr, uint16_t server_port_no); // 异步连接, 返回的客户端由 Controller 持有
     void CopyAllClientsTolist(std::list<TcpClient *> *list);
     TcpClient *LookupActiveOpened(uint32_t ip_addr, uint16_t port_no);
+    void ActiveClientConnected(TcpClient *); // Used by DRS, 主动连接成功
+
+    // Outbound connection pools, 必须在 Start() 之后创建, Stop() 时释放
+    TcpConnPool *CreateConnPool(uint32_t server_ip_addr, uint16_t server_port_no, uint16_t n_conns);
+    void DestroyConnPool(TcpConnPool *);
 };
 
 #endif /*TCPSERVERCONTROLLER*/
\ No newline at end of file
@@ -0,0 +1,196 @@
+#include <stdlib.h>
+#include <memory.h>
+#include <assert.h>
+#include "TcpServerController.h"
+#include "TcpServerMsgQueue.h"
+
+TcpServerMsgQueue::TcpServerMsgQueue()
+{
+    this->stub = (TcpServerMsg_t *)calloc(1, sizeof(TcpServerMsg_t));
+    this->stub->next.store(nullptr, std::memory_order_relaxed);
+    this->head.store(this->stub, std::memory_order_relaxed);
+    this->tail = this->stub;
+}
+
+TcpServerMsgQueue::~TcpServerMsgQueue()
+{
+    assert(this->IsEmpty());
+    free(this->stub);
+}
+
+void TcpServerMsgQueue::Push(TcpServerMsg_t *msg)
+{
+    TcpServerMsg_t *prev;
+
+    msg->next.store(nullptr, std::memory_order_relaxed);
+
+    // 1.原子地成为新的 head(seq_cst: 与消费者 声明空闲 -> 检查队列 构成完整的内存屏障, 保证不会错过唤醒)
+    prev = this->head.exchange(msg, std::memory_order_seq_cst);
+
+    // 2.链接到前一个节点之后, release 保证消费者看到 next 时也能看到消息内容
+    prev->next.store(msg, std::memory_order_release);
+}
+
+/**
+ * @brief 消息入队, 可以被任意线程并发调用
+ *
+ * @param msg 消息节点
+ */
+void TcpServerMsgQueue::Enqueue(TcpServerMsg_t *msg)
+{
+    this->Push(msg);
+}
+
+/**
+ * @brief 消息出队, 只能由消费者线程调用
+ *
+ * @return TcpServerMsg_t* 出队的消息; 队列为空或生产者正在入队时返回 nullptr
+ */
+TcpServerMsg_t *TcpServerMsgQueue::Dequeue()
+{
+    TcpServerMsg_t *tail = this->tail;
+    TcpServerMsg_t *next = tail->next.load(std::memory_order_acquire);
+
+    // 跳过哨兵节点
+    if (tail == this->stub)
+    {
+        if (!next)
+            return nullptr;
+
+        this->tail = next;
+        tail = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+
+    if (next)
+    {
+        this->tail = next;
+        return tail;
+    }
+
+    // tail 后面没有节点: 要么 tail 是最后一个节点, 要么生产者还没有完成链接
+    if (tail != this->head.load(std::memory_order_acquire))
+        return nullptr;
+
+    // tail 是最后一个节点, 重新放入哨兵节点后才能把 tail 取出
+    this->Push(this->stub);
+
+    next = tail->next.load(std::memory_order_acquire);
+
+    if (next)
+    {
+        this->tail = next;
+        return tail;
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief 队列是否为空, 只能由消费者线程调用
+ *
+ * tail 不是哨兵节点时, tail 本身就是下一个要出队的消息; 是哨兵节点时, head 也必须是哨兵节点
+ */
+bool TcpServerMsgQueue::IsEmpty()
+{
+    return this->tail == this->stub &&
+           this->head.load(std::memory_order_seq_cst) == this->stub;
+}
+
+#define POOL_INDEX(_head) ((uint32_t)(_head))
+#define POOL_TAG(_head) ((uint32_t)((_head) >> 32))
+#define POOL_HEAD(_tag, _index) (((uint64_t)(_tag) << 32) | (_index))
+
+TcpServerMsgPool::TcpServerMsgPool(uint32_t n_nodes)
+{
+    uint32_t i;
+
+    this->nodes = (TcpServerMsg_t *)calloc(n_nodes, sizeof(TcpServerMsg_t));
+    this->n_nodes = n_nodes;
+    this->n_fallback.store(0, std::memory_order_relaxed);
+
+    // 初始时所有节点依次链接在空闲栈中
+    for (i = 0; i < n_nodes; i++)
+    {
+        this->nodes[i].pool_index = i;
+        this->nodes[i].free_next.store(i + 1 < n_nodes ? i + 1 : TCP_SERVER_MSG_POOL_NONE, std::memory_order_relaxed);
+    }
+
+    this->free_head.store(POOL_HEAD(0, n_nodes ? 0 : TCP_SERVER_MSG_POOL_NONE), std::memory_order_release);
+}
+
+TcpServerMsgPool::~TcpServerMsgPool()
+{
+    free(this->nodes);
+}
+
+/**
+ * @brief 从节点池中分配一个消息节点, 节点池耗尽时退回 calloc
+ *
+ * @return TcpServerMsg_t* 已清零的消息节点
+ */
+TcpServerMsg_t *TcpServerMsgPool::Alloc()
+{
+    uint32_t index;
+    TcpServerMsg_t *msg;
+    uint64_t head = this->free_head.load(std::memory_order_acquire);
+
+    while (true)
+    {
+        index = POOL_INDEX(head);
+
+        if (index == TCP_SERVER_MSG_POOL_NONE)
+        {
+            this->n_fallback.fetch_add(1, std::memory_order_relaxed);
+            msg = (TcpServerMsg_t *)calloc(1, sizeof(TcpServerMsg_t));
+            msg->pool_index = TCP_SERVER_MSG_POOL_NONE;
+            return msg;
+        }
+
+        // free_next 可能已经被其他线程修改, 此时版本号必然变化, CAS 失败重试
+        if (this->free_head.compare_exchange_weak(head,
+                                                  POOL_HEAD(POOL_TAG(head) + 1, this->nodes[index].free_next.load(std::memory_order_relaxed)),
+                                                  std::memory_order_acquire,
+                                                  std::memory_order_acquire))
+            break;
+    }
+
+    msg = &this->nodes[index];
+    msg->code = (tcp_server_msg_code_t)0;
+    msg->data = nullptr;
+    msg->zero_sema = nullptr;
+    msg->next.store(nullptr, std::memory_order_relaxed);
+    return msg;
+}
+
+/**
+ * @brief 归还消息节点
+ *
+ * @param msg 由 Alloc() 分配的消息节点
+ */
+void TcpServerMsgPool::Free(TcpServerMsg_t *msg)
+{
+    uint32_t index = msg->pool_index;
+    uint64_t head = this->free_head.load(std::memory_order_relaxed);
+
+    if (index == TCP_SERVER_MSG_POOL_NONE)
+    {
+        free(msg);
+        return;
+    }
+
+    assert(index < this->n_nodes);
+
+    do
+    {
+        msg->free_next.store(POOL_INDEX(head), std::memory_order_relaxed);
+    } while (!this->free_head.compare_exchange_weak(head,
+                                                    POOL_HEAD(POOL_TAG(head) + 1, index),
+                                                    std::memory_order_release,
+                                                    std::memory_order_relaxed));
+}
+
+uint64_t TcpServerMsgPool::GetFallbackCount()
+{
+    return this->n_fallback.load(std::memory_order_relaxed);
+}
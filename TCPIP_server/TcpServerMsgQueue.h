@@ -0,0 +1,64 @@
+#ifndef TCPSERVERMSGQUEUE_H_
+#define TCPSERVERMSGQUEUE_H_
+
+#include <stdint.h>
+#include <atomic>
+
+#define TCP_SERVER_MSG_POOL_SIZE 4096           // 消息节点池的节点数, 用完后退回 calloc
+#define TCP_SERVER_MSG_POOL_NONE UINT32_MAX     // 节点不属于节点池(calloc 分配)
+
+typedef struct TcpServerMsg_ TcpServerMsg_t;
+
+/**
+ * @brief 无锁多生产者单消费者(MPSC)侵入式消息队列
+ *
+ * 1.链接字段(next)位于 TcpServerMsg_t 中, 入队/出队不分配内存
+ *
+ * 2.生产者(CAS 线程, DRS 线程, 应用线程)入队只需一次原子交换(wait-free), 互不阻塞
+ *
+ * 3.只有 Controller 的消息队列线程可以出队
+ *
+ * 4.生产者交换 head 之后、链接 next 之前, 消费者可能暂时看不到该消息, 此时 Dequeue 返回 nullptr 但 IsEmpty 为 false
+ */
+class TcpServerMsgQueue
+{
+private:
+    std::atomic<TcpServerMsg_t *> head; // 最后入队的节点(生产者)
+    TcpServerMsg_t *tail;               // 下一个出队的节点(消费者)
+    TcpServerMsg_t *stub;               // 哨兵节点, 保证队列中至少有一个节点
+
+    void Push(TcpServerMsg_t *);
+
+public:
+    TcpServerMsgQueue();
+    ~TcpServerMsgQueue();
+
+    void Enqueue(TcpServerMsg_t *); // (任意线程) 消息入队
+    TcpServerMsg_t *Dequeue();      // (消费者) 消息出队, 没有可出队的消息返回 nullptr
+    bool IsEmpty();                 // (消费者) 队列是否为空
+};
+
+/**
+ * @brief 消息节点池, 使用 索引+版本号 的无锁栈(Treiber stack)管理空闲节点
+ *
+ * 栈顶保存为 64 位: 高 32 位为版本号, 每次修改 +1, 避免 ABA 问题; 低 32 位为节点索引.
+ * 节点池用完时退回 calloc/free, 不会阻塞或失败.
+ */
+class TcpServerMsgPool
+{
+private:
+    TcpServerMsg_t *nodes;            // 节点数组
+    uint32_t n_nodes;                 // 节点数
+    std::atomic<uint64_t> free_head;  // 空闲栈顶: (版本号 << 32) | 节点索引
+    std::atomic<uint64_t> n_fallback; // 节点池耗尽, 退回 calloc 的次数
+
+public:
+    TcpServerMsgPool(uint32_t n_nodes);
+    ~TcpServerMsgPool();
+
+    TcpServerMsg_t *Alloc(); // 分配一个已清零的消息节点
+    void Free(TcpServerMsg_t *);
+    uint64_t GetFallbackCount();
+};
+
+#endif
@@ -0,0 +1,749 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <memory.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include "TcpShmChannel.h"
+
+#define TCP_SHM_REC_SIZE(msg_size) (((uint64_t)(msg_size) + sizeof(uint32_t) + 7) & ~(uint64_t)7)
+#define TCP_SHM_CHUNK_REC_SIZE(chunk_size) (((uint64_t)(chunk_size) + sizeof(TcpShmChunkHdr_t) + 7) & ~(uint64_t)7)
+
+static uint64_t tcp_shm_page_size()
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+
+    return page_size > 0 ? (uint64_t)page_size : 4096;
+}
+
+/**
+ * @brief 根据共享内存的第一页设置 tx/rx 两个方向
+ *
+ * @param server true: rx = c2s, tx = s2c; false 相反
+ */
+static void tcp_shm_channel_init_rings(TcpShmChannel_t *channel, bool server)
+{
+    uint64_t ring_size = channel->hdr->ring_size;
+    unsigned char *c2s_data = (unsigned char *)channel->hdr + tcp_shm_page_size();
+    unsigned char *s2c_data = c2s_data + ring_size;
+
+    channel->rx.ctrl = server ? &channel->hdr->c2s : &channel->hdr->s2c;
+    channel->rx.data = server ? c2s_data : s2c_data;
+    channel->tx.ctrl = server ? &channel->hdr->s2c : &channel->hdr->c2s;
+    channel->tx.data = server ? s2c_data : c2s_data;
+    channel->rx.size = channel->tx.size = ring_size;
+    channel->rx.peer_pos = __atomic_load_n(&channel->rx.ctrl->head, __ATOMIC_ACQUIRE);
+    channel->tx.peer_pos = __atomic_load_n(&channel->tx.ctrl->tail, __ATOMIC_ACQUIRE);
+    channel->rx.pending = channel->tx.pending = 0;
+}
+
+static TcpShmChannel_t *tcp_shm_channel_alloc()
+{
+    TcpShmChannel_t *channel = (TcpShmChannel_t *)calloc(1, sizeof(TcpShmChannel_t));
+
+    channel->mem_fd = -1;
+    channel->rx_event_fd = -1;
+    channel->tx_event_fd = -1;
+    pthread_mutex_init(&channel->tx_mutex, NULL);
+    return channel;
+}
+
+/**
+ * @brief (服务器端) 创建共享内存通道: memfd 中依次是控制页, c2s 数据区, s2c 数据区, 以及两个方向的 eventfd
+ *
+ * @param ring_size 每个方向的数据区长度, 向上取整为 2 的幂, 不小于 TCP_SHM_RING_SIZE_MIN
+ * @return TcpShmChannel_t* 失败返回 NULL(errno)
+ */
+TcpShmChannel_t *TcpShmChannelCreate(uint64_t ring_size)
+{
+    uint64_t size = TCP_SHM_RING_SIZE_MIN;
+    TcpShmChannel_t *channel;
+    void *mem;
+
+    while (size < ring_size)
+        size <<= 1;
+
+    channel = tcp_shm_channel_alloc();
+    channel->map_size = tcp_shm_page_size() + 2 * size;
+    channel->mem_fd = memfd_create("tcp_shm_channel", MFD_CLOEXEC);
+
+    if (channel->mem_fd < 0 || ftruncate(channel->mem_fd, channel->map_size) < 0)
+    {
+        TcpShmChannelDestroy(channel);
+        return NULL;
+    }
+
+    mem = mmap(NULL, channel->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, channel->mem_fd, 0);
+
+    if (mem == MAP_FAILED)
+    {
+        TcpShmChannelDestroy(channel);
+        return NULL;
+    }
+
+    channel->hdr = (TcpShmHeader_t *)mem;
+    channel->hdr->magic = TCP_SHM_MAGIC;
+    channel->hdr->version = TCP_SHM_VERSION;
+    channel->hdr->ring_size = size;
+    // 两端的消费者初始处于等待状态, 第一条消息总会唤醒对方
+    channel->hdr->c2s.waiting = 1;
+    channel->hdr->s2c.waiting = 1;
+
+    // c2s: 客户端写入后通知服务器; s2c: 服务器写入后通知客户端
+    channel->rx_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    channel->tx_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (channel->rx_event_fd < 0 || channel->tx_event_fd < 0)
+    {
+        TcpShmChannelDestroy(channel);
+        return NULL;
+    }
+
+    tcp_shm_channel_init_rings(channel, true);
+    return channel;
+}
+
+/**
+ * @brief 映射对端创建的通道, 通道接管所有 fd(失败时也会关闭)
+ *
+ * @param mem_fd 共享内存
+ * @param rx_event_fd 对端写入后通知本端的 eventfd
+ * @param tx_event_fd 本端写入后通知对端的 eventfd
+ * @param server 本端是否为服务器
+ * @return TcpShmChannel_t* 失败返回 NULL
+ */
+TcpShmChannel_t *TcpShmChannelMap(int mem_fd, int rx_event_fd, int tx_event_fd, bool server)
+{
+    struct stat st;
+    void *mem;
+    TcpShmChannel_t *channel = tcp_shm_channel_alloc();
+
+    channel->mem_fd = mem_fd;
+    channel->rx_event_fd = rx_event_fd;
+    channel->tx_event_fd = tx_event_fd;
+
+    if (fstat(mem_fd, &st) < 0 || (uint64_t)st.st_size <= tcp_shm_page_size())
+    {
+        TcpShmChannelDestroy(channel);
+        return NULL;
+    }
+
+    channel->map_size = st.st_size;
+    mem = mmap(NULL, channel->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+
+    if (mem == MAP_FAILED)
+    {
+        TcpShmChannelDestroy(channel);
+        return NULL;
+    }
+
+    channel->hdr = (TcpShmHeader_t *)mem;
+
+    // 数据区长度由对端写入, 必须与映射长度一致
+    if (channel->hdr->magic != TCP_SHM_MAGIC || channel->hdr->version != TCP_SHM_VERSION ||
+        channel->hdr->ring_size < TCP_SHM_RING_SIZE_MIN || (channel->hdr->ring_size & (channel->hdr->ring_size - 1)) ||
+        tcp_shm_page_size() + 2 * channel->hdr->ring_size != channel->map_size)
+    {
+        TcpShmChannelDestroy(channel);
+        return NULL;
+    }
+
+    tcp_shm_channel_init_rings(channel, server);
+
+    // 映射之后不再需要 memfd
+    close(channel->mem_fd);
+    channel->mem_fd = -1;
+
+    return channel;
+}
+
+void TcpShmChannelDestroy(TcpShmChannel_t *channel)
+{
+    if (channel->hdr)
+        munmap(channel->hdr, channel->map_size);
+
+    if (channel->mem_fd >= 0)
+        close(channel->mem_fd);
+
+    if (channel->rx_event_fd >= 0)
+        close(channel->rx_event_fd);
+
+    if (channel->tx_event_fd >= 0)
+        close(channel->tx_event_fd);
+
+    pthread_mutex_destroy(&channel->tx_mutex);
+    free(channel);
+}
+
+/**
+ * @brief 对端处于等待状态时写 tx_event_fd 唤醒
+ *
+ * 写入 head 与读取 waiting 之间需要完整的内存屏障, 与 TcpShmChannelWaitArm() 中的屏障配对,
+ * 保证要么生产者看到 waiting, 要么消费者看到新的 head
+ */
+static void tcp_shm_channel_notify(TcpShmChannel_t *channel)
+{
+    uint64_t one = 1;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (!__atomic_load_n(&channel->tx.ctrl->waiting, __ATOMIC_RELAXED))
+        return;
+
+    if (write(channel->tx_event_fd, &one, sizeof(one)) == sizeof(one))
+        channel->n_wakeups++;
+}
+
+/**
+ * @brief 通知对端本端不再写入, 对端等待时会被唤醒
+ *
+ */
+void TcpShmChannelClose(TcpShmChannel_t *channel)
+{
+    pthread_mutex_lock(&channel->tx_mutex);
+    __atomic_store_n(&channel->tx.ctrl->closed, 1, __ATOMIC_RELEASE);
+    tcp_shm_channel_notify(channel);
+    pthread_mutex_unlock(&channel->tx_mutex);
+}
+
+bool TcpShmChannelIsPeerClosed(TcpShmChannel_t *channel)
+{
+    return channel->rx.corrupt || __atomic_load_n(&channel->rx.ctrl->closed, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief 记录不跨越数据区末尾, 剩余空间不足时需要先填充到末尾
+ *
+ * @return uint64_t 填充的字节数
+ */
+static uint64_t tcp_shm_ring_pad(TcpShmRing_t *ring, uint64_t head, uint64_t rec_size)
+{
+    uint64_t offset = head & (ring->size - 1);
+
+    return ring->size - offset < rec_size ? ring->size - offset : 0;
+}
+
+/**
+ * @brief (持有 tx_mutex) 写入一条记录: 记录头 + 数据, 放不下时不写入任何内容
+ *
+ * @param hdr 记录头, 第一个字段是长度字段
+ * @param rec_size 记录的总长度(8 字节对齐)
+ * @return int 成功返回 0; 失败返回 -1: EAGAIN tx 环已满, EPIPE 本端已关闭
+ */
+static int tcp_shm_channel_write(TcpShmChannel_t *channel, const void *hdr, uint32_t hdr_size,
+                                 const unsigned char *data, uint32_t data_size, uint64_t rec_size)
+{
+    TcpShmRing_t *ring = &channel->tx;
+    uint64_t head, offset, pad;
+
+    if (__atomic_load_n(&ring->ctrl->closed, __ATOMIC_RELAXED))
+    {
+        errno = EPIPE;
+        return -1;
+    }
+
+    head = __atomic_load_n(&ring->ctrl->head, __ATOMIC_RELAXED);
+    offset = head & (ring->size - 1);
+    pad = tcp_shm_ring_pad(ring, head, rec_size);
+
+    if (pad + rec_size > ring->size - (head - ring->peer_pos))
+    {
+        ring->peer_pos = __atomic_load_n(&ring->ctrl->tail, __ATOMIC_ACQUIRE);
+
+        if (pad + rec_size > ring->size - (head - ring->peer_pos))
+        {
+            channel->n_full++;
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+
+    if (pad)
+    {
+        *(uint32_t *)(ring->data + offset) = TCP_SHM_WRAP;
+        head += pad;
+        offset = 0;
+    }
+
+    memcpy(ring->data + offset, hdr, hdr_size);
+    memcpy(ring->data + offset + hdr_size, data, data_size);
+    __atomic_store_n(&ring->ctrl->head, head + rec_size, __ATOMIC_RELEASE);
+
+    // 积压的消息已经写入, 消费者不需要再通知
+    if (__atomic_load_n(&ring->ctrl->blocked, __ATOMIC_RELAXED))
+        __atomic_store_n(&ring->ctrl->blocked, 0, __ATOMIC_RELAXED);
+
+    tcp_shm_channel_notify(channel);
+    return 0;
+}
+
+/**
+ * @brief 发送一条消息, 不会阻塞调用线程
+ *
+ * @param msg 消息内容, 返回后调用方可以重用
+ * @param msg_size 消息长度, 不超过 TCP_SHM_MSG_MAX, 更长的消息用 TcpShmChannelSendChunk() 分段发送
+ * @return int 成功返回 msg_size; 失败返回 -1: EMSGSIZE 消息过长, EAGAIN tx 环已满, EPIPE 本端已关闭
+ */
+int TcpShmChannelSend(TcpShmChannel_t *channel, const unsigned char *msg, uint32_t msg_size)
+{
+    uint32_t len = msg_size;
+    int rc;
+
+    if (msg_size > TCP_SHM_MSG_MAX)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    pthread_mutex_lock(&channel->tx_mutex);
+    rc = tcp_shm_channel_write(channel, &len, sizeof(len), msg, msg_size, TCP_SHM_REC_SIZE(msg_size));
+    if (!rc)
+        channel->n_sent++;
+    pthread_mutex_unlock(&channel->tx_mutex);
+
+    return rc < 0 ? -1 : (int)msg_size;
+}
+
+/**
+ * @brief 发送大消息的一个片段, 不会阻塞调用线程
+ *
+ * 同一条消息的片段必须按顺序连续发送, 中间不能插入其他消息; 对端按片段交付(与 TCP 的流式交付相同)
+ *
+ * @param chunk 片段内容
+ * @param chunk_size 片段长度, 不超过 TCP_SHM_MSG_MAX
+ * @param frame_offset 片段在整条消息中的偏移
+ * @param frame_size 整条消息的长度
+ * @return int 成功返回 chunk_size; 失败返回 -1: EMSGSIZE 片段过长, EAGAIN tx 环已满, EPIPE 本端已关闭
+ */
+int TcpShmChannelSendChunk(TcpShmChannel_t *channel, const unsigned char *chunk, uint32_t chunk_size,
+                           uint64_t frame_offset, uint64_t frame_size)
+{
+    TcpShmChunkHdr_t hdr;
+    int rc;
+
+    if (chunk_size > TCP_SHM_MSG_MAX || frame_offset + chunk_size > frame_size)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    hdr.len = TCP_SHM_REC_CHUNK | chunk_size;
+    hdr.reserved = 0;
+    hdr.frame_offset = frame_offset;
+    hdr.frame_size = frame_size;
+
+    pthread_mutex_lock(&channel->tx_mutex);
+    rc = tcp_shm_channel_write(channel, &hdr, sizeof(hdr), chunk, chunk_size, TCP_SHM_CHUNK_REC_SIZE(chunk_size));
+    // 最后一个片段写入后才算发送了一条消息
+    if (!rc && frame_offset + chunk_size == frame_size)
+        channel->n_sent++;
+    pthread_mutex_unlock(&channel->tx_mutex);
+
+    return rc < 0 ? -1 : (int)chunk_size;
+}
+
+/**
+ * @brief 原地取出 rx 环中的消息, 调用 TcpShmChannelRelease() 之前消息保持有效
+ *
+ * 可以连续调用多次, 每次从上一次取出的位置继续; 遇到大消息的片段时停止, 由 TcpShmChannelRecvChunk() 取出
+ *
+ * @param spans 输出, 消息
+ * @param max_spans spans 的长度
+ * @return uint32_t 取出的消息数, 0 表示没有消息
+ */
+uint32_t TcpShmChannelRecv(TcpShmChannel_t *channel, TcpMsgSpan_t *spans, uint32_t max_spans)
+{
+    TcpShmRing_t *ring = &channel->rx;
+    uint64_t tail = __atomic_load_n(&ring->ctrl->tail, __ATOMIC_RELAXED);
+    uint64_t pos = tail + ring->pending, offset;
+    uint32_t len, n_spans = 0;
+
+    while (n_spans < max_spans)
+    {
+        if (pos == ring->peer_pos)
+        {
+            ring->peer_pos = __atomic_load_n(&ring->ctrl->head, __ATOMIC_ACQUIRE);
+
+            if (pos == ring->peer_pos)
+                break;
+        }
+
+        // 共享内存可以被对端任意修改, 记录必须完整地位于 [pos, head) 之内
+        if (ring->corrupt || ring->peer_pos - pos > ring->size)
+        {
+            ring->corrupt = true;
+            break;
+        }
+
+        offset = pos & (ring->size - 1);
+        memcpy(&len, ring->data + offset, sizeof(len));
+
+        if (len == TCP_SHM_WRAP)
+        {
+            pos += ring->size - offset;
+            continue;
+        }
+
+        if (len & TCP_SHM_REC_CHUNK)
+            break;
+
+        if (len > TCP_SHM_MSG_MAX || TCP_SHM_REC_SIZE(len) > ring->peer_pos - pos || TCP_SHM_REC_SIZE(len) > ring->size - offset)
+        {
+            ring->corrupt = true;
+            break;
+        }
+
+        spans[n_spans].data = ring->data + offset + sizeof(len);
+        spans[n_spans].size = (uint16_t)len;
+        n_spans++;
+        pos += TCP_SHM_REC_SIZE(len);
+    }
+
+    ring->pending = pos - tail;
+    channel->n_recvd += n_spans;
+
+    return n_spans;
+}
+
+/**
+ * @brief 原地取出 rx 环中的下一个大消息片段, 与 TcpShmChannelRecv() 共用取出位置, 由 TcpShmChannelRelease() 一并释放
+ *
+ * @param chunk 输出, 片段数据
+ * @param frame_offset 输出, 片段在整条消息中的偏移
+ * @param frame_size 输出, 整条消息的长度
+ * @return true 取出了一个片段; false 没有数据, 下一条记录是普通消息, 或者记录非法(设置 corrupt)
+ */
+bool TcpShmChannelRecvChunk(TcpShmChannel_t *channel, TcpMsgSpan_t *chunk, uint64_t *frame_offset, uint64_t *frame_size)
+{
+    TcpShmRing_t *ring = &channel->rx;
+    uint64_t tail = __atomic_load_n(&ring->ctrl->tail, __ATOMIC_RELAXED);
+    uint64_t pos = tail + ring->pending, offset;
+    uint32_t len;
+    TcpShmChunkHdr_t hdr;
+
+    while (true)
+    {
+        if (pos == ring->peer_pos)
+        {
+            ring->peer_pos = __atomic_load_n(&ring->ctrl->head, __ATOMIC_ACQUIRE);
+
+            if (pos == ring->peer_pos)
+                break;
+        }
+
+        if (ring->corrupt || ring->peer_pos - pos > ring->size)
+        {
+            ring->corrupt = true;
+            break;
+        }
+
+        offset = pos & (ring->size - 1);
+        memcpy(&len, ring->data + offset, sizeof(len));
+
+        if (len == TCP_SHM_WRAP)
+        {
+            pos += ring->size - offset;
+            continue;
+        }
+
+        if (!(len & TCP_SHM_REC_CHUNK))
+            break;
+
+        len &= ~TCP_SHM_REC_CHUNK;
+
+        if (len > TCP_SHM_MSG_MAX || TCP_SHM_CHUNK_REC_SIZE(len) > ring->peer_pos - pos ||
+            TCP_SHM_CHUNK_REC_SIZE(len) > ring->size - offset)
+        {
+            ring->corrupt = true;
+            break;
+        }
+
+        memcpy(&hdr, ring->data + offset, sizeof(hdr));
+
+        if (hdr.frame_offset > hdr.frame_size || len > hdr.frame_size - hdr.frame_offset)
+        {
+            ring->corrupt = true;
+            break;
+        }
+
+        chunk->data = ring->data + offset + sizeof(hdr);
+        chunk->size = (uint16_t)len;
+        *frame_offset = hdr.frame_offset;
+        *frame_size = hdr.frame_size;
+        pos += TCP_SHM_CHUNK_REC_SIZE(len);
+
+        ring->pending = pos - tail;
+        if (hdr.frame_offset + len == hdr.frame_size)
+            channel->n_recvd++;
+
+        return true;
+    }
+
+    ring->pending = pos - tail;
+    return false;
+}
+
+/**
+ * @brief 释放 TcpShmChannelRecv() 取出的所有消息, 之后生产者可以重用这部分空间
+ *
+ * 生产者设置了 blocked 时写 tx_event_fd, 对端的接收线程被唤醒后继续写入积压的消息
+ */
+void TcpShmChannelRelease(TcpShmChannel_t *channel)
+{
+    TcpShmRing_t *ring = &channel->rx;
+    uint64_t one = 1;
+
+    if (!ring->pending)
+        return;
+
+    __atomic_store_n(&ring->ctrl->tail, __atomic_load_n(&ring->ctrl->tail, __ATOMIC_RELAXED) + ring->pending, __ATOMIC_RELEASE);
+    ring->pending = 0;
+
+    // 与 TcpShmChannelSendWaitArm() 中的屏障配对: 要么生产者看到新的 tail, 要么本端看到 blocked
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&ring->ctrl->blocked, __ATOMIC_RELAXED) &&
+        write(channel->tx_event_fd, &one, sizeof(one)) != sizeof(one))
+        perror("TcpShmChannelRelease() eventfd write failed");
+}
+
+/**
+ * @brief 消费者准备阻塞: 设置 waiting 后再检查一次 rx 环
+ *
+ * @return true rx 环为空, 可以阻塞在 rx_event_fd 上
+ * @return false 设置 waiting 之前已经有新消息, waiting 已清除, 应继续接收
+ */
+bool TcpShmChannelWaitArm(TcpShmChannel_t *channel)
+{
+    TcpShmRing_t *ring = &channel->rx;
+    uint64_t pos = __atomic_load_n(&ring->ctrl->tail, __ATOMIC_RELAXED) + ring->pending;
+
+    __atomic_store_n(&ring->ctrl->waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&ring->ctrl->head, __ATOMIC_ACQUIRE) == pos)
+        return true;
+
+    __atomic_store_n(&ring->ctrl->waiting, 0, __ATOMIC_RELAXED);
+    return false;
+}
+
+/**
+ * @brief 消费者被唤醒: 读掉 rx_event_fd 的计数, 清除 waiting, 之后生产者不再写 eventfd
+ *
+ */
+void TcpShmChannelWaitDisarm(TcpShmChannel_t *channel)
+{
+    uint64_t count;
+
+    __atomic_store_n(&channel->rx.ctrl->waiting, 0, __ATOMIC_RELAXED);
+
+    while (read(channel->rx_event_fd, &count, sizeof(count)) < 0 && errno == EINTR)
+        ;
+}
+
+/**
+ * @brief 生产者准备等待空间: 设置 blocked 后再检查一次 tx 环
+ *
+ * 之后对端每次 TcpShmChannelRelease() 都会写它的 tx_event_fd(本端的 rx_event_fd), 直到下一次发送成功清除 blocked
+ *
+ * @param msg_size 积压的第一条消息(或片段)的长度
+ * @param chunk 是否是大消息的片段
+ * @return true tx 环仍然放不下, 等待通知
+ * @return false 设置 blocked 之前消费者已经释放了足够的空间, 应立即重试
+ */
+bool TcpShmChannelSendWaitArm(TcpShmChannel_t *channel, uint32_t msg_size, bool chunk)
+{
+    TcpShmRing_t *ring = &channel->tx;
+    uint64_t head, rec_size = chunk ? TCP_SHM_CHUNK_REC_SIZE(msg_size) : TCP_SHM_REC_SIZE(msg_size);
+    bool full;
+
+    pthread_mutex_lock(&channel->tx_mutex);
+
+    head = __atomic_load_n(&ring->ctrl->head, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->ctrl->blocked, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    ring->peer_pos = __atomic_load_n(&ring->ctrl->tail, __ATOMIC_ACQUIRE);
+    full = tcp_shm_ring_pad(ring, head, rec_size) + rec_size > ring->size - (head - ring->peer_pos);
+
+    pthread_mutex_unlock(&channel->tx_mutex);
+
+    return full;
+}
+
+/**
+ * @brief 唤醒本端的接收线程重新检查 rx 环, 用于接收方暂停取消息之后恢复
+ *
+ * 暂停时接收方没有设置 waiting, 对端写入不会通知, 只能由本端写 rx_event_fd
+ */
+void TcpShmChannelWakeRx(TcpShmChannel_t *channel)
+{
+    uint64_t one = 1;
+
+    if (write(channel->rx_event_fd, &one, sizeof(one)) != sizeof(one))
+        perror("TcpShmChannelWakeRx() eventfd write failed");
+}
+
+/**
+ * @brief 服务器端口对应的抽象 Unix socket 地址, 同一主机上的客户端根据 TCP 连接的对端端口找到它
+ *
+ * @return socklen_t 地址长度
+ */
+socklen_t TcpShmSocketAddr(uint16_t server_port_no, struct sockaddr_un *addr)
+{
+    int len;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    // sun_path[0] = '\0' 表示抽象命名空间, 不在文件系统中创建文件
+    len = snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1, "tcpip_server.shm.%u", server_port_no);
+
+    return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + len);
+}
+
+/**
+ * @brief 通过 Unix socket 发送一条消息, 并通过 SCM_RIGHTS 附带 fd
+ *
+ * @return int sendmsg() 的返回值
+ */
+int TcpShmSendFds(int sock_fd, const void *msg, size_t msg_size, const int *fds, int n_fds)
+{
+    struct msghdr mh;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    char control[CMSG_SPACE(sizeof(int) * 4)];
+
+    memset(&mh, 0, sizeof(mh));
+    iov.iov_base = (void *)msg;
+    iov.iov_len = msg_size;
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+
+    if (n_fds > 0)
+    {
+        memset(control, 0, sizeof(control));
+        mh.msg_control = control;
+        mh.msg_controllen = CMSG_SPACE(sizeof(int) * n_fds);
+        cmsg = CMSG_FIRSTHDR(&mh);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * n_fds);
+    }
+
+    return (int)sendmsg(sock_fd, &mh, MSG_NOSIGNAL);
+}
+
+/**
+ * @brief 通过 Unix socket 接收一条长度为 msg_size 的消息以及附带的 fd
+ *
+ * @return int 收到的 fd 数, 消息不完整或出错返回 -1(收到的 fd 已关闭)
+ */
+int TcpShmRecvFds(int sock_fd, void *msg, size_t msg_size, int *fds, int max_fds)
+{
+    int i, n_fds = 0;
+    ssize_t rc;
+    struct msghdr mh;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    char control[CMSG_SPACE(sizeof(int) * 4)];
+
+    memset(&mh, 0, sizeof(mh));
+    iov.iov_base = msg;
+    iov.iov_len = msg_size;
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = control;
+    mh.msg_controllen = sizeof(control);
+
+    do
+    {
+        rc = recvmsg(sock_fd, &mh, MSG_CMSG_CLOEXEC);
+    } while (rc < 0 && errno == EINTR);
+
+    for (cmsg = CMSG_FIRSTHDR(&mh); rc >= 0 && cmsg; cmsg = CMSG_NXTHDR(&mh, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        n_fds = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * n_fds);
+    }
+
+    if (rc != (ssize_t)msg_size || n_fds > max_fds || (mh.msg_flags & MSG_CTRUNC))
+    {
+        for (i = 0; i < n_fds && i < max_fds; i++)
+            close(fds[i]);
+
+        return -1;
+    }
+
+    return n_fds;
+}
+
+/**
+ * @brief (客户端) 在已经建立的 TCP 连接上协商共享内存通道
+ *
+ * 连接服务器端口对应的抽象 Unix socket, 通过 SCM_RIGHTS 发送 TCP socket 证明拥有该连接,
+ * 服务器回复共享内存和两个 eventfd. 服务器不在本机, 没有启用共享内存传输或协商失败时返回 NULL,
+ * 调用方继续使用 TCP. 应在发送任何应用层数据之前调用, 成功之后消息只通过共享内存收发,
+ * TCP 连接保持打开, 用于服务器检测客户端退出.
+ *
+ * @param tcp_fd 已经连接到服务器的 TCP socket
+ * @return TcpShmChannel_t* 失败返回 NULL
+ */
+TcpShmChannel_t *TcpShmConnect(int tcp_fd)
+{
+    int i, n_fds, unix_fd, fds[3];
+    struct sockaddr_in peer_addr;
+    struct sockaddr_un unix_addr;
+    socklen_t addr_len = sizeof(peer_addr);
+    struct timeval tv = {1, 0};
+    TcpShmHello_t hello;
+    TcpShmReply_t reply;
+
+    if (getpeername(tcp_fd, (struct sockaddr *)&peer_addr, &addr_len) < 0 || peer_addr.sin_family != AF_INET)
+        return NULL;
+
+    unix_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (unix_fd < 0)
+        return NULL;
+
+    setsockopt(unix_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    addr_len = TcpShmSocketAddr(ntohs(peer_addr.sin_port), &unix_addr);
+
+    hello.magic = TCP_SHM_MAGIC;
+    hello.version = TCP_SHM_VERSION;
+
+    if (connect(unix_fd, (struct sockaddr *)&unix_addr, addr_len) < 0 ||
+        TcpShmSendFds(unix_fd, &hello, sizeof(hello), &tcp_fd, 1) != sizeof(hello))
+    {
+        close(unix_fd);
+        return NULL;
+    }
+
+    n_fds = TcpShmRecvFds(unix_fd, &reply, sizeof(reply), fds, 3);
+    close(unix_fd);
+
+    if (n_fds < 0)
+        return NULL;
+
+    if (reply.magic != TCP_SHM_MAGIC || reply.status != 0 || n_fds != 3)
+    {
+        for (i = 0; i < n_fds; i++)
+            close(fds[i]);
+
+        return NULL;
+    }
+
+    // fds: memfd, c2s eventfd(客户端写入后通知服务器), s2c eventfd(服务器写入后通知客户端)
+    return TcpShmChannelMap(fds[0], fds[2], fds[1], false);
+}
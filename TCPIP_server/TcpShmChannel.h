@@ -0,0 +1,144 @@
+#ifndef TCPSHMCHANNEL_H_
+#define TCPSHMCHANNEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "TcpMsgDemarcar.h"
+
+#define TCP_SHM_MAGIC 0x54534d31             // "TSM1"
+#define TCP_SHM_RING_SIZE_DEFAULT (1 << 20)  // 每个方向的环形缓冲区默认长度
+#define TCP_SHM_RING_SIZE_MIN (256 << 10)    // 最小长度, 保证最长的消息加上末尾填充总能放下
+#define TCP_SHM_MSG_MAX UINT16_MAX           // 单条消息的最大长度(与 TcpMsgSpan_t 一致)
+#define TCP_SHM_VERSION 1
+#define TCP_SHM_WRAP UINT32_MAX              // 记录长度为此值表示数据区末尾的填充
+#define TCP_SHM_REC_CHUNK 0x80000000u        // 长度字段的最高位: 大消息的一个片段, 记录头为 TcpShmChunkHdr_t
+
+/**
+ * @brief 单生产者单消费者环形缓冲区的控制字段, 位于共享内存中, 生产者和消费者分别在不同的 cache line 上更新
+ *
+ * head/tail 是累计字节数, 不回绕; 所有字段原子访问
+ */
+typedef struct TcpShmRingCtrl_
+{
+    uint64_t head __attribute__((aligned(64))); // 写位置, 只由生产者更新
+    uint64_t closed;                            // 生产者已关闭, 不会再写入
+    uint64_t blocked;                           // 生产者因环满有消息积压, 消费者释放空间后需要通知
+    uint64_t tail __attribute__((aligned(64))); // 读位置, 只由消费者更新
+    uint64_t waiting;                           // 消费者可能阻塞在 eventfd 上, 生产者写入后需要通知
+} TcpShmRingCtrl_t;
+
+/**
+ * @brief 共享内存的第一页: 两个方向的控制字段, 之后依次是 c2s 和 s2c 的数据区
+ */
+typedef struct TcpShmHeader_
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t ring_size;    // 每个方向的数据区长度(2 的幂)
+    TcpShmRingCtrl_t c2s;  // 客户端 -> 服务器
+    TcpShmRingCtrl_t s2c;  // 服务器 -> 客户端
+} TcpShmHeader_t;
+
+/**
+ * @brief 协商消息(Unix socket): 客户端发送 hello 并通过 SCM_RIGHTS 附带自己的 TCP socket, 证明它拥有该连接;
+ * 服务器回复 reply, 成功时附带 memfd, c2s eventfd, s2c eventfd
+ */
+typedef struct TcpShmHello_
+{
+    uint32_t magic;
+    uint32_t version;
+} TcpShmHello_t;
+
+typedef struct TcpShmReply_
+{
+    uint32_t magic;
+    int32_t status; // 0 成功, 否则为 errno, 客户端继续使用 TCP
+} TcpShmReply_t;
+
+/**
+ * @brief 大消息片段的记录头, 每个片段携带自己在消息中的位置, 接收方不需要保存重组状态
+ */
+typedef struct TcpShmChunkHdr_
+{
+    uint32_t len;          // TCP_SHM_REC_CHUNK | 片段长度
+    uint32_t reserved;     // 保持 8 字节对齐, 写 0
+    uint64_t frame_offset; // 片段在整条消息中的偏移
+    uint64_t frame_size;   // 整条消息的长度
+} TcpShmChunkHdr_t;
+
+/**
+ * @brief 本端看到的一个方向的环形缓冲区
+ *
+ * 消息格式: | 长度(uint32_t) | 消息 | 填充到 8 字节 |, 放不下时写入长度为 TCP_SHM_WRAP 的记录, 从数据区开头继续;
+ * 超过 TCP_SHM_MSG_MAX 的消息拆成多个片段记录: | TcpShmChunkHdr_t | 片段 | 填充到 8 字节 |
+ */
+typedef struct TcpShmRing_
+{
+    TcpShmRingCtrl_t *ctrl; // 共享的控制字段
+    unsigned char *data;    // 数据区
+    uint64_t size;          // 数据区长度(2 的幂)
+    uint64_t peer_pos;      // 生产者: 最近读到的 tail; 消费者: 最近读到的 head, 减少对另一条 cache line 的访问
+    uint64_t pending;       // 消费者: 最近一次 TcpShmChannelRecv() 取出但尚未释放的字节数
+    bool corrupt;           // 消费者: 对端写入了非法的记录, 不再接收
+} TcpShmRing_t;
+
+/**
+ * @brief 共享内存通道, 服务器和客户端各自持有一份, tx/rx 方向相反
+ *
+ * 1.发送: 消息写入 tx 环, 对端处于等待状态时才写 tx_event_fd 唤醒, 忙碌时不需要系统调用
+ *
+ * 2.接收: TcpShmChannelRecv() 原地返回 rx 环中的消息, TcpShmChannelRelease() 之后才删除
+ *
+ * 3.消费者空闲时 TcpShmChannelWaitArm() 设置 waiting 并再次检查, 之后才能阻塞在 rx_event_fd 上
+ *
+ * 4.tx 环满时生产者用 TcpShmChannelSendWaitArm() 设置 blocked, 消费者释放空间后写自己的 tx_event_fd 通知
+ *
+ * 发送可以被任意线程调用(tx_mutex 串行化), 接收只能由一个线程调用
+ */
+typedef struct TcpShmChannel_
+{
+    TcpShmHeader_t *hdr;      // 共享内存映射的起始地址
+    uint64_t map_size;        // 映射长度
+    int mem_fd;               // memfd, 协商完成后服务器端关闭
+    int rx_event_fd;          // 对端写入 rx 环后通知本端
+    int tx_event_fd;          // 本端写入 tx 环后通知对端
+    TcpShmRing_t rx;          // 本端读取的环
+    TcpShmRing_t tx;          // 本端写入的环
+    pthread_mutex_t tx_mutex; // 多个发送线程之间互斥(生产者只能有一个)
+    uint64_t n_sent;          // 发送的消息数
+    uint64_t n_recvd;         // 接收的消息数
+    uint64_t n_wakeups;       // 写 tx_event_fd 的次数
+    uint64_t n_full;          // tx 环已满导致发送失败的次数
+} TcpShmChannel_t;
+
+TcpShmChannel_t *TcpShmChannelCreate(uint64_t ring_size);                                    // 服务器端: 创建共享内存和 eventfd
+TcpShmChannel_t *TcpShmChannelMap(int mem_fd, int rx_event_fd, int tx_event_fd, bool server); // 映射对端创建的通道
+void TcpShmChannelDestroy(TcpShmChannel_t *channel);
+void TcpShmChannelClose(TcpShmChannel_t *channel); // 通知对端本端不再写入
+
+int TcpShmChannelSend(TcpShmChannel_t *channel, const unsigned char *msg, uint32_t msg_size);
+int TcpShmChannelSendChunk(TcpShmChannel_t *channel, const unsigned char *chunk, uint32_t chunk_size,
+                           uint64_t frame_offset, uint64_t frame_size); // 按顺序发送大消息的片段
+uint32_t TcpShmChannelRecv(TcpShmChannel_t *channel, TcpMsgSpan_t *spans, uint32_t max_spans);
+bool TcpShmChannelRecvChunk(TcpShmChannel_t *channel, TcpMsgSpan_t *chunk, uint64_t *frame_offset, uint64_t *frame_size); // 下一条记录是片段时取出
+void TcpShmChannelRelease(TcpShmChannel_t *channel);
+bool TcpShmChannelIsPeerClosed(TcpShmChannel_t *channel); // 对端已关闭, 或者写入了非法的记录
+
+// 消费者等待协议
+bool TcpShmChannelWaitArm(TcpShmChannel_t *channel);    // 返回 true 表示 rx 环为空, 可以阻塞在 rx_event_fd 上
+void TcpShmChannelWaitDisarm(TcpShmChannel_t *channel); // 被唤醒后读掉 rx_event_fd 并清除 waiting
+void TcpShmChannelWakeRx(TcpShmChannel_t *channel);     // 唤醒本端的接收线程重新检查 rx 环
+
+// 生产者等待协议
+bool TcpShmChannelSendWaitArm(TcpShmChannel_t *channel, uint32_t msg_size, bool chunk); // 返回 true 表示 tx 环仍放不下, 等待对端释放空间后的通知
+
+// 协商: 在已经建立的 TCP 连接上协商共享内存通道(客户端), 失败返回 NULL, 继续使用 TCP
+socklen_t TcpShmSocketAddr(uint16_t server_port_no, struct sockaddr_un *addr); // 服务器端口对应的抽象 Unix socket 地址
+int TcpShmSendFds(int sock_fd, const void *msg, size_t msg_size, const int *fds, int n_fds);
+int TcpShmRecvFds(int sock_fd, void *msg, size_t msg_size, int *fds, int max_fds); // 返回收到的 fd 数, 出错返回 -1
+TcpShmChannel_t *TcpShmConnect(int tcp_fd);
+
+#endif
@@ -0,0 +1,539 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <memory.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/time.h>
+#include "TcpShmTransport.h"
+#include "TcpServerController.h"
+#include "TcpClient.h"
+#include "TcpClientServiceManager.h"
+#include "TcpMetrics.h"
+
+TcpShmTransport::TcpShmTransport(TcpServerController *tcp_ctrlr, uint64_t ring_size)
+{
+    this->tcp_ctrlr = tcp_ctrlr;
+    this->ring_size = ring_size;
+    this->listen_fd = -1;
+    this->epoll_fd = -1;
+    this->stop_event_fd = -1;
+    this->running = false;
+    this->next_channel_id = TCP_SHM_EPOLL_STOP_ID + 1;
+    this->n_negotiated = 0;
+    this->n_rejected = 0;
+    pthread_mutex_init(&this->mutex, nullptr);
+}
+
+TcpShmTransport::~TcpShmTransport()
+{
+    assert(!this->running);
+    assert(this->channels.empty());
+
+    pthread_mutex_destroy(&this->mutex);
+}
+
+static void *tcp_shm_transport_thread_fn(void *arg)
+{
+    TcpShmTransport *shm_transport = (TcpShmTransport *)arg;
+
+    shm_transport->ThreadFn();
+    return nullptr;
+}
+
+static void *tcp_shm_negotiate_thread_fn(void *arg)
+{
+    TcpShmTransport *shm_transport = (TcpShmTransport *)arg;
+
+    shm_transport->NegotiateThreadFn();
+    return nullptr;
+}
+
+/**
+ * @brief 绑定服务器端口对应的抽象 Unix socket 并启动唤醒线程和协商线程
+ *
+ * 同一主机上同一端口只能有一个服务器启用共享内存传输, 绑定失败时只打印错误, 客户端继续使用 TCP
+ *
+ * @return true 启动成功
+ */
+bool TcpShmTransport::Start()
+{
+    struct sockaddr_un addr;
+    socklen_t addr_len = TcpShmSocketAddr(this->tcp_ctrlr->port_no, &addr);
+    struct epoll_event ev;
+
+    this->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (this->listen_fd < 0 ||
+        bind(this->listen_fd, (struct sockaddr *)&addr, addr_len) < 0 ||
+        listen(this->listen_fd, SOMAXCONN) < 0)
+    {
+        printf("Error : Shm transport Unix socket bind failed, error = %d, using TCP only\n", errno);
+        this->Stop();
+        return false;
+    }
+
+    this->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    this->stop_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (this->epoll_fd < 0 || this->stop_event_fd < 0)
+    {
+        printf("Error : Shm transport epoll/eventfd creation failed, error = %d, using TCP only\n", errno);
+        this->Stop();
+        return false;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.u64 = TCP_SHM_EPOLL_STOP_ID;
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, this->stop_event_fd, &ev);
+
+    this->running = true;
+    pthread_create(&this->thread, nullptr, tcp_shm_transport_thread_fn, (void *)this);
+    pthread_create(&this->negotiate_thread, nullptr, tcp_shm_negotiate_thread_fn, (void *)this);
+    return true;
+}
+
+/**
+ * @brief 停止两个线程, 关闭所有通道并释放客户端的引用
+ *
+ * 通道本身在客户端析构时释放, 其他线程此时仍可以安全地调用 SendMsg()(返回 EPIPE)
+ */
+void TcpShmTransport::Stop()
+{
+    uint64_t one = 1;
+    std::unordered_map<uint64_t, TcpClient *> channels;
+
+    if (this->running)
+    {
+        if (write(this->stop_event_fd, &one, sizeof(one)) < 0)
+            printf("Error : Shm transport stop notification failed, error = %d\n", errno);
+
+        // stop_event_fd 不被读取, 两个线程都能看到
+        pthread_join(this->thread, nullptr);
+        pthread_join(this->negotiate_thread, nullptr);
+        this->running = false;
+    }
+
+    pthread_mutex_lock(&this->mutex);
+    for (auto it = this->channels.begin(); it != this->channels.end(); it++)
+        TcpShmChannelClose(it->second->shm);
+    channels.swap(this->channels);
+    pthread_mutex_unlock(&this->mutex);
+
+    for (auto it = channels.begin(); it != channels.end(); it++)
+        it->second->Dereference();
+
+    if (this->listen_fd >= 0)
+        close(this->listen_fd);
+
+    if (this->epoll_fd >= 0)
+        close(this->epoll_fd);
+
+    if (this->stop_event_fd >= 0)
+        close(this->stop_event_fd);
+
+    this->listen_fd = this->epoll_fd = this->stop_event_fd = -1;
+}
+
+void TcpShmTransport::ThreadFn()
+{
+    int i, n_events;
+    struct epoll_event events[TCP_SHM_EPOLL_MAX_EVENTS];
+
+    while (true)
+    {
+        n_events = epoll_wait(this->epoll_fd, events, TCP_SHM_EPOLL_MAX_EVENTS, -1);
+
+        if (n_events < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            printf("Error : Shm transport epoll_wait failed, error = %d\n", errno);
+            return;
+        }
+
+        for (i = 0; i < n_events; i++)
+        {
+            if (events[i].data.u64 == TCP_SHM_EPOLL_STOP_ID)
+                return;
+
+            this->DispatchChannel(events[i].data.u64);
+        }
+    }
+}
+
+/**
+ * @brief 协商线程: 等待 Unix socket 上的协商请求, 直到 Stop()
+ *
+ */
+void TcpShmTransport::NegotiateThreadFn()
+{
+    struct pollfd fds[2];
+
+    fds[0].fd = this->listen_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = this->stop_event_fd;
+    fds[1].events = POLLIN;
+
+    while (true)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            printf("Error : Shm transport poll failed, error = %d\n", errno);
+            return;
+        }
+
+        if (fds[1].revents)
+            return;
+
+        if (fds[0].revents)
+            this->AcceptPeer();
+    }
+}
+
+/**
+ * @brief 接受一个协商请求, 回复之后关闭 Unix socket
+ *
+ * 协商在协商线程中同步完成, 客户端只在建立连接时协商一次, 读取设置了超时, 异常的客户端只会延迟其他客户端的协商
+ */
+void TcpShmTransport::AcceptPeer()
+{
+    int unix_fd, status;
+    struct timeval tv = {0, 100 * 1000};
+    TcpShmReply_t reply;
+
+    while ((unix_fd = accept4(this->listen_fd, nullptr, nullptr, SOCK_CLOEXEC)) >= 0)
+    {
+        setsockopt(unix_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(unix_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+        status = this->Negotiate(unix_fd);
+
+        if (status)
+        {
+            // 失败时回复错误码, 客户端继续使用 TCP
+            reply.magic = TCP_SHM_MAGIC;
+            reply.status = status;
+            TcpShmSendFds(unix_fd, &reply, sizeof(reply), nullptr, 0);
+            this->n_rejected++;
+        }
+        else
+            this->n_negotiated++;
+
+        close(unix_fd);
+    }
+}
+
+/**
+ * @brief 协商: 根据客户端附带的 TCP socket 找到对应的 TcpClient, 创建通道并回复 memfd 和 eventfd
+ *
+ * 只有持有该 TCP 连接的进程才能发出附带它的请求, 因此不需要额外的认证
+ *
+ * @param unix_fd 已接受的 Unix socket
+ * @return int 成功返回 0(已回复), 否则返回 errno(未回复)
+ */
+int TcpShmTransport::Negotiate(int unix_fd)
+{
+    int tcp_fd, fds[3], rc;
+    struct sockaddr_in client_addr, server_addr;
+    socklen_t client_addr_len = sizeof(client_addr), server_addr_len = sizeof(server_addr);
+    TcpShmHello_t hello;
+    TcpShmReply_t reply;
+    TcpShmChannel_t *channel;
+    TcpClient *tcp_client;
+
+    if (TcpShmRecvFds(unix_fd, &hello, sizeof(hello), &tcp_fd, 1) != 1)
+        return EPROTO;
+
+    // 客户端的 TCP socket: 本端地址是客户端, 对端地址必须是本服务器
+    rc = getsockname(tcp_fd, (struct sockaddr *)&client_addr, &client_addr_len) |
+         getpeername(tcp_fd, (struct sockaddr *)&server_addr, &server_addr_len);
+    close(tcp_fd);
+
+    if (hello.magic != TCP_SHM_MAGIC || hello.version != TCP_SHM_VERSION)
+        return EPROTO;
+
+    if (rc < 0 || client_addr.sin_family != AF_INET || server_addr.sin_family != AF_INET ||
+        ntohs(server_addr.sin_port) != this->tcp_ctrlr->port_no)
+        return EACCES;
+
+    tcp_client = this->tcp_ctrlr->LookupPassiveClient(ntohl(client_addr.sin_addr.s_addr), ntohs(client_addr.sin_port));
+
+    if (!tcp_client)
+        return ENOENT;
+
+    // 通道中的消息由客户端所在的 DRS 交付, 独立线程的客户端没有 DRS, 继续使用 TCP
+    if (!tcp_client->svc_mgr)
+    {
+        tcp_client->Dereference();
+        return EOPNOTSUPP;
+    }
+
+    if (__atomic_load_n(&tcp_client->shm, __ATOMIC_ACQUIRE))
+    {
+        tcp_client->Dereference();
+        return EALREADY;
+    }
+
+    channel = TcpShmChannelCreate(this->ring_size);
+
+    if (!channel)
+    {
+        rc = errno;
+        tcp_client->Dereference();
+        return rc;
+    }
+
+    // 先回复再开始接收: 回复失败时客户端仍使用 TCP, 服务器端不需要回退
+    reply.magic = TCP_SHM_MAGIC;
+    reply.status = 0;
+    fds[0] = channel->mem_fd;
+    fds[1] = channel->rx_event_fd; // c2s
+    fds[2] = channel->tx_event_fd; // s2c
+
+    if (TcpShmSendFds(unix_fd, &reply, sizeof(reply), fds, 3) != sizeof(reply))
+    {
+        rc = errno;
+        TcpShmChannelDestroy(channel);
+        tcp_client->Dereference();
+        return rc;
+    }
+
+    // 客户端已经映射, 服务器端不再需要 memfd
+    close(channel->mem_fd);
+    channel->mem_fd = -1;
+
+    if (!this->Attach(tcp_client, channel))
+    {
+        // 客户端看到 s2c 关闭后断开
+        printf("Error : Shm transport failed to attach channel, error = %d\n", errno);
+        TcpShmChannelClose(channel);
+        TcpShmChannelDestroy(channel);
+        tcp_client->Dereference();
+    }
+
+    return 0;
+}
+
+/**
+ * @brief 把通道交给客户端, 之后客户端的消息通过通道收发, channels 接管调用方持有的引用
+ *
+ * 协商期间客户端可能已经被删除(Detach() 时还没有通道), 注册之后再查一次数据库, 不在数据库中时立即 Detach()
+ *
+ * @return true 成功
+ */
+bool TcpShmTransport::Attach(TcpClient *tcp_client, TcpShmChannel_t *channel)
+{
+    struct epoll_event ev;
+    uint64_t channel_id;
+    TcpClient *db_client;
+
+    pthread_mutex_lock(&this->mutex);
+
+    channel_id = this->next_channel_id++;
+    ev.events = EPOLLIN;
+    ev.data.u64 = channel_id;
+
+    if (epoll_ctl(this->epoll_fd, EPOLL_CTL_ADD, channel->rx_event_fd, &ev) < 0)
+    {
+        pthread_mutex_unlock(&this->mutex);
+        return false;
+    }
+
+    tcp_client->shm_channel_id = channel_id;
+    __atomic_store_n(&tcp_client->shm, channel, __ATOMIC_RELEASE);
+    this->channels[channel_id] = tcp_client;
+
+    pthread_mutex_unlock(&this->mutex);
+
+    db_client = this->tcp_ctrlr->LookupPassiveClient(tcp_client->ip_addr, tcp_client->port_no);
+
+    if (db_client != tcp_client)
+        this->Detach(tcp_client);
+
+    if (db_client)
+        db_client->Dereference();
+
+    return true;
+}
+
+/**
+ * @brief (唤醒线程) 通道的 c2s eventfd 可读: 读掉计数并清除 waiting, 把通道交给客户端所在的 DRS
+ *
+ * eventfd 既表示对端写入了新消息, 也表示对端释放了 s2c 环的空间(有积压的发送消息时)
+ *
+ * @param channel_id 通道编号
+ */
+void TcpShmTransport::DispatchChannel(uint64_t channel_id)
+{
+    TcpClient *tcp_client;
+    TcpClientServiceManager *svc_mgr;
+
+    pthread_mutex_lock(&this->mutex);
+    auto it = this->channels.find(channel_id);
+
+    // 已经 Detach(), epoll_wait() 返回的事件已经过期
+    if (it == this->channels.end())
+    {
+        pthread_mutex_unlock(&this->mutex);
+        return;
+    }
+
+    tcp_client = it->second;
+    tcp_client->Reference();
+    pthread_mutex_unlock(&this->mutex);
+
+    // 之后对端的写入不再通知, 直到 DRS 取空通道后重新设置 waiting
+    TcpShmChannelWaitDisarm(tcp_client->shm);
+
+    // 只读取一次, 客户端可能同时被移出监听集合; 移出后 DRS 不再处理它的通道, 客户端随后被删除
+    svc_mgr = __atomic_load_n(&tcp_client->svc_mgr, __ATOMIC_RELAXED);
+    if (svc_mgr)
+        svc_mgr->ClientShmReadable(tcp_client);
+
+    tcp_client->Dereference();
+}
+
+/**
+ * @brief (DRS 线程) 先继续写入积压的发送消息, 再取出通道中的所有消息, 按批交给 ClientMsgBatchRecvd(),
+ * 大消息的片段逐个交给 ClientMsgChunkRecvd(); 通道为空后重新进入等待状态
+ *
+ * 客户端关闭通道, 写入了非法的记录, 或者发送了大消息而应用层没有注册流式回调时关闭 TCP 连接,
+ * 由 DRS 按正常的断开流程删除客户端
+ *
+ * @param tcp_client 本 DRS 监听的已协商共享内存的客户端
+ */
+void TcpShmTransport::DrainChannel(TcpClient *tcp_client)
+{
+    uint32_t i, n_spans;
+    uint64_t n_bytes, frame_offset, frame_size;
+    bool peer_closed, protocol_error = false;
+    TcpShmChannel_t *channel = tcp_client->shm;
+    TcpMsgSpan_t spans[TCP_MSG_BATCH_MAX];
+    TcpReactorMetrics_t *metrics = this->tcp_ctrlr->GetClientMetricsShard(tcp_client);
+
+    tcp_client->out_queue.FlushShm(tcp_client, channel);
+
+    while (true)
+    {
+        // 先读取 closed 再取消息, 对端关闭之前写入的消息都能取到
+        peer_closed = TcpShmChannelIsPeerClosed(channel);
+        n_spans = TcpShmChannelRecv(channel, spans, TCP_MSG_BATCH_MAX);
+
+        if (n_spans)
+        {
+            for (i = 0, n_bytes = 0; i < n_spans; i++)
+                n_bytes += spans[i].size;
+
+            tcp_client->conn.recv_ns = TcpMetricsNowNs();
+            tcp_client->conn.bytes_recvd += n_bytes;
+            tcp_client->conn.recv_calls++;
+            TcpMetricAdd(&metrics->bytes_recvd, n_bytes);
+
+            this->tcp_ctrlr->ClientMsgBatchRecvd(tcp_client, spans, n_spans);
+        }
+        else if (TcpShmChannelRecvChunk(channel, &spans[0], &frame_offset, &frame_size))
+        {
+            // 与 TCP 的流式交付相同: 没有注册片段回调时超过 TCP_SHM_MSG_MAX 的消息是协议错误
+            if (!this->tcp_ctrlr->client_msg_chunk_recvd)
+            {
+                this->tcp_ctrlr->ClientProtocolError(tcp_client, TCP_DEMARCAR_ERR_FRAME_TOO_LARGE, frame_size);
+                protocol_error = true;
+                break;
+            }
+
+            tcp_client->conn.recv_ns = TcpMetricsNowNs();
+            tcp_client->conn.bytes_recvd += spans[0].size;
+            tcp_client->conn.recv_calls++;
+            TcpMetricAdd(&metrics->bytes_recvd, spans[0].size);
+
+            this->tcp_ctrlr->ClientMsgChunkRecvd(tcp_client, spans[0].data, spans[0].size, frame_offset, frame_size);
+        }
+        else
+        {
+            if (peer_closed || TcpShmChannelWaitArm(channel))
+                break;
+
+            continue;
+        }
+
+        TcpShmChannelRelease(channel);
+
+        // 线程池积压过多: 剩下的消息留在环中, 不进入等待状态, 恢复时由 ResumeRead() 唤醒
+        if (tcp_client->strand.IsThrottled())
+        {
+            peer_closed = false;
+            break;
+        }
+    }
+
+    if (peer_closed || protocol_error)
+    {
+        if (channel->rx.corrupt)
+            printf("Error : Shm channel of client %u:%u is corrupted, disconnecting\n", tcp_client->ip_addr, tcp_client->port_no);
+
+        shutdown(tcp_client->comm_fd, SHUT_RDWR);
+    }
+}
+
+/**
+ * @brief (工作线程) 线程池积压回落后写 c2s eventfd, 由 DRS 继续取出 DrainChannel() 暂停时留在环中的消息
+ *
+ * @param tcp_client 调用方持有引用的客户端, 没有协商共享内存时不做任何事
+ */
+void TcpShmTransport::ResumeRead(TcpClient *tcp_client)
+{
+    TcpShmChannel_t *channel = __atomic_load_n(&tcp_client->shm, __ATOMIC_ACQUIRE);
+
+    // 通道在客户端析构时才释放, 已经 Detach() 的通道唤醒后找不到客户端, 直接返回
+    if (channel)
+        TcpShmChannelWakeRx(channel);
+}
+
+/**
+ * @brief 客户端被删除时调用: 停止接收并关闭 s2c, 对端看到关闭后停止使用通道
+ *
+ * 通道在客户端析构时释放, 之后的 SendMsg() 返回 EPIPE, 不会回退到 TCP
+ *
+ * @param tcp_client 被删除的客户端
+ */
+void TcpShmTransport::Detach(TcpClient *tcp_client)
+{
+    TcpShmChannel_t *channel = __atomic_load_n(&tcp_client->shm, __ATOMIC_ACQUIRE);
+
+    if (!channel)
+        return;
+
+    pthread_mutex_lock(&this->mutex);
+    auto it = this->channels.find(tcp_client->shm_channel_id);
+
+    if (it == this->channels.end() || it->second != tcp_client)
+    {
+        pthread_mutex_unlock(&this->mutex);
+        return;
+    }
+
+    epoll_ctl(this->epoll_fd, EPOLL_CTL_DEL, channel->rx_event_fd, nullptr);
+    this->channels.erase(it);
+    TcpShmChannelClose(channel);
+    pthread_mutex_unlock(&this->mutex);
+
+    tcp_client->Dereference();
+}
+
+void TcpShmTransport::Display()
+{
+    pthread_mutex_lock(&this->mutex);
+    printf("Shm transport : %s, channels = %lu, negotiated = %lu, rejected = %lu, ring size = %lu\n",
+           this->running ? "running" : "stopped", (unsigned long)this->channels.size(),
+           (unsigned long)this->n_negotiated, (unsigned long)this->n_rejected, (unsigned long)this->ring_size);
+    pthread_mutex_unlock(&this->mutex);
+}
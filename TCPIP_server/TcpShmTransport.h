@@ -0,0 +1,72 @@
+#ifndef TCPSHMTRANSPORT_H_
+#define TCPSHMTRANSPORT_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <unordered_map>
+#include "TcpShmChannel.h"
+
+class TcpServerController;
+class TcpClient;
+
+#define TCP_SHM_EPOLL_STOP_ID 1   // epoll data: 停止通知 eventfd
+#define TCP_SHM_EPOLL_MAX_EVENTS 64
+
+/**
+ * @brief 同一主机上的客户端的共享内存传输(服务器端)
+ *
+ * 1.协商: 在服务器端口对应的抽象 Unix socket 上接受客户端的请求, 客户端通过 SCM_RIGHTS 附带自己的 TCP socket,
+ *   服务器据此找到已经接受的 TcpClient, 为其创建 TcpShmChannel_t 并把 memfd 和 eventfd 发回客户端
+ *
+ * 2.接收: 唤醒线程在 epoll 上等待所有通道的 c2s eventfd, 只负责把通道交给客户端所在的 DRS(DRS_CMD_CLIENT_SHM_READ);
+ *   DRS 线程调用 DrainChannel() 原地取出消息交给 ClientMsgBatchRecvd()/ClientMsgChunkRecvd(), 与同一客户端的
+ *   TCP 数据在同一个线程中按顺序交付, 内联回调不会并发
+ *
+ * 3.发送: TcpClient::SendMsg() 发现客户端已协商共享内存时, 所有消息都写 s2c 环(大消息拆成片段), 环满时在发送队列中排队;
+ *   对端释放空间后写 c2s eventfd, DRS 在 DrainChannel() 中先继续写入积压的消息
+ *
+ * 4.关闭: TCP 连接仍由 DRS 监听, 客户端断开时 ProcessClientDelete() 调用 Detach() 释放通道
+ *
+ * 5.协商在单独的线程中进行, 读取超时的客户端不会延迟已协商通道的消息
+ *
+ * 协商失败(不在同一主机, 服务器未启用等)时客户端继续使用 TCP, 服务器端不需要做任何事
+ */
+class TcpShmTransport
+{
+private:
+    TcpServerController *tcp_ctrlr;
+    uint64_t ring_size;  // 每个方向的环形缓冲区长度
+    int listen_fd;       // 协商用的抽象 Unix socket
+    int epoll_fd;        // 监听 listen_fd, stop_event_fd 和所有通道的 c2s eventfd
+    int stop_event_fd;   // Stop() 通知两个线程退出
+    pthread_t thread;    // 唤醒线程: 等待通道的 c2s eventfd
+    pthread_t negotiate_thread; // 协商线程: 接受 Unix socket 上的协商请求
+    bool running;        // 线程是否在运行
+
+    pthread_mutex_t mutex;                                 // 保护 channels
+    std::unordered_map<uint64_t, TcpClient *> channels;    // 通道编号(epoll data) -> 客户端, 持有客户端的一个引用
+    uint64_t next_channel_id;                              // 下一个通道编号
+    uint64_t n_negotiated;                                 // 协商成功的次数
+    uint64_t n_rejected;                                   // 协商失败的次数
+
+    void AcceptPeer();                                // 处理一个协商请求
+    int Negotiate(int unix_fd);                       // 协商, 成功返回 0, 否则返回 errno
+    bool Attach(TcpClient *, TcpShmChannel_t *);      // 把通道交给客户端并开始接收
+    void DispatchChannel(uint64_t channel_id);        // 通道可读, 交给客户端所在的 DRS
+    void DetachInternal(TcpClient *, uint64_t);       // 停止接收并关闭通道(持有 mutex)
+
+public:
+    TcpShmTransport(TcpServerController *, uint64_t ring_size);
+    ~TcpShmTransport();
+
+    bool Start();                 // 绑定 Unix socket 并启动线程, 失败返回 false(客户端继续使用 TCP)
+    void Stop();                  // 停止线程并关闭所有通道
+    void Detach(TcpClient *);     // 客户端被删除时调用, 停止接收并通知对端
+    void ResumeRead(TcpClient *); // 线程池积压回落后继续取出通道中的消息
+    void DrainChannel(TcpClient *); // (DRS 线程) 写入积压的发送消息, 取出通道中的所有消息并交付
+    void ThreadFn();              // 唤醒线程函数
+    void NegotiateThreadFn();     // 协商线程函数
+    void Display();               // 打印统计信息
+};
+
+#endif
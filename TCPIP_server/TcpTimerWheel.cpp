@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <time.h>
+#include <assert.h>
+#include "TcpTimerWheel.h"
+
+TcpTimer::TcpTimer()
+{
+    this->next = nullptr;
+    this->prev = nullptr;
+    this->expires = 0;
+    this->cb = nullptr;
+    this->arg = nullptr;
+}
+
+bool TcpTimer::IsPending()
+{
+    return this->next != nullptr;
+}
+
+TcpTimerWheel::TcpTimerWheel()
+{
+    uint32_t level, slot;
+
+    for (level = 0; level < TCP_TIMER_WHEEL_LEVELS; level++)
+    {
+        for (slot = 0; slot < TCP_TIMER_WHEEL_SLOTS; slot++)
+        {
+            this->slots[level][slot].next = &this->slots[level][slot];
+            this->slots[level][slot].prev = &this->slots[level][slot];
+        }
+    }
+
+    this->current_tick = 0;
+    this->start_ms = TcpTimerWheel::NowMs();
+    this->n_timers = 0;
+    this->n_fired = 0;
+}
+
+/**
+ * @brief 获取单调时钟(毫秒), 使用 COARSE 时钟, 开销远小于精确时钟, 精度满足 tick 的要求
+ *
+ */
+uint64_t TcpTimerWheel::NowMs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief 按距离到期的 tick 数选择层, 按到期 tick 在该层对应的位选择槽
+ *
+ */
+void TcpTimerWheel::Place(TcpTimer *timer)
+{
+    uint32_t level;
+    uint64_t delta, slot;
+    TcpTimer *head;
+
+    // 已经过期的定时器在下一个 tick 到期
+    if (timer->expires < this->current_tick)
+        timer->expires = this->current_tick;
+
+    delta = timer->expires - this->current_tick;
+
+    for (level = 0; level < TCP_TIMER_WHEEL_LEVELS - 1; level++)
+    {
+        if (delta < (1ULL << (TCP_TIMER_WHEEL_LEVEL_BITS * (level + 1))))
+            break;
+    }
+
+    // 超过时间轮范围的定时器放在最高层的最远处, cascade 时会重新计算
+    if (delta >= (1ULL << (TCP_TIMER_WHEEL_LEVEL_BITS * TCP_TIMER_WHEEL_LEVELS)))
+        timer->expires = this->current_tick + (1ULL << (TCP_TIMER_WHEEL_LEVEL_BITS * TCP_TIMER_WHEEL_LEVELS)) - 1;
+
+    slot = (timer->expires >> (TCP_TIMER_WHEEL_LEVEL_BITS * level)) & TCP_TIMER_WHEEL_SLOT_MASK;
+    head = &this->slots[level][slot];
+
+    // 插入链表尾部
+    timer->next = head;
+    timer->prev = head->prev;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+/**
+ * @brief 添加定时器, 已经在时间轮中的定时器会被重新调度
+ *
+ * @param timer 定时器
+ * @param expires 到期的绝对 tick
+ */
+void TcpTimerWheel::Add(TcpTimer *timer, uint64_t expires)
+{
+    this->Remove(timer);
+    timer->expires = expires;
+    this->Place(timer);
+    this->n_timers++;
+}
+
+void TcpTimerWheel::AddAfterMs(TcpTimer *timer, uint64_t ms)
+{
+    this->Add(timer, this->current_tick + this->MsToTicks(ms));
+}
+
+void TcpTimerWheel::Remove(TcpTimer *timer)
+{
+    if (!timer->IsPending())
+        return;
+
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = nullptr;
+    timer->prev = nullptr;
+    this->n_timers--;
+}
+
+/**
+ * @brief 把 level 层当前的槽中的定时器重新放入下层
+ *
+ */
+void TcpTimerWheel::Cascade(uint32_t level)
+{
+    uint64_t slot = (this->current_tick >> (TCP_TIMER_WHEEL_LEVEL_BITS * level)) & TCP_TIMER_WHEEL_SLOT_MASK;
+    TcpTimer *head = &this->slots[level][slot];
+    TcpTimer *timer;
+
+    while (head->next != head)
+    {
+        timer = head->next;
+        head->next = timer->next;
+        timer->next->prev = head;
+        this->Place(timer);
+    }
+}
+
+/**
+ * @brief 处理 current_tick 到期的定时器
+ *
+ */
+void TcpTimerWheel::Tick()
+{
+    uint32_t level;
+    uint64_t slot = this->current_tick & TCP_TIMER_WHEEL_SLOT_MASK;
+    TcpTimer expired;
+    TcpTimer *head = &this->slots[0][slot];
+    TcpTimer *timer;
+
+    // 第 0 层转完一圈, 从上一层取出接下来 64 个 tick 内到期的定时器
+    for (level = 1; slot == 0 && level < TCP_TIMER_WHEEL_LEVELS; level++)
+    {
+        this->Cascade(level);
+
+        if ((this->current_tick >> (TCP_TIMER_WHEEL_LEVEL_BITS * level)) & TCP_TIMER_WHEEL_SLOT_MASK)
+            break;
+    }
+
+    if (head->next == head)
+    {
+        this->current_tick++;
+        return;
+    }
+
+    // 先把到期的定时器移到本地链表, 回调中重新添加的定时器最早在下一个 tick 到期
+    expired.next = head->next;
+    expired.prev = head->prev;
+    expired.next->prev = &expired;
+    expired.prev->next = &expired;
+    head->next = head->prev = head;
+    this->current_tick++;
+
+    while (expired.next != &expired)
+    {
+        timer = expired.next;
+        expired.next = timer->next;
+        timer->next->prev = &expired;
+        timer->next = timer->prev = nullptr;
+        this->n_timers--;
+        this->n_fired++;
+
+        timer->cb(timer, timer->arg);
+    }
+
+    // 本地哨兵析构前保证链表为空
+    expired.next = expired.prev = nullptr;
+}
+
+/**
+ * @brief 处理到 now_ms 为止到期的所有定时器
+ *
+ * @param now_ms TcpTimerWheel::NowMs() 的返回值
+ */
+void TcpTimerWheel::Advance(uint64_t now_ms)
+{
+    uint64_t target;
+
+    if (now_ms < this->start_ms)
+        return;
+
+    target = (now_ms - this->start_ms) / TCP_TIMER_WHEEL_TICK_MS;
+
+    // 时间轮为空时直接跳到当前时间
+    if (this->n_timers == 0)
+    {
+        if (this->current_tick <= target)
+            this->current_tick = target + 1;
+        return;
+    }
+
+    while (this->current_tick <= target)
+        this->Tick();
+}
+
+/**
+ * @brief 距离下一个 tick 的毫秒数, 作为 epoll_wait()/select() 的超时时间
+ *
+ * @return int 没有定时器时返回 -1(无限等待)
+ */
+int TcpTimerWheel::GetTimeoutMs(uint64_t now_ms)
+{
+    uint64_t next_ms;
+
+    if (this->n_timers == 0)
+        return -1;
+
+    next_ms = this->start_ms + this->current_tick * TCP_TIMER_WHEEL_TICK_MS;
+
+    return next_ms > now_ms ? (int)(next_ms - now_ms) : 0;
+}
+
+uint64_t TcpTimerWheel::GetCurrentTick()
+{
+    return this->current_tick;
+}
+
+uint64_t TcpTimerWheel::MsToTicks(uint64_t ms)
+{
+    return (ms + TCP_TIMER_WHEEL_TICK_MS - 1) / TCP_TIMER_WHEEL_TICK_MS;
+}
+
+uint32_t TcpTimerWheel::GetTimerCount()
+{
+    return this->n_timers;
+}
+
+uint64_t TcpTimerWheel::GetFiredCount()
+{
+    return this->n_fired;
+}
@@ -0,0 +1,67 @@
+#ifndef TCPTIMERWHEEL_H_
+#define TCPTIMERWHEEL_H_
+
+#include <stdint.h>
+
+#define TCP_TIMER_WHEEL_TICK_MS 100      // 时间轮精度(毫秒)
+#define TCP_TIMER_WHEEL_LEVEL_BITS 6     // 每层 64 个槽
+#define TCP_TIMER_WHEEL_SLOTS (1 << TCP_TIMER_WHEEL_LEVEL_BITS)
+#define TCP_TIMER_WHEEL_SLOT_MASK (TCP_TIMER_WHEEL_SLOTS - 1)
+#define TCP_TIMER_WHEEL_LEVELS 4         // 4 层共 2^24 个 tick, 100ms 精度下约 19 天
+
+class TcpTimerWheel;
+
+/**
+ * @brief 时间轮中的定时器, 嵌入在使用者的对象中(侵入式双向链表), 添加/删除不需要分配内存
+ */
+class TcpTimer
+{
+public:
+    TcpTimer *next;                     // 同一槽中的下一个定时器, nullptr 表示未加入时间轮
+    TcpTimer *prev;                     // 同一槽中的上一个定时器
+    uint64_t expires;                   // 到期的 tick
+    void (*cb)(TcpTimer *, void *arg);  // 到期回调, 回调时定时器已经从时间轮中移除
+    void *arg;                          // 回调参数
+
+    TcpTimer();
+    bool IsPending(); // 是否在时间轮中等待到期
+};
+
+/**
+ * @brief 分层时间轮(每个 DRS 分片一个, 只由 DRS 线程访问)
+ *
+ * 1.4 层 x 64 槽, 第 n 层的一个槽覆盖 64^n 个 tick; 定时器按距离到期的 tick 数放入对应的层
+ *
+ * 2.添加/删除为 O(1); 每个 tick 只处理第 0 层的一个槽, 第 0 层转完一圈时把上一层的一个槽重新分配到下层(cascade)
+ *
+ * 3.到期检查不需要遍历所有客户端, 10 万个定时器时每个 tick 的开销只与本 tick 到期的定时器数有关
+ */
+class TcpTimerWheel
+{
+private:
+    TcpTimer slots[TCP_TIMER_WHEEL_LEVELS][TCP_TIMER_WHEEL_SLOTS]; // 每个槽是一个带哨兵的循环链表
+    uint64_t current_tick; // 下一个要处理的 tick
+    uint64_t start_ms;     // tick 0 对应的时间
+    uint32_t n_timers;     // 时间轮中的定时器数量
+    uint64_t n_fired;      // 已经到期的定时器数量
+
+    void Place(TcpTimer *);           // 按到期时间放入对应的层和槽
+    void Cascade(uint32_t level);     // 把 level 层当前的槽重新分配到下层
+    void Tick();                      // 处理 current_tick 到期的定时器
+
+public:
+    TcpTimerWheel();
+
+    static uint64_t NowMs();                    // CLOCK_MONOTONIC_COARSE 毫秒
+    void Add(TcpTimer *, uint64_t expires);     // 添加定时器, expires 为绝对 tick
+    void AddAfterMs(TcpTimer *, uint64_t ms);   // 添加定时器, ms 毫秒后到期
+    void Remove(TcpTimer *);                    // 删除定时器, 未加入时间轮时无操作
+    void Advance(uint64_t now_ms);              // 处理到 now_ms 为止到期的所有定时器
+    int GetTimeoutMs(uint64_t now_ms);          // 距下一个 tick 的毫秒数, 没有定时器时返回 -1(用于 epoll_wait)
+    uint64_t GetCurrentTick();
+    uint64_t MsToTicks(uint64_t ms);            // 毫秒换算为 tick 数(向上取整)
+    uint32_t GetTimerCount();
+    uint64_t GetFiredCount();
+};
+
+#endif
@@ -0,0 +1,515 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <assert.h>
+#include "TcpWorkerPool.h"
+#include "TcpClient.h"
+#include "TcpClientServiceManager.h"
+#include "TcpServerController.h"
+#include "TcpMetrics.h"
+#include "TcpMemPool.h"
+
+TcpClientStrand::TcpClientStrand()
+{
+    pthread_mutex_init(&this->mutex, nullptr);
+    this->head = nullptr;
+    this->tail = nullptr;
+    this->n_frames = 0;
+    this->scheduled = false;
+    this->throttled = false;
+}
+
+TcpClientStrand::~TcpClientStrand()
+{
+    assert(!this->scheduled);
+    pthread_mutex_destroy(&this->mutex);
+}
+
+bool TcpClientStrand::IsIdle()
+{
+    bool idle;
+
+    pthread_mutex_lock(&this->mutex);
+    idle = !this->scheduled && !this->head;
+    pthread_mutex_unlock(&this->mutex);
+
+    return idle;
+}
+
+/**
+ * @brief 读取方在每次读取后检查, 不需要加锁
+ *
+ */
+bool TcpClientStrand::IsThrottled()
+{
+    return __atomic_load_n(&this->throttled, __ATOMIC_ACQUIRE);
+}
+
+TcpWorkerPool::TcpWorkerPool(TcpServerController *tcp_ctrlr, uint16_t n_workers)
+{
+    uint16_t i;
+    TcpWorker_t *worker;
+
+    this->tcp_ctrlr = tcp_ctrlr;
+    this->n_queued.store(0);
+    this->n_idle.store(0);
+    this->n_throttled.store(0);
+    this->n_dropped.store(0);
+    this->running = false;
+    pthread_mutex_init(&this->idle_mutex, nullptr);
+    pthread_cond_init(&this->idle_cv, nullptr);
+
+    if (n_workers == 0)
+        n_workers = 1;
+
+    for (i = 0; i < n_workers; i++)
+    {
+        worker = new TcpWorker_t();
+        pthread_mutex_init(&worker->mutex, nullptr);
+        worker->pool = this;
+        worker->worker_id = i;
+        worker->n_frames = 0;
+        worker->n_steals = 0;
+        worker->n_ready.store(0);
+        this->workers.push_back(worker);
+    }
+}
+
+TcpWorkerPool::~TcpWorkerPool()
+{
+    size_t i;
+
+    assert(!this->running);
+
+    for (i = 0; i < this->workers.size(); i++)
+    {
+        assert(this->workers[i]->run_queue.empty());
+        pthread_mutex_destroy(&this->workers[i]->mutex);
+        delete this->workers[i];
+    }
+
+    pthread_mutex_destroy(&this->idle_mutex);
+    pthread_cond_destroy(&this->idle_cv);
+}
+
+static void *tcp_worker_thread_fn(void *arg)
+{
+    TcpWorker_t *worker = (TcpWorker_t *)arg;
+
+    worker->pool->WorkerThreadFn(worker);
+    return nullptr;
+}
+
+void TcpWorkerPool::Start()
+{
+    size_t i;
+
+    this->running = true;
+
+    for (i = 0; i < this->workers.size(); i++)
+    {
+        if (pthread_create(&this->workers[i]->thread, nullptr, tcp_worker_thread_fn, (void *)this->workers[i]))
+        {
+            printf("Error : Could not create worker thread %zu\n", i);
+            exit(0);
+        }
+    }
+}
+
+/**
+ * @brief 停止所有工作线程. 调用前 DRS 必须已经注销所有客户端(StopListenAll), 不会再有新的消息
+ *
+ * 工作线程处理完队列中已有的消息后退出
+ *
+ */
+void TcpWorkerPool::Stop()
+{
+    size_t i;
+    TcpClient *tcp_client;
+
+    if (!this->running)
+        return;
+
+    pthread_mutex_lock(&this->idle_mutex);
+    this->running = false;
+    pthread_cond_broadcast(&this->idle_cv);
+    pthread_mutex_unlock(&this->idle_mutex);
+
+    // 工作线程取不到任务时才检查 running, 退出时队列已经为空
+    for (i = 0; i < this->workers.size(); i++)
+        pthread_join(this->workers[i]->thread, nullptr);
+
+    // 防御性清理: 正常情况下不会有剩余的客户端
+    for (i = 0; i < this->workers.size(); i++)
+    {
+        while (!this->workers[i]->run_queue.empty())
+        {
+            tcp_client = this->workers[i]->run_queue.front();
+            this->workers[i]->run_queue.pop_front();
+            this->workers[i]->n_ready--;
+            this->n_queued--;
+            this->DrainStrand(tcp_client);
+        }
+    }
+}
+
+/**
+ * @brief 丢弃客户端积压的消息, 释放调度时持有的引用
+ *
+ * @param tcp_client 已经从运行队列中取出的客户端
+ */
+void TcpWorkerPool::DrainStrand(TcpClient *tcp_client)
+{
+    TcpPoolFrame_t *frame, *next_frame;
+    TcpClientStrand *strand = &tcp_client->strand;
+
+    pthread_mutex_lock(&strand->mutex);
+    frame = strand->head;
+    strand->head = strand->tail = nullptr;
+    strand->n_frames = 0;
+    strand->scheduled = false;
+    __atomic_store_n(&strand->throttled, false, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&strand->mutex);
+
+    for (; frame; frame = next_frame)
+    {
+        next_frame = frame->next;
+        TcpMemPoolFree(frame);
+    }
+
+    tcp_client->Dereference();
+}
+
+/**
+ * @brief 将客户端放入工作线程的本地队列, 有空闲线程时唤醒
+ *
+ * @param tcp_client 已经被标记为 scheduled 的客户端
+ * @param worker_id 目标工作线程
+ */
+void TcpWorkerPool::Submit(TcpClient *tcp_client, uint16_t worker_id)
+{
+    TcpWorker_t *worker = this->workers[worker_id % this->workers.size()];
+
+    pthread_mutex_lock(&worker->mutex);
+    worker->run_queue.push_back(tcp_client);
+    worker->n_ready++;
+    pthread_mutex_unlock(&worker->mutex);
+
+    // 先增加任务数再检查空闲线程, 与工作线程 增加空闲数 -> 检查任务数 的顺序相反, 保证不会错过唤醒
+    this->n_queued++;
+
+    if (this->n_idle.load() == 0)
+        return;
+
+    pthread_mutex_lock(&this->idle_mutex);
+    pthread_cond_signal(&this->idle_cv);
+    pthread_mutex_unlock(&this->idle_mutex);
+}
+
+/**
+ * @brief (DRS 线程) 将一条消息交给线程池处理
+ *
+ * 客户端处于 TCP_CLIENT_STATE_POOLED 状态, 或者迁移回内联处理后仍有积压的消息时, 消息进入该客户端的 strand,
+ * 保证迁移前后消息顺序不变.
+ *
+ * 消息不会因积压而丢弃: 积压达到 TCP_WORKER_STRAND_HIGH_WM 时标记 strand, 读取方在本次读取后暂停读取此客户端,
+ * 之后的积压最多是已经读入分帧器缓冲区的数据; 工作线程处理到 TCP_WORKER_STRAND_LOW_WM 以下时恢复读取.
+ * 只有分配不到内存时才丢弃消息(计入 n_dropped)
+ *
+ * @param tcp_client 消息来源的客户端
+ * @param msg 消息内容(只在本次调用期间有效)
+ * @param msg_size 消息长度
+ * @param frame_offset 大消息片段在整条消息中的偏移
+ * @param frame_size 大消息片段所属消息的长度, 0 表示 msg 是一条完整消息
+ * @return true 消息已交给线程池
+ * @return false 客户端不是线程池模式, 调用方应该直接回调应用层
+ */
+bool TcpWorkerPool::Dispatch(TcpClient *tcp_client, unsigned char *msg, uint16_t msg_size,
+                             uint64_t frame_offset, uint64_t frame_size)
+{
+    bool submit = false, throttle = false;
+    TcpPoolFrame_t *frame;
+    TcpClientStrand *strand = &tcp_client->strand;
+
+    pthread_mutex_lock(&strand->mutex);
+
+    if (!tcp_client->IsStateSet(TCP_CLIENT_STATE_POOLED) && !strand->scheduled)
+    {
+        pthread_mutex_unlock(&strand->mutex);
+        return false;
+    }
+
+    frame = (TcpPoolFrame_t *)TcpMemPoolAlloc(sizeof(TcpPoolFrame_t) + msg_size);
+
+    // 内存不足: 丢弃这条消息并计数; 有积压时同时暂停读取, 工作线程处理完积压后恢复
+    if (!frame)
+    {
+        if (strand->scheduled && !strand->throttled)
+        {
+            __atomic_store_n(&strand->throttled, true, __ATOMIC_RELEASE);
+            throttle = true;
+        }
+
+        pthread_mutex_unlock(&strand->mutex);
+
+        this->n_dropped++;
+        if (throttle)
+            this->n_throttled++;
+
+        return true;
+    }
+
+    frame->next = nullptr;
+    frame->size = msg_size;
+    frame->recv_ns = tcp_client->conn.recv_ns;
+    frame->frame_offset = frame_offset;
+    frame->frame_size = frame_size;
+    memcpy(frame->data, msg, msg_size);
+
+    if (strand->tail)
+        strand->tail->next = frame;
+    else
+        strand->head = frame;
+
+    strand->tail = frame;
+    strand->n_frames++;
+
+    // 应用层处理过慢, 暂停读取此客户端来限制它占用的内存
+    if (strand->n_frames >= TCP_WORKER_STRAND_HIGH_WM && !strand->throttled)
+    {
+        __atomic_store_n(&strand->throttled, true, __ATOMIC_RELEASE);
+        throttle = true;
+    }
+
+    if (!strand->scheduled)
+    {
+        strand->scheduled = true;
+        submit = true;
+    }
+
+    pthread_mutex_unlock(&strand->mutex);
+
+    if (throttle)
+        this->n_throttled++;
+
+    if (submit)
+    {
+        // 调度期间持有客户端的引用
+        tcp_client->Reference();
+        this->Submit(tcp_client, tcp_client->svc_mgr ? tcp_client->svc_mgr->GetReactorId() : 0);
+    }
+
+    return true;
+}
+
+/**
+ * @brief 取出下一个要处理的客户端: 先从本地队列头部取, 再依次从其他线程的队列尾部窃取
+ *
+ * @return TcpClient* 没有任务时返回 nullptr
+ */
+TcpClient *TcpWorkerPool::NextClient(TcpWorker_t *worker)
+{
+    size_t i, n_workers = this->workers.size();
+    TcpWorker_t *victim;
+    TcpClient *tcp_client = nullptr;
+
+    pthread_mutex_lock(&worker->mutex);
+    if (!worker->run_queue.empty())
+    {
+        tcp_client = worker->run_queue.front();
+        worker->run_queue.pop_front();
+        worker->n_ready--;
+    }
+    pthread_mutex_unlock(&worker->mutex);
+
+    for (i = 1; !tcp_client && i < n_workers; i++)
+    {
+        victim = this->workers[(worker->worker_id + i) % n_workers];
+
+        // 避免对空队列加锁
+        if (victim->n_ready.load() == 0)
+            continue;
+
+        pthread_mutex_lock(&victim->mutex);
+        if (!victim->run_queue.empty())
+        {
+            tcp_client = victim->run_queue.back();
+            victim->run_queue.pop_back();
+            victim->n_ready--;
+            worker->n_steals++;
+        }
+        pthread_mutex_unlock(&victim->mutex);
+    }
+
+    if (tcp_client)
+        this->n_queued--;
+
+    return tcp_client;
+}
+
+/**
+ * @brief 处理客户端当前积压的全部消息; 处理期间又有新消息到达时, 把客户端重新排到本地队列尾部
+ *
+ * 读取被暂停的客户端在积压回落到低水位以下时恢复读取
+ */
+void TcpWorkerPool::RunClient(TcpWorker_t *worker, TcpClient *tcp_client)
+{
+    uint32_t i, n_spans = 0;
+    uint64_t now_ns = 0;
+    bool resume;
+    TcpPoolFrame_t *frame, *next_frame;
+    TcpPoolFrame_t *batch[TCP_MSG_BATCH_MAX];
+    TcpMsgSpan_t spans[TCP_MSG_BATCH_MAX];
+    TcpReactorMetrics_t *metrics = this->tcp_ctrlr->GetClientMetricsShard(tcp_client);
+    TcpClientStrand *strand = &tcp_client->strand;
+
+    pthread_mutex_lock(&strand->mutex);
+    frame = strand->head;
+    strand->head = strand->tail = nullptr;
+    strand->n_frames = 0;
+    pthread_mutex_unlock(&strand->mutex);
+
+    // 这一批消息产生的回复合并发送
+    tcp_client->out_queue.Cork();
+
+    for (; frame; frame = next_frame)
+    {
+        next_frame = frame->next;
+
+        // 大消息的片段单独回调; 成批回调时片段之前的消息已经先交付, 顺序不变
+        if (frame->frame_size)
+        {
+            if (this->tcp_ctrlr->client_msg_chunk_recvd)
+                this->tcp_ctrlr->client_msg_chunk_recvd(this->tcp_ctrlr, tcp_client, frame->data, frame->size,
+                                                        frame->frame_offset, frame->frame_size);
+
+            if (frame->frame_offset + frame->size == frame->frame_size)
+                worker->n_frames++;
+
+            TcpMemPoolFree(frame);
+            continue;
+        }
+
+        // 包括在 strand 和工作线程队列中等待的时间, 同一批消息使用同一个回调开始时间
+        if (frame->recv_ns && (this->tcp_ctrlr->client_msg_recvd || this->tcp_ctrlr->client_msg_batch_recvd))
+        {
+            if (!n_spans || !now_ns)
+                now_ns = TcpMetricsNowNs();
+
+            TcpHistogramRecord(&metrics->recv_to_cb, now_ns - frame->recv_ns);
+        }
+
+        if (this->tcp_ctrlr->client_msg_batch_recvd)
+        {
+            // 积压的消息成批回调, 一批处理完之后才释放
+            batch[n_spans] = frame;
+            spans[n_spans].data = frame->data;
+            spans[n_spans].size = frame->size;
+
+            if (++n_spans < TCP_MSG_BATCH_MAX && next_frame && !next_frame->frame_size)
+                continue;
+
+            this->tcp_ctrlr->client_msg_batch_recvd(this->tcp_ctrlr, tcp_client, spans, n_spans);
+
+            for (i = 0; i < n_spans; i++)
+                TcpMemPoolFree(batch[i]);
+
+            worker->n_frames += n_spans;
+            n_spans = 0;
+            continue;
+        }
+
+        if (this->tcp_ctrlr->client_msg_recvd)
+            this->tcp_ctrlr->client_msg_recvd(this->tcp_ctrlr, tcp_client, frame->data, frame->size);
+
+        worker->n_frames++;
+        TcpMemPoolFree(frame);
+    }
+
+    tcp_client->out_queue.Uncork(tcp_client);
+
+    pthread_mutex_lock(&strand->mutex);
+
+    resume = strand->throttled && strand->n_frames <= TCP_WORKER_STRAND_LOW_WM;
+    if (resume)
+        __atomic_store_n(&strand->throttled, false, __ATOMIC_RELEASE);
+
+    if (strand->head)
+    {
+        // 仍有新消息, 继续持有引用并重新排队
+        pthread_mutex_unlock(&strand->mutex);
+
+        if (resume)
+            this->tcp_ctrlr->ClientResumeRead(tcp_client);
+
+        this->Submit(tcp_client, worker->worker_id);
+        return;
+    }
+
+    strand->scheduled = false;
+    pthread_mutex_unlock(&strand->mutex);
+
+    // 先清除标记再恢复, 读取方恢复后立即看到新的状态
+    if (resume)
+        this->tcp_ctrlr->ClientResumeRead(tcp_client);
+
+    tcp_client->Dereference();
+}
+
+/**
+ * @brief 工作线程函数
+ *
+ */
+void TcpWorkerPool::WorkerThreadFn(TcpWorker_t *worker)
+{
+    TcpClient *tcp_client;
+
+    while (true)
+    {
+        tcp_client = this->NextClient(worker);
+
+        if (tcp_client)
+        {
+            this->RunClient(worker, tcp_client);
+            continue;
+        }
+
+        pthread_mutex_lock(&this->idle_mutex);
+        this->n_idle++;
+
+        while (this->running && this->n_queued.load() == 0)
+            pthread_cond_wait(&this->idle_cv, &this->idle_mutex);
+
+        this->n_idle--;
+
+        if (!this->running)
+        {
+            pthread_mutex_unlock(&this->idle_mutex);
+            return;
+        }
+
+        pthread_mutex_unlock(&this->idle_mutex);
+    }
+}
+
+uint16_t TcpWorkerPool::GetWorkerCount()
+{
+    return (uint16_t)this->workers.size();
+}
+
+void TcpWorkerPool::Display()
+{
+    size_t i;
+
+    printf("Worker Pool : %zu workers, queued clients = %u, idle = %u, read throttled = %lu, dropped = %lu\n",
+           this->workers.size(), this->n_queued.load(), this->n_idle.load(), (unsigned long)this->n_throttled.load(),
+           (unsigned long)this->n_dropped.load());
+
+    for (i = 0; i < this->workers.size(); i++)
+    {
+        printf("  worker %u : frames = %lu, steals = %lu\n",
+               this->workers[i]->worker_id,
+               (unsigned long)this->workers[i]->n_frames,
+               (unsigned long)this->workers[i]->n_steals);
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef TCPWORKERPOOL_H_
+#define TCPWORKERPOOL_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+#include <deque>
+#include <vector>
+
+#define TCP_WORKER_STRAND_HIGH_WM 4096 // 每个客户端积压的消息数达到此值时暂停读取该客户端(不丢弃消息)
+#define TCP_WORKER_STRAND_LOW_WM 1024  // 积压回落到此值以下时工作线程恢复读取
+
+class TcpClient;
+class TcpServerController;
+class TcpWorkerPool;
+
+/**
+ * @brief 交给工作线程处理的一条消息(DRS 交付的消息只在回调期间有效, 必须拷贝)
+ */
+typedef struct TcpPoolFrame_
+{
+    struct TcpPoolFrame_ *next; // 同一客户端的下一条消息
+    uint16_t size;              // 消息长度
+    uint64_t recv_ns;           // 消息所在数据的读取时间, 0 表示未知
+    uint64_t frame_offset;      // 大消息片段在整条消息中的偏移
+    uint64_t frame_size;        // 大消息片段所属消息的长度, 0 表示这是一条完整消息
+    unsigned char data[];       // 消息内容
+} TcpPoolFrame_t;
+
+/**
+ * @brief 客户端的串行执行队列(strand)
+ *
+ * 同一客户端的消息按到达顺序排队, 同一时刻最多只有一个工作线程处理该客户端, 保证消息顺序
+ */
+class TcpClientStrand
+{
+private:
+    pthread_mutex_t mutex;  // 保护以下字段
+    TcpPoolFrame_t *head;   // 等待处理的第一条消息
+    TcpPoolFrame_t *tail;   // 等待处理的最后一条消息
+    uint32_t n_frames;      // 等待处理的消息数
+    bool scheduled;         // 客户端是否已经在某个工作线程的队列中或正在被处理
+    bool throttled;         // 积压达到高水位, 读取方(DRS/共享内存线程)应暂停读取, 回落到低水位后由工作线程恢复
+
+    friend class TcpWorkerPool;
+
+public:
+    TcpClientStrand();
+    ~TcpClientStrand();
+
+    bool IsIdle();      // 没有等待处理的消息, 也没有被调度
+    bool IsThrottled(); // (读取方) 积压过多, 应暂停读取此客户端
+};
+
+/**
+ * @brief 工作线程的本地任务队列
+ */
+typedef struct TcpWorker_
+{
+    pthread_t thread;               // 工作线程
+    pthread_mutex_t mutex;          // 保护 run_queue
+    std::deque<TcpClient *> run_queue; // 待处理的客户端, 本线程从头部取, 其他线程从尾部窃取
+    std::atomic<uint32_t> n_ready;  // run_queue 的长度, 窃取时不加锁先检查
+    TcpWorkerPool *pool;            // 所属线程池
+    uint16_t worker_id;             // 线程编号
+    uint64_t n_frames;              // 处理的消息数
+    uint64_t n_steals;              // 从其他线程窃取的任务数
+} TcpWorker_t;
+
+/**
+ * @brief 固定大小的工作窃取线程池, 取代每个客户端一个线程的多线程模式
+ *
+ * 1.客户端的 I/O 仍然由 DRS(reactor) 线程完成, "多线程客户端" 只是把分帧后的消息交给线程池处理
+ *
+ * 2.每个客户端是一个 strand: 消息按顺序排队, 同一时刻只有一个工作线程处理它, 处理完一批后重新排到队尾, 保证公平
+ *
+ * 3.客户端首先放入 reactor 对应的工作线程队列, 空闲的工作线程从其他线程的队列尾部窃取任务
+ *
+ * 4.所有工作线程都忙时不需要唤醒; 只有存在空闲线程时才通过条件变量唤醒
+ */
+class TcpWorkerPool
+{
+private:
+    TcpServerController *tcp_ctrlr;
+    std::vector<TcpWorker_t *> workers;   // 工作线程
+    std::atomic<uint32_t> n_queued;       // 所有本地队列中的客户端总数
+    std::atomic<uint32_t> n_idle;         // 正在等待任务的工作线程数
+    std::atomic<uint64_t> n_throttled;    // 因积压达到高水位而暂停读取客户端的次数
+    std::atomic<uint64_t> n_dropped;      // 分配不到内存而丢弃的消息数
+    pthread_mutex_t idle_mutex;           // 配合 idle_cv 使用
+    pthread_cond_t idle_cv;               // 空闲线程在此等待任务
+    bool running;                         // 线程池是否在运行
+
+    void Submit(TcpClient *, uint16_t worker_id); // 将客户端放入指定工作线程的队列
+    TcpClient *NextClient(TcpWorker_t *);         // 取出下一个客户端, 本地队列为空时窃取
+    void RunClient(TcpWorker_t *, TcpClient *);   // 处理客户端的一批消息
+    void DrainStrand(TcpClient *);                // 丢弃客户端积压的消息
+
+public:
+    TcpWorkerPool(TcpServerController *, uint16_t n_workers);
+    ~TcpWorkerPool();
+
+    void Start();
+    void Stop();
+    void WorkerThreadFn(TcpWorker_t *);
+
+    bool Dispatch(TcpClient *, unsigned char *msg, uint16_t msg_size,
+                  uint64_t frame_offset = 0, uint64_t frame_size = 0); // (DRS 线程) 把消息(或大消息的片段)交给线程池, 返回 false 表示应内联处理
+    uint16_t GetWorkerCount();
+    void Display();
+};
+
+#endif
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <list>
+#include <vector>
+#include "TcpClientHashIndex.h"
+
+/*
+ * Client lookup benchmark: std::list 线性查找 vs TcpClientHashIndex
+ *
+ * usage : client_lookup_bench.exe [n_lookups]
+ *
+ * 分别在 10k / 100k 个客户端下测量 插入 / 按 (ip, port) 查找 / 删除 的平均耗时.
+ * 客户端对象只需要 ip/port 字段, 这里用同样大小的结构体代替 TcpClient.
+ */
+
+typedef struct bench_client_
+{
+    uint32_t ip_addr;
+    uint16_t port_no;
+    unsigned char payload[1024 + 128]; // 与 TcpClient 大小相近, 线性查找时每个客户端都是一次 cache miss
+} bench_client_t;
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bench_client_t *list_lookup(std::list<bench_client_t *> *db, uint32_t ip_addr, uint16_t port_no)
+{
+    std::list<bench_client_t *>::iterator it;
+
+    for (it = db->begin(); it != db->end(); ++it)
+    {
+        if ((*it)->ip_addr == ip_addr && (*it)->port_no == port_no)
+            return *it;
+    }
+
+    return nullptr;
+}
+
+static void run(uint32_t n_clients, uint32_t n_lookups)
+{
+    uint32_t i;
+    double t0, t_list_ins, t_list_lookup, t_list_rm, t_hash_ins, t_hash_lookup, t_hash_rm;
+    uint64_t found_list = 0, found_hash = 0;
+    std::vector<bench_client_t *> clients(n_clients);
+    std::vector<uint32_t> order(n_lookups);
+    std::list<bench_client_t *> db;
+    TcpClientHashIndex index;
+
+    // 模拟来自少量网段、端口随机的客户端
+    for (i = 0; i < n_clients; i++)
+    {
+        clients[i] = (bench_client_t *)calloc(1, sizeof(bench_client_t));
+        clients[i]->ip_addr = 0x0a000000 | (i / 60000) << 8 | (rand() & 0xff);
+        clients[i]->port_no = 1024 + i % 60000;
+    }
+
+    for (i = 0; i < n_lookups; i++)
+        order[i] = rand() % n_clients;
+
+    // std::list
+    t0 = now_sec();
+    for (i = 0; i < n_clients; i++)
+        db.push_back(clients[i]);
+    t_list_ins = now_sec() - t0;
+
+    t0 = now_sec();
+    for (i = 0; i < n_lookups; i++)
+        found_list += list_lookup(&db, clients[order[i]]->ip_addr, clients[order[i]]->port_no) != nullptr;
+    t_list_lookup = now_sec() - t0;
+
+    t0 = now_sec();
+    for (i = 0; i < n_lookups && !db.empty(); i++)
+        db.remove(list_lookup(&db, clients[order[i]]->ip_addr, clients[order[i]]->port_no));
+    t_list_rm = now_sec() - t0;
+
+    // TcpClientHashIndex
+    t0 = now_sec();
+    for (i = 0; i < n_clients; i++)
+        index.Insert(clients[i]->ip_addr, clients[i]->port_no, (TcpClient *)clients[i]);
+    t_hash_ins = now_sec() - t0;
+
+    t0 = now_sec();
+    for (i = 0; i < n_lookups; i++)
+        found_hash += index.Lookup(clients[order[i]]->ip_addr, clients[order[i]]->port_no) == (TcpClient *)clients[order[i]];
+    t_hash_lookup = now_sec() - t0;
+
+    t0 = now_sec();
+    for (i = 0; i < n_lookups; i++)
+        index.Remove(clients[order[i]]->ip_addr, clients[order[i]]->port_no);
+    t_hash_rm = now_sec() - t0;
+
+    printf("%8u clients | list : insert %8.1f  lookup %10.1f  remove %10.1f | hash : insert %6.1f  lookup %6.1f  remove %6.1f ns/op%s\n",
+           n_clients,
+           t_list_ins / n_clients * 1e9, t_list_lookup / n_lookups * 1e9, t_list_rm / n_lookups * 1e9,
+           t_hash_ins / n_clients * 1e9, t_hash_lookup / n_lookups * 1e9, t_hash_rm / n_lookups * 1e9,
+           found_list == n_lookups && found_hash == n_lookups ? "" : "  (MISMATCH)");
+
+    for (i = 0; i < n_clients; i++)
+        free(clients[i]);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t n_lookups = argc > 1 ? atoi(argv[1]) : 2000;
+
+    srand(1);
+    run(10000, n_lookups);
+    run(100000, n_lookups);
+    return 0;
+}
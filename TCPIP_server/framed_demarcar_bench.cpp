@@ -0,0 +1,360 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "TcpMsgDemarcar.h"
+#include "TcpMsgFramedDemarcar.h"
+#include "TcpServerController.h"
+
+/*
+ * Benchmark : templated batch framing vs the per-frame virtual framing loop
+ *
+ * usage : framed_demarcar_bench.exe [stream_mb] [max_chunk]
+ *
+ * legacy  : 重现模板化之前的实现, 每条消息经过一次虚函数 IsBufferReadyToFlush() 重新读取消息头,
+ *           再逐条调用消息回调
+ * batched : TcpMsgFramedDemarcar::ParseFrames(), 分帧策略在编译期确定, 每批(最多 TCP_MSG_BATCH_MAX 条)调用一次回调
+ *
+ * runtime : TcpLengthPrefixRuntimeFraming, 长度头宽度/字节序在运行时配置(TCP_DEMARCAR_LENGTH_PREFIX)
+ * stream  : 64 KiB ~ 1 MiB 的消息远大于环形缓冲区, 按片段流式交付
+ *
+ * 字节流按随机长度(1 ~ max_chunk)分块写入分帧器, 模拟 recv() 返回的任意切分.
+ * 各实现对同一个字节流分帧, 输出 MB/s 和 消息数/秒, 并校验消息数和校验和.
+ */
+
+/**
+ * @brief 分帧器目标文件通过 TcpServerController 交付消息和更新计数器, 基准测试不经过这些路径,
+ * 提供空实现以便只链接分帧器相关的目标文件
+ */
+void TcpServerController::ClientMsgRecvd(TcpClient *, unsigned char *, uint16_t)
+{
+}
+
+void TcpServerController::ClientMsgBatchRecvd(TcpClient *, TcpMsgSpan_t *, uint32_t)
+{
+}
+
+void TcpServerController::ClientMsgChunkRecvd(TcpClient *, unsigned char *, uint16_t, uint64_t, uint64_t)
+{
+}
+
+void TcpServerController::ClientProtocolError(TcpClient *, TcpMsgDemarcarError, uint64_t)
+{
+}
+
+TcpReactorMetrics_t *TcpServerController::GetClientMetricsShard(TcpClient *)
+{
+    return NULL;
+}
+
+void TcpServerController::GetMetricsSnapshot(TcpMetricsSnapshot_t *)
+{
+}
+
+typedef struct bench_result_
+{
+    uint64_t n_frames;
+    uint64_t checksum;
+} bench_result_t;
+
+// 回调不内联, 与应用层通过函数指针回调的开销相当
+static void __attribute__((noinline)) frame_recvd(bench_result_t *result, unsigned char *msg, uint16_t msg_size)
+{
+    result->n_frames++;
+    result->checksum += msg_size + msg[msg_size - 1];
+}
+
+static void __attribute__((noinline)) batch_recvd(bench_result_t *result, TcpMsgSpan_t *spans, uint32_t n_spans)
+{
+    uint32_t i;
+
+    result->n_frames += n_spans;
+
+    for (i = 0; i < n_spans; i++)
+        result->checksum += spans[i].size + spans[i].data[spans[i].size - 1];
+}
+
+// 流式交付的片段, 最后一段到达时才算一条消息
+static void __attribute__((noinline)) chunk_recvd(bench_result_t *result, unsigned char *chunk, uint16_t chunk_size,
+                                                  uint64_t frame_offset, uint64_t frame_size)
+{
+    if (frame_offset + chunk_size < frame_size)
+        return;
+
+    result->n_frames++;
+    result->checksum += frame_size + chunk[chunk_size - 1];
+}
+
+/**
+ * @brief 模板化之前的分帧循环: 每条消息重新调用虚函数判断是否完整, 再读一次消息头
+ */
+class LegacyDemarcar : public TcpMsgDemarcar
+{
+private:
+    uint32_t header_size; // 0 表示固定长度
+    uint16_t fixed_size;
+
+    uint64_t FrameSize()
+    {
+        uint16_t msg_size;
+
+        if (!this->header_size)
+            return this->fixed_size;
+
+        memcpy(&msg_size, this->RingPeek(0, 2), 2);
+        return msg_size;
+    }
+
+public:
+    bench_result_t result;
+
+    LegacyDemarcar(uint16_t fixed_size, TcpMsgDemarcarRingType ring_type)
+        : TcpMsgDemarcar(DEFAULT_CBC_SIZE, ring_type)
+    {
+        this->header_size = fixed_size ? 0 : 2;
+        this->fixed_size = fixed_size;
+        memset(&this->result, 0, sizeof(this->result));
+    }
+
+    bool IsBufferReadyToFlush() override
+    {
+        uint64_t data_size = this->RingDataSize();
+
+        if (data_size <= this->header_size)
+            return false;
+
+        return this->FrameSize() <= data_size;
+    }
+
+    void ProcessClientMsg(TcpClient *) override
+    {
+        uint64_t frame_size;
+
+        while (this->IsBufferReadyToFlush())
+        {
+            frame_size = this->FrameSize();
+            frame_recvd(&this->result, this->RingPeek(0, frame_size), (uint16_t)frame_size);
+            this->RingConsume(frame_size);
+        }
+    }
+
+    void Feed(unsigned char *data, uint64_t size)
+    {
+        TcpMsgDemarcar *msgd = this;
+
+        if (!this->RingWrite(data, size))
+        {
+            printf("ring buffer overflow\n");
+            exit(0);
+        }
+
+        if (msgd->IsBufferReadyToFlush())
+            msgd->ProcessClientMsg(NULL);
+    }
+};
+
+class BenchSink
+{
+public:
+    bench_result_t *result;
+
+    BenchSink(bench_result_t *result) : result(result) {}
+
+    void Frames(TcpMsgSpan_t *spans, uint32_t n_spans)
+    {
+        batch_recvd(this->result, spans, n_spans);
+    }
+
+    void Chunk(unsigned char *chunk, uint16_t chunk_size, uint64_t frame_offset, uint64_t frame_size)
+    {
+        chunk_recvd(this->result, chunk, chunk_size, frame_offset, frame_size);
+    }
+
+    void Error(TcpMsgDemarcarError error, uint64_t frame_size)
+    {
+        printf("protocol error %d, frame size = %lu\n", error, (unsigned long)frame_size);
+        exit(0);
+    }
+};
+
+template <typename Framing>
+class BatchedDemarcar : public TcpMsgFramedDemarcar<Framing>
+{
+public:
+    bench_result_t result;
+
+    BatchedDemarcar(const Framing &framing, TcpMsgDemarcarRingType ring_type, bool stream_frames = false)
+        : TcpMsgFramedDemarcar<Framing>(framing, ring_type)
+    {
+        memset(&this->result, 0, sizeof(this->result));
+        this->SetFrameLimits(0, stream_frames);
+    }
+
+    void Feed(unsigned char *data, uint64_t size)
+    {
+        BenchSink sink(&this->result);
+
+        if (!this->RingWrite(data, size))
+        {
+            printf("ring buffer overflow\n");
+            exit(0);
+        }
+
+        this->ParseFrames(sink);
+    }
+};
+
+typedef TcpLengthPrefixFraming<uint16_t, TCP_FRAME_HOST_ORDER, true> VarFraming;
+typedef TcpLengthPrefixFraming<uint32_t, TCP_FRAME_BIG_ENDIAN, false> Be32Framing;
+
+typedef enum
+{
+    BENCH_FIXED,    // 固定 64 字节
+    BENCH_VAR,      // 2 字节本机字节序长度头(包括长度头), 16 ~ 512 字节
+    BENCH_VAR_BE32, // 4 字节网络字节序长度头(不包括长度头), 16 ~ 512 字节
+    BENCH_STREAM    // 4 字节网络字节序长度头(不包括长度头), 64 KiB ~ 1 MiB
+} bench_framing_t;
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief 生成测试字节流
+ *
+ * @return uint64_t 流的实际长度(只包含完整的消息)
+ */
+static uint64_t build_stream(unsigned char *stream, uint64_t stream_size, bench_framing_t framing, bench_result_t *expected)
+{
+    uint16_t len16;
+    uint32_t len32;
+    uint64_t offset = 0, frame_size;
+
+    memset(expected, 0, sizeof(*expected));
+    srand(2);
+
+    while (true)
+    {
+        if (framing == BENCH_FIXED)
+            frame_size = 64;
+        else if (framing == BENCH_STREAM)
+            frame_size = (64 << 10) + rand() % (960 << 10);
+        else
+            frame_size = 16 + rand() % 497;
+
+        if (offset + frame_size > stream_size)
+            break;
+
+        memset(stream + offset, 'a' + expected->n_frames % 26, frame_size);
+        stream[offset + frame_size - 1] = (unsigned char)expected->n_frames;
+
+        if (framing == BENCH_VAR)
+        {
+            len16 = (uint16_t)frame_size;
+            memcpy(stream + offset, &len16, sizeof(len16));
+        }
+        else if (framing != BENCH_FIXED)
+        {
+            len32 = __builtin_bswap32((uint32_t)(frame_size - sizeof(len32)));
+            memcpy(stream + offset, &len32, sizeof(len32));
+        }
+
+        expected->n_frames++;
+        expected->checksum += frame_size + stream[offset + frame_size - 1];
+        offset += frame_size;
+    }
+
+    return offset;
+}
+
+template <typename Demarcar>
+static void run_case(const char *name, Demarcar *msgd, unsigned char *stream, uint64_t stream_size,
+                     uint32_t *chunks, uint32_t n_chunks, bench_result_t *expected)
+{
+    uint32_t chunk;
+    uint64_t offset, size;
+    double t0, elapsed;
+
+    t0 = now_sec();
+
+    for (offset = 0, chunk = 0; offset < stream_size; chunk++)
+    {
+        size = chunks[chunk & (n_chunks - 1)];
+
+        if (size > stream_size - offset)
+            size = stream_size - offset;
+
+        msgd->Feed(stream + offset, size);
+        offset += size;
+    }
+
+    elapsed = now_sec() - t0;
+
+    printf("%-30s %-9s %10.0f %14.2f%s\n", name,
+           msgd->GetRingType() == TCP_DEMARCAR_RING_MIRRORED ? "mirrored" : "bcb",
+           stream_size / elapsed / (1 << 20), msgd->result.n_frames / elapsed / 1e6,
+           msgd->result.n_frames == expected->n_frames && msgd->result.checksum == expected->checksum ? "" : "  (MISMATCH)");
+
+    delete msgd;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t i, r, max_chunk;
+    uint64_t stream_mb, stream_size;
+    unsigned char *stream;
+    uint32_t *chunks;
+    uint32_t n_chunks = 1 << 16;
+    bench_result_t expected;
+    const TcpMsgDemarcarRingType ring_types[] = {TCP_DEMARCAR_RING_BCB, TCP_DEMARCAR_RING_MIRRORED};
+
+    stream_mb = argc > 1 ? atoi(argv[1]) : 256;
+    max_chunk = argc > 2 ? atoi(argv[2]) : 4096;
+
+    // 分块长度不能超过环形缓冲区, 否则写入失败
+    if (max_chunk == 0 || max_chunk > DEFAULT_CBC_SIZE / 2)
+        max_chunk = DEFAULT_CBC_SIZE / 2;
+
+    stream = (unsigned char *)malloc(stream_mb << 20);
+    chunks = (uint32_t *)malloc(n_chunks * sizeof(uint32_t));
+
+    srand(1);
+    for (i = 0; i < n_chunks; i++)
+        chunks[i] = 1 + rand() % max_chunk;
+
+    printf("stream : %lu MB, chunk : 1 ~ %u bytes\n", (unsigned long)stream_mb, max_chunk);
+    printf("%-30s %-9s %10s %14s\n", "framing", "ring", "MB/s", "Mframes/s");
+
+    for (r = 0; r < sizeof(ring_types) / sizeof(ring_types[0]); r++)
+    {
+        stream_size = build_stream(stream, stream_mb << 20, BENCH_FIXED, &expected);
+        run_case("fixed 64 legacy", new LegacyDemarcar(64, ring_types[r]), stream, stream_size, chunks, n_chunks, &expected);
+        run_case("fixed 64 batched", new BatchedDemarcar<TcpFixedSizeFraming>(TcpFixedSizeFraming(64), ring_types[r]),
+                 stream, stream_size, chunks, n_chunks, &expected);
+
+        stream_size = build_stream(stream, stream_mb << 20, BENCH_VAR, &expected);
+        run_case("var u16 16-512 legacy", new LegacyDemarcar(0, ring_types[r]), stream, stream_size, chunks, n_chunks, &expected);
+        run_case("var u16 16-512 batched", new BatchedDemarcar<VarFraming>(VarFraming(), ring_types[r]),
+                 stream, stream_size, chunks, n_chunks, &expected);
+
+        stream_size = build_stream(stream, stream_mb << 20, BENCH_VAR_BE32, &expected);
+        run_case("var be32 16-512 batched", new BatchedDemarcar<Be32Framing>(Be32Framing(), ring_types[r]),
+                 stream, stream_size, chunks, n_chunks, &expected);
+        run_case("var be32 16-512 runtime",
+                 new BatchedDemarcar<TcpLengthPrefixRuntimeFraming>(TcpLengthPrefixRuntimeFraming(4, TCP_FRAME_BIG_ENDIAN, false), ring_types[r]),
+                 stream, stream_size, chunks, n_chunks, &expected);
+
+        stream_size = build_stream(stream, stream_mb << 20, BENCH_STREAM, &expected);
+        run_case("stream be32 64K-1M runtime",
+                 new BatchedDemarcar<TcpLengthPrefixRuntimeFraming>(TcpLengthPrefixRuntimeFraming(4, TCP_FRAME_BIG_ENDIAN, false), ring_types[r], true),
+                 stream, stream_size, chunks, n_chunks, &expected);
+    }
+
+    free(chunks);
+    free(stream);
+    return 0;
+}
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "TcpMsgDemarcar.h"
+#include "TcpMsgPatternDemarcar.h"
+#include "TcpServerController.h"
+
+/*
+ * Throughput benchmark for TcpMsgPatternDemarcar
+ *
+ * usage : pattern_demarcar_bench.exe [stream_mb] [max_chunk]
+ *
+ * 生成由大量小消息组成的字节流("$SET key_N value_M\r\n", 20 ~ 70 字节), 按随机长度(1 ~ max_chunk)
+ * 分块写入分帧器, 模拟 recv() 返回的任意切分, 标记会落在分块边界和环形缓冲区末尾上.
+ * 对每种 标记 x 环形缓冲区 组合输出 MB/s 和 消息数/秒, 并校验分帧结果.
+ */
+
+/**
+ * @brief 分帧器目标文件通过 TcpServerController 交付消息和更新计数器, 基准测试不经过这些路径,
+ * 提供空实现以便只链接分帧器相关的目标文件
+ */
+void TcpServerController::ClientMsgRecvd(TcpClient *, unsigned char *, uint16_t)
+{
+}
+
+void TcpServerController::ClientMsgBatchRecvd(TcpClient *, TcpMsgSpan_t *, uint32_t)
+{
+}
+
+void TcpServerController::ClientMsgChunkRecvd(TcpClient *, unsigned char *, uint16_t, uint64_t, uint64_t)
+{
+}
+
+void TcpServerController::ClientProtocolError(TcpClient *, TcpMsgDemarcarError, uint64_t)
+{
+}
+
+TcpReactorMetrics_t *TcpServerController::GetClientMetricsShard(TcpClient *)
+{
+    return NULL;
+}
+
+void TcpServerController::GetMetricsSnapshot(TcpMetricsSnapshot_t *)
+{
+}
+
+/**
+ * @brief 通过子类直接驱动分帧逻辑, 不需要 TcpClient/TcpServerController
+ */
+class BenchPatternDemarcar : public TcpMsgPatternDemarcar
+{
+public:
+    uint64_t n_frames;
+    uint64_t frame_bytes;
+
+    BenchPatternDemarcar(unsigned char start_pattern[], uint8_t start_pattern_size,
+                         unsigned char end_pattern[], uint8_t end_pattern_size,
+                         TcpMsgDemarcarRingType ring_type)
+        : TcpMsgPatternDemarcar(start_pattern, start_pattern_size, end_pattern, end_pattern_size, ring_type)
+    {
+        this->n_frames = 0;
+        this->frame_bytes = 0;
+    }
+
+    // 与 ProcessClientMsg() 相同, 只是把回调换成计数
+    void Feed(unsigned char *data, uint64_t size)
+    {
+        unsigned char *msg;
+        uint64_t frame_size;
+
+        if (!this->RingWrite(data, size))
+        {
+            printf("ring buffer overflow\n");
+            exit(0);
+        }
+
+        if (!this->IsBufferReadyToFlush())
+            return;
+
+        while ((msg = this->ExtractFrame(&frame_size)))
+        {
+            this->n_frames++;
+            this->frame_bytes += frame_size + msg[frame_size / 2];
+            this->RingConsume(frame_size);
+        }
+    }
+};
+
+typedef struct bench_case_
+{
+    const char *name;
+    const char *start_pattern;
+    const char *end_pattern;
+} bench_case_t;
+
+static const bench_case_t bench_cases[] = {
+    {"end \"\\n\"", "", "\n"},
+    {"end \"\\r\\n\"", "", "\r\n"},
+    {"start \"$\" end \"\\r\\n\"", "$", "\r\n"},
+    {"end \"<EOM>\\r\\n\"", "", "<EOM>\r\n"},
+};
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief 生成测试字节流
+ *
+ * @return uint64_t 流中的消息数
+ */
+static uint64_t build_stream(unsigned char *stream, uint64_t stream_size, const char *end_pattern,
+                             uint64_t *used_size, uint64_t *expected_bytes)
+{
+    char frame[128];
+    int frame_size;
+    uint64_t n_frames = 0, offset = 0;
+
+    *expected_bytes = 0;
+
+    while (true)
+    {
+        frame_size = snprintf(frame, sizeof(frame), "$SET key_%lu value_%0*lu%s",
+                              (unsigned long)n_frames, (int)(n_frames % 40), (unsigned long)(n_frames * 7), end_pattern);
+
+        if (offset + frame_size > stream_size)
+            break;
+
+        memcpy(stream + offset, frame, frame_size);
+        offset += frame_size;
+        *expected_bytes += frame_size + (unsigned char)frame[frame_size / 2];
+        n_frames++;
+    }
+
+    *used_size = offset;
+    return n_frames;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t i, r, max_chunk, chunk;
+    uint64_t stream_mb, stream_size, offset, n_frames, expected_bytes;
+    unsigned char *stream;
+    uint32_t *chunks;
+    uint32_t n_chunks = 1 << 16;
+    double t0, elapsed;
+    const TcpMsgDemarcarRingType ring_types[] = {TCP_DEMARCAR_RING_BCB, TCP_DEMARCAR_RING_MIRRORED};
+
+    stream_mb = argc > 1 ? atoi(argv[1]) : 256;
+    max_chunk = argc > 2 ? atoi(argv[2]) : 4096;
+
+    // 分块长度不能超过环形缓冲区, 否则写入失败
+    if (max_chunk == 0 || max_chunk > DEFAULT_CBC_SIZE / 2)
+        max_chunk = DEFAULT_CBC_SIZE / 2;
+
+    stream = (unsigned char *)malloc(stream_mb << 20);
+    chunks = (uint32_t *)malloc(n_chunks * sizeof(uint32_t));
+
+    srand(1);
+    for (i = 0; i < n_chunks; i++)
+        chunks[i] = 1 + rand() % max_chunk;
+
+    printf("stream : %lu MB, chunk : 1 ~ %u bytes\n", (unsigned long)stream_mb, max_chunk);
+    printf("%-26s %-9s %10s %14s\n", "pattern", "ring", "MB/s", "Mframes/s");
+
+    for (i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++)
+    {
+        n_frames = build_stream(stream, stream_mb << 20, bench_cases[i].end_pattern, &stream_size, &expected_bytes);
+
+        for (r = 0; r < sizeof(ring_types) / sizeof(ring_types[0]); r++)
+        {
+            BenchPatternDemarcar msgd((unsigned char *)bench_cases[i].start_pattern, strlen(bench_cases[i].start_pattern),
+                                      (unsigned char *)bench_cases[i].end_pattern, strlen(bench_cases[i].end_pattern),
+                                      ring_types[r]);
+
+            t0 = now_sec();
+
+            for (offset = 0, chunk = 0; offset < stream_size; chunk++)
+            {
+                uint64_t size = chunks[chunk & (n_chunks - 1)];
+
+                if (size > stream_size - offset)
+                    size = stream_size - offset;
+
+                msgd.Feed(stream + offset, size);
+                offset += size;
+            }
+
+            elapsed = now_sec() - t0;
+
+            printf("%-26s %-9s %10.0f %14.2f%s\n",
+                   bench_cases[i].name,
+                   msgd.GetRingType() == TCP_DEMARCAR_RING_MIRRORED ? "mirrored" : "bcb",
+                   stream_size / elapsed / (1 << 20),
+                   msgd.n_frames / elapsed / 1e6,
+                   msgd.n_frames == n_frames && msgd.frame_bytes == expected_bytes ? "" : "  (MISMATCH)");
+
+            msgd.Destroy();
+        }
+    }
+
+    free(chunks);
+    free(stream);
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "ByteCircularBuffer.h"
+#include "MirroredCircularBuffer.h"
+
+/*
+ * Microbenchmark: ByteCircularBuffer vs MirroredCircularBuffer
+ *
+ * usage : ring_buffer_bench.exe [ring_size] [n_msgs]
+ *
+ * 模拟分帧器的工作方式: 每次写入 RECV_CHUNK_MSGS 条消息(相当于一次 recv), 再逐条取出完整消息并读取其内容.
+ * 消息长度不能整除缓冲区长度, 因此会不断出现跨越缓冲区末尾的消息.
+ *
+ * bcb read : BCBWrite + BCBRead(拷贝到外部缓冲区, 跨越末尾时拆成两次 memcpy)
+ * bcb peek : BCBWrite + BCBPeek/BCBConsume(连续时原地读取, 跨越末尾时拷贝)
+ * mcb peek : MCBWrite + MCBPeek/MCBConsume(总是原地读取)
+ */
+
+#define RECV_CHUNK_MSGS 4
+
+static const uint16_t msg_sizes[] = {64, 100, 700, 1400};
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 读取消息的首尾字节, 模拟应用层解析消息头/消息尾, 使测得的时间主要是环形缓冲区本身的开销
+static uint64_t consume_msg(const unsigned char *msg, uint16_t msg_size)
+{
+    return msg[0] + msg[msg_size / 2] + msg[msg_size - 1];
+}
+
+static double bench_bcb(uint16_t ring_size, uint16_t msg_size, uint32_t n_msgs, bool peek, uint64_t *checksum)
+{
+    uint32_t i, j;
+    unsigned char *msg;
+    unsigned char *data = (unsigned char *)malloc(msg_size * RECV_CHUNK_MSGS);
+    unsigned char *scratch = (unsigned char *)malloc(msg_size);
+    ByteCircularBuffer_t *bcb = BCBCreateNew(ring_size);
+    double t0;
+
+    for (i = 0; i < (uint32_t)msg_size * RECV_CHUNK_MSGS; i++)
+        data[i] = (unsigned char)i;
+
+    t0 = now_sec();
+
+    for (i = 0; i < n_msgs; i += RECV_CHUNK_MSGS)
+    {
+        BCBWrite(bcb, data, msg_size * RECV_CHUNK_MSGS);
+
+        for (j = 0; j < RECV_CHUNK_MSGS; j++)
+        {
+            if (peek)
+            {
+                msg = BCBPeek(bcb, 0, msg_size, scratch);
+                *checksum += consume_msg(msg, msg_size);
+                BCBConsume(bcb, msg_size);
+            }
+            else
+            {
+                BCBRead(bcb, scratch, msg_size, true);
+                *checksum += consume_msg(scratch, msg_size);
+            }
+        }
+    }
+
+    t0 = now_sec() - t0;
+
+    BCBFree(bcb);
+    free(scratch);
+    free(data);
+    return t0;
+}
+
+static double bench_mcb(uint64_t ring_size, uint16_t msg_size, uint32_t n_msgs, uint64_t *checksum)
+{
+    uint32_t i, j;
+    unsigned char *msg;
+    unsigned char *data = (unsigned char *)malloc(msg_size * RECV_CHUNK_MSGS);
+    MirroredCircularBuffer_t *mcb = MCBCreateNew(ring_size);
+    double t0;
+
+    if (!mcb)
+    {
+        free(data);
+        return -1;
+    }
+
+    for (i = 0; i < (uint32_t)msg_size * RECV_CHUNK_MSGS; i++)
+        data[i] = (unsigned char)i;
+
+    t0 = now_sec();
+
+    for (i = 0; i < n_msgs; i += RECV_CHUNK_MSGS)
+    {
+        MCBWrite(mcb, data, msg_size * RECV_CHUNK_MSGS);
+
+        for (j = 0; j < RECV_CHUNK_MSGS; j++)
+        {
+            msg = MCBPeek(mcb, 0, msg_size);
+            *checksum += consume_msg(msg, msg_size);
+            MCBConsume(mcb, msg_size);
+        }
+    }
+
+    t0 = now_sec() - t0;
+
+    MCBFree(mcb);
+    free(data);
+    return t0;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t i, n_msgs;
+    uint16_t ring_size;
+    uint64_t sum_bcb_read = 0, sum_bcb_peek = 0, sum_mcb = 0;
+    double t_read, t_peek, t_mcb;
+
+    // 默认使用页大小的整数倍, 保证两种缓冲区的实际长度相同
+    ring_size = argc > 1 ? atoi(argv[1]) : 8192;
+    n_msgs = argc > 2 ? atoi(argv[2]) : 4000000;
+
+    printf("ring size : %u bytes, %u msgs per size, %u msgs per write\n", ring_size, n_msgs, RECV_CHUNK_MSGS);
+    printf("%10s %16s %16s %16s\n", "msg size", "bcb read ns/msg", "bcb peek ns/msg", "mcb peek ns/msg");
+
+    for (i = 0; i < sizeof(msg_sizes) / sizeof(msg_sizes[0]); i++)
+    {
+        if ((uint32_t)msg_sizes[i] * RECV_CHUNK_MSGS > ring_size)
+            continue;
+
+        t_read = bench_bcb(ring_size, msg_sizes[i], n_msgs, false, &sum_bcb_read);
+        t_peek = bench_bcb(ring_size, msg_sizes[i], n_msgs, true, &sum_bcb_peek);
+        t_mcb = bench_mcb(ring_size, msg_sizes[i], n_msgs, &sum_mcb);
+
+        printf("%10u %16.1f %16.1f %16.1f\n",
+               msg_sizes[i],
+               t_read / n_msgs * 1e9,
+               t_peek / n_msgs * 1e9,
+               t_mcb < 0 ? -1.0 : t_mcb / n_msgs * 1e9);
+    }
+
+    // 三种方式读到的数据必须一致
+    if (sum_bcb_read != sum_bcb_peek || sum_bcb_read != sum_mcb)
+        printf("checksum mismatch : %lu %lu %lu\n",
+               (unsigned long)sum_bcb_read, (unsigned long)sum_bcb_peek, (unsigned long)sum_mcb);
+
+    return 0;
+}
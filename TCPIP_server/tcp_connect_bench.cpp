@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+/*
+ * Connect-rate benchmark for TcpServerController
+ *
+ * usage : tcp_connect_bench.exe <server_ip> <port> <n_connections> [n_threads] [hold|churn] [probe_size]
+ *
+ * hold  : 每个线程建立各自的连接并保持, 全部建立后统一关闭, 测量建立连接的速率
+ * churn : 每个连接 建立 -> 收到 Welcome -> 关闭, 测量连接 注册+注销 的速率
+ *
+ * probe_size > 0 时, 每个连接在收到 Welcome 后再发送 probe_size 字节并等待服务器回显同样长度的数据,
+ * 只有客户端已经被 DRS 监听后服务器才能回显, 因此此时测得的速率包含 DRS 注册客户端的开销.
+ */
+
+#define WELCOME_MSG "Welcome\n"
+
+typedef struct bench_thread_
+{
+    pthread_t thread;
+    struct sockaddr_in dest;
+    uint32_t n_connections; // 本线程负责的连接数
+    bool churn;             // churn 模式
+    uint32_t probe_size;    // 回显探测的字节数, 0 表示不探测
+    int *fds;               // hold 模式下保持的连接
+    uint32_t n_ok;          // 成功的连接数
+    uint32_t n_failed;      // 失败的连接数
+    double total_latency;   // 所有成功连接的耗时总和(秒)
+} bench_thread_t;
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief 从 socket 中读满 size 字节
+ *
+ * @return true 读满
+ * @return false 连接关闭或出错
+ */
+static bool read_full(int fd, unsigned char *buffer, uint32_t size)
+{
+    uint32_t done = 0;
+    ssize_t rc;
+
+    while (done < size)
+    {
+        rc = recv(fd, buffer + done, size - done, 0);
+
+        if (rc < 0 && errno == EINTR)
+            continue;
+
+        if (rc <= 0)
+            return false;
+
+        done += rc;
+    }
+
+    return true;
+}
+
+/**
+ * @brief 建立一个连接, 等待 Welcome 消息, 可选的回显探测
+ *
+ * @return int 成功返回连接 fd, 失败返回 -1
+ */
+static int open_one_connection(bench_thread_t *bt, unsigned char *probe, unsigned char *reply)
+{
+    int opt = 1;
+    unsigned char welcome[sizeof(WELCOME_MSG) - 1];
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    if (fd < 0)
+        return -1;
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+    if (connect(fd, (struct sockaddr *)&bt->dest, sizeof(bt->dest)) < 0 ||
+        !read_full(fd, welcome, sizeof(welcome)))
+    {
+        close(fd);
+        return -1;
+    }
+
+    if (bt->probe_size)
+    {
+        if (send(fd, probe, bt->probe_size, 0) != (ssize_t)bt->probe_size ||
+            !read_full(fd, reply, bt->probe_size))
+        {
+            close(fd);
+            return -1;
+        }
+    }
+
+    return fd;
+}
+
+static void *bench_thread_fn(void *arg)
+{
+    int fd;
+    uint32_t i;
+    double t0;
+    bench_thread_t *bt = (bench_thread_t *)arg;
+    unsigned char *probe = (unsigned char *)calloc(bt->probe_size + 1, 1);
+    unsigned char *reply = (unsigned char *)calloc(bt->probe_size + 1, 1);
+
+    for (i = 0; i < bt->n_connections; i++)
+    {
+        t0 = now_sec();
+        fd = open_one_connection(bt, probe, reply);
+
+        if (fd < 0)
+        {
+            bt->n_failed++;
+            continue;
+        }
+
+        bt->total_latency += now_sec() - t0;
+        bt->n_ok++;
+
+        if (bt->churn)
+            close(fd);
+        else
+            bt->fds[i] = fd;
+    }
+
+    free(probe);
+    free(reply);
+    return nullptr;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t i, j, n_connections, n_threads, probe_size, n_ok = 0, n_failed = 0;
+    double t0, elapsed, total_latency = 0;
+    bool churn;
+    bench_thread_t *threads;
+
+    if (argc < 4)
+    {
+        printf("usage : %s <server_ip> <port> <n_connections> [n_threads] [hold|churn] [probe_size]\n", argv[0]);
+        return 0;
+    }
+
+    n_connections = atoi(argv[3]);
+    n_threads = argc > 4 ? atoi(argv[4]) : 1;
+    churn = argc > 5 && strcmp(argv[5], "churn") == 0;
+    probe_size = argc > 6 ? atoi(argv[6]) : 0;
+
+    if (n_threads == 0)
+        n_threads = 1;
+
+    threads = (bench_thread_t *)calloc(n_threads, sizeof(bench_thread_t));
+
+    for (i = 0; i < n_threads; i++)
+    {
+        threads[i].dest.sin_family = AF_INET;
+        threads[i].dest.sin_port = htons(atoi(argv[2]));
+        inet_pton(AF_INET, argv[1], &threads[i].dest.sin_addr);
+        threads[i].n_connections = n_connections / n_threads + (i < n_connections % n_threads ? 1 : 0);
+        threads[i].churn = churn;
+        threads[i].probe_size = probe_size;
+        threads[i].fds = (int *)calloc(threads[i].n_connections + 1, sizeof(int));
+    }
+
+    t0 = now_sec();
+
+    for (i = 0; i < n_threads; i++)
+        pthread_create(&threads[i].thread, nullptr, bench_thread_fn, &threads[i]);
+
+    for (i = 0; i < n_threads; i++)
+        pthread_join(threads[i].thread, nullptr);
+
+    elapsed = now_sec() - t0;
+
+    for (i = 0; i < n_threads; i++)
+    {
+        n_ok += threads[i].n_ok;
+        n_failed += threads[i].n_failed;
+        total_latency += threads[i].total_latency;
+
+        // hold 模式: 统计完成后再关闭所有连接
+        for (j = 0; j < threads[i].n_connections; j++)
+        {
+            if (threads[i].fds[j] > 0)
+                close(threads[i].fds[j]);
+        }
+
+        free(threads[i].fds);
+    }
+
+    printf("mode : %s, threads : %u, probe : %u bytes\n", churn ? "churn" : "hold", n_threads, probe_size);
+    printf("connections : %u ok, %u failed, in %.3f sec\n", n_ok, n_failed, elapsed);
+    printf("connect rate : %.0f conn/sec, avg latency : %.1f usec\n",
+           elapsed > 0 ? n_ok / elapsed : 0.0,
+           n_ok ? total_latency / n_ok * 1e6 : 0.0);
+
+    free(threads);
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "TcpServerController.h"
+#include "TcpClient.h"
+
+/*
+ * Echo server used by tcp_load_gen.exe / make loadtest
+ *
+ * usage : tcp_echo_server.exe <ip> <port> [none|fixed|var|pattern|prefix] [fixed_size] [n_reactors] [epoll|select|uring] [n_workers] [shm]
+ *
+ * none    : 不分帧, 收到多少字节回显多少字节
+ * fixed   : 固定长度 fixed_size 字节分帧
+ * var     : 2 字节长度头(包括长度头本身, 本机字节序)分帧
+ * pattern : 按 '\n' 结束标记分帧
+ * prefix  : 与 var 相同的消息格式, 使用可配置的长度前缀分帧器; 超过环形缓冲区的消息按片段流式回显,
+ *           fixed_size 非 0 时作为消息的最大长度
+ *
+ * n_workers > 0 时消息在线程池中回显, 否则在 DRS 线程中直接回显
+ * shm : 启用共享内存传输, 同一主机上的 tcp_load_gen.exe -x 协商后通过共享内存收发
+ * 收到 SIGINT/SIGTERM 后打印服务器状态和指标并退出
+ */
+
+static volatile sig_atomic_t stop_server = 0;
+
+static void signal_handler(int /*sig*/)
+{
+    stop_server = 1;
+}
+
+static void echo_msg_recvd(const TcpServerController * /*tcp_ctrlr*/, const TcpClient *tcp_client, unsigned char *msg, uint16_t msg_size)
+{
+    ((TcpClient *)tcp_client)->SendMsg((char *)msg, msg_size);
+}
+
+// 分帧器一次读取得到的消息成批回调
+static void echo_msg_batch_recvd(const TcpServerController * /*tcp_ctrlr*/, const TcpClient *tcp_client, TcpMsgSpan_t *spans, uint32_t n_spans)
+{
+    uint32_t i;
+
+    for (i = 0; i < n_spans; i++)
+        ((TcpClient *)tcp_client)->SendMsg((char *)spans[i].data, spans[i].size);
+}
+
+// 大消息的片段按顺序回显, 对端收到的字节流与发送的相同
+static void echo_msg_chunk_recvd(const TcpServerController * /*tcp_ctrlr*/, const TcpClient *tcp_client, unsigned char *chunk, uint16_t chunk_size,
+                                 uint64_t /*frame_offset*/, uint64_t /*frame_size*/)
+{
+    ((TcpClient *)tcp_client)->SendMsg((char *)chunk, chunk_size);
+}
+
+static void echo_protocol_error(const TcpServerController * /*tcp_ctrlr*/, const TcpClient * /*tcp_client*/, TcpMsgDemarcarError error,
+                                uint64_t frame_size)
+{
+    printf("protocol error %d from client, frame size = %lu\n", error, (unsigned long)frame_size);
+}
+
+/**
+ * @brief 提高打开文件数上限, 压测时连接数可能超过默认的 1024
+ *
+ */
+static void raise_fd_limit()
+{
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    TcpServerController *server;
+    TcpMultiplexType mx_type = TCP_MULTIPLEX_EPOLL;
+    const char *mode = argc > 3 ? argv[3] : "none";
+    uint16_t fixed_size = argc > 4 ? atoi(argv[4]) : 64;
+    int n_reactors = argc > 5 ? atoi(argv[5]) : 0;
+    int n_workers = argc > 7 ? atoi(argv[7]) : 0;
+
+    if (argc < 3)
+    {
+        printf("usage : %s <ip> <port> [none|fixed|var|pattern|prefix] [fixed_size] [n_reactors] [epoll|select|uring] [n_workers] [shm]\n", argv[0]);
+        exit(0);
+    }
+
+    if (argc > 6)
+    {
+        if (strcmp(argv[6], "select") == 0)
+            mx_type = TCP_MULTIPLEX_SELECT;
+        else if (strcmp(argv[6], "uring") == 0)
+            mx_type = TCP_MULTIPLEX_IO_URING;
+    }
+
+    raise_fd_limit();
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    server = new TcpServerController(argv[1], atoi(argv[2]), "EchoServer", mx_type);
+    // 回调必须在设置其它状态位之前注册
+    server->SetServerNotifCallbacks(nullptr, nullptr, echo_msg_recvd, nullptr);
+    server->SetServerMsgBatchCallback(echo_msg_batch_recvd);
+    server->SetServerMsgChunkCallback(echo_msg_chunk_recvd);
+    server->SetProtocolErrorCallback(echo_protocol_error);
+
+    if (strcmp(mode, "fixed") == 0)
+        server->SetTcpMsgDemarcar(TCP_DEMARCAR_FIXED_SIZE, fixed_size);
+    else if (strcmp(mode, "var") == 0)
+        server->SetTcpMsgDemarcar(TCP_DEMARCAR_VARIABLE_SIZE);
+    else if (strcmp(mode, "pattern") == 0)
+        server->SetTcpMsgDemarcar(TCP_DEMARCAR_PATTERN, 0, nullptr, "\n");
+    else if (strcmp(mode, "prefix") == 0)
+        server->SetLengthPrefixDemarcar(2, TCP_FRAME_HOST_ORDER, true, argc > 4 ? fixed_size : 0);
+
+    if (n_reactors > 0)
+        server->SetReactorCount(n_reactors);
+
+    // 连接按接受它的 accept 线程分配 DRS, 避免跨分片的负载不均
+    server->SetReactorShardPolicy(TCP_REACTOR_SHARD_ACCEPTOR);
+
+    if (n_workers > 0)
+    {
+        server->SetWorkerPoolSize(n_workers);
+        server->SetClientCreationMode(true);
+    }
+
+    if (argc > 8 && strcmp(argv[8], "shm") == 0)
+        server->SetShmTransport(true);
+
+    server->Start();
+
+    while (!stop_server)
+        pause();
+
+    server->Dispaly();
+    // Stop() 会释放 server
+    server->Stop();
+
+    return 0;
+}
@@ -0,0 +1,876 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include "TcpShmChannel.h"
+
+/*
+ * Load generator for TcpServerController (use with tcp_echo_server.exe)
+ *
+ * usage : tcp_load_gen.exe <server_ip> <port> [-c conns] [-t threads] [-m fixed|var|pattern]
+ *                          [-s max_size] [-S min_size] [-r rate] [-p depth] [-d seconds] [-w seconds] [-x] [-q]
+ *
+ * -c : 连接数(默认 100), 平均分配给各线程, 每个线程用一个 epoll 实例驱动自己的连接
+ * -t : 线程数(默认 4)
+ * -m : 分帧方式, 必须与服务器一致
+ *      fixed   : 每条消息 max_size 字节
+ *      var     : 2 字节长度头(包括长度头本身, 本机字节序), 与 TcpMsgVariableSizeDemarcar 一致
+ *      pattern : 以 '\n' 结尾, 消息体中不含 '\n'
+ * -s/-S : 消息长度范围, var/pattern 在 [min_size, max_size] 中随机选择
+ * -r : 所有连接合计的目标速率(消息/秒), 0(默认) 表示闭环: 每个连接收到回显后立即发送下一条
+ *      开环模式下延迟从计划发送时间开始计算, 发送被窗口阻塞的时间也计入延迟(避免 coordinated omission)
+ * -p : 每个连接同时在途的消息数(默认 1)
+ * -d : 测量时长(默认 5 秒), -w : 预热时长(默认 1 秒), 预热期间的消息不计入结果
+ * -x : 建立连接后协商共享内存通道(服务器需要 SetShmTransport()), 每条消息作为一条记录收发;
+ *      协商失败的连接继续使用 TCP. 在途消息必须能放进服务器的环形缓冲区, 环满时计为 io 错误
+ * -q : 只输出一行 CSV 结果, 供 make loadtest 汇总
+ *
+ * 服务器按序回显, 因此不需要在消息中携带时间戳: 每个连接按发送顺序记录在途消息的长度和发送时间,
+ * 收满一条消息的长度即完成一次往返
+ */
+
+#define WELCOME_MSG "Welcome\n"
+#define LG_RECV_BUFFER_SIZE 65536
+#define LG_MAX_EVENTS 256
+
+#define LG_HIST_SUB_BITS 3 // 与 TcpMetrics.h 相同的对数-线性分桶, 相对误差不超过 12.5%
+#define LG_HIST_SUB_BUCKETS (1 << LG_HIST_SUB_BITS)
+#define LG_HIST_N_BUCKETS ((64 - LG_HIST_SUB_BITS + 1) << LG_HIST_SUB_BITS)
+
+typedef enum
+{
+    LG_MODE_FIXED,
+    LG_MODE_VAR,
+    LG_MODE_PATTERN
+} lg_mode_t;
+
+typedef struct lg_config_
+{
+    struct sockaddr_in dest;
+    lg_mode_t mode;
+    uint32_t n_connections;
+    uint32_t n_threads;
+    uint32_t min_size;
+    uint32_t max_size;
+    uint64_t rate;     // 合计消息/秒, 0 表示闭环
+    uint32_t depth;    // 每个连接的在途消息数
+    double duration;   // 测量时长(秒)
+    double warmup;     // 预热时长(秒)
+    bool shm;          // 协商共享内存通道
+    bool quiet;        // 只输出 CSV
+} lg_config_t;
+
+typedef struct lg_histogram_
+{
+    uint64_t buckets[LG_HIST_N_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+} lg_histogram_t;
+
+typedef struct lg_conn_
+{
+    int fd;
+    unsigned char *out;      // 待发送的字节
+    uint32_t out_off;        // out 中已发送的字节数
+    uint32_t out_len;        // out 中的字节数
+    uint32_t *inflight_size; // 在途消息长度(按发送顺序的环形队列)
+    uint64_t *inflight_ns;   // 在途消息的发送时间(开环模式为计划发送时间)
+    uint32_t head;           // 最早的在途消息
+    uint32_t n_inflight;     // 在途消息数
+    uint32_t recvd;          // 最早的在途消息已收到的字节数
+    uint64_t next_send_ns;   // 开环模式下一次计划发送时间
+    bool want_out;           // 已注册 EPOLLOUT
+    TcpShmChannel_t *shm;    // 协商成功的共享内存通道, 消息不再经过 TCP
+    bool shm_failed;         // 共享内存通道发送失败
+} lg_conn_t;
+
+typedef struct lg_thread_
+{
+    pthread_t thread;
+    uint32_t id;
+    lg_config_t *config;
+    lg_conn_t *conns;
+    uint32_t n_conns;
+    int epoll_fd;
+    int timer_fd;             // 开环模式下一次计划发送时间的定时器(epoll_wait 只有毫秒精度)
+    uint64_t rand_state;      // xorshift 随机数状态
+    uint64_t n_msgs;          // 测量期间完成的往返数
+    uint64_t n_bytes;         // 测量期间完成的往返字节数(单向)
+    uint32_t connect_errors;  // 连接失败数
+    uint32_t io_errors;       // 连接中途关闭或出错
+    uint32_t protocol_errors; // 收到多于在途消息的数据
+    uint32_t shm_fallbacks;   // 共享内存协商失败, 继续使用 TCP 的连接数
+    lg_histogram_t latency;   // 往返延迟(纳秒)
+} lg_thread_t;
+
+static pthread_barrier_t start_barrier;
+static volatile uint64_t measure_start_ns; // 预热结束时间, 0 表示还未开始
+static volatile uint64_t measure_end_ns;   // 测量结束时间
+static volatile bool stop_load;
+
+static uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t next_rand(lg_thread_t *lt)
+{
+    lt->rand_state ^= lt->rand_state << 13;
+    lt->rand_state ^= lt->rand_state >> 7;
+    lt->rand_state ^= lt->rand_state << 17;
+    return lt->rand_state;
+}
+
+static uint32_t hist_index(uint64_t value)
+{
+    uint32_t msb;
+
+    if (value < LG_HIST_SUB_BUCKETS)
+        return (uint32_t)value;
+
+    msb = 63 - __builtin_clzll(value);
+    return ((msb - LG_HIST_SUB_BITS + 1) << LG_HIST_SUB_BITS) +
+           (uint32_t)((value >> (msb - LG_HIST_SUB_BITS)) & (LG_HIST_SUB_BUCKETS - 1));
+}
+
+static void hist_record(lg_histogram_t *hist, uint64_t value)
+{
+    hist->buckets[hist_index(value)]++;
+    hist->count++;
+    hist->sum += value;
+
+    if (value > hist->max)
+        hist->max = value;
+}
+
+/**
+ * @brief 百分位数, 返回所在桶的上界(不超过最大值)
+ */
+static uint64_t hist_percentile(lg_histogram_t *hist, double percentile)
+{
+    uint32_t i, group, shift;
+    uint64_t seen = 0, upper;
+    uint64_t target = (uint64_t)(hist->count * percentile / 100.0 + 0.5);
+
+    if (!hist->count)
+        return 0;
+
+    if (target == 0)
+        target = 1;
+
+    for (i = 0; i < LG_HIST_N_BUCKETS; i++)
+    {
+        seen += hist->buckets[i];
+
+        if (seen < target)
+            continue;
+
+        if (i < LG_HIST_SUB_BUCKETS)
+            return i;
+
+        group = i >> LG_HIST_SUB_BITS;
+        shift = group - 1;
+        upper = ((uint64_t)(LG_HIST_SUB_BUCKETS + (i & (LG_HIST_SUB_BUCKETS - 1))) << shift) + ((1ULL << shift) - 1);
+        return upper < hist->max ? upper : hist->max;
+    }
+
+    return hist->max;
+}
+
+static bool read_full(int fd, unsigned char *buffer, uint32_t size)
+{
+    uint32_t done = 0;
+    ssize_t rc;
+
+    while (done < size)
+    {
+        rc = recv(fd, buffer + done, size - done, 0);
+
+        if (rc < 0 && errno == EINTR)
+            continue;
+
+        if (rc <= 0)
+            return false;
+
+        done += rc;
+    }
+
+    return true;
+}
+
+/**
+ * @brief 建立连接并读掉服务器的 Welcome 消息, 之后切换为非阻塞
+ *
+ * @return int 成功返回 fd, 失败返回 -1
+ */
+static int open_connection(lg_config_t *config)
+{
+    int opt = 1;
+    unsigned char welcome[sizeof(WELCOME_MSG) - 1];
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    if (fd < 0)
+        return -1;
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+    if (connect(fd, (struct sockaddr *)&config->dest, sizeof(config->dest)) < 0 ||
+        !read_full(fd, welcome, sizeof(welcome)))
+    {
+        close(fd);
+        return -1;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+static void close_connection(lg_thread_t *lt, lg_conn_t *conn)
+{
+    if (conn->shm)
+    {
+        epoll_ctl(lt->epoll_fd, EPOLL_CTL_DEL, conn->shm->rx_event_fd, NULL);
+        TcpShmChannelClose(conn->shm);
+        TcpShmChannelDestroy(conn->shm);
+        conn->shm = NULL;
+    }
+    else
+        epoll_ctl(lt->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+
+    close(conn->fd);
+    conn->fd = -1;
+}
+
+static void update_epoll(lg_thread_t *lt, lg_conn_t *conn, bool want_out)
+{
+    struct epoll_event ev;
+
+    if (conn->want_out == want_out)
+        return;
+
+    ev.events = EPOLLIN | (want_out ? (uint32_t)EPOLLOUT : 0u);
+    ev.data.ptr = conn;
+    epoll_ctl(lt->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+    conn->want_out = want_out;
+}
+
+/**
+ * @brief 尽量发送 out 中的字节, 内核缓冲区满时注册 EPOLLOUT
+ *
+ * @return false 连接出错
+ */
+static bool flush_conn(lg_thread_t *lt, lg_conn_t *conn)
+{
+    ssize_t rc;
+
+    // 共享内存通道的消息在 enqueue_msg() 中已经写入
+    if (conn->shm)
+        return !conn->shm_failed;
+
+    while (conn->out_off < conn->out_len)
+    {
+        rc = send(conn->fd, conn->out + conn->out_off, conn->out_len - conn->out_off, MSG_NOSIGNAL);
+
+        if (rc < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+
+            return false;
+        }
+
+        conn->out_off += rc;
+    }
+
+    if (conn->out_off == conn->out_len)
+        conn->out_off = conn->out_len = 0;
+
+    update_epoll(lt, conn, conn->out_len != 0);
+    return true;
+}
+
+/**
+ * @brief 按配置的分帧方式生成一条消息追加到 out, 并记入在途队列
+ *
+ * @param sent_ns 延迟的起点
+ */
+static void enqueue_msg(lg_thread_t *lt, lg_conn_t *conn, uint64_t sent_ns)
+{
+    lg_config_t *config = lt->config;
+    uint32_t size = config->max_size;
+    uint32_t slot;
+    uint16_t hdr;
+    unsigned char *msg;
+
+    if (config->mode != LG_MODE_FIXED && config->max_size > config->min_size)
+        size = config->min_size + next_rand(lt) % (config->max_size - config->min_size + 1);
+
+    // 在途消息的未发送部分不会超过 depth * max_size
+    if (conn->out_off)
+    {
+        memmove(conn->out, conn->out + conn->out_off, conn->out_len - conn->out_off);
+        conn->out_len -= conn->out_off;
+        conn->out_off = 0;
+    }
+
+    msg = conn->out + conn->out_len;
+    memset(msg, 'a' + (lt->n_msgs % 26), size);
+
+    if (config->mode == LG_MODE_VAR)
+    {
+        hdr = (uint16_t)size;
+        memcpy(msg, &hdr, sizeof(hdr));
+    }
+    else if (config->mode == LG_MODE_PATTERN)
+    {
+        msg[size - 1] = '\n';
+    }
+
+    // 共享内存通道: 每条消息作为一条记录发送, 不经过 out
+    if (conn->shm)
+    {
+        if (TcpShmChannelSend(conn->shm, msg, size) < 0)
+            conn->shm_failed = true;
+    }
+    else
+        conn->out_len += size;
+
+    slot = (conn->head + conn->n_inflight) % config->depth;
+    conn->inflight_size[slot] = size;
+    conn->inflight_ns[slot] = sent_ns;
+    conn->n_inflight++;
+}
+
+/**
+ * @brief 收到 n_bytes 字节回显数据, 按在途队列完成往返并记录延迟
+ *
+ * @return uint32_t 完成的往返数
+ */
+static uint32_t complete_inflight(lg_thread_t *lt, lg_conn_t *conn, uint32_t n_bytes, uint64_t now)
+{
+    uint32_t n_done = 0, take, need;
+    uint64_t start = measure_start_ns;
+
+    while (n_bytes > 0)
+    {
+        if (!conn->n_inflight)
+        {
+            lt->protocol_errors++;
+            break;
+        }
+
+        need = conn->inflight_size[conn->head] - conn->recvd;
+        take = n_bytes < need ? n_bytes : need;
+        conn->recvd += take;
+        n_bytes -= take;
+
+        if (conn->recvd < conn->inflight_size[conn->head])
+            break;
+
+        if (start && now >= start && !stop_load)
+        {
+            hist_record(&lt->latency, now - conn->inflight_ns[conn->head]);
+            lt->n_msgs++;
+            lt->n_bytes += conn->inflight_size[conn->head];
+        }
+
+        conn->recvd = 0;
+        conn->head = (conn->head + 1) % lt->config->depth;
+        conn->n_inflight--;
+        n_done++;
+    }
+
+    return n_done;
+}
+
+/**
+ * @brief 闭环模式: 每完成一次往返立即补发一条
+ *
+ * @return false 连接出错
+ */
+static bool refill_conn(lg_thread_t *lt, lg_conn_t *conn, uint32_t n_done, uint64_t now)
+{
+    if (lt->config->rate || !n_done)
+        return true;
+
+    while (conn->n_inflight < lt->config->depth)
+        enqueue_msg(lt, conn, now);
+
+    return flush_conn(lt, conn);
+}
+
+/**
+ * @brief 读取回显数据, 按在途队列完成往返并记录延迟
+ *
+ * @return false 连接关闭或出错
+ */
+static bool read_conn(lg_thread_t *lt, lg_conn_t *conn, unsigned char *buffer)
+{
+    ssize_t rc;
+    uint64_t now;
+
+    while (true)
+    {
+        rc = recv(conn->fd, buffer, LG_RECV_BUFFER_SIZE, 0);
+
+        if (rc < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        if (rc == 0)
+            return false;
+
+        now = now_ns();
+
+        if (!refill_conn(lt, conn, complete_inflight(lt, conn, (uint32_t)rc, now), now))
+            return false;
+    }
+}
+
+/**
+ * @brief 取出共享内存通道中的所有回显消息, 通道为空后重新进入等待状态
+ *
+ * @return false 服务器关闭了通道或发送失败
+ */
+static bool read_shm_conn(lg_thread_t *lt, lg_conn_t *conn)
+{
+    uint32_t i, n_spans, n_done;
+    uint64_t now;
+    bool peer_closed;
+    TcpMsgSpan_t spans[64];
+
+    TcpShmChannelWaitDisarm(conn->shm);
+
+    while (true)
+    {
+        peer_closed = TcpShmChannelIsPeerClosed(conn->shm);
+        n_spans = TcpShmChannelRecv(conn->shm, spans, 64);
+
+        if (n_spans)
+        {
+            now = now_ns();
+
+            for (i = 0, n_done = 0; i < n_spans; i++)
+                n_done += complete_inflight(lt, conn, spans[i].size, now);
+
+            TcpShmChannelRelease(conn->shm);
+
+            if (!refill_conn(lt, conn, n_done, now))
+                return false;
+
+            continue;
+        }
+
+        if (peer_closed)
+            return false;
+
+        if (TcpShmChannelWaitArm(conn->shm))
+            return true;
+    }
+}
+
+static void *load_thread_fn(void *arg)
+{
+    uint32_t i;
+    int n;
+    uint64_t now, next_due, expirations, interval_ns = 0;
+    struct itimerspec its;
+    lg_conn_t *conn;
+    lg_thread_t *lt = (lg_thread_t *)arg;
+    lg_config_t *config = lt->config;
+    struct epoll_event ev, events[LG_MAX_EVENTS];
+    unsigned char *buffer = (unsigned char *)malloc(LG_RECV_BUFFER_SIZE);
+
+    lt->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    lt->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    memset(&its, 0, sizeof(its));
+
+    // data.ptr 为 NULL 表示定时器事件
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(lt->epoll_fd, EPOLL_CTL_ADD, lt->timer_fd, &ev);
+
+    for (i = 0; i < lt->n_conns; i++)
+    {
+        conn = &lt->conns[i];
+        conn->out = (unsigned char *)malloc((size_t)config->depth * config->max_size);
+        conn->inflight_size = (uint32_t *)calloc(config->depth, sizeof(uint32_t));
+        conn->inflight_ns = (uint64_t *)calloc(config->depth, sizeof(uint64_t));
+        conn->fd = open_connection(config);
+
+        if (conn->fd < 0)
+        {
+            lt->connect_errors++;
+            continue;
+        }
+
+        // 共享内存通道的消息通过 eventfd 通知, TCP 连接保持打开但不再监听
+        if (config->shm)
+        {
+            conn->shm = TcpShmConnect(conn->fd);
+
+            if (!conn->shm)
+                lt->shm_fallbacks++;
+        }
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        epoll_ctl(lt->epoll_fd, EPOLL_CTL_ADD, conn->shm ? conn->shm->rx_event_fd : conn->fd, &ev);
+    }
+
+    // 所有线程建立完连接后同时开始发送
+    pthread_barrier_wait(&start_barrier);
+
+    now = now_ns();
+
+    if (config->rate)
+        interval_ns = (uint64_t)(1e9 * config->n_connections / config->rate);
+
+    for (i = 0; i < lt->n_conns; i++)
+    {
+        conn = &lt->conns[i];
+
+        if (conn->fd < 0)
+            continue;
+
+        if (config->rate)
+        {
+            // 错开各连接的发送时间
+            conn->next_send_ns = now + (interval_ns ? next_rand(lt) % interval_ns : 0);
+            continue;
+        }
+
+        while (conn->n_inflight < config->depth)
+            enqueue_msg(lt, conn, now);
+
+        if (!flush_conn(lt, conn))
+        {
+            lt->io_errors++;
+            close_connection(lt, conn);
+        }
+    }
+
+    while (!stop_load)
+    {
+        if (config->rate)
+        {
+            now = now_ns();
+            next_due = UINT64_MAX;
+
+            for (i = 0; i < lt->n_conns; i++)
+            {
+                conn = &lt->conns[i];
+
+                if (conn->fd < 0)
+                    continue;
+
+                if (conn->next_send_ns <= now && conn->n_inflight < config->depth)
+                {
+                    while (conn->next_send_ns <= now && conn->n_inflight < config->depth)
+                    {
+                        enqueue_msg(lt, conn, conn->next_send_ns);
+                        conn->next_send_ns += interval_ns;
+                    }
+
+                    if (!flush_conn(lt, conn))
+                    {
+                        lt->io_errors++;
+                        close_connection(lt, conn);
+                        continue;
+                    }
+                }
+
+                // 窗口已满的连接由回显推动, 不参与计算等待时间
+                if (conn->n_inflight < config->depth && conn->next_send_ns < next_due)
+                    next_due = conn->next_send_ns;
+            }
+
+            // 绝对时间的定时器, 发送不会因为 epoll_wait 的毫秒精度被推迟(推迟的时间会计入延迟)
+            if (next_due != UINT64_MAX)
+            {
+                its.it_value.tv_sec = next_due / 1000000000ULL;
+                its.it_value.tv_nsec = next_due % 1000000000ULL;
+                timerfd_settime(lt->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+            }
+        }
+
+        n = epoll_wait(lt->epoll_fd, events, LG_MAX_EVENTS, 100);
+
+        for (i = 0; i < (uint32_t)(n > 0 ? n : 0); i++)
+        {
+            conn = (lg_conn_t *)events[i].data.ptr;
+
+            if (!conn)
+            {
+                read(lt->timer_fd, &expirations, sizeof(expirations));
+                continue;
+            }
+
+            if (conn->fd < 0)
+                continue;
+
+            if (conn->shm ? !read_shm_conn(lt, conn) :
+                (((events[i].events & EPOLLOUT) && !flush_conn(lt, conn)) ||
+                 ((events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && !read_conn(lt, conn, buffer))))
+            {
+                if (!stop_load)
+                    lt->io_errors++;
+
+                close_connection(lt, conn);
+            }
+        }
+    }
+
+    for (i = 0; i < lt->n_conns; i++)
+    {
+        conn = &lt->conns[i];
+
+        if (conn->fd >= 0)
+            close_connection(lt, conn);
+
+        free(conn->out);
+        free(conn->inflight_size);
+        free(conn->inflight_ns);
+    }
+
+    close(lt->timer_fd);
+    close(lt->epoll_fd);
+    free(buffer);
+    return NULL;
+}
+
+static void raise_fd_limit()
+{
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+static void sleep_sec(double sec)
+{
+    struct timespec ts;
+
+    ts.tv_sec = (time_t)sec;
+    ts.tv_nsec = (long)((sec - ts.tv_sec) * 1e9);
+
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+        ;
+}
+
+static void usage(const char *prog)
+{
+    printf("usage : %s <server_ip> <port> [-c conns] [-t threads] [-m fixed|var|pattern] "
+           "[-s max_size] [-S min_size] [-r rate] [-p depth] [-d seconds] [-w seconds] [-x] [-q]\n",
+           prog);
+    exit(0);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    uint32_t i, j;
+    double elapsed;
+    uint64_t n_msgs = 0, n_bytes = 0;
+    uint32_t connect_errors = 0, io_errors = 0, protocol_errors = 0, shm_fallbacks = 0;
+    const char *mode_names[] = {"fixed", "var", "pattern"};
+    lg_config_t config;
+    lg_thread_t *threads;
+    lg_histogram_t *latency = (lg_histogram_t *)calloc(1, sizeof(lg_histogram_t));
+
+    if (argc < 3 || argv[1][0] == '-')
+        usage(argv[0]);
+
+    memset(&config, 0, sizeof(config));
+    config.dest.sin_family = AF_INET;
+    config.dest.sin_port = htons(atoi(argv[2]));
+
+    if (inet_pton(AF_INET, argv[1], &config.dest.sin_addr) != 1)
+        usage(argv[0]);
+
+    config.mode = LG_MODE_FIXED;
+    config.n_connections = 100;
+    config.n_threads = 4;
+    config.max_size = 64;
+    config.depth = 1;
+    config.duration = 5;
+    config.warmup = 1;
+
+    optind = 3;
+
+    while ((opt = getopt(argc, argv, "c:t:m:s:S:r:p:d:w:xq")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            config.n_connections = atoi(optarg);
+            break;
+        case 't':
+            config.n_threads = atoi(optarg);
+            break;
+        case 'm':
+            if (strcmp(optarg, "var") == 0)
+                config.mode = LG_MODE_VAR;
+            else if (strcmp(optarg, "pattern") == 0)
+                config.mode = LG_MODE_PATTERN;
+            else if (strcmp(optarg, "fixed") == 0)
+                config.mode = LG_MODE_FIXED;
+            else
+                usage(argv[0]);
+            break;
+        case 's':
+            config.max_size = atoi(optarg);
+            break;
+        case 'S':
+            config.min_size = atoi(optarg);
+            break;
+        case 'r':
+            config.rate = strtoull(optarg, NULL, 10);
+            break;
+        case 'p':
+            config.depth = atoi(optarg);
+            break;
+        case 'd':
+            config.duration = atof(optarg);
+            break;
+        case 'w':
+            config.warmup = atof(optarg);
+            break;
+        case 'x':
+            config.shm = true;
+            break;
+        case 'q':
+            config.quiet = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    // 变长消息至少要比 2 字节长度头长, 服务器回调的消息长度是 uint16_t
+    if (config.mode == LG_MODE_FIXED || config.min_size == 0 || config.min_size > config.max_size)
+        config.min_size = config.max_size;
+
+    if (config.mode == LG_MODE_VAR && config.min_size < 3)
+        config.min_size = 3;
+
+    if (config.max_size < config.min_size || config.max_size > UINT16_MAX ||
+        config.n_connections == 0 || config.n_threads == 0 || config.depth == 0)
+        usage(argv[0]);
+
+    if (config.n_threads > config.n_connections)
+        config.n_threads = config.n_connections;
+
+    raise_fd_limit();
+    signal(SIGPIPE, SIG_IGN);
+
+    threads = (lg_thread_t *)calloc(config.n_threads, sizeof(lg_thread_t));
+    pthread_barrier_init(&start_barrier, NULL, config.n_threads + 1);
+
+    for (i = 0; i < config.n_threads; i++)
+    {
+        threads[i].id = i;
+        threads[i].config = &config;
+        threads[i].n_conns = config.n_connections / config.n_threads + (i < config.n_connections % config.n_threads ? 1 : 0);
+        threads[i].conns = (lg_conn_t *)calloc(threads[i].n_conns, sizeof(lg_conn_t));
+        threads[i].rand_state = 0x9E3779B97F4A7C15ULL * (i + 1);
+        pthread_create(&threads[i].thread, NULL, load_thread_fn, &threads[i]);
+    }
+
+    pthread_barrier_wait(&start_barrier);
+
+    sleep_sec(config.warmup);
+    measure_start_ns = now_ns();
+    sleep_sec(config.duration);
+    measure_end_ns = now_ns();
+    stop_load = true;
+
+    for (i = 0; i < config.n_threads; i++)
+    {
+        pthread_join(threads[i].thread, NULL);
+
+        n_msgs += threads[i].n_msgs;
+        n_bytes += threads[i].n_bytes;
+        connect_errors += threads[i].connect_errors;
+        io_errors += threads[i].io_errors;
+        protocol_errors += threads[i].protocol_errors;
+        shm_fallbacks += threads[i].shm_fallbacks;
+
+        for (j = 0; j < LG_HIST_N_BUCKETS; j++)
+            latency->buckets[j] += threads[i].latency.buckets[j];
+
+        latency->count += threads[i].latency.count;
+        latency->sum += threads[i].latency.sum;
+
+        if (threads[i].latency.max > latency->max)
+            latency->max = threads[i].latency.max;
+
+        free(threads[i].conns);
+    }
+
+    elapsed = (measure_end_ns - measure_start_ns) / 1e9;
+
+    if (config.quiet)
+    {
+        // mode,min_size,max_size,conns,threads,depth,rate,msgs_per_sec,mb_per_sec,p50_us,p90_us,p99_us,p999_us,max_us,errors
+        printf("%s,%u,%u,%u,%u,%u,%lu,%.0f,%.2f,%.1f,%.1f,%.1f,%.1f,%.1f,%u\n",
+               mode_names[config.mode], config.min_size, config.max_size, config.n_connections, config.n_threads,
+               config.depth, (unsigned long)config.rate, n_msgs / elapsed, n_bytes / elapsed / 1e6,
+               hist_percentile(latency, 50) / 1e3, hist_percentile(latency, 90) / 1e3,
+               hist_percentile(latency, 99) / 1e3, hist_percentile(latency, 99.9) / 1e3, latency->max / 1e3,
+               connect_errors + io_errors + protocol_errors);
+    }
+    else
+    {
+        printf("mode %s, size %u-%u, connections %u, threads %u, depth %u, ",
+               mode_names[config.mode], config.min_size, config.max_size, config.n_connections, config.n_threads, config.depth);
+
+        if (config.rate)
+            printf("rate %lu msgs/s\n", (unsigned long)config.rate);
+        else
+            printf("closed loop\n");
+
+        printf("%.2f s : %lu msgs, %.0f msgs/s, %.2f MB/s each way\n",
+               elapsed, (unsigned long)n_msgs, n_msgs / elapsed, n_bytes / elapsed / 1e6);
+        printf("round trip (us) : mean = %.1f, p50 = %.1f, p90 = %.1f, p99 = %.1f, p99.9 = %.1f, max = %.1f\n",
+               latency->count ? latency->sum / 1e3 / latency->count : 0.0,
+               hist_percentile(latency, 50) / 1e3, hist_percentile(latency, 90) / 1e3,
+               hist_percentile(latency, 99) / 1e3, hist_percentile(latency, 99.9) / 1e3, latency->max / 1e3);
+        printf("errors : connect = %u, io = %u, protocol = %u\n", connect_errors, io_errors, protocol_errors);
+
+        if (config.shm)
+            printf("shm : %u connections, %u fell back to TCP\n", config.n_connections - connect_errors - shm_fallbacks, shm_fallbacks);
+    }
+
+    pthread_barrier_destroy(&start_barrier);
+    free(threads);
+    free(latency);
+
+    return (connect_errors + io_errors + protocol_errors) ? 1 : 0;
+}
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "TcpTimerWheel.h"
+
+/*
+ * Microbenchmark: TcpTimerWheel
+ *
+ * usage : timer_wheel_bench.exe [n_timers] [n_ticks] [reset_per_mille]
+ *
+ * 模拟 DRS 中每个客户端一个 keepalive/空闲定时器:
+ *   - 所有定时器在 1~600 秒内随机到期, 到期后按同样的方式重新添加(周期性 keepalive)
+ *   - 每个 tick 有 reset_per_mille(默认 10)‰ 的客户端收到数据并重置定时器(Add 一个已经在时间轮中的定时器)
+ *     DRS 中收到数据只记录时间, 到期时才重新添加, 对应 reset_per_mille = 0
+ * 同时检查每个定时器都在正确的 tick 到期.
+ */
+
+typedef struct bench_timer_
+{
+    TcpTimer timer;
+    uint64_t expect; // 预期到期的 tick
+} bench_timer_t;
+
+static TcpTimerWheel *wheel;
+static uint64_t n_errors;
+static uint64_t max_ticks;
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t random_ticks()
+{
+    return 1 + (uint64_t)rand() % (max_ticks);
+}
+
+static void rearm(bench_timer_t *bt, uint64_t delta)
+{
+    bt->expect = wheel->GetCurrentTick() + delta;
+    wheel->Add(&bt->timer, bt->expect);
+}
+
+static void timer_expired(TcpTimer * /*timer*/, void *arg)
+{
+    bench_timer_t *bt = (bench_timer_t *)arg;
+
+    // 回调时 current_tick 已经指向下一个 tick
+    if (wheel->GetCurrentTick() - 1 != bt->expect)
+        n_errors++;
+
+    rearm(bt, random_ticks());
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t i, j, n_timers = argc > 1 ? atoi(argv[1]) : 100000;
+    uint64_t n_ticks = argc > 2 ? atoll(argv[2]) : 36000;
+    uint32_t reset_per_mille = argc > 3 ? atoi(argv[3]) : 10;
+    uint64_t n_resets = 0, fired;
+    uint64_t start_ms;
+    double t0, elapsed;
+    bench_timer_t *timers = new bench_timer_t[n_timers];
+
+    srand(1);
+    wheel = new TcpTimerWheel();
+    max_ticks = 600 * 1000 / TCP_TIMER_WHEEL_TICK_MS;
+
+    for (i = 0; i < n_timers; i++)
+    {
+        timers[i].timer.cb = timer_expired;
+        timers[i].timer.arg = &timers[i];
+        rearm(&timers[i], random_ticks());
+    }
+
+    // 以 tick 为单位推进虚拟时间
+    start_ms = TcpTimerWheel::NowMs();
+    t0 = now_sec();
+
+    for (j = 0; j < n_ticks; j++)
+    {
+        for (i = 0; i < (uint64_t)n_timers * reset_per_mille / 1000; i++)
+        {
+            rearm(&timers[rand() % n_timers], random_ticks());
+            n_resets++;
+        }
+
+        wheel->Advance(start_ms + (j + 1) * TCP_TIMER_WHEEL_TICK_MS);
+    }
+
+    elapsed = now_sec() - t0;
+    fired = wheel->GetFiredCount();
+
+    printf("timers : %u, ticks : %lu (%.0f sec simulated), pending : %u\n",
+           n_timers, (unsigned long)n_ticks, n_ticks * TCP_TIMER_WHEEL_TICK_MS / 1000.0, wheel->GetTimerCount());
+    printf("fired : %lu, resets : %lu, wrong tick : %lu\n",
+           (unsigned long)fired, (unsigned long)n_resets, (unsigned long)n_errors);
+    printf("total %.3f sec, %.1f ns per timer operation, %.2f usec per tick\n",
+           elapsed, elapsed * 1e9 / (fired + n_resets), elapsed * 1e6 / n_ticks);
+
+    delete wheel;
+    delete[] timers;
+    return n_errors ? 1 : 0;
+}
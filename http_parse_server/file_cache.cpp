@@ -0,0 +1,266 @@
+#include <unistd.h>       // close(), read(), pread()
+#include <fcntl.h>        // open()
+#include <sys/stat.h>     // fstat()
+#include <sys/inotify.h>  // inotify_init1(), inotify_add_watch(), inotify_rm_watch()
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "file_cache.h"
+
+#define FILE_CACHE_WATCH_MASK (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF)
+
+/**
+ * @brief 创建缓存
+ *
+ * inotify 创建失败时不缓存任何文件(无法知道文件何时变化), 每个请求都重新打开文件
+ *
+ * @param max_bytes 内存上限
+ */
+FileCache::FileCache(size_t max_bytes)
+{
+    this->max_bytes = max_bytes;
+    this->used_bytes = 0;
+
+    this->notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (this->notify_fd < 0)
+        perror("inotify_init1() failed, file cache disabled");
+}
+
+FileCache::~FileCache()
+{
+    while (!this->lru.empty())
+        this->Remove(this->lru.front());
+
+    if (this->notify_fd >= 0)
+        close(this->notify_fd);
+}
+
+int FileCache::GetNotifyFd()
+{
+    return this->notify_fd;
+}
+
+/**
+ * @brief 缓存项计入内存上限的字节数, 大文件的内容在页缓存中, 只计固定开销
+ */
+size_t FileCache::EntryCost(const FileCacheEntry *entry)
+{
+    return (entry->data ? entry->size : 0) + entry->header.size() + entry->not_modified_header.size() + entry->path.size() +
+           FILE_CACHE_ENTRY_OVERHEAD;
+}
+
+/**
+ * @brief 查找缓存, 命中时移到 LRU 表头
+ *
+ * @param path 文件路径
+ * @return FileCacheEntry* 命中时返回缓存项并增加引用, 用完后调用 Release(); 未命中返回 nullptr
+ */
+FileCacheEntry *FileCache::Lookup(const string &path)
+{
+    auto it = this->entries.find(path);
+    if (it == this->entries.end())
+        return nullptr;
+
+    FileCacheEntry *entry = it->second;
+    this->lru.splice(this->lru.begin(), this->lru, entry->lru_pos);
+    entry->refs++;
+
+    return entry;
+}
+
+/**
+ * @brief 打开文件, 生成响应头并加入缓存
+ *
+ * 先添加 inotify watch 再打开文件, 打开之后的任何修改都会收到通知;
+ * 无法添加 watch 时返回的缓存项不进入缓存, 最后一个 Release() 时释放
+ *
+ * @param path 文件路径
+ * @param headerPrefix 状态行和 Content-Type
+ * @param notModifiedStatus 304 的状态行
+ * @param cacheControl Cache-Control 字段, 200 和 304 响应都带
+ * @return FileCacheEntry* 引用计数已经加一, 用完后调用 Release(); 文件不存在或不是普通文件时返回 nullptr, errno 说明原因
+ */
+FileCacheEntry *FileCache::Load(const string &path, const string &headerPrefix, const string &notModifiedStatus,
+                                const string &cacheControl)
+{
+    struct stat stat_buf;
+    int wd = -1;
+    int err;
+
+    // ---------- [1] 添加 watch ----------
+    if (this->notify_fd >= 0)
+    {
+        wd = inotify_add_watch(this->notify_fd, path.c_str(), FILE_CACHE_WATCH_MASK);
+        if (wd < 0 && (errno == ENOENT || errno == ENOTDIR || errno == EACCES))
+            return nullptr;
+    }
+
+    // ---------- [2] 打开文件 ----------
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &stat_buf) < 0 || !S_ISREG(stat_buf.st_mode))
+    {
+        err = (fd >= 0 && S_ISDIR(stat_buf.st_mode)) ? EISDIR : errno;
+        if (fd >= 0)
+            close(fd);
+        if (wd >= 0 && this->watches.find(wd) == this->watches.end())
+            inotify_rm_watch(this->notify_fd, wd);
+        errno = err;
+        return nullptr;
+    }
+
+    FileCacheEntry *entry = new FileCacheEntry();
+    entry->path = path;
+    entry->size = stat_buf.st_size;
+    entry->mtime = stat_buf.st_mtime;
+    entry->data = nullptr;
+    entry->fd = -1;
+    entry->wd = -1;
+    entry->refs = 1;
+    entry->cached = false;
+
+    // ---------- [3] 小文件读入内存, 大文件保留 fd ----------
+    if (entry->size > 0 && entry->size <= FILE_CACHE_INLINE_MAX)
+        entry->data = (char *)malloc(entry->size);
+
+    // 大文件, 或者分配不到内存的小文件, 保留 fd 用 sendfile() 发送
+    if (entry->size > 0 && !entry->data)
+        entry->fd = fd;
+    else
+    {
+        off_t done = 0;
+        if (entry->size > 0)
+        {
+            while (done < entry->size)
+            {
+                ssize_t n = pread(fd, entry->data + done, entry->size - done, done);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    break;
+                done += n;
+            }
+        }
+        entry->size = done; // 读的过程中文件被截断时以实际读到的为准, watch 会让它随后失效
+        close(fd);
+    }
+
+    // ---------- [4] 生成响应头 ----------
+    char buf[64];
+    struct tm tm_buf;
+
+    snprintf(buf, sizeof(buf), "\"%lx-%lx\"", (unsigned long)entry->mtime, (unsigned long)entry->size);
+    entry->etag = buf;
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", gmtime_r(&entry->mtime, &tm_buf));
+    entry->last_modified = buf;
+
+    string validators = "ETag: " + entry->etag + "\r\nLast-Modified: " + entry->last_modified + "\r\n" + cacheControl;
+    entry->header = headerPrefix + "Content-Length: " + to_string(entry->size) + "\r\n" + validators;
+    entry->not_modified_header = notModifiedStatus + validators;
+
+    if (wd < 0)
+        return entry;
+
+    // ---------- [5] 加入缓存, 超过上限时从表尾淘汰 ----------
+    entry->wd = wd;
+    entry->cached = true;
+    entry->refs++;
+    this->entries[path] = entry;
+    this->lru.push_front(entry);
+    entry->lru_pos = this->lru.begin();
+    this->watches[wd].push_back(entry);
+    this->used_bytes += this->EntryCost(entry);
+
+    while ((this->used_bytes > this->max_bytes || this->entries.size() > FILE_CACHE_MAX_ENTRIES) && !this->lru.empty())
+        this->Remove(this->lru.back());
+
+    return entry;
+}
+
+/**
+ * @brief 连接不再使用缓存项, 已经移出缓存的在最后一个引用释放时释放
+ */
+void FileCache::Release(FileCacheEntry *entry)
+{
+    if (--entry->refs == 0)
+        this->Free(entry);
+}
+
+/**
+ * @brief 从缓存中移除, 同一个 watch 没有其他缓存项时删除 watch
+ */
+void FileCache::Remove(FileCacheEntry *entry)
+{
+    this->entries.erase(entry->path);
+    this->lru.erase(entry->lru_pos);
+    this->used_bytes -= this->EntryCost(entry);
+    entry->cached = false;
+
+    auto it = this->watches.find(entry->wd);
+    if (it != this->watches.end())
+    {
+        vector<FileCacheEntry *> &users = it->second;
+        for (size_t i = 0; i < users.size(); ++i)
+        {
+            if (users[i] == entry)
+            {
+                users.erase(users.begin() + i);
+                break;
+            }
+        }
+
+        if (users.empty())
+        {
+            this->watches.erase(it);
+            inotify_rm_watch(this->notify_fd, entry->wd);
+        }
+    }
+    entry->wd = -1;
+
+    this->Release(entry);
+}
+
+void FileCache::Free(FileCacheEntry *entry)
+{
+    if (entry->data)
+        free(entry->data);
+    if (entry->fd >= 0)
+        close(entry->fd);
+    delete entry;
+}
+
+/**
+ * @brief (worker 线程) inotify 可读: 让发生变化的文件对应的缓存项失效, 下一个请求重新打开文件
+ *
+ * 正在发送旧内容的连接不受影响, 它们持有旧缓存项的引用
+ */
+void FileCache::ProcessNotify()
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    while (true)
+    {
+        ssize_t n = read(this->notify_fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+
+        for (char *p = buf; p < buf + n;)
+        {
+            struct inotify_event *event = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + event->len;
+
+            auto it = this->watches.find(event->wd);
+            if (it == this->watches.end())
+                continue;
+
+            // Remove() 会修改 watches, 先复制
+            vector<FileCacheEntry *> stale = it->second;
+            for (FileCacheEntry *entry : stale)
+                this->Remove(entry);
+        }
+    }
+}
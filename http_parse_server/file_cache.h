@@ -0,0 +1,73 @@
+#ifndef FILE_CACHE_H_
+#define FILE_CACHE_H_
+
+#include <sys/types.h>
+#include <time.h>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+#define FILE_CACHE_INLINE_MAX (64 * 1024) // 不超过这个大小的文件把内容读进内存, 更大的文件保留 fd 用 sendfile() 发送
+#define FILE_CACHE_ENTRY_OVERHEAD 1024    // 每个缓存项计入内存上限的固定开销(结构体, 路径, 响应头, fd)
+#define FILE_CACHE_MAX_ENTRIES 1024       // 每个缓存最多的缓存项数: 每项占一个 inotify watch, 大文件还占一个 fd
+
+/**
+ * @brief 一个缓存的文件
+ *
+ * 缓存项被淘汰或失效时如果还有连接在发送它, 等最后一个连接 Release() 后才释放
+ */
+typedef struct FileCacheEntry
+{
+    string path;                 // 文件路径(缓存的键), 例如 "./public/index.html"
+    string header;               // 预先生成的响应头: 状态行, Content-Type, Content-Length, ETag, Last-Modified, Cache-Control, 不含 Connection 和结尾的空行
+    string not_modified_header;  // 预先生成的 304 响应头: 状态行, ETag, Last-Modified, Cache-Control, 不含 Connection 和结尾的空行
+    string etag;                 // ETag 的值(带引号), 由大小和修改时间生成
+    string last_modified;        // Last-Modified 的值(HTTP 日期)
+    off_t size;                  // 文件大小
+    time_t mtime;                // 修改时间
+    char *data;                  // 小文件的内容, 大文件, 空文件或分配内存失败时为 nullptr
+    int fd;                      // 大文件(或分配内存失败的小文件)打开的 fd, 内容在内存中时为 -1
+    int wd;                      // inotify watch, 没有时为 -1
+    int refs;                    // 正在发送它的连接数, 加上缓存本身持有的一个
+    bool cached;                 // 是否还在缓存中
+    list<FileCacheEntry *>::iterator lru_pos; // 在 LRU 链表中的位置
+} FileCacheEntry;
+
+/**
+ * @brief 静态文件缓存, 每个 worker 一个, 只在 worker 线程中使用, 不需要加锁
+ *
+ * 1. Lookup() 命中时直接返回缓存项, 不需要 open()/fstat(), 响应头也不需要再拼接
+ * 2. Load() 在未命中时打开文件, 小文件读入内存, 大文件保留 fd, 生成响应头后加入缓存
+ * 3. 每个缓存的文件有一个 inotify watch, 文件被修改, 改属性, 删除或移走时 ProcessNotify() 让它失效
+ * 4. 内存或缓存项数超过上限时从 LRU 链表尾部淘汰; 大文件只计固定开销, 由缓存项数限制占用的 fd 和 watch
+ */
+class FileCache
+{
+private:
+    size_t max_bytes;                                  // 内存上限
+    size_t used_bytes;                                 // 当前计入上限的字节数
+    int notify_fd;                                     // inotify, 创建失败时为 -1(不缓存, 每次都重新打开文件)
+    unordered_map<string, FileCacheEntry *> entries;   // 路径 -> 缓存项
+    list<FileCacheEntry *> lru;                        // 最近使用的在表头
+    unordered_map<int, vector<FileCacheEntry *>> watches; // inotify watch -> 缓存项(同一个文件的不同路径共享 watch)
+
+    size_t EntryCost(const FileCacheEntry *);          // 缓存项计入上限的字节数
+    void Remove(FileCacheEntry *);                     // 从缓存中移除(还有连接在用时延迟释放)
+    void Free(FileCacheEntry *);                       // 释放内存和 fd
+
+public:
+    FileCache(size_t max_bytes);
+    ~FileCache();
+
+    int GetNotifyFd();                                           // 加入 worker 的 epoll
+    FileCacheEntry *Lookup(const string &path);                  // 命中时增加引用并返回, 否则返回 nullptr
+    FileCacheEntry *Load(const string &path, const string &headerPrefix, const string &notModifiedStatus,
+                         const string &cacheControl); // 打开文件并加入缓存, 失败返回 nullptr(errno)
+    void Release(FileCacheEntry *);                              // 连接发送完毕
+    void ProcessNotify();                                        // 读取 inotify 事件, 让变化的文件失效
+};
+
+#endif
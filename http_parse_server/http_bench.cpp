@@ -0,0 +1,238 @@
+#include <arpa/inet.h> // socket(), connect(), inet_pton()
+#include <unistd.h>    // close(), read(), write()
+#include <pthread.h>   // pthread_create(), pthread_join()
+#include <time.h>      // clock_gettime()
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define BENCH_BUF_SIZE 65536
+
+/**
+ * @brief 压测参数
+ */
+typedef struct
+{
+    string host;    // 服务器地址
+    int port;       // 服务器端口
+    string path;    // 请求的文件
+    double seconds; // 每个并发数运行的时间
+    bool keep_alive; // 是否复用连接(-k)
+} benchConfig;
+
+/**
+ * @brief 一个客户端线程的统计
+ */
+typedef struct
+{
+    const benchConfig *cfg;
+    pthread_t thread;
+    uint64_t requests; // 完成的请求数
+    uint64_t bytes;    // 收到的字节数(响应头 + 文件内容)
+    uint64_t errors;   // 连接/读写失败或非 200 响应
+} benchClient;
+
+static atomic<bool> stop_flag{false};
+
+/**
+ * @brief 取当前时间(秒)
+ */
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief 发送一个请求并读完响应
+ *
+ * 有 Content-Length 时读到长度为止, 否则读到对端关闭
+ *
+ * @param fd 已连接的 socket
+ * @param cfg 压测参数
+ * @param client 统计
+ * @param reusable 输出: 连接是否可以继续发送下一个请求
+ * @return true 收到完整的 200 响应
+ */
+static bool do_request(int fd, const benchConfig *cfg, benchClient *client, bool *reusable)
+{
+    string req = "GET " + cfg->path + " HTTP/1.1\r\nHost: " + cfg->host +
+                 (cfg->keep_alive ? "\r\n\r\n" : "\r\nConnection: close\r\n\r\n");
+    char buf[BENCH_BUF_SIZE];
+    string header;
+    long content_length = -1;
+    long body = 0;
+    ssize_t n;
+
+    *reusable = false;
+    if (write(fd, req.c_str(), req.length()) != (ssize_t)req.length())
+        return false;
+
+    // ---------- [1] 读响应头 ----------
+    size_t header_end = string::npos;
+    while (header_end == string::npos)
+    {
+        n = read(fd, buf, sizeof(buf));
+        if (n <= 0)
+            return false;
+        client->bytes += n;
+        header.append(buf, n);
+        header_end = header.find("\r\n\r\n");
+    }
+
+    if (header.compare(0, 12, "HTTP/1.1 200") != 0)
+        return false;
+
+    size_t found = header.find("Content-Length:");
+    if (found != string::npos && found < header_end)
+        content_length = strtol(header.c_str() + found + 15, nullptr, 10);
+    body = header.size() - (header_end + 4);
+
+    found = header.find("Connection: close");
+    bool server_close = (found != string::npos && found < header_end);
+
+    // ---------- [2] 读文件内容 ----------
+    while (content_length < 0 || body < content_length)
+    {
+        n = read(fd, buf, sizeof(buf));
+        if (n < 0)
+            return false;
+        if (n == 0)
+            return content_length < 0;
+        client->bytes += n;
+        body += n;
+    }
+
+    *reusable = cfg->keep_alive && !server_close;
+    return true;
+}
+
+/**
+ * @brief 客户端线程: 发送请求直到 stop_flag, 默认每个请求一个新连接, -k 时复用连接直到服务器关闭
+ */
+static void *client_thread(void *arg)
+{
+    benchClient *client = (benchClient *)arg;
+    const benchConfig *cfg = client->cfg;
+    struct sockaddr_in server;
+
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(cfg->port);
+    inet_pton(AF_INET, cfg->host.c_str(), &server.sin_addr);
+
+    int fd = -1;
+    bool reusable = false;
+
+    while (!stop_flag.load(memory_order_relaxed))
+    {
+        if (fd < 0)
+        {
+            fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (fd < 0 || connect(fd, (struct sockaddr *)&server, sizeof(server)) < 0)
+            {
+                client->errors++;
+                if (fd >= 0)
+                    close(fd);
+                fd = -1;
+                usleep(1000);
+                continue;
+            }
+        }
+
+        if (do_request(fd, cfg, client, &reusable))
+            client->requests++;
+        else
+            client->errors++;
+
+        if (!reusable)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    if (fd >= 0)
+        close(fd);
+
+    return nullptr;
+}
+
+/**
+ * @brief 用 n_clients 个并发客户端运行 cfg->seconds 秒, 输出一行 CSV
+ */
+static void run(const benchConfig *cfg, int n_clients)
+{
+    vector<benchClient> clients(n_clients);
+
+    stop_flag = false;
+    double start = now_sec();
+    for (int i = 0; i < n_clients; ++i)
+    {
+        clients[i].cfg = cfg;
+        clients[i].requests = clients[i].bytes = clients[i].errors = 0;
+        if (pthread_create(&clients[i].thread, nullptr, client_thread, &clients[i]) != 0)
+        {
+            perror("could not create thread");
+            exit(1);
+        }
+    }
+
+    usleep((useconds_t)(cfg->seconds * 1e6));
+    stop_flag = true;
+
+    uint64_t requests = 0, bytes = 0, errors = 0;
+    for (int i = 0; i < n_clients; ++i)
+    {
+        pthread_join(clients[i].thread, nullptr);
+        requests += clients[i].requests;
+        bytes += clients[i].bytes;
+        errors += clients[i].errors;
+    }
+    double elapsed = now_sec() - start;
+
+    printf("%d,%lu,%.0f,%.1f,%lu\n", n_clients, requests, requests / elapsed, bytes / elapsed / (1024 * 1024), errors);
+    fflush(stdout);
+}
+
+/**
+ * @brief HTTP 压测: 对同一个文件依次用不同的并发数请求, 观察总吞吐量随客户端数的变化
+ *
+ * 用法: ./http_bench.exe [-k] [path] [seconds] [clients ...]
+ * -k 使用持久连接, 默认每个请求一个新连接; 默认请求 /assets/images/banner1.jpg, 每个并发数 3 秒, 并发数 1 2 4 8 16 32 64
+ */
+int main(int argc, char *argv[])
+{
+    benchConfig cfg;
+    vector<int> client_counts;
+
+    cfg.keep_alive = (argc > 1 && strcmp(argv[1], "-k") == 0);
+    if (cfg.keep_alive)
+    {
+        argc--;
+        argv++;
+    }
+
+    cfg.host = "127.0.0.1";
+    cfg.port = 8080;
+    cfg.path = (argc > 1) ? argv[1] : "/assets/images/banner1.jpg";
+    cfg.seconds = (argc > 2) ? atof(argv[2]) : 3.0;
+
+    for (int i = 3; i < argc; ++i)
+        client_counts.push_back(atoi(argv[i]));
+    if (client_counts.empty())
+        client_counts = {1, 2, 4, 8, 16, 32, 64};
+
+    printf("clients,requests,req_per_sec,MB_per_sec,errors\n");
+    for (int n : client_counts)
+        run(&cfg, n);
+
+    return 0;
+}
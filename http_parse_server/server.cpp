@@ -1,24 +1,36 @@
 #include <arpa/inet.h>    // socket(), bind(), accept(), listen()
+#include <netinet/tcp.h>  // TCP_NODELAY
 #include <unistd.h>       // close(), write(), read()
-#include <semaphore.h>    // sem_t() 信号量
 #include <pthread.h>      // pthread()
 #include <sys/stat.h>     // struct stat 是用于获取文件属性（大小、时间、权限等）的结构体
 #include <fcntl.h>        // open()
 #include <sys/sendfile.h> // sendfile()
+#include <sys/uio.h>      // struct iovec
+#include <sys/epoll.h>    // epoll_create1(), epoll_ctl(), epoll_wait()
+#include <sys/resource.h> // getrlimit(), setrlimit()
+#include <signal.h>       // signal()
+#include <strings.h>      // strncasecmp(), strcasecmp()
+#include <time.h>         // clock_gettime()
 
 #include <iostream>
 #include <cstring>
 #include <vector>
+#include <atomic>
 
 #include "server.h"
 
 using namespace std;
 
-#define client_message_SIZE 1024
+#define client_message_SIZE 4096 // 每次 read() 的缓冲区大小
+#define MAX_REQUEST_SIZE 65536   // 请求头(加上非上传的请求体)的上限, 超过时返回 BAD_REQUEST
+#define MAX_CONNECTIONS 65536    // 同时处理的连接数上限, 超过时返回 BAD_REQUEST
+#define MAX_EVENTS 256           // 每次 epoll_wait() 最多取出的事件数
+#define MAX_KEEPALIVE_REQUESTS 100 // 一个持久连接最多处理的请求数, 最后一个响应带 Connection: close
+#define IDLE_TIMEOUT_MS 10000      // 连接超过这个时间没有任何事件时关闭(等待下一个请求, 或对端不读不写)
+#define IDLE_SWEEP_MS 1000         // epoll_wait() 的超时, 即检查空闲连接的间隔
+#define FILE_CACHE_SIZE_MB 64      // 文件缓存的默认内存上限(所有 worker 合计), 可以用第二个命令行参数修改
 #define PORT 8080
-sem_t mutex;
-int thread_count = 0;
-std::vector<std::string> serverData{};
+std::atomic<int> connection_count{0}; // 所有 worker 当前的连接数
 
 /**
  * @brief 从字符中提取指定分隔符前的子字符串
@@ -60,139 +72,98 @@ std::string findFileExt(std::string fileEx)
 
     printf("serveing .%s as html\n", fileEx.c_str());
 
-    return "Content-Type: text/html\r\n\r\n";
+    return "Content-Type: text/html\r\n";
 }
 
+static_assert(sizeof(ContentType) / sizeof(ContentType[0]) == sizeof(fileExtension) / sizeof(fileExtension[0]),
+              "ContentType[] must match fileExtension[]");
+static_assert(sizeof(CacheMaxAge) / sizeof(CacheMaxAge[0]) == sizeof(fileExtension) / sizeof(fileExtension[0]),
+              "CacheMaxAge[] must match fileExtension[]");
+
 /**
- * @brief 向客户端发送 HTTP 响应头和指定文件内容
- *
- * 该函数实现一个简单的 HTTP 文件响应：
- * 1. 发送 HTTP 响应头（例如 200 OK + Content-Type）
- * 2. 再发送指定路径的文件内容
+ * @brief 根据文件扩展名,返回对应的 Cache-Control
  *
- * @param fd            客户端套接字文件描述符，用于 write/send
- * @param filePath      客户端请求的文件路径，例如 "/index.html"
- * @param headerFile    Content-Type 对应字符串，例如 "Content-Type: text/html\r\n\r\n"
+ * @param fileEx  要查找的文件扩展名
+ * @return std::string Cache-Control HTTP 头部字符串, 未知的扩展名和 html 一样要求每次验证
  */
-void send_message(int fd, string filePath, string headerFile)
+std::string findCacheControl(std::string fileEx)
 {
-    // ---------- [1] 构建 HTTP 响应头 ----------
-    string header = Messages[HTTP_HEADER] + headerFile;
-    if (filePath == "/" || filePath == "." || filePath.empty())
-        filePath = "/index.html"; // 默认首页
-    filePath = "./public" + filePath;
-
-    struct stat stat_buf;
-
-    // ---------- [2] 发送响应头 ----------
-    ssize_t bytes_written = write(fd, header.c_str(), header.length());
-    if (bytes_written < 0)
-    {
-        perror("[Error] Failed to send HTTP header");
-        return;
-    }
-    else if ((size_t)bytes_written < header.length())
-    {
-        fprintf(stderr, "[Warn] HTTP header only partially sent (%zd/%zu bytes)\n", bytes_written, header.length());
-    }
-
-    // ---------- [3] 打开文件 ----------
-    int fdimg = open(filePath.c_str(), O_RDONLY);
-    if (fdimg < 0)
+    for (size_t i = 0; i < sizeof(fileExtension) / sizeof(fileExtension[0]); ++i)
     {
-        fprintf(stderr, "[Error] Cannot open file: %s (%s)\n", filePath.c_str(), strerror(errno));
-        return;
+        if (fileExtension[i] == fileEx)
+        {
+            if (CacheMaxAge[i] > 0)
+                return "Cache-Control: max-age=" + to_string(CacheMaxAge[i]) + "\r\n";
+            break;
+        }
     }
 
-    // ---------- [4] 获取文件信息 ----------
-    if (fstat(fdimg, &stat_buf) < 0)
-    {
-        fprintf(stderr, "[Error] fstat() failed for %s (%s)\n", filePath.c_str(), strerror(errno));
-        close(fdimg);
-        return;
-    }
-    // 检查是否是普通文件
-    if (!S_ISREG(stat_buf.st_mode))
-    {
-        fprintf(stderr, "[Error] Not a regular file: %s\n", filePath.c_str());
-        close(fdimg);
-        return;
-    }
+    return "Cache-Control: no-cache\r\n";
+}
 
-    int img_total_size = stat_buf.st_size;
-    int block_size = stat_buf.st_blksize;
-    if (img_total_size <= 0)
-    {
-        fprintf(stderr, "[Warn] File is empty: %s\n", filePath.c_str());
-        close(fdimg);
-        return;
-    }
+/**
+ * @brief 在请求头中查找指定的字段(不区分大小写), 返回去掉首尾空白的值
+ *
+ * @param request       请求数据, 从请求行开始
+ * @param header_end    请求头结束的位置("\r\n\r\n" 之后)
+ * @param name          字段名, 例如 "Content-Length"
+ * @return string       字段值, 没有这个字段时返回空字符串
+ */
+string findHeader(const string &request, size_t header_end, const char *name)
+{
+    size_t name_len = strlen(name);
+    size_t line = request.find("\r\n");
 
-    if (block_size <= 0)
+    while (line != string::npos && line + 2 < header_end)
     {
-        block_size = 4096; // fallback 默认块大小
-    }
+        line += 2;
+        size_t line_end = request.find("\r\n", line);
+        if (line_end == string::npos || line_end > header_end)
+            break;
 
-    // ---------- [5] 发送文件内容 ----------
-    if (fdimg >= 0)
-    {
-        size_t sent_size = 0;
-        while (img_total_size > 0)
+        if (line_end - line > name_len && request[line + name_len] == ':' &&
+            strncasecmp(request.c_str() + line, name, name_len) == 0)
         {
-            int send_bytes = ((img_total_size < block_size) ? img_total_size : block_size);
-            int done_bytes = sendfile(fd, fdimg, nullptr, send_bytes);
-
-            if (done_bytes < 0)
-            {
-                if (errno == EINTR)
-                {
-                    fprintf(stderr, "[Warn] sendfile interrupted, retrying...\n");
-                    continue;
-                }
-                else if (errno == EAGAIN)
-                {
-                    fprintf(stderr, "[Warn] sendfile temporarily unavailable, retrying...\n");
-                    usleep(1000);
-                    continue;
-                }
-                else
-                {
-                    fprintf(stderr, "[Error] sendfile() failed: %s\n", strerror(errno));
-                    break;
-                }
-            }
-            else if (done_bytes == 0)
-            {
-                fprintf(stderr, "[Warn] sendfile() returned 0, possible EOF reached early\n");
-                break;
-            }
-
-            img_total_size -= done_bytes;
-            sent_size += done_bytes;
+            size_t begin = line + name_len + 1;
+            while (begin < line_end && (request[begin] == ' ' || request[begin] == '\t'))
+                ++begin;
+            size_t end = line_end;
+            while (end > begin && (request[end - 1] == ' ' || request[end - 1] == '\t'))
+                --end;
+            return request.substr(begin, end - begin);
         }
 
-        if (sent_size >= 0)
-            printf("sent file: %s (total %zu bytes)\n", filePath.c_str(), sent_size);
-        else
-            fprintf(stderr, "[Error] sendfile logic error (sent_size < 0)\n");
-
-        close(fdimg);
+        line = line_end;
     }
+
+    return "";
+}
+
+/**
+ * @brief 取单调时钟的当前时间(毫秒)
+ */
+long current_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
 /**
  * @brief 解析 HTTP 请求中的数据参数(GET / POST / Cookie)
  *
  * 根据请求类型（GET 或 POST）从客户端请求报文中提取参数数据，
- * 并将解析出的键值对（例如 "username=Tom"）存入全局容器 serverData。
+ * 并将解析出的键值对（例如 "username=Tom"）存入 params。
+ * 结果只属于这一个请求, 多个 worker 可以同时调用。
  *
  * @param requestType       请求类型，例如 "GET" 或 "POST"
  * @param client_message    客户端发送的完整 HTTP 请求报文
+ * @param params            输出: 解析出的参数
  */
-void getData(const string &requestType, const string &client_message)
+void getData(const string &requestType, const string &client_message, vector<string> &params)
 {
-    string data;        // 用于存储参数
-    serverData.clear(); // 清空上一次的数据
+    string data;    // 用于存储参数
+    params.clear(); // 清空上一次的数据
 
     // ---------- [1] 处理 GET 请求 ----------
     if (requestType == "GET")
@@ -260,225 +231,793 @@ void getData(const string &requestType, const string &client_message)
         }
 
         if (!extract.empty())
-            serverData.push_back(extract);
+            params.push_back(extract);
     }
 }
 
-void *connection_handler(void *socket_desc)
+/**
+ * @brief 把连接从 worker 的空闲链表中摘下
+ */
+void idle_list_remove(worker *w, connection *conn)
 {
-    if (socket_desc == nullptr)
-    {
-        perror("null socket_desc");
-        pthread_exit(nullptr);
-    }
+    if (conn->prev)
+        conn->prev->next = conn->next;
+    else
+        w->idle_head = conn->next;
 
-    int newSock = *((int *)socket_desc);                                 // 客户端套接字描述符
-    char client_message[client_message_SIZE] = {0};                      // 缓冲区初始化
-    int request = read(newSock, client_message, sizeof(client_message)); // 读取 HTTP 请求
-    string message = client_message;
+    if (conn->next)
+        conn->next->prev = conn->prev;
+    else
+        w->idle_tail = conn->prev;
 
-    if (request < 0)
-    {
-        perror("read() failed");
-        close(newSock);
-        pthread_exit(nullptr);
-    }
+    conn->prev = conn->next = nullptr;
+}
 
-    if (request == 0)
-    {
-        puts("Client disconnected unexpectedly");
-        close(newSock);
-        pthread_exit(nullptr);
-    }
+/**
+ * @brief 记录连接的活动时间, 并移到空闲链表的表尾
+ *
+ * 所有连接使用同一个超时时间, 所以表头总是最早超时的连接, 检查超时只需要看表头
+ */
+void idle_list_touch(worker *w, connection *conn)
+{
+    if (conn->prev || w->idle_head == conn)
+        idle_list_remove(w, conn);
+
+    conn->last_active_ms = w->now_ms;
+    conn->prev = w->idle_tail;
+    conn->next = nullptr;
+    if (w->idle_tail)
+        w->idle_tail->next = conn;
+    else
+        w->idle_head = conn;
+    w->idle_tail = conn;
+}
 
-    // === [1] 增加线程计数 ===
-    sem_wait(&mutex);
-    thread_count++;
-    printf("thread counter %d\n", thread_count);
-    if (thread_count > 20)
-    {
-        write(newSock, Messages[BAD_REQUEST].c_str(), Messages[BAD_REQUEST].length());
-        thread_count--;
-        close(newSock);
-        sem_post(&mutex);
-        pthread_exit(nullptr);
-    }
-    sem_post(&mutex);
+/**
+ * @brief 关闭连接, 释放它打开的文件
+ *
+ * close() 会把套接字从 epoll 中移除, 不需要单独 EPOLL_CTL_DEL
+ *
+ * @param w 连接所在的 worker
+ * @param conn 要关闭的连接
+ */
+void close_connection(worker *w, connection *conn)
+{
+    idle_list_remove(w, conn);
+
+    if (conn->entry)
+        w->cache->Release(conn->entry);
+    if (conn->upload_fd >= 0)
+        close(conn->upload_fd);
+    close(conn->fd);
+    delete conn;
+
+    connection_count.fetch_sub(1, memory_order_relaxed);
+}
+
+/**
+ * @brief 返回响应中的 Connection 字段
+ *
+ * HTTP/1.1 默认保持连接, 只在要关闭时声明; HTTP/1.0 默认关闭, 只在保持连接时声明
+ */
+string connection_header(const connection *conn)
+{
+    if (!conn->keep_alive)
+        return "Connection: close\r\n";
+    if (conn->http10)
+        return "Connection: keep-alive\r\n";
+    return "";
+}
+
+/**
+ * @brief 生成完整的错误响应(状态行 + 头部 + MessageBodies 中的内容)
+ *
+ * @param type          BAD_REQUEST 或 NOT_FOUND
+ * @param connHeader    connection_header() 的返回值
+ */
+string error_response(messageType type, const string &connHeader)
+{
+    return Messages[type] + "Content-Type: text/html\r\nContent-Length: " + to_string(MessageBodies[type].length()) +
+           "\r\n" + connHeader + "\r\n" + MessageBodies[type];
+}
 
-    // === [2] 检查 multipart/form-data 文件上传请求 ===
-    string mess = client_message;
-    if (mess.find("multipart/form-data") != string::npos)
+/**
+ * @brief 准备一个错误响应, 发送完后按 conn->keep_alive 决定是否继续处理下一个请求
+ *
+ * BAD_REQUEST 说明请求无法解析, 后面的数据也无法分帧, 总是关闭连接
+ */
+void set_error_response(connection *conn, messageType type)
+{
+    if (type == BAD_REQUEST)
+        conn->keep_alive = false;
+
+    conn->out_buf = error_response(type, connection_header(conn));
+    conn->out_sent = 0;
+    conn->state = CONN_WRITE_HEADER;
+}
+
+/**
+ * @brief 判断条件请求是否可以回复 304 Not Modified
+ *
+ * 有 If-None-Match 时只比较 ETag(弱比较, "*" 匹配任何版本), 忽略 If-Modified-Since;
+ * 否则比较 If-Modified-Since 和文件的修改时间, 日期无法解析时当作没有这个字段
+ *
+ * @param request       请求数据
+ * @param header_end    请求头结束的位置
+ * @param entry         请求的文件
+ * @return true 客户端缓存的版本仍然有效
+ */
+bool not_modified(const string &request, size_t header_end, const FileCacheEntry *entry)
+{
+    // ---------- [1] If-None-Match: 逗号分隔的 ETag 列表 ----------
+    string inm = findHeader(request, header_end, "If-None-Match");
+    if (!inm.empty())
     {
-        size_t found = mess.find("Content-Length:");
-        if (found != string::npos)
+        size_t pos = 0;
+        while (pos < inm.size())
         {
-            mess.erase(0, found + 16);
-            int length = stoi(getStr(mess, ' '));
+            size_t comma = inm.find(',', pos);
+            if (comma == string::npos)
+                comma = inm.size();
 
-            found = mess.find("filename=");
-            if (found != string::npos)
+            size_t begin = inm.find_first_not_of(" \t", pos);
+            size_t end = inm.find_last_not_of(" \t", comma - 1);
+            if (begin != string::npos && begin < comma && end != string::npos && end >= begin)
             {
-                mess.erase(0, found + 10);
-                string newf = getStr(mess, '"');
-                newf = "./public/downloads/" + newf;
-
-                found = mess.find("Content-Type:");
-                if (found != string::npos)
-                {
-                    mess.erase(0, found + 15);
-                    mess.erase(0, getStr(mess, '\n').length() + 3);
-                }
-
-                int fd = open(newf.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                if (fd < 0)
-                    perror(("cannot open file for upload: " + newf).c_str());
-                else
-                {
-                    write(fd, mess.c_str(), mess.size());
-                    printf("filesize: %d\n", length);
-
-                    char client_mess[client_message_SIZE];
-                    int counter = 0;
-                    while (length > 0)
-                    {
-                        int req = read(newSock, client_mess, sizeof(client_mess));
-                        if (req <= 0)
-                            break;
-                        if (write(fd, client_mess, req) < 0)
-                        {
-                            perror("write upload failed");
-                            break;
-                        }
-                        length -= req;
-                        counter += req;
-                        printf("remains: %d, received: %d, total: %d\n", length, req, counter);
-                        if (req < 1000)
-                            break;
-                    }
-                    close(fd);
-                }
+                string tag = inm.substr(begin, end - begin + 1);
+                if (tag.compare(0, 2, "W/") == 0)
+                    tag.erase(0, 2);
+                if (tag == "*" || tag == entry->etag)
+                    return true;
             }
+
+            pos = comma + 1;
         }
+        return false;
     }
 
-    // === [3] 解析 HTTP 请求 (GET / POST) ===
+    // ---------- [2] If-Modified-Since: HTTP 日期, 精确到秒 ----------
+    string ims = findHeader(request, header_end, "If-Modified-Since");
+    if (ims.empty())
+        return false;
+
+    struct tm tm_buf;
+    memset(&tm_buf, 0, sizeof(tm_buf));
+    if (strptime(ims.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm_buf) == nullptr)
+        return false;
+
+    return entry->mtime <= timegm(&tm_buf);
+}
+
+/**
+ * @brief 根据 conn->request 准备响应: 从文件缓存取出文件和预先生成的响应头, 之后由 CONN_WRITE_HEADER/CONN_SEND_BODY 发送
+ *
+ * 文件不存在或不是普通文件时返回 NOT_FOUND, 不是 GET / POST 的请求返回 BAD_REQUEST,
+ * GET 的条件请求命中时返回 NOT_MODIFIED(只有响应头)
+ *
+ * 同时根据请求的版本和 Connection 字段决定响应后是否保持连接
+ *
+ * @param w 连接所在的 worker
+ * @param conn 请求已经读完的连接
+ */
+void prepare_response(worker *w, connection *conn)
+{
+    // ---------- [1] 解析请求行 ----------
+    string message = conn->request;
     string requestType = getStr(message, ' ');
     message.erase(0, requestType.length() + 1);
     string requestFile = getStr(message, ' ');
+    message.erase(0, requestFile.length() + 1);
+    string version = getStr(message, '\r');
+    size_t header_end = conn->request.find("\r\n\r\n") + 4;
+
+    // ---------- [2] 是否保持连接 ----------
+    string connValue = findHeader(conn->request, header_end, "Connection");
+    conn->n_requests++;
+    conn->http10 = (version == "HTTP/1.0");
+    if (conn->http10)
+        conn->keep_alive = (strcasecmp(connValue.c_str(), "keep-alive") == 0);
+    else
+        conn->keep_alive = (version == "HTTP/1.1" && strcasecmp(connValue.c_str(), "close") != 0);
+    if (conn->n_requests >= MAX_KEEPALIVE_REQUESTS)
+        conn->keep_alive = false;
 
-    // ---------- 【修改部分：清理路径并处理根目录】 ----------
-    // 去掉结尾控制符
+    // 去掉结尾控制符和 query 字符串
     while (!requestFile.empty() && (requestFile.back() == '\r' || requestFile.back() == '\n'))
         requestFile.pop_back();
+    requestFile = getStr(requestFile, '?');
 
     // 根路径映射到 index.html
     if (requestFile.empty() || requestFile == "/" || requestFile == "." || requestFile == "./")
         requestFile = "/index.html";
 
-    // ---------- 提取扩展名 ----------
+    // ---------- [3] 提取扩展名 ----------
     string fileExt;
     size_t dotPos = requestFile.rfind('.');
     if (dotPos != string::npos)
         fileExt = requestFile.substr(dotPos + 1);
-    else
-        fileExt = "";
 
-    // ---------- 处理 GET / POST 请求 ----------
-    if (requestType == "GET" || requestType == "POST")
+    if (requestType != "GET" && requestType != "POST")
     {
-        if (fileExt == "php")
-            getData(requestType, client_message);
+        set_error_response(conn, BAD_REQUEST);
+        return;
+    }
+
+    if (fileExt == "php")
+        getData(requestType, conn->request, conn->params);
 
-        sem_wait(&mutex);
-        send_message(newSock, requestFile, findFileExt(fileExt));
-        sem_post(&mutex);
+    // ---------- [4] 查找文件缓存, 未命中时打开文件 ----------
+    string filePath = "./public" + requestFile;
+
+    FileCacheEntry *entry = w->cache->Lookup(filePath);
+    if (!entry)
+        entry = w->cache->Load(filePath, Messages[HTTP_HEADER] + findFileExt(fileExt), Messages[NOT_MODIFIED],
+                               findCacheControl(fileExt));
+    if (!entry)
+    {
+        fprintf(stderr, "[Error] Cannot open file: %s (%s)\n", filePath.c_str(), strerror(errno));
+        set_error_response(conn, NOT_FOUND);
+        return;
     }
 
-    printf("\n---- exiting server thread ----\n");
+    // ---------- [5] 条件请求: 客户端缓存的版本仍然有效时只回复 304 响应头 ----------
+    if (requestType == "GET" && not_modified(conn->request, header_end, entry))
+    {
+        conn->out_buf = entry->not_modified_header + connection_header(conn) + "\r\n";
+        conn->out_sent = 0;
+        conn->file_offset = 0;
+        conn->file_remain = 0;
+        conn->state = CONN_WRITE_HEADER;
+        w->cache->Release(entry);
+        return;
+    }
 
-    close(newSock);
-    sem_wait(&mutex);
-    thread_count--;
-    sem_post(&mutex);
+    // ---------- [6] 响应头只需要补上 Connection 和空行 ----------
+    conn->entry = entry;
+    conn->out_buf = connection_header(conn) + "\r\n";
+    conn->out_sent = 0;
+    conn->file_offset = 0;
+    conn->file_remain = (entry->fd >= 0) ? entry->size : 0;
+    conn->state = CONN_WRITE_HEADER;
+}
 
-    pthread_exit(nullptr);
-    return nullptr;
+/**
+ * @brief 一个响应发送完毕: 保持连接时清理本次请求的状态, 回到 CONN_READ_REQUEST 处理 in_buf 中的下一个请求;
+ * 否则 shutdown(SHUT_WR) 后进入 CONN_LINGER
+ *
+ * 直接 close() 时如果接收缓冲区里还有对端流水线发来的请求, 内核会发送 RST, 对端可能收不到最后一个响应
+ *
+ * @param w 连接所在的 worker
+ * @param conn 响应已发送完毕的连接
+ */
+void finish_response(worker *w, connection *conn)
+{
+    if (conn->entry)
+        w->cache->Release(conn->entry);
+    conn->entry = nullptr;
+
+    conn->request.clear();
+    conn->params.clear();
+    conn->out_buf.clear();
+    conn->out_sent = 0;
+
+    if (conn->keep_alive)
+    {
+        conn->state = CONN_READ_REQUEST;
+        return;
+    }
+
+    conn->in_buf.clear();
+    shutdown(conn->fd, SHUT_WR);
+    conn->state = CONN_LINGER;
 }
 
-int main(int argc, char *argv[])
+/**
+ * @brief 检查 conn->in_buf 中的请求是否完整, 完整时决定下一个状态
+ *
+ * 1. 请求头以 "\r\n\r\n" 结束, 带 Content-Length 的 POST 还要等请求体读完
+ * 2. multipart/form-data 上传: 读到文件名和分段头之后就打开文件, 剩余的请求体在 CONN_READ_UPLOAD 中边读边写
+ * 3. 其他请求交给 prepare_response()
+ *
+ * @param w 连接所在的 worker
+ * @param conn 正在读请求的连接
+ * @return true 状态已经改变
+ * @return false 请求还不完整, 需要继续读
+ */
+bool parse_request(worker *w, connection *conn)
+{
+    size_t header_end = conn->in_buf.find("\r\n\r\n");
+    if (header_end == string::npos)
+        return false;
+    header_end += 4;
+
+    long content_length = strtol(findHeader(conn->in_buf, header_end, "Content-Length").c_str(), nullptr, 10);
+    if (content_length < 0)
+        content_length = 0;
+
+    // ---------- [1] multipart/form-data 文件上传 ----------
+    size_t found = conn->in_buf.find("multipart/form-data");
+    if (found != string::npos && found < header_end && content_length > 0)
+    {
+        size_t name_pos = conn->in_buf.find("filename=\"", header_end);
+        size_t data_start = (name_pos == string::npos) ? string::npos : conn->in_buf.find("\r\n\r\n", name_pos);
+        if (data_start != string::npos)
+        {
+            string newf = "./public/downloads/" + getStr(conn->in_buf.substr(name_pos + 10), '"');
+            conn->upload_fd = open(newf.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (conn->upload_fd < 0)
+                perror(("cannot open file for upload: " + newf).c_str());
+
+            size_t body_end = header_end + content_length;
+            if (body_end > conn->in_buf.size())
+                body_end = conn->in_buf.size();
+            data_start += 4;
+
+            if (conn->upload_fd >= 0 && data_start < body_end &&
+                write(conn->upload_fd, conn->in_buf.data() + data_start, body_end - data_start) < 0)
+            {
+                perror("write upload failed");
+                close(conn->upload_fd);
+                conn->upload_fd = -1;
+            }
+
+            conn->request = conn->in_buf.substr(0, header_end);
+            conn->upload_remain = header_end + content_length - body_end;
+            conn->in_buf.erase(0, body_end);
+            conn->state = CONN_READ_UPLOAD;
+            return true;
+        }
+
+        if (conn->in_buf.size() < header_end + content_length)
+            return false; // 还没有读到文件名和分段头
+    }
+
+    // ---------- [2] 普通请求: 等请求体读完 ----------
+    if (header_end + content_length > MAX_REQUEST_SIZE)
+    {
+        set_error_response(conn, BAD_REQUEST);
+        return true;
+    }
+
+    if (conn->in_buf.size() < header_end + content_length)
+        return false;
+
+    conn->request = conn->in_buf.substr(0, header_end + content_length);
+    conn->in_buf.erase(0, header_end + content_length);
+    prepare_response(w, conn);
+    return true;
+}
+
+/**
+ * @brief 把一段数据去掉已经发送的 *skip 字节后加入 iov
+ */
+void append_iov(struct iovec *iov, int *iovcnt, size_t *skip, const char *data, size_t len)
+{
+    if (*skip >= len)
+    {
+        *skip -= len;
+        return;
+    }
+
+    iov[*iovcnt].iov_base = (void *)(data + *skip);
+    iov[*iovcnt].iov_len = len - *skip;
+    (*iovcnt)++;
+    *skip = 0;
+}
+
+/**
+ * @brief 连接的状态机: 从当前状态开始读写, 直到 socket 返回 EAGAIN 或连接关闭
+ *
+ * 连接以 EPOLLIN | EPOLLOUT | EPOLLET 注册, 每个状态都读写到 EAGAIN 为止, 下一次边沿触发时从原状态继续
+ *
+ * @param w 连接所在的 worker
+ * @param conn 有事件的连接
+ */
+void handle_connection(worker *w, connection *conn)
 {
-    int server_fd, client_sock, c;
-    struct sockaddr_in server, client;
-    pthread_t thread_id;
+    char client_message[client_message_SIZE];
+    ssize_t n;
 
-    // === [1] 初始化信号量 ===
-    if (sem_init(&mutex, 0, 1) != 0)
+    idle_list_touch(w, conn);
+
+    while (true)
     {
-        perror("sem_init failed");
-        return 1;
+        switch (conn->state)
+        {
+        // ---------- [1] 读取请求 ----------
+        case CONN_READ_REQUEST:
+            if (parse_request(w, conn))
+                break;
+
+            if (conn->in_buf.size() >= MAX_REQUEST_SIZE)
+            {
+                set_error_response(conn, BAD_REQUEST);
+                break;
+            }
+
+            n = read(conn->fd, client_message, sizeof(client_message));
+            if (n > 0)
+                conn->in_buf.append(client_message, n);
+            else if (n == 0)
+                conn->state = CONN_CLOSE;
+            else if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            else if (errno != EINTR)
+            {
+                perror("read() failed");
+                conn->state = CONN_CLOSE;
+            }
+            break;
+
+        // ---------- [2] 接收上传的文件 ----------
+        case CONN_READ_UPLOAD:
+            if (conn->upload_remain <= 0)
+            {
+                if (conn->upload_fd >= 0)
+                    close(conn->upload_fd);
+                conn->upload_fd = -1;
+                prepare_response(w, conn);
+                break;
+            }
+
+            n = read(conn->fd, client_message,
+                     conn->upload_remain < (long)sizeof(client_message) ? conn->upload_remain : sizeof(client_message));
+            if (n > 0)
+            {
+                if (conn->upload_fd >= 0 && write(conn->upload_fd, client_message, n) < 0)
+                {
+                    perror("write upload failed");
+                    close(conn->upload_fd);
+                    conn->upload_fd = -1;
+                }
+                conn->upload_remain -= n;
+            }
+            else if (n == 0)
+                conn->state = CONN_CLOSE;
+            else if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            else if (errno != EINTR)
+            {
+                perror("read() failed");
+                conn->state = CONN_CLOSE;
+            }
+            break;
+
+        // ---------- [3] 发送响应头 ----------
+        case CONN_WRITE_HEADER:
+        {
+            // 缓存中的响应头, Connection 和空行, 小文件的内容用一次 sendmsg() 发送
+            FileCacheEntry *entry = conn->entry;
+            struct iovec iov[3];
+            int iovcnt = 0;
+            size_t skip = conn->out_sent;
+
+            if (entry)
+                append_iov(iov, &iovcnt, &skip, entry->header.data(), entry->header.size());
+            append_iov(iov, &iovcnt, &skip, conn->out_buf.data(), conn->out_buf.size());
+            if (entry && entry->data)
+                append_iov(iov, &iovcnt, &skip, entry->data, entry->size);
+
+            if (iovcnt == 0)
+            {
+                if (conn->file_remain > 0)
+                    conn->state = CONN_SEND_BODY;
+                else
+                    finish_response(w, conn);
+                break;
+            }
+
+            // 后面还有大文件的内容时用 MSG_MORE, 响应头和文件开头合并到同一个报文段
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = iovcnt;
+            n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL | (conn->file_remain > 0 ? MSG_MORE : 0));
+            if (n >= 0)
+                conn->out_sent += n;
+            else if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            else if (errno != EINTR)
+            {
+                perror("[Error] Failed to send HTTP header");
+                conn->state = CONN_CLOSE;
+            }
+            break;
+        }
+
+        // ---------- [4] 发送大文件的内容 ----------
+        case CONN_SEND_BODY:
+            if (conn->file_remain <= 0)
+            {
+                finish_response(w, conn);
+                break;
+            }
+
+            n = sendfile(conn->fd, conn->entry->fd, &conn->file_offset, conn->file_remain);
+            if (n > 0)
+                conn->file_remain -= n;
+            else if (n == 0)
+            {
+                fprintf(stderr, "[Warn] sendfile() returned 0, possible EOF reached early\n");
+                conn->state = CONN_CLOSE;
+            }
+            else if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            else if (errno != EINTR)
+            {
+                fprintf(stderr, "[Error] sendfile() failed: %s\n", strerror(errno));
+                conn->state = CONN_CLOSE;
+            }
+            break;
+
+        // ---------- [5] 等待对端关闭 ----------
+        case CONN_LINGER:
+            n = read(conn->fd, client_message, sizeof(client_message));
+            if (n == 0)
+                conn->state = CONN_CLOSE;
+            else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return;
+            else if (n < 0 && errno != EINTR)
+                conn->state = CONN_CLOSE;
+            break;
+
+        // ---------- [6] 关闭连接 ----------
+        case CONN_CLOSE:
+            close_connection(w, conn);
+            return;
+        }
     }
+}
 
-    // === [2] 创建 socket ===
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
+/**
+ * @brief 接受监听 socket 上所有等待的连接, 设为非阻塞并加入 worker 的 epoll
+ *
+ * 连接数超过 MAX_CONNECTIONS 时回复 BAD_REQUEST 后关闭
+ *
+ * @param w 监听 socket 可读的 worker
+ */
+void accept_connections(worker *w)
+{
+    struct sockaddr_in client;
+    socklen_t c;
+
+    while (true)
+    {
+        c = sizeof(client);
+        int client_sock = accept4(w->listen_fd, (struct sockaddr *)&client, &c, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_sock < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                perror("accept failed");
+            return;
+        }
+
+        if (connection_count.fetch_add(1, memory_order_relaxed) >= MAX_CONNECTIONS)
+        {
+            connection_count.fetch_sub(1, memory_order_relaxed);
+            string busy = error_response(BAD_REQUEST, "Connection: close\r\n");
+            send(client_sock, busy.c_str(), busy.length(), MSG_NOSIGNAL);
+            close(client_sock);
+            continue;
+        }
+
+        // 持久连接上响应的最后一段不能等 Nagle 攒满, 否则对端的延迟确认会让每个请求多等几十毫秒
+        int on = 1;
+        setsockopt(client_sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        connection *conn = new connection();
+        conn->fd = client_sock;
+        conn->state = CONN_READ_REQUEST;
+        conn->out_sent = 0;
+        conn->entry = nullptr;
+        conn->file_offset = 0;
+        conn->file_remain = 0;
+        conn->upload_fd = -1;
+        conn->upload_remain = 0;
+        conn->keep_alive = false;
+        conn->http10 = false;
+        conn->n_requests = 0;
+        conn->prev = conn->next = nullptr;
+        idle_list_touch(w, conn);
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conn;
+        if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, client_sock, &ev) < 0)
+        {
+            perror("epoll_ctl() failed");
+            close_connection(w, conn);
+        }
+    }
+}
+
+/**
+ * @brief 关闭超过 IDLE_TIMEOUT_MS 没有事件的连接
+ *
+ * @param w worker
+ */
+void expire_idle_connections(worker *w)
+{
+    while (w->idle_head && w->now_ms - w->idle_head->last_active_ms >= IDLE_TIMEOUT_MS)
+        close_connection(w, w->idle_head);
+}
+
+/**
+ * @brief worker 线程: 在自己的 epoll 上等待新连接和连接上的事件, 每 IDLE_SWEEP_MS 检查一次空闲连接
+ *
+ * @param arg worker
+ */
+void *worker_thread(void *arg)
+{
+    worker *w = (worker *)arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (true)
+    {
+        int n = epoll_wait(w->epoll_fd, events, MAX_EVENTS, IDLE_SWEEP_MS);
+        w->now_ms = current_ms();
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait() failed");
+            break;
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            if (events[i].data.ptr == nullptr)
+                accept_connections(w);
+            else if (events[i].data.ptr == w->cache)
+                w->cache->ProcessNotify();
+            else
+                handle_connection(w, (connection *)events[i].data.ptr);
+        }
+
+        expire_idle_connections(w);
+    }
+
+    return nullptr;
+}
+
+/**
+ * @brief 创建一个非阻塞的监听 socket
+ *
+ * 每个 worker 各自 bind 同一个端口(SO_REUSEPORT), 由内核把新连接分散到各个 worker, 不需要共享 accept 队列
+ *
+ * @param port 监听端口
+ * @return int 监听 socket, 失败返回 -1
+ */
+int create_listen_socket(int port)
+{
+    struct sockaddr_in server;
+    int on = 1;
+
+    int server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (server_fd == -1)
     {
         perror("Could not create socket");
-        return 1;
+        return -1;
+    }
+
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0 ||
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0)
+    {
+        perror("setsockopt() failed");
+        close(server_fd);
+        return -1;
     }
-    puts("Socket created");
 
-    // === [3] 设置服务器地址 ===
+    memset(&server, 0, sizeof(server));
     server.sin_family = AF_INET;
     server.sin_addr.s_addr = INADDR_ANY;
-    server.sin_port = htons(8080);
+    server.sin_port = htons(port);
 
-    // === [4] 绑定 socket ===
     if (bind(server_fd, (struct sockaddr *)&server, sizeof(server)) < 0)
     {
         perror("bind failed");
         close(server_fd);
-        return 1;
+        return -1;
     }
-    puts("bind done");
 
-    // === [5] 开始监听 ===
-    if (listen(server_fd, 5) < 0)
+    if (listen(server_fd, SOMAXCONN) < 0)
     {
         perror("listen failed");
         close(server_fd);
-        return 1;
+        return -1;
     }
-    puts("Waiting for incoming connections...");
 
-    c = sizeof(struct sockaddr_in);
+    return server_fd;
+}
+
+int main(int argc, char *argv[])
+{
+    struct rlimit rl;
 
-    // === [6] 主循环：接受客户端 ===
-    while ((client_sock = accept(server_fd, (struct sockaddr *)&client, (socklen_t *)&c)))
+    // === [1] 对端关闭时 send()/sendfile() 返回 EPIPE 而不是终止进程 ===
+    signal(SIGPIPE, SIG_IGN);
+
+    // === [2] 把文件描述符上限提高到硬限制, 每个连接至少占用一个 ===
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max)
     {
-        printf("Connected to %s\n", inet_ntoa(client.sin_addr));
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
 
-        int *new_sock = new int;
-        *new_sock = client_sock;
+    // === [3] worker 数量: 默认每个 CPU 一个 ===
+    int n_workers = (argc > 1) ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_workers <= 0)
+        n_workers = 1;
 
-        if (pthread_create(&thread_id, nullptr, connection_handler, (void *)new_sock) < 0)
+    // === [4] 文件缓存的内存上限, 平均分给各个 worker ===
+    long cache_mb = (argc > 2) ? atol(argv[2]) : FILE_CACHE_SIZE_MB;
+    if (cache_mb < 0)
+        cache_mb = 0;
+    size_t cache_bytes = (size_t)cache_mb * 1024 * 1024 / n_workers;
+
+    // === [5] 每个 worker 创建自己的监听 socket, epoll 和文件缓存 ===
+    worker *workers = new worker[n_workers];
+    for (int i = 0; i < n_workers; ++i)
+    {
+        workers[i].id = i;
+        workers[i].now_ms = current_ms();
+        workers[i].idle_head = workers[i].idle_tail = nullptr;
+        workers[i].cache = new FileCache(cache_bytes);
+        workers[i].listen_fd = create_listen_socket(PORT);
+        if (workers[i].listen_fd < 0)
+            return 1;
+
+        workers[i].epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (workers[i].epoll_fd < 0)
         {
-            perror("could not create thread");
-            delete new_sock;
-            continue;
+            perror("epoll_create1() failed");
+            return 1;
+        }
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr; // 监听 socket
+        if (epoll_ctl(workers[i].epoll_fd, EPOLL_CTL_ADD, workers[i].listen_fd, &ev) < 0)
+        {
+            perror("epoll_ctl() failed");
+            return 1;
         }
 
-        pthread_detach(thread_id); // 自动回收资源
+        if (workers[i].cache->GetNotifyFd() >= 0)
+        {
+            ev.events = EPOLLIN;
+            ev.data.ptr = workers[i].cache; // inotify
+            if (epoll_ctl(workers[i].epoll_fd, EPOLL_CTL_ADD, workers[i].cache->GetNotifyFd(), &ev) < 0)
+            {
+                perror("epoll_ctl() failed");
+                return 1;
+            }
+        }
     }
+    printf("%d workers listening on port %d, file cache %ld MB\n", n_workers, PORT, cache_mb);
+    puts("Waiting for incoming connections...");
 
-    if (client_sock < 0)
+    // === [6] 启动 worker, 主线程等待 ===
+    for (int i = 0; i < n_workers; ++i)
     {
-        perror("accept failed");
-        close(server_fd);
-        return 1;
+        if (pthread_create(&workers[i].thread, nullptr, worker_thread, &workers[i]) != 0)
+        {
+            perror("could not create thread");
+            return 1;
+        }
+    }
+
+    for (int i = 0; i < n_workers; ++i)
+    {
+        pthread_join(workers[i].thread, nullptr);
+        close(workers[i].epoll_fd);
+        close(workers[i].listen_fd);
+        delete workers[i].cache;
     }
 
-    close(server_fd);
-    sem_destroy(&mutex);
+    delete[] workers;
 
     return 0;
 }
@@ -1,18 +1,93 @@
 #include <string>
+#include <vector>
+#include <pthread.h>
+#include <sys/types.h>
+#include "file_cache.h"
 using namespace std;
 
 typedef enum
 {
     HTTP_HEADER, // 0
     BAD_REQUEST, // 1
-    NOT_FOUND    // 2
+    NOT_FOUND,   // 2
+    NOT_MODIFIED // 3
 } messageType;
 
+/**
+ * @brief 连接的状态(每个连接一个状态机, 由所在 worker 的 epoll 循环驱动)
+ */
+typedef enum
+{
+    CONN_READ_REQUEST, // 读取请求头(POST 时还包括请求体)
+    CONN_READ_UPLOAD,  // multipart/form-data 上传: 把请求体写入文件
+    CONN_WRITE_HEADER, // 发送响应头(或完整的错误响应), 小文件的内容一起发送
+    CONN_SEND_BODY,    // 用 sendfile() 发送大文件的内容
+    CONN_LINGER,       // 最后一个响应已发送, 已 shutdown(SHUT_WR), 丢弃对端剩余的数据直到对端关闭
+    CONN_CLOSE         // 出错或对端已关闭, 关闭连接
+} connState;
+
+/**
+ * @brief 一个客户端连接
+ *
+ * socket 是非阻塞的, 每一步读写都在 EAGAIN 处停下, 等 epoll 通知后从当前状态继续
+ *
+ * 持久连接: 一个响应发送完后回到 CONN_READ_REQUEST, 先处理 in_buf 中已经读入的下一个请求(流水线)
+ */
+typedef struct connection
+{
+    int fd;                // 客户端套接字
+    connState state;       // 当前状态
+    string in_buf;         // 已读入尚未处理的请求数据
+    string request;        // 完整的请求头(POST 时包括请求体), 供 getData() 解析
+    vector<string> params; // 本次请求解析出的参数(getData())
+    string out_buf;        // 待发送的响应头
+    size_t out_sent;       // out_buf 已发送的字节数
+    FileCacheEntry *entry; // 要发送的文件(持有一个引用), 没有时为 nullptr
+    off_t file_offset;     // 大文件已用 sendfile() 发送到的位置
+    off_t file_remain;     // 大文件剩余的字节数
+    int upload_fd;         // 上传写入的文件, 没有时为 -1
+    long upload_remain;    // 请求体还剩多少字节没有读
+    bool keep_alive;       // 当前响应发送完后是否保持连接
+    bool http10;           // 当前请求是 HTTP/1.0(保持连接时需要回复 Connection: keep-alive)
+    int n_requests;        // 这个连接上已经处理的请求数
+    long last_active_ms;   // 最后一次有事件的时间, 超过 IDLE_TIMEOUT_MS 没有事件时关闭
+    struct connection *prev, *next; // worker 的空闲链表, 按 last_active_ms 从旧到新排列
+} connection;
+
+/**
+ * @brief 一个 worker 线程: 独立的监听 socket(SO_REUSEPORT), 独立的 epoll, 只处理自己接受的连接
+ */
+typedef struct worker
+{
+    int id;           // worker 编号
+    int listen_fd;    // 监听 socket, 内核按四元组哈希把新连接分配给各个 worker
+    int epoll_fd;     // epoll 实例
+    pthread_t thread; // 线程
+    long now_ms;      // 本轮 epoll_wait() 返回时的时间
+    FileCache *cache; // 这个 worker 的文件缓存, inotify fd 也加入 epoll
+    connection *idle_head, *idle_tail; // 所有连接, 最久没有事件的在表头
+} worker;
+
+/**
+ * @brief 状态行, 下标为 messageType
+ */
 string Messages[] =
     {
         "HTTP/1.1 200 OK\r\n",
-        "HTTP/1.0 400 Bad request\r\n Content-Type: text/html\r\n\r\n <!doctype html><html><body>System is busy right now</body></html>",
-        "HTTP/1.0 404 File not found \r\n Content-Type: text/html\r\n\r\n <!doctype html><html><body>The requested files does not exits on this server</body></html>",
+        "HTTP/1.1 400 Bad Request\r\n",
+        "HTTP/1.1 404 Not Found\r\n",
+        "HTTP/1.1 304 Not Modified\r\n",
+};
+
+/**
+ * @brief 错误响应的内容, 下标为 messageType
+ */
+string MessageBodies[] =
+    {
+        "",
+        "<!doctype html><html><body>System is busy right now</body></html>",
+        "<!doctype html><html><body>The requested files does not exits on this server</body></html>",
+        "",
 };
 
 string fileExtension[] =
@@ -42,32 +117,74 @@ string fileExtension[] =
         "htm",
         "jpeg",
         "jpg",
+        "ttf",
+        "eot",
 };
 
 string ContentType[] =
     {
-        "Content-Type: audio/aac\r\n\r\n",
-        "Content-Type: video/x-msvideo\r\n\r\n",
-        "Content-Type: image/bmp\r\n\r\n",
-        "Content-Type: text/css\r\n\r\n",
-        "Content-Type: image/gif\r\n\r\n",
-        "Content-Type: image/vnd.microsoft.icon\r\n\r\n",
-        "Content-Type: text/javascript\r\n\r\n",
-        "Content-Type: application/json\r\n\r\n",
-        "Content-Type: audio/mpeg\r\n\r\n",
-        "Content-Type: video/mp4\r\n\r\n",
-        "Content-Type: font/otf\r\n\r\n",
-        "Content-Type: image/png\r\n\r\n",
-        "Content-Type: application/x-httpd-php\r\n\r\n",
-        "Content-Type: application/rtf\r\n\r\n",
-        "Content-Type: image/svg+xml\r\n\r\n",
-        "Content-Type: text/plain\r\n\r\n",
-        "Content-Type: video/webm\r\n\r\n",
-        "Content-Type: video/webp\r\n\r\n",
-        "Content-Type: font/woff\r\n\r\n",
-        "Content-Type: font/woff2\r\n\r\n",
-        "Content-Type: application/zip\r\n\r\n",
-        "Content-Type: text/html\r\n\r\n",
-        "Content-Type: text/html\r\n\r\n",
-        "Content-Type: image/jpeg\r\n\r\n",
+        "Content-Type: audio/aac\r\n",
+        "Content-Type: video/x-msvideo\r\n",
+        "Content-Type: image/bmp\r\n",
+        "Content-Type: text/css\r\n",
+        "Content-Type: image/gif\r\n",
+        "Content-Type: image/vnd.microsoft.icon\r\n",
+        "Content-Type: text/javascript\r\n",
+        "Content-Type: application/json\r\n",
+        "Content-Type: audio/mpeg\r\n",
+        "Content-Type: video/mp4\r\n",
+        "Content-Type: font/otf\r\n",
+        "Content-Type: image/png\r\n",
+        "Content-Type: application/x-httpd-php\r\n",
+        "Content-Type: application/rtf\r\n",
+        "Content-Type: image/svg+xml\r\n",
+        "Content-Type: text/plain\r\n",
+        "Content-Type: video/webm\r\n",
+        "Content-Type: video/webp\r\n",
+        "Content-Type: font/woff\r\n",
+        "Content-Type: font/woff2\r\n",
+        "Content-Type: application/zip\r\n",
+        "Content-Type: text/html\r\n",
+        "Content-Type: text/html\r\n",
+        "Content-Type: image/jpeg\r\n",
+        "Content-Type: image/jpeg\r\n",
+        "Content-Type: font/ttf\r\n",
+        "Content-Type: application/vnd.ms-fontobject\r\n",
+};
+
+/**
+ * @brief 浏览器可以直接使用缓存而不重新验证的时间(秒), 下标与 fileExtension 对应
+ *
+ * 0 表示 Cache-Control: no-cache, 每次都要用 ETag / Last-Modified 验证(通常得到 304);
+ * 页面经常修改, 设为 0; 样式和脚本缓存一天; 图片, 字体和音视频缓存 30 天
+ */
+int CacheMaxAge[] =
+    {
+        2592000, // aac
+        2592000, // avi
+        2592000, // bmp
+        86400,   // css
+        2592000, // gif
+        2592000, // ico
+        86400,   // js
+        0,       // json
+        2592000, // mp3
+        2592000, // mp4
+        2592000, // otf
+        2592000, // png
+        0,       // php
+        3600,    // rtf
+        2592000, // svg
+        3600,    // txt
+        2592000, // webm
+        2592000, // webp
+        2592000, // woff
+        2592000, // woff2
+        3600,    // zip
+        0,       // html
+        0,       // htm
+        2592000, // jpeg
+        2592000, // jpg
+        2592000, // ttf
+        2592000, // eot
 };
\ No newline at end of file